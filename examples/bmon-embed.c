@@ -0,0 +1,122 @@
+/*
+ * bmon-embed.c		Example User of libbmon
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Runs one collection context per input given and prints the rates of
+ * one attribute of all elements, e.g.
+ *
+ *   bmon-embed -i netlink -i 'dummy:num=2' -a bytes -c 5
+ */
+
+#include <bmon/libbmon.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define MAX_CTX		8
+
+static void usage(void)
+{
+	printf("Usage: bmon-embed [-i input]... [-a attr] [-I interval] [-c count]\n");
+	exit(1);
+}
+
+static int print_element(struct bmon_element *e, void *arg)
+{
+	const char *attr = arg;
+	struct bmon_rate r;
+	unsigned int level = bmon_element_level(e);
+
+	if (bmon_element_rate(e, attr, &r) < 0)
+		return 0;
+
+	printf("%-10s %*s%-*s %16.2f %16.2f\n",
+	       bmon_element_group(e), level * 2, "", 20 - level * 2,
+	       bmon_element_name(e), r.rx_rate, r.tx_rate);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bmon_ctx *ctx[MAX_CTX];
+	const char *attr = "bytes";
+	double interval = 1.0;
+	int nctx = 0, count = 3, err, n, i, c;
+
+	while ((c = getopt(argc, argv, "i:a:I:c:h")) != -1) {
+		switch (c) {
+		case 'i':
+			if (nctx >= MAX_CTX)
+				usage();
+
+			if (!(ctx[nctx] = bmon_ctx_new()))
+				return 1;
+
+			if ((err = bmon_ctx_enable_input(ctx[nctx], optarg)) < 0) {
+				fprintf(stderr, "Unable to enable input \"%s\": %s\n",
+					optarg, strerror(-err));
+				return 1;
+			}
+			nctx++;
+			break;
+		case 'a': attr = optarg; break;
+		case 'I': interval = strtod(optarg, NULL); break;
+		case 'c': count = strtol(optarg, NULL, 0); break;
+		default: usage();
+		}
+	}
+
+	if (!nctx)
+		usage();
+
+	for (n = 0; n < count; n++) {
+		if (n)
+			usleep(interval * 1000000);
+
+		for (i = 0; i < nctx; i++) {
+			if ((err = bmon_ctx_tick(ctx[i])) < 0) {
+				fprintf(stderr, "Unable to read context %d: %s\n",
+					i, strerror(-err));
+				return 1;
+			}
+
+			printf("Context %d\n", i);
+			printf("%-10s %-20s %16s %16s\n", "Group", "Element",
+			       "RX/s", "TX/s");
+			bmon_ctx_foreach_element(ctx[i], print_element,
+						 (void *) attr);
+		}
+	}
+
+	for (i = 0; i < nctx; i++)
+		bmon_ctx_free(ctx[i]);
+
+	return 0;
+}
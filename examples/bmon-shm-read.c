@@ -0,0 +1,120 @@
+/*
+ * bmon-shm-read.c	Example Reader of the Shared Memory Export
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Prints the rates of one attribute of all elements published by
+ * bmon -o shm, e.g.
+ *
+ *   bmon -o 'shm,curses' &
+ *   bmon-shm-read -a bytes -i 1
+ */
+
+#include <bmon/shm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+static void usage(void)
+{
+	printf("Usage: bmon-shm-read [-n name] [-a attr] [-i interval] [-c count]\n");
+	exit(1);
+}
+
+static void print_snapshot(struct bmon_shm_hdr *hdr, int attr)
+{
+	unsigned int i;
+
+	printf("%-10s %-20s %16s %16s\n", "Group", "Element",
+	       "RX/s", "TX/s");
+
+	for (i = 0; i < hdr->sh_nelements; i++) {
+		struct bmon_shm_element *se = bmon_shm_element(hdr, i);
+		struct bmon_shm_attr *sa = &se->se_attr[attr];
+
+		if (!(sa->sa_flags & (BMON_SHM_ATTR_RX | BMON_SHM_ATTR_TX)))
+			continue;
+
+		printf("%-10s %*s%-*s %16.2f %16.2f\n",
+		       se->se_group, se->se_level * 2, "",
+		       20 - se->se_level * 2, se->se_name,
+		       sa->sa_rx_rate, sa->sa_tx_rate);
+	}
+
+	if (hdr->sh_flags & BMON_SHM_TRUNCATED)
+		printf("(more elements than the region can hold)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = NULL, *attr_name = "bytes";
+	double interval = 0;
+	int count = 1, attr, n, c;
+	struct bmon_shm shm;
+	void *buf;
+
+	while ((c = getopt(argc, argv, "n:a:i:c:h")) != -1) {
+		switch (c) {
+		case 'n': name = optarg; break;
+		case 'a': attr_name = optarg; break;
+		case 'i': interval = strtod(optarg, NULL); count = 0; break;
+		case 'c': count = strtol(optarg, NULL, 0); break;
+		default: usage();
+		}
+	}
+
+	if ((n = bmon_shm_open(&shm, name)) < 0) {
+		fprintf(stderr, "Unable to open shared memory: %s\n",
+			strerror(-n));
+		return 1;
+	}
+
+	if ((attr = bmon_shm_attr_index(shm.s_hdr, attr_name)) < 0) {
+		fprintf(stderr, "Attribute \"%s\" is not exported\n", attr_name);
+		return 1;
+	}
+
+	if (!(buf = malloc(shm.s_size)))
+		return 1;
+
+	for (n = 0; !count || n < count; n++) {
+		if (n)
+			usleep(interval * 1000000);
+
+		if (bmon_shm_snapshot(&shm, buf, shm.s_size) < 0) {
+			fprintf(stderr, "Unable to take consistent snapshot\n");
+			continue;
+		}
+
+		print_snapshot(buf, attr);
+	}
+
+	free(buf);
+	bmon_shm_close(&shm);
+
+	return 0;
+}
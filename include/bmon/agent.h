@@ -0,0 +1,71 @@
+/*
+ * bmon/agent.h		Agent/Collector Protocol
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_AGENT_H_
+#define __BMON_AGENT_H_
+
+#include <bmon/bmon.h>
+
+/*
+ * An agent streams its elements over TCP to a collector which shows
+ * them as its own, one group per host. The stream starts with
+ * AGENT_MAGIC followed by messages:
+ *
+ *   uint8_t	type
+ *   uint16_t	length of payload, network byte order
+ *   payload
+ *
+ * Integers in the payload are LEB128 varints, signed values are zigzag
+ * encoded, strings are a varint length followed by the characters.
+ *
+ * Attributes and elements are announced once per connection and then
+ * referred to by id. SAMPLE messages carry the difference of the
+ * counters to the values sent last, for the attributes which changed.
+ * The collector keeps the last values of all attributes and updates
+ * the elements with them on every read.
+ */
+
+#define AGENT_MAGIC		"bmonagt1"
+#define AGENT_MAGIC_LEN		8
+#define AGENT_DEFAULT_PORT	"9450"
+
+#define AGENT_HDR_LEN		3
+#define AGENT_MAX_PAYLOAD	65535
+
+enum {
+	AGENT_MSG_HELLO = 1,	/* str hostname */
+	AGENT_MSG_ATTR,		/* id, type, flags, str name, desc, unit */
+	AGENT_MSG_ELEMENT,	/* id, parent id + 1 or 0, element id,
+				 * str group, name, major, minor, usage */
+	AGENT_MSG_REMOVE,	/* id */
+	AGENT_MSG_SAMPLE,	/* id, then repeated: attr id, flags,
+				 * rx delta, tx delta */
+};
+
+/* flags of a sampled attribute */
+#define AGENT_RX		(1 << 0)
+#define AGENT_TX		(1 << 1)
+
+#endif
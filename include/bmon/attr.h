@@ -30,6 +30,10 @@
 #include <bmon/unit.h>
 
 struct element;
+struct history_file;
+struct sched_class;
+struct burst_def;
+struct burst;
 
 struct rate
 {
@@ -50,6 +54,9 @@ struct rate
 
 	/* Time of last calculation */
 	timestamp_t		r_last_calc;
+
+	/* Value of r_total at last calculation */
+	uint64_t		r_calc_total;
 };
 
 extern uint64_t			rate_get_total(struct rate *);
@@ -67,7 +74,13 @@ struct attr_def {
 	char *			ad_description;
 	int			ad_type;
 	int			ad_flags;
+	/* position when sorted by description */
+	int			ad_rank;
 	struct unit *		ad_unit;
+	/* schedule limiting updates of the attribute, if any */
+	struct sched_class *	ad_sched;
+	/* sampled for bursts in between rate calculations, if any */
+	struct burst_def *	ad_burst;
 
 	struct list_head	ad_list;
 };
@@ -90,12 +103,27 @@ extern struct attr_def *	attr_def_lookup_id(int);
 
 extern int			attr_map_load(struct attr_map *map, size_t size);
 
+/* List of attributes selected by name, e.g. for export */
+struct attr_set {
+	int			as_n;
+	char **			as_name;
+	/* attribute id, -1 while unresolved, -2 if undefined */
+	int *			as_id;
+};
+
+extern void			attr_set_parse(struct attr_set *, const char *);
+extern void			attr_set_free(struct attr_set *);
+extern struct attr_def *	attr_set_def(struct attr_set *, int);
+extern struct attr *		attr_set_get(struct attr_set *, int,
+					     const struct element *);
+
 #define ATTR_FORCE_HISTORY		0x01	/* collect history */
 #define ATTR_IGNORE_OVERFLOWS		0x02
 #define ATTR_TRUE_64BIT			0x04
 #define ATTR_RX_ENABLED			0x08	/* has RX counter */
 #define ATTR_TX_ENABLED			0x10	/* has TX counter */
 #define ATTR_DOING_HISTORY		0x20	/* history collected */
+#define ATTR_HISTORY_EVICTED		0x40	/* history evicted */
 
 struct attr
 {
@@ -104,9 +132,16 @@ struct attr
 
 	uint8_t			a_flags;
 	struct attr_def *	a_def;
-	timestamp_t		a_last_update;
+	struct element *	a_element;
+	/* seconds between updates, see sched_interval() */
+	float			a_interval;
+	/* burst window, see burst_sample() */
+	struct burst *		a_burst;
 
 	struct list_head	a_history_list;
+	struct history_file *	a_history_file;
+	/* round in which the history was last displayed */
+	unsigned long		a_history_viewed;
 
 	struct list_head	a_list;
 	struct list_head	a_sort_list;
@@ -128,6 +163,11 @@ extern void			attr_calc_usage(struct attr *, float *, float *,
 
 #define ATTR_HASH_SIZE 32
 
+static inline unsigned int attr_hash(int id)
+{
+	return id % ATTR_HASH_SIZE;
+}
+
 #define UPDATE_FLAG_RX			0x01
 #define UPDATE_FLAG_TX			0x02
 #define UPDATE_FLAG_64BIT		0x04
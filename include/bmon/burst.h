@@ -0,0 +1,64 @@
+/*
+ * bmon/burst.h		Microburst Detection
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_BURST_H_
+#define __BMON_BURST_H_
+
+#include <bmon/bmon.h>
+#include <bmon/attr.h>
+
+/*
+ * Attributes listed in a burst section are watched in between rate
+ * calculations: every read of a counter yields a rate over the time
+ * since the previous read, every read of a gauge its current value.
+ * Once per rate interval the peak rate of counters, the minimum and
+ * maximum of gauges and the number of bursts above the threshold are
+ * reported as attributes of their own, named after the attribute with
+ * _peak, _min, _max and _bursts appended. The resolution is the read
+ * interval of the input, see SCHEDULES.
+ */
+struct burst_def
+{
+	char *			bd_name;
+	float			bd_threshold;	/* 0 to not count bursts */
+
+	/* derived attributes, -1 if not reported */
+	int			bd_peak_id;
+	int			bd_min_id;
+	int			bd_max_id;
+	int			bd_bursts_id;
+
+	struct list_head	bd_list;
+};
+
+extern struct burst_def *	burst_def_add(const char *, float);
+extern struct burst_def *	burst_lookup(const char *);
+extern void			burst_def_attach(struct attr_def *);
+
+extern void			burst_sample(struct attr *, timestamp_t *);
+extern void			burst_free(struct attr *);
+
+#endif
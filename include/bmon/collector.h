@@ -0,0 +1,49 @@
+/*
+ * bmon/collector.h	Sampling Thread
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __BMON_COLLECTOR_H_
+#define __BMON_COLLECTOR_H_
+
+#include <bmon/bmon.h>
+
+/*
+ * Sampling runs on a thread of its own. Every read publishes a new
+ * generation of the element tree. The main thread copies a generation
+ * into a snapshot while holding the collector lock and renders the
+ * snapshot after releasing it, see snapshot.h. The lock is not
+ * recursive.
+ */
+extern void		collector_start(double);
+extern void		collector_stop(void);
+extern void		collector_read(void);
+
+extern void		collector_lock(void);
+extern void		collector_unlock(void);
+
+extern unsigned int	collector_generation(void);
+extern unsigned int	collector_wait(unsigned int, unsigned long);
+
+#endif
@@ -36,6 +36,9 @@ extern float			cfg_rate_variance;
 extern float			cfg_history_variance;
 extern int			cfg_show_all;
 extern int			cfg_unit_exp;
+extern int			cfg_unit_variant;
+extern char *			cfg_history_dir;
+extern uint64_t			cfg_history_budget;
 
 extern void			conf_init_pre(void);
 extern void			conf_init_post(void);
@@ -65,7 +68,9 @@ typedef struct module_conf_s
 	struct list_head	m_list;
 } module_conf_t;
 
+extern module_conf_t *parse_module(char *);
 extern int parse_module_param(const char *, struct list_head *);
+extern void module_conf_free(module_conf_t *);
 
 enum {
 	LAYOUT_UNSPEC,
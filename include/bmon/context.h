@@ -0,0 +1,70 @@
+/*
+ * bmon/context.h	Collection Context
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_CONTEXT_H_
+#define __BMON_CONTEXT_H_
+
+#include <bmon/bmon.h>
+#include <bmon/input.h>
+
+/*
+ * State of one instance of the collection engine: the element tree
+ * and the timing of reads. bmon itself runs a single context, users of
+ * libbmon may create several and switch between them.
+ *
+ * Modules, attribute definitions, group titles and the configuration
+ * are shared by all contexts. Input modules resolve attribute ids once
+ * and keep them, so the definitions must be the same everywhere.
+ */
+struct bmon_ctx
+{
+	struct list_head	c_groups;
+	unsigned int		c_ngroups;
+	struct element_group *	c_current_group;
+
+	struct reader_timing	c_rtiming;
+
+	/* input modules read by bmon_ctx_tick() */
+	struct bmon_module **	c_inputs;
+	int			c_ninputs;
+
+	unsigned int		c_flags;
+};
+
+/* only read the inputs enabled for the context, see libbmon */
+#define BMON_CTX_OWN_INPUTS	(1 << 0)
+/* interrupted by an error, only bmon_ctx_free() is allowed */
+#define BMON_CTX_FAILED		(1 << 1)
+
+/*
+ * Context the engine currently works on. Kept per thread so that the
+ * main thread may render a snapshot while the sampling thread updates
+ * the live context, see snapshot.h.
+ */
+extern __thread struct bmon_ctx *bmon_ctx;
+
+extern void			bmon_ctx_init(struct bmon_ctx *);
+
+#endif
@@ -62,6 +62,8 @@ struct element
 
 	struct list_head	e_list;
 	struct list_head	e_childs;
+	/* lookup by name, id and parent, see element_lookup() */
+	struct list_head	e_hash_list;
 
 	unsigned int		e_nattrs;
 	struct list_head	e_attrhash[ATTR_HASH_SIZE];
@@ -79,6 +81,16 @@ struct element
 	struct element_cfg *	e_cfg;
 
 	struct attr *		e_current_attr;
+
+	/* row in the element list of the curses output */
+	unsigned int		e_row;
+
+	/* kept by the flight recorder, see recorder.h */
+	struct list_head	e_record_list;
+	int			e_record_slot;
+
+	/* copy of the element rendered, see snapshot.h */
+	struct element *	e_snapshot;
 };
 
 #define ELEMENT_CREAT		(1 << 0)
@@ -116,6 +128,8 @@ extern struct element *		element_select_first(void);
 extern struct element *		element_select_last(void);
 extern struct element *		element_select_next(void);
 extern struct element *		element_select_prev(void);
+extern void			element_select(struct element *);
+extern void			element_set_folded(struct element *, int);
 
 extern int			element_allowed(const char *, struct element_cfg *);
 extern void			element_parse_policy(const char *);
@@ -31,6 +31,7 @@
 
 #define ELEMENT_CFG_SHOW	(1 << 0)
 #define ELEMENT_CFG_HIDE	(1 << 1)
+#define ELEMENT_CFG_RECORD	(1 << 2)
 
 struct element_cfg
 {
@@ -36,9 +36,14 @@ struct graph_cfg {
 				gc_width,
 				gc_flags;
 
+	/* 2^gc_zoom samples per column, ending gc_pan samples back */
+	int			gc_zoom;
+	unsigned long		gc_pan;
+
 	char			gc_background,
 				gc_foreground,
 				gc_noise,
+				gc_peak,
 				gc_unknown;
 	
 	struct unit *		gc_unit;
@@ -48,6 +53,13 @@ struct graph_table {
 	char *			gt_table;
 	char *			gt_y_unit;
 	float *			gt_scale;
+
+	/* samples shown, column 0 is the newest */
+	uint64_t *		gt_mean;
+	uint64_t *		gt_peak;
+	uint64_t		gt_max;
+	double			gt_step;
+	int			gt_valid;
 };
 
 struct graph {
@@ -55,12 +67,16 @@ struct graph {
 	struct graph_table	g_rx,
 				g_tx;
 
+	/* history sequence number the tables are up to date with */
+	unsigned long		g_seq;
+
 	struct list_head	g_list;
 };
 	
 extern void			graph_free(struct graph *);
 extern struct graph *		graph_alloc(struct history *, struct graph_cfg *);
 extern void			graph_refill(struct graph *, struct history *);
+extern struct graph *		graph_get(struct history *, struct graph_cfg *);
 
 extern size_t			graph_row_size(struct graph_cfg *);
 
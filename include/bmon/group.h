@@ -29,6 +29,7 @@
 #include <bmon/bmon.h>
 
 struct element;
+struct sched_class;
 
 enum {
 	GT_MAJOR,
@@ -64,6 +65,13 @@ struct element_group
 	struct list_head	g_elements;
 	unsigned int		g_nelements;
 
+	/* all elements of the group hashed for element_lookup() */
+	struct list_head *	g_hash;
+	unsigned int		g_hash_size;
+
+	/* schedule limiting updates of the group, if any */
+	struct sched_class *	g_sched;
+
 	/* Currently selected element in this group */
 	struct element *	g_current;
 
@@ -72,9 +80,17 @@ struct element_group
 
 #define GROUP_CREATE		1
 
+/*
+ * Bumped whenever groups or elements are added, removed or folded so
+ * that outputs can cache the layout of the element tree. Per thread
+ * like bmon_ctx.
+ */
+extern __thread unsigned int	group_tree_gen;
+
 extern struct element_group *	group_lookup(const char *, int);
 extern void			reset_update_flags(void);
-extern void			free_unused_elements(void);
+extern void			free_unused_elements(unsigned int);
+extern void			group_free_all(void);
 extern void			calc_rates(void);
 
 extern void			group_foreach(
@@ -96,5 +112,6 @@ extern struct element_group *	group_select_first(void);
 extern struct element_group *	group_select_last(void);
 extern struct element_group *	group_select_next(void);
 extern struct element_group *	group_select_prev(void);
+extern void			group_select(struct element_group *);
 
 #endif
@@ -32,6 +32,10 @@
 #define HISTORY_UNKNOWN		((uint64_t) -1)
 #define HBEAT_TRIGGER		60.0f
 
+/* Number of samples sharing an exponent */
+#define HISTORY_BLOCK_SIZE	16
+
+/* Mantissa width in bytes */
 enum {
 	HISTORY_TYPE_8	= 1,
 	HISTORY_TYPE_16	= 2,
@@ -39,6 +43,13 @@ enum {
 	HISTORY_TYPE_64	= 8,
 };
 
+#define HISTORY_CLONE		0x01	/* copy made by history_clone() */
+
+struct history_file;
+struct history_lod;
+struct graph;
+struct history_file_entry;
+
 struct history_def
 {
 	char *			hd_name;
@@ -46,43 +57,115 @@ struct history_def
 				hd_type;
 	float			hd_interval;
 
+	/* held by the definition list and every history */
+	int			hd_refcnt;
+
 	struct list_head	hd_list;
 };
 
+/* Series of a history store */
+enum {
+	HISTORY_MEAN,
+	HISTORY_MIN,
+	HISTORY_MAX,
+};
+
 struct history_store
 {
 	/* TODO? store error ratio? */
 	void *			hs_data;
+	/* only allocated for rolled up histories */
+	void *			hs_min;
+	void *			hs_max;
 	uint64_t		hs_prev_total;
+
+	/* decimation pyramid, built on demand */
+	struct history_lod *	hs_lod;
+
+	/* bucket being rolled up */
+	uint64_t		hs_bucket_sum,
+				hs_bucket_min,
+				hs_bucket_max;
+	int			hs_nknown;
 };
 
 struct history
 {
 	/* index to current entry in data array */
 	int			h_index;
+	/* number of samples stored so far */
+	unsigned long		h_seq;
 	struct history_def *	h_definition;
 	/* time of last history update */
 	timestamp_t		h_last_update;
 	struct list_head	h_list;
 
-	float			h_min_interval,
-				h_max_interval;
+	/* longest gap accounted to samples */
+	float			h_max_interval;
+
+	/* time of last read of the attribute */
+	timestamp_t		h_last_read;
+
+	/* finer history this one is rolled up from */
+	struct history_def *	h_source;
+	int			h_ratio;
+
+	/* source samples in current bucket */
+	int			h_nrolled;
+
+	/* HISTORY_* flags */
+	int			h_flags;
+
+	/* history file backing the data, if any */
+	struct history_file *	h_file;
+	struct history_file_entry *h_file_entry;
+
+	/* cached graph, see graph_get() */
+	struct graph *		h_graph;
 
 	struct history_store	h_rx,
 				h_tx;
 
 };
 
+struct history_stats
+{
+	uint64_t		hst_budget;
+	size_t			hst_used;
+	unsigned long		hst_count;
+	unsigned long		hst_evictions;
+};
+
 extern struct history_def *	history_def_lookup(const char *);
 extern struct history_def *	history_def_alloc(const char *);
 
 extern uint64_t			history_data(struct history *,
 					     struct history_store *, int);
+extern uint64_t			history_sample(struct history *,
+					       struct history_store *,
+					       int, int);
+extern int			history_copy(struct history *,
+					     struct history_store *, int,
+					     uint64_t *, int);
 extern void			history_update(struct attr *,
 					       struct history *, timestamp_t *);
-extern struct history *		history_alloc(struct history_def *);
+extern struct history *		history_alloc(struct history_def *, float);
 extern void			history_free(struct history *);
 extern void			history_attach(struct attr *);
+extern void			history_detach(struct attr *);
+extern void			history_skip(struct history *, unsigned long);
+extern struct history *		history_clone(struct history *,
+					      struct history *);
+extern void			history_clone_free(struct history *);
+extern size_t			history_data_size(struct history_def *);
+
+extern size_t			history_bytes(struct history *);
+extern size_t			attr_history_bytes(struct attr *);
+extern size_t			element_history_bytes(struct element *);
+extern void			history_get_stats(struct history_stats *);
+extern void			history_account(ssize_t);
+extern void			history_viewed(struct attr *);
+extern void			history_enforce_budget(void);
 
 extern struct history_def *	history_select_first(void);
 extern struct history_def *	history_select_last(void);
@@ -90,4 +173,20 @@ extern struct history_def *	history_select_next(void);
 extern struct history_def *	history_select_prev(void);
 extern struct history_def *	history_current(void);
 
+/* history_lod.c */
+extern void			history_decimate(struct history *,
+						 struct history_store *,
+						 unsigned long, unsigned long,
+						 int, uint64_t *, uint64_t *,
+						 uint64_t *);
+extern size_t			history_lod_bytes(struct history_store *);
+extern void			history_lod_free(struct history_store *);
+
+/* history_file.c */
+extern void			history_file_open(struct attr *);
+extern void			history_file_close(struct attr *);
+extern void			history_file_store(struct history *,
+						   struct history_store *);
+extern void			history_file_sync(struct history *);
+
 #endif
@@ -33,6 +33,9 @@
 extern int input_set(const char *);
 extern void input_register(struct bmon_module *);
 extern void input_read(void);
+extern void input_init(void);
+extern void input_schedule(void);
+extern int input_enable(module_conf_t *, struct bmon_module **);
 
 struct reader_timing
 {
@@ -47,6 +50,4 @@ struct reader_timing
 	} rt_variance;
 };
 
-extern struct reader_timing rtiming;
-
 #endif
@@ -0,0 +1,152 @@
+/*
+ * bmon/libbmon.h	Embeddable Collection Engine
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_LIBBMON_H_
+#define __BMON_LIBBMON_H_
+
+/*
+ * libbmon runs the input modules and the element tree of bmon inside
+ * another program:
+ *
+ *	struct bmon_ctx *ctx = bmon_ctx_new();
+ *
+ *	bmon_ctx_enable_input(ctx, "netlink");
+ *
+ *	for (;;) {
+ *		bmon_ctx_tick(ctx);
+ *		bmon_ctx_foreach_element(ctx, print_element, NULL);
+ *		sleep(1);
+ *	}
+ *
+ * Every context owns an element tree including rates and histories,
+ * several contexts may run side by side. Input modules, attribute
+ * definitions and the configuration are shared by all contexts of the
+ * process. Options given when enabling an input are applied only by
+ * the first context enabling it.
+ *
+ * The library is not thread safe: all calls, including those on
+ * different contexts, must be serialized by the caller.
+ *
+ * Element handles stay valid until the next bmon_ctx_tick() or
+ * bmon_ctx_free() of the context they belong to.
+ *
+ * Errors in the configuration, in module options or while reading are
+ * returned to the caller, the reason is printed to stderr. Such an
+ * error may interrupt the engine half way through an update, the
+ * context is then marked failed: every later call on it returns
+ * -EINVAL and its element handles are invalid until it is freed with
+ * bmon_ctx_free().
+ *
+ * Input modules register themselves from constructors which are not
+ * pulled in from the static archive by references alone, link with
+ *	-Wl,--whole-archive libbmon.a -Wl,--no-whole-archive
+ */
+
+#include <stdint.h>
+
+struct bmon_ctx;
+struct bmon_element;
+
+#define BMON_RATE_RX		(1 << 0)	/* rx fields valid */
+#define BMON_RATE_TX		(1 << 1)	/* tx fields valid */
+
+struct bmon_rate
+{
+	unsigned int		flags;
+	uint64_t		rx_total,
+				tx_total;
+	/* per second */
+	double			rx_rate,
+				tx_rate;
+};
+
+/*
+ * Optional, reads the configuration file and must be called before
+ * the first context is created. Returns 0 or a negative error code,
+ * -EINVAL if the configuration is invalid. A failed configuration is
+ * not retried, later calls return the same error.
+ */
+extern int			bmon_configure(const char *configfile);
+
+/* Returns NULL if the configuration failed, see bmon_configure() */
+extern struct bmon_ctx *	bmon_ctx_new(void);
+extern void			bmon_ctx_free(struct bmon_ctx *);
+
+/*
+ * Enables one input module, given as "name" or "name:opt1=v;opt2".
+ * Returns 0, -ENOENT if the module does not exist or -EINVAL if the
+ * options are invalid, it cannot be used on this system or the context
+ * failed.
+ */
+extern int			bmon_ctx_enable_input(struct bmon_ctx *,
+						      const char *);
+
+/*
+ * Reads all inputs of the context and updates rates and histories.
+ * Returns 0 or -EINVAL if an input failed to read or the context
+ * failed.
+ */
+extern int			bmon_ctx_tick(struct bmon_ctx *);
+
+/*
+ * Calls cb for every element, parents before their children. Stops
+ * and returns the value returned by cb if it is not 0. Returns
+ * -EINVAL if the context failed.
+ */
+extern int			bmon_ctx_foreach_element(struct bmon_ctx *,
+					int (*cb)(struct bmon_element *, void *),
+					void *);
+
+extern const char *		bmon_element_name(struct bmon_element *);
+extern const char *		bmon_element_group(struct bmon_element *);
+extern struct bmon_element *	bmon_element_parent(struct bmon_element *);
+extern unsigned int		bmon_element_level(struct bmon_element *);
+
+/* Calls cb with the name of every attribute of the element */
+extern int			bmon_element_foreach_attr(struct bmon_element *,
+					int (*cb)(struct bmon_element *,
+						  const char *, void *),
+					void *);
+
+/* Returns 0 or -ENOENT if the element lacks the attribute */
+extern int			bmon_element_rate(struct bmon_element *,
+						  const char *attr,
+						  struct bmon_rate *);
+
+/*
+ * Copies up to n samples of the history (e.g. "second", "minute") of
+ * an attribute into buf, newest first, in units per second. Samples
+ * not known are NAN. Histories are collected once they are asked for,
+ * the first call usually returns 0 samples.
+ *
+ * Returns the number of samples or -ENOENT.
+ */
+extern int			bmon_element_history(struct bmon_element *,
+						     const char *attr,
+						     const char *history,
+						     int tx, double *buf, int n);
+
+#endif
@@ -47,6 +47,19 @@ static inline void list_add_head(struct list_head *obj, struct list_head *head)
 	__list_add(obj, head, head->next);
 }
 
+/*
+ * Like list_add_tail() but the entry is complete before it is linked so
+ * that another thread may walk the list forward meanwhile.
+ */
+static inline void list_add_tail_publish(struct list_head *obj,
+					 struct list_head *head)
+{
+	obj->next = head;
+	obj->prev = head->prev;
+	__atomic_store_n(&head->prev->next, obj, __ATOMIC_RELEASE);
+	head->prev = obj;
+}
+
 static inline void list_del(struct list_head *obj)
 {
 	obj->next->prev = obj->prev;
@@ -58,6 +71,30 @@ static inline int list_empty(struct list_head *head)
 	return head->next == head;
 }
 
+static inline void list_move_tail(struct list_head *obj,
+				  struct list_head *head)
+{
+	list_del(obj);
+	list_add_tail(obj, head);
+}
+
+/* Move all entries of list to the front of head */
+static inline void list_splice_init(struct list_head *list,
+				    struct list_head *head)
+{
+	struct list_head *first = list->next, *last = list->prev;
+
+	if (list_empty(list))
+		return;
+
+	first->prev = head;
+	last->next = head->next;
+	head->next->prev = last;
+	head->next = first;
+
+	INIT_LIST_HEAD(list);
+}
+
 #define container_of(ptr, type, member) ({			\
         const typeof( ((type *)0)->member ) *__mptr = (ptr);	\
         (type *)( (char *)__mptr - ((size_t) &((type *)0)->member));})
@@ -34,6 +34,7 @@
 #define BMON_MODULE_AUTO		(1 << 2) /* Auto enable */
 
 struct bmon_subsys;
+struct sched_class;
 
 struct bmon_module
 {
@@ -52,6 +53,9 @@ struct bmon_module
 	int			m_flags;
 	struct list_head	m_list;
 	struct bmon_subsys     *m_subsys;
+
+	/* timer of input modules, resolved on first read */
+	struct sched_class *	m_sched;
 };
 
 struct bmon_subsys
@@ -71,8 +75,11 @@ extern void		module_foreach_run_enabled_post(struct bmon_subsys *);
 
 extern int		module_register(struct bmon_subsys *, struct bmon_module *);
 extern int		module_set(struct bmon_subsys *, const char *);
+extern int		module_enable(struct bmon_subsys *, module_conf_t *,
+				      struct bmon_module **);
 
 extern void		module_init(void);
+extern void		module_init_subsys(struct bmon_subsys *);
 extern void		module_shutdown(void);
 extern void		module_register_subsys(struct bmon_subsys *);
 
@@ -0,0 +1,84 @@
+/*
+ * bmon/outbuf.h		Output Buffer
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __BMON_OUTBUF_H_
+#define __BMON_OUTBUF_H_
+
+#include <bmon/bmon.h>
+
+/*
+ * Growable buffer collecting the text output of a whole tick, written
+ * out with a single write(). The buffer is kept across ticks so a
+ * steady output does not allocate.
+ */
+struct outbuf
+{
+	char *			ob_buf;
+	size_t			ob_len;
+	size_t			ob_size;
+	int			ob_fd;
+};
+
+#define OUTBUF_INIT(fd)		{ .ob_fd = (fd) }
+
+extern void		outbuf_reserve(struct outbuf *, size_t);
+extern int		outbuf_flush(struct outbuf *);
+
+extern void		outbuf_printf(struct outbuf *, const char *, ...)
+				__attribute__ ((format (printf, 2, 3)));
+
+/* Strings padded to width, left aligned if width is negative */
+extern void		outbuf_str(struct outbuf *, const char *, int);
+extern void		outbuf_u64(struct outbuf *, uint64_t, int);
+extern void		outbuf_fixed(struct outbuf *, double, int, int);
+
+/* Quoted and escaped as required by the respective format */
+extern void		outbuf_json_str(struct outbuf *, const char *);
+extern void		outbuf_csv_str(struct outbuf *, const char *);
+
+static inline void outbuf_put(struct outbuf *ob, const char *s, size_t len)
+{
+	if (ob->ob_len + len > ob->ob_size)
+		outbuf_reserve(ob, len);
+
+	memcpy(ob->ob_buf + ob->ob_len, s, len);
+	ob->ob_len += len;
+}
+
+static inline void outbuf_puts(struct outbuf *ob, const char *s)
+{
+	outbuf_put(ob, s, strlen(s));
+}
+
+static inline void outbuf_putc(struct outbuf *ob, char c)
+{
+	if (ob->ob_len + 1 > ob->ob_size)
+		outbuf_reserve(ob, 1);
+
+	ob->ob_buf[ob->ob_len++] = c;
+}
+
+#endif
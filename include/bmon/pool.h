@@ -0,0 +1,83 @@
+/*
+ * bmon/pool.h		Object Pools
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_POOL_H_
+#define __BMON_POOL_H_
+
+#include <bmon/bmon.h>
+
+/*
+ * Fixed size object pool. Objects are carved out of larger chunks and
+ * recycled through a free list. Chunks are kept when their objects are
+ * freed, so a workload with constant churn runs in a flat memory
+ * footprint. pool_trim_all() returns the chunks without objects in use.
+ */
+struct pool
+{
+	const char *		p_name;
+	size_t			p_size;		/* object size */
+	unsigned int		p_chunk_objs;	/* objects per chunk */
+
+	void *			p_free_list;
+	struct list_head	p_chunks;
+
+	/* statistics */
+	unsigned long		p_nchunks;
+	unsigned long		p_inuse;
+	unsigned long		p_nfree;
+	unsigned long		p_allocs;
+	unsigned long		p_frees;
+
+	struct list_head	p_list;
+};
+
+#define POOL_INIT(var, name, size)				\
+	{							\
+		.p_name		= name,				\
+		.p_size		= size,				\
+		.p_chunks	= LIST_SELF((var).p_chunks),	\
+		.p_list		= LIST_SELF((var).p_list),	\
+	}
+
+#define DEFINE_POOL(var, name, type)				\
+	struct pool var = POOL_INIT(var, name, sizeof(type))
+
+extern void *		pool_alloc(struct pool *);
+extern void		pool_free(struct pool *, void *);
+
+/* Variable sized allocations served from power of two size classes */
+extern void *		pool_alloc_size(size_t);
+extern void		pool_free_size(void *, size_t);
+
+extern char *		pool_strdup(const char *);
+extern void		pool_strfree(char *);
+
+extern void		pool_trim_all(void);
+
+extern size_t		pool_bytes(struct pool *);
+extern void		pool_foreach(void (*cb)(struct pool *, void *),
+				     void *);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * bmon/recorder.h	Flight Recorder
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_RECORDER_H_
+#define __BMON_RECORDER_H_
+
+#include <bmon/bmon.h>
+#include <bmon/element.h>
+#include <bmon/element_cfg.h>
+
+/*
+ * The flight recorder keeps the raw counters of the attributes of
+ * elements configured with "record = true" for every read in a ring
+ * covering the last few minutes. Once a rule fires or SIGUSR1 arrives,
+ * the ring is handed to a writer thread and sampling continues in a
+ * second ring, so the dump never stalls reads.
+ */
+
+extern void	recorder_setup(const char *, const char *, const char *,
+			       float, float);
+extern void	recorder_add_rule(const char *);
+extern void	recorder_add_element(struct element_cfg *);
+
+extern void	recorder_start(void);
+extern void	recorder_attach(struct element *);
+extern void	recorder_read(timestamp_t *);
+
+/* async signal safe */
+extern void	recorder_request_dump(void);
+
+#endif
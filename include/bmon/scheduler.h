@@ -0,0 +1,110 @@
+/*
+ * bmon/scheduler.h	Read Scheduler
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_SCHEDULER_H_
+#define __BMON_SCHEDULER_H_
+
+#include <bmon/bmon.h>
+#include <bmon/attr.h>
+
+struct element_group;
+
+/*
+ * A schedule is a named read interval. Input modules and parts of
+ * them, e.g. the tc walk of netlink, are timers: their deadlines are
+ * kept in a heap and drive the sampling thread. Groups and attributes
+ * are gates: they are only updated if a read happens to come by after
+ * their deadline passed. Everything not listed in a schedule follows
+ * the read interval.
+ *
+ * An adaptive timer reads at its interval while the rates of its
+ * trigger attributes are stable and switches to the fast interval for
+ * the cooldown period once they change.
+ */
+struct sched_class
+{
+	char *			sc_name;
+	float			sc_interval;
+	timestamp_t		sc_next;	/* next deadline */
+
+	int			sc_flags;
+	int			sc_heap;	/* heap slot, -1 if none */
+
+	/* adaptive sampling, sc_fast_interval is 0 if disabled */
+	float			sc_fast_interval;
+	float			sc_cooldown;
+	float			sc_rate_change;	/* relative change */
+	float			sc_rate_floor;	/* ignored below */
+	float			sc_rate_threshold;
+	struct attr_set		sc_trigger;
+	timestamp_t		sc_fast_until;
+
+	struct list_head	sc_list;
+};
+
+#define SCHED_TIMER		(1 << 0) /* has input members */
+#define SCHED_DUE		(1 << 1) /* due in current read */
+#define SCHED_HIT		(1 << 2) /* gate passed in current read */
+#define SCHED_USED		(1 << 3) /* returned by sched_lookup() */
+
+enum {
+	SCHED_INPUT,
+	SCHED_GROUP,
+	SCHED_ATTR,
+};
+
+/* set while sampling thread reads, see sched_begin() */
+extern int			sched_active;
+
+extern struct sched_class *	sched_class_add(const char *, float);
+extern void			sched_member_add(struct sched_class *,
+						 int, const char *);
+extern struct sched_class *	sched_lookup(int, const char *);
+
+extern void			sched_start(float);
+extern void			sched_next(timestamp_t *);
+extern void			sched_begin(timestamp_t *);
+extern void			sched_end(timestamp_t *);
+extern float			sched_tick_interval(void);
+
+extern struct sched_class *	sched_enter(struct sched_class *);
+extern void			sched_observe(struct attr *, float, float);
+extern float			sched_interval(struct element_group *,
+					       struct attr_def *);
+
+static inline int sched_due(struct sched_class *sc)
+{
+	if (!sched_active || !sc)
+		return 1;
+
+	if (!(sc->sc_flags & SCHED_DUE))
+		return 0;
+
+	sc->sc_flags |= SCHED_HIT;
+
+	return 1;
+}
+
+#endif
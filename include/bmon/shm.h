@@ -0,0 +1,128 @@
+/*
+ * bmon/shm.h		Shared Memory Export
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_SHM_H_
+#define __BMON_SHM_H_
+
+/*
+ * Layout of the shared memory region published by the shm output
+ * module. This header is self contained so that readers do not need
+ * any other part of bmon.
+ *
+ * The region starts with a header followed by up to sh_capacity element
+ * records of sh_stride bytes each. Every element record is followed by
+ * sh_nattrs attribute records in the order of sh_attr_name. The layout
+ * is fixed for the lifetime of the region, only the contents change.
+ *
+ * The writer increments sh_seq before and after every update, the value
+ * is odd while an update is in progress. Readers copy the region and
+ * retry if sh_seq was odd or changed in the meantime, see
+ * bmon_shm_snapshot().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define BMON_SHM_MAGIC		0x6e6f6d62	/* "bmon" */
+#define BMON_SHM_VERSION	1
+#define BMON_SHM_DEFAULT_NAME	"/bmon"
+
+#define BMON_SHM_NAMSIZ		32
+#define BMON_SHM_MAX_ATTRS	16
+
+/* Header flags */
+#define BMON_SHM_TRUNCATED	(1 << 0)	/* more elements than capacity */
+
+struct bmon_shm_hdr
+{
+	uint32_t		sh_magic;
+	uint32_t		sh_version;
+	uint32_t		sh_seq;
+	uint32_t		sh_flags;
+
+	/* fixed layout */
+	uint64_t		sh_size;
+	uint32_t		sh_capacity;
+	uint32_t		sh_stride;
+	uint32_t		sh_nattrs;
+	int32_t			sh_pid;
+
+	/* updated every interval */
+	uint64_t		sh_generation;
+	int64_t			sh_update_sec;
+	int64_t			sh_update_usec;
+	uint32_t		sh_nelements;
+	uint32_t		sh_pad;
+
+	char			sh_attr_name[BMON_SHM_MAX_ATTRS][BMON_SHM_NAMSIZ];
+};
+
+/* Attribute flags */
+#define BMON_SHM_ATTR_RX	(1 << 0)	/* element has rx counter */
+#define BMON_SHM_ATTR_TX	(1 << 1)	/* element has tx counter */
+
+struct bmon_shm_attr
+{
+	uint64_t		sa_rx;
+	uint64_t		sa_tx;
+	double			sa_rx_rate;
+	double			sa_tx_rate;
+	uint32_t		sa_flags;
+	uint32_t		sa_pad;
+};
+
+struct bmon_shm_element
+{
+	char			se_group[BMON_SHM_NAMSIZ];
+	char			se_name[BMON_SHM_NAMSIZ];
+	/* empty for top level elements */
+	char			se_parent[BMON_SHM_NAMSIZ];
+	uint32_t		se_level;
+	uint32_t		se_id;
+	struct bmon_shm_attr	se_attr[];
+};
+
+static inline struct bmon_shm_element *
+bmon_shm_element(const struct bmon_shm_hdr *hdr, unsigned int i)
+{
+	return (struct bmon_shm_element *)
+		((char *) hdr + sizeof(*hdr) + (size_t) i * hdr->sh_stride);
+}
+
+/* Reader library, see shm_reader.c */
+struct bmon_shm
+{
+	struct bmon_shm_hdr *	s_hdr;
+	size_t			s_size;
+};
+
+extern int		bmon_shm_open(struct bmon_shm *, const char *);
+extern void		bmon_shm_close(struct bmon_shm *);
+extern int		bmon_shm_snapshot(struct bmon_shm *, void *, size_t);
+extern int		bmon_shm_attr_index(const struct bmon_shm_hdr *,
+					    const char *);
+
+#endif
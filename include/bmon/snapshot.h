@@ -0,0 +1,53 @@
+/*
+ * bmon/snapshot.h	Element Tree Snapshot
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_SNAPSHOT_H_
+#define __BMON_SNAPSHOT_H_
+
+#include <bmon/bmon.h>
+#include <bmon/attr.h>
+
+/*
+ * The main thread renders a copy of the element tree so that drawing
+ * never holds up the sampling thread. snapshot_start() switches the
+ * calling thread over to the copy, snapshot_update() brings it up to
+ * date with the live tree and must be called with the collector lock
+ * held.
+ *
+ * Outputs must not modify the copy beyond selection and folding.
+ * Changes to attributes are passed to snapshot_apply() and carried out
+ * on the live attribute with the next update.
+ */
+
+#define SNAPSHOT_RESTART	0x01	/* change restarts histories */
+
+extern void		snapshot_start(void);
+extern void		snapshot_update(void);
+extern void		snapshot_free(void);
+
+extern void		snapshot_apply(struct attr *,
+				       void (*)(struct attr *), int);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * bmon/subscribe.h	Subscription Protocol
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_SUBSCRIBE_H_
+#define __BMON_SUBSCRIBE_H_
+
+/*
+ * Protocol spoken on the Unix socket of the "unix" output module. This
+ * header is self contained so that clients do not need any other part
+ * of bmon. All integers are in host byte order.
+ *
+ * A client subscribes by writing a line of options separated by ';':
+ *
+ *   group=PATTERN	shell pattern matching the group name (default: *)
+ *   element=PATTERN	shell pattern matching the element name (default: *)
+ *   attrs=LIST		attribute names separated by '+' (default: all)
+ *   interval=SECS	minimum time between two frames (default: 0, every
+ *			interval of bmon)
+ *
+ * e.g. "element=eth*;attrs=bytes+packets;interval=5\n". Sending another
+ * line replaces the subscription and starts over.
+ *
+ * The server answers with frames. Every series, i.e. attribute of an
+ * element, is announced once with a DEFINE record assigning it an id.
+ * VALUES frames then only carry the series whose values changed since
+ * the last frame sent to the client. Series of elements which have
+ * disappeared are announced in a REMOVE frame, their id may be reused
+ * by a later DEFINE.
+ */
+
+#include <stdint.h>
+
+#define BMON_SUB_MAGIC		0x62757362	/* "bsub" */
+
+enum {
+	BMON_SUB_DEFINE = 1,	/* f_count bmon_sub_define records */
+	BMON_SUB_VALUES,	/* f_count bmon_sub_value records */
+	BMON_SUB_REMOVE,	/* f_count uint32_t ids */
+	BMON_SUB_ERROR,		/* NUL terminated message */
+};
+
+struct bmon_sub_frame
+{
+	uint32_t		f_magic;
+	/* length of frame including this header */
+	uint32_t		f_len;
+	uint16_t		f_type;
+	uint16_t		f_pad;
+	uint32_t		f_count;
+	/* time of the sample, microseconds since the epoch */
+	uint64_t		f_time;
+};
+
+/*
+ * Followed by the NUL terminated names of group, element, parent and
+ * attribute. d_len covers the names and padding to a multiple of 4.
+ */
+struct bmon_sub_define
+{
+	uint32_t		d_id;
+	uint16_t		d_len;
+	uint16_t		d_level;
+	char			d_names[];
+};
+
+#define BMON_SUB_RX		(1 << 0)	/* rx values are valid */
+#define BMON_SUB_TX		(1 << 1)	/* tx values are valid */
+
+struct bmon_sub_value
+{
+	uint32_t		v_id;
+	uint32_t		v_flags;
+	uint64_t		v_rx;
+	uint64_t		v_tx;
+	float			v_rx_rate;
+	float			v_tx_rate;
+};
+
+#endif
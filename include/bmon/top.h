@@ -0,0 +1,78 @@
+/*
+ * bmon/top.h		Top-N Ranking
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_TOP_H_
+#define __BMON_TOP_H_
+
+#include <bmon/bmon.h>
+#include <bmon/attr.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+
+struct bmon_ctx;
+
+#define TOP_RX			(1 << 0)
+#define TOP_TX			(1 << 1)
+
+struct top_entry
+{
+	struct element *	te_element;
+	float			te_rate;
+};
+
+/*
+ * Ranking of the top level elements of all groups by the rate of one
+ * attribute. The N heaviest are kept in a bounded min-heap while the
+ * elements are walked, so a read costs O(elements * log N) instead of
+ * sorting all elements. The ranking is redone at most once per read
+ * and only when asked for.
+ */
+struct top
+{
+	struct attr_set		t_attr;
+	int			t_dir;		/* TOP_RX and/or TOP_TX */
+	int			t_n;		/* 0 if disabled */
+
+	/* heaviest first */
+	struct top_entry *	t_rank;
+	int			t_len;
+
+	/* read the ranking is from */
+	struct bmon_ctx *	t_ctx;
+	timestamp_t		t_read;
+	unsigned int		t_tree_gen;
+};
+
+extern void			top_set_attr(struct top *, const char *);
+extern void			top_set_size(struct top *, int);
+extern int			top_update(struct top *);
+extern void			top_foreach(struct top *,
+					void (*cb)(struct element_group *,
+						   struct element *, void *),
+					void *);
+extern void			top_free(struct top *);
+
+#endif
@@ -49,9 +49,20 @@ struct fraction {
 	struct list_head	f_list;
 };
 
+/* Divisors of a unit variant in ascending order, built on first use */
+struct unit_table {
+	int			ut_n;
+	int			ut_valid;
+	float *			ut_div;
+	/* integral divisors, 0 if the divisor has a fraction */
+	uint64_t *		ut_idiv;
+	char **			ut_name;
+};
+
 struct unit {
 	char *			u_name;
 	struct list_head	u_div[__UNIT_MAX];
+	struct unit_table	u_table[__UNIT_MAX];
 
 	struct list_head	u_list;
 };
@@ -28,11 +28,16 @@
 
 #include <bmon/bmon.h>
 
+#include <setjmp.h>
+
 extern void * xcalloc(size_t, size_t);
 extern void * xrealloc(void *, size_t);
 extern void xfree(void *);
 extern void quit (const char *, ...);
 
+/* quit() jumps here instead of exiting if set, see libbmon.c */
+extern jmp_buf *quit_env;
+
 extern float timestamp_to_float(timestamp_t *);
 extern int64_t timestamp_to_int(timestamp_t *);
 
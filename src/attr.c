@@ -26,10 +26,13 @@
 #include <bmon/bmon.h>
 #include <bmon/conf.h>
 #include <bmon/attr.h>
+#include <bmon/burst.h>
 #include <bmon/history.h>
 #include <bmon/element.h>
 #include <bmon/unit.h>
 #include <bmon/input.h>
+#include <bmon/pool.h>
+#include <bmon/scheduler.h>
 #include <bmon/utils.h>
 
 #if 0
@@ -45,6 +48,21 @@ static int allow_all_attrs;
 static LIST_HEAD(attr_def_list);
 static int attr_id_gen = 1;
 
+/*
+ * Definitions indexed by id. Definitions may be added while the main
+ * thread renders a snapshot, the table is replaced as a whole when
+ * growing and the previous one kept until exit.
+ */
+struct attr_def_table {
+	int			t_size;
+	struct attr_def_table *	t_prev;
+	struct attr_def *	t_defs[];
+};
+
+static struct attr_def_table *attr_def_ids;
+
+static DEFINE_POOL(attr_pool, "attr", struct attr);
+
 struct attr_def *attr_def_lookup(const char *name)
 {
 	struct attr_def *def;
@@ -57,14 +75,84 @@ struct attr_def *attr_def_lookup(const char *name)
 }
 
 struct attr_def *attr_def_lookup_id(int id)
+{
+	if (id <= 0 || id >= __atomic_load_n(&attr_id_gen, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	return __atomic_load_n(&attr_def_ids, __ATOMIC_ACQUIRE)->t_defs[id];
+}
+
+/**
+ * Parse list of attribute names
+ * @set		Attribute set
+ * @names	Attribute names separated by '+' or blanks
+ *
+ * Replaces the previous content of the set. The names are resolved on
+ * first use as input modules define their attributes after the output
+ * modules have been configured.
+ */
+void attr_set_parse(struct attr_set *set, const char *names)
+{
+	char *buf, *tok, *save;
+
+	attr_set_free(set);
+
+	buf = strdup(names);
+
+	for (tok = strtok_r(buf, "+ \t", &save); tok;
+	     tok = strtok_r(NULL, "+ \t", &save)) {
+		set->as_name = xrealloc(set->as_name,
+					(set->as_n + 1) * sizeof(char *));
+		set->as_id = xrealloc(set->as_id,
+				      (set->as_n + 1) * sizeof(int));
+
+		set->as_name[set->as_n] = strdup(tok);
+		set->as_id[set->as_n] = -1;
+		set->as_n++;
+	}
+
+	free(buf);
+}
+
+void attr_set_free(struct attr_set *set)
+{
+	int i;
+
+	for (i = 0; i < set->as_n; i++)
+		xfree(set->as_name[i]);
+
+	xfree(set->as_name);
+	xfree(set->as_id);
+
+	memset(set, 0, sizeof(*set));
+}
+
+struct attr_def *attr_set_def(struct attr_set *set, int i)
 {
 	struct attr_def *def;
 
-	list_for_each_entry(def, &attr_def_list, ad_list)
-		if (def->ad_id == id)
-			return def;
+	if (set->as_id[i] == -1) {
+		if ((def = attr_def_lookup(set->as_name[i])))
+			set->as_id[i] = def->ad_id;
+		else {
+			fprintf(stderr, "Undefined attribute \"%s\"\n",
+				set->as_name[i]);
+			set->as_id[i] = -2;
+		}
+	}
 
-	return NULL;
+	if (set->as_id[i] < 0)
+		return NULL;
+
+	return attr_def_lookup_id(set->as_id[i]);
+}
+
+struct attr *attr_set_get(struct attr_set *set, int i, const struct element *e)
+{
+	if (set->as_id[i] < 0 && !attr_set_def(set, i))
+		return NULL;
+
+	return attr_lookup(e, set->as_id[i]);
 }
 
 #if 0
@@ -85,6 +173,41 @@ int foreach_attr_type(int (*cb)(struct attr_type *, void *), void *arg)
 }
 #endif
 
+/*
+ * Ranks keep the definitions ordered by description so attributes can
+ * be sorted without comparing strings, see attrcmp().
+ */
+static void attr_def_rank(struct attr_def *new)
+{
+	struct attr_def *def;
+	int cmp;
+
+	list_for_each_entry(def, &attr_def_list, ad_list) {
+		cmp = strcasecmp(def->ad_description, new->ad_description);
+
+		if (cmp < 0)
+			new->ad_rank++;
+		else if (cmp > 0)
+			def->ad_rank++;
+	}
+}
+
+static void attr_def_grow(void)
+{
+	struct attr_def_table *t, *old = attr_def_ids;
+	int size = old ? old->t_size * 2 : 64;
+
+	t = xcalloc(1, sizeof(*t) + size * sizeof(struct attr_def *));
+	t->t_size = size;
+	t->t_prev = old;
+
+	if (old)
+		memcpy(t->t_defs, old->t_defs,
+		       old->t_size * sizeof(struct attr_def *));
+
+	__atomic_store_n(&attr_def_ids, t, __ATOMIC_RELEASE);
+}
+
 int attr_def_add(const char *name, const char *desc, struct unit *unit,
 		 int type, int flags)
 {
@@ -95,19 +218,33 @@ int attr_def_add(const char *name, const char *desc, struct unit *unit,
 
 	def = xcalloc(1, sizeof(*def));
 
-	def->ad_id = attr_id_gen++;
+	def->ad_id = attr_id_gen;
 	def->ad_name = strdup(name);
 
 	def->ad_description = strdup(desc ? : "");
 	def->ad_type = type;
 	def->ad_unit = unit;
 	def->ad_flags = flags;
+	def->ad_sched = sched_lookup(SCHED_ATTR, name);
+	def->ad_burst = burst_lookup(name);
+
+	attr_def_rank(def);
+
+	if (!attr_def_ids || def->ad_id >= attr_def_ids->t_size)
+		attr_def_grow();
 
-	list_add_tail(&def->ad_list, &attr_def_list);
+	attr_def_ids->t_defs[def->ad_id] = def;
+
+	/* complete before readers outside of the collector lock see it */
+	list_add_tail_publish(&def->ad_list, &attr_def_list);
+	__atomic_store_n(&attr_id_gen, def->ad_id + 1, __ATOMIC_RELEASE);
 
 	DBG("New attribute %s desc=\"%s\" unit=%s type=%d",
 	    def->ad_name, def->ad_description, def->ad_unit->u_name, type);
 
+	if (def->ad_burst)
+		burst_def_attach(def);
+
 	return def->ad_id;
 }
 
@@ -141,11 +278,6 @@ int attr_map_load(struct attr_map *map, size_t size)
 	return nfailed;
 }
 
-static inline unsigned int attr_hash(int id)
-{
-	return id % ATTR_HASH_SIZE;
-}
-
 struct attr *attr_lookup(const struct element *e, int id)
 {
 	unsigned int hash = attr_hash(id);
@@ -266,15 +398,17 @@ static int attrcmp(struct element *e, struct attr *a, struct attr *b)
 		return (e->e_key_attr[GT_MAJOR] == a->a_def) ? -1 : 1;
 
 	/* otherwise sort by alphabet */
-	return strcasecmp(a->a_def->ad_description, b->a_def->ad_description);
+	return a->a_def->ad_rank - b->a_def->ad_rank;
 }
 
 void attr_update(struct element *e, int id, uint64_t rx, uint64_t tx, int flags)
 {
 	struct attr *attr, *n;
-	int update_ts = 0;
 
-	if (!(attr = attr_lookup(e, id))) {
+	if ((attr = attr_lookup(e, id))) {
+		if (!sched_due(attr->a_def->ad_sched))
+			return;
+	} else {
 		unsigned int hash = attr_hash(id);
 		struct attr_def *def;
 
@@ -284,9 +418,11 @@ void attr_update(struct element *e, int id, uint64_t rx, uint64_t tx, int flags)
 		DBG("Tracking new attribute %d (\"%s\") of element %s",
 		    def->ad_id, def->ad_name, e->e_name);
 
-		attr = xcalloc(1, sizeof(*attr));
+		attr = pool_alloc(&attr_pool);
 		attr->a_def = def;
+		attr->a_element = e;
 		attr->a_flags = def->ad_flags;
+		attr->a_interval = sched_interval(e->e_group, def);
 
 		init_list_head(&attr->a_history_list);
 
@@ -311,31 +447,24 @@ inserted:
 	if (flags & UPDATE_FLAG_RX) {
 		attr->a_rx_rate.r_current = rx;
 		attr->a_flags |= ATTR_RX_ENABLED;
-		update_ts = 1;
 	}
 
 	if (flags & UPDATE_FLAG_TX) {
 		attr->a_tx_rate.r_current = tx;
 		attr->a_flags |= ATTR_TX_ENABLED;
-		update_ts = 1;
 	}
 
-	if (update_ts)
-		update_timestamp(&attr->a_last_update);
-
 	DBG("Updated attribute %d (\"%s\") of element %s", id, attr->a_def->ad_name, e->e_name);
 }
 
 void attr_free(struct attr *a)
 {
-	struct history *h, *n;
-
-	list_for_each_entry_safe(h, n, &a->a_history_list, h_list)
-		history_free(h);
+	history_detach(a);
+	burst_free(a);
 
 	list_del(&a->a_list);
 
-	xfree(a);
+	pool_free(&attr_pool, a);
 }
 
 void attr_rate2float(struct attr *a, double *rx, char **rxu, int *rxprec,
@@ -581,19 +710,22 @@ static void calc_counter_rate(struct attr *a, struct rate *rate,
 
 	old_rate = rate->r_rate;
 
-	if (rate->r_total < prev_total) {
+	/* reads in between add up when reading faster than rate_interval */
+	if (rate->r_total < rate->r_calc_total) {
 		/* overflow */
-		delta = 0xFFFFFFFFFFFFFFFFULL - prev_total;
+		delta = 0xFFFFFFFFFFFFFFFFULL - rate->r_calc_total;
 		delta += rate->r_total + 1;
 	} else
-		delta = rate->r_total - prev_total;
+		delta = rate->r_total - rate->r_calc_total;
 
 	rate->r_rate = delta / diff;
+	sched_observe(a, old_rate, rate->r_rate);
 
 	if (old_rate)
 		rate->r_rate = ((rate->r_rate * 3.0f) + old_rate) / 4.0f;
 
 out:
+	rate->r_calc_total = rate->r_total;
 	copy_timestamp(&rate->r_last_calc, ts);
 }
 
@@ -621,6 +753,9 @@ void attr_notify_update(struct attr *a, timestamp_t *ts)
 		break;
 	}
 
+	if (a->a_def->ad_burst)
+		burst_sample(a, ts);
+
 	if (a->a_flags & ATTR_DOING_HISTORY) {
 		struct history *h;
 
@@ -641,8 +776,14 @@ void attr_reset_counter(struct attr *a)
 
 static void __exit attr_exit(void)
 {
+	struct attr_def_table *t, *prev;
 	struct attr_def *ad, *n;
 
 	list_for_each_entry_safe(ad, n, &attr_def_list, ad_list)
 		attr_def_free(ad);
+
+	for (t = attr_def_ids; t; t = prev) {
+		prev = t->t_prev;
+		xfree(t);
+	}
 }
@@ -26,15 +26,22 @@
 #include <bmon/bmon.h>
 #include <bmon/conf.h>
 #include <bmon/attr.h>
+#include <bmon/collector.h>
 #include <bmon/utils.h>
 #include <bmon/input.h>
 #include <bmon/output.h>
 #include <bmon/module.h>
 #include <bmon/group.h>
+#include <bmon/history.h>
+#include <bmon/scheduler.h>
+#include <bmon/recorder.h>
+#include <bmon/snapshot.h>
 
 int start_time;
 
-struct reader_timing rtiming;
+static int oneshot;
+static double oneshot_gap = 0.1;
+static int output_selected;
 
 static char *usage_text =
 "Usage: bmon [OPTION]...\n" \
@@ -44,6 +51,7 @@ static char *usage_text =
 "   -i, --input=MODPARM             Input module(s)\n" \
 "   -o, --output=MODPARM            Output module(s)\n" \
 "   -f, --configfile=PATH           Alternative path to configuration file\n" \
+"   -1, --one-shot                  Take two samples, print rates once and exit\n" \
 "   -h, --help                      Show this help text\n" \
 "   -V, --version                   Show version\n" \
 "\n" \
@@ -54,6 +62,7 @@ static char *usage_text =
 "   -R, --rate-interval=FLOAT       Rate interval in seconds (float)\n" \
 "   -s, --sleep-interval=FLOAT      Sleep time in seconds (float)\n" \
 "   -L, --lifetime=LIFETIME         Lifetime of an element in seconds (float)\n" \
+"   -G, --gap=FLOAT                 Time between the samples of --one-shot (float)\n" \
 "\n" \
 "Output:\n" \
 "   -U, --use-si                    Use SI units\n" \
@@ -82,6 +91,8 @@ static void do_shutdown(void)
 	
 	if (!done) {
 		done = 1;
+		collector_stop();
+		snapshot_free();
 		module_shutdown();
 	}
 }
@@ -91,21 +102,17 @@ static void sig_exit(void)
 	do_shutdown();
 }
 
-void quit(const char *fmt, ...)
-{
-	static int done;
-	va_list args;
-
-	va_start(args, fmt);
-	vfprintf(stderr, fmt, args);
-	va_end(args);
+static volatile sig_atomic_t exit_requested;
 
-	if (!done) {
-		done = 1;
-		do_shutdown();
-	}
+/* Leave the main loop so that modules get to clean up via atexit() */
+static void sig_term(int sig)
+{
+	exit_requested = 1;
+}
 
-	exit(1);
+static void sig_usr1(int sig)
+{
+	recorder_request_dump();
 }
 
 static inline void print_version(void)
@@ -163,7 +170,7 @@ static int parse_args_post(int argc, char *argv[])
 	for (;;)
 	{
 		char *gostr = "i:o:p:r:R:s:aUb" \
-			      "L:hvVf:";
+			      "L:hvVf:1G:";
 
 		struct option long_opts[] = {
 			{"input", 1, NULL, 'i'},
@@ -176,6 +183,8 @@ static int parse_args_post(int argc, char *argv[])
 			{"use-si", 0, NULL, 'U'},
 			{"use-bit", 0, NULL, 'b'},
 			{"lifetime", 1, NULL, 'L'},
+			{"one-shot", 0, NULL, '1'},
+			{"gap", 1, NULL, 'G'},
 			{NULL, 0, NULL, 0},
 		};
 		int c = getopt_long(argc, argv, gostr, long_opts, NULL);
@@ -192,6 +201,7 @@ static int parse_args_post(int argc, char *argv[])
 			case 'o':
 				if (output_set(optarg))
 					return 1;
+				output_selected = 1;
 				break;
 
 			case 'p':
@@ -226,6 +236,14 @@ static int parse_args_post(int argc, char *argv[])
 				cfg_setint(cfg, "lifetime", strtoul(optarg, NULL, 0));
 				break;
 
+			case '1':
+				oneshot = 1;
+				break;
+
+			case 'G':
+				oneshot_gap = strtod(optarg, NULL);
+				break;
+
 			case 'f':
 				/* Already handled in pre getopt loop */
 				break;
@@ -245,25 +263,59 @@ static void calc_variance(timestamp_t *c, timestamp_t *ri)
 {
 	float v = (ts_to_float(c) / ts_to_float(ri)) * 100.0f;
 
-	rtiming.rt_variance.v_error = v;
-	rtiming.rt_variance.v_total += v;
+	bmon_ctx->c_rtiming.rt_variance.v_error = v;
+	bmon_ctx->c_rtiming.rt_variance.v_total += v;
 
-	if (v > rtiming.rt_variance.v_max)
-		rtiming.rt_variance.v_max = v;
+	if (v > bmon_ctx->c_rtiming.rt_variance.v_max)
+		bmon_ctx->c_rtiming.rt_variance.v_max = v;
 
-	if (v < rtiming.rt_variance.v_min)
-		rtiming.rt_variance.v_min = v;
+	if (v < bmon_ctx->c_rtiming.rt_variance.v_min)
+		bmon_ctx->c_rtiming.rt_variance.v_min = v;
 }
 #endif
 
+/*
+ * One-shot mode takes two samples oneshot_gap apart, so the rates span
+ * exactly the gap, draws a single frame and exits. The sampling thread
+ * is not started.
+ */
+static void oneshot_setup(void)
+{
+	if (oneshot_gap <= 0.0f)
+		quit("The gap between samples must be positive\n");
+
+	/* curses would only flash a single frame */
+	if (!output_selected)
+		output_set("ascii");
+
+	cfg_rate_interval = oneshot_gap;
+	cfg_rate_variance = 0.0f;
+}
+
+static void oneshot_run(void)
+{
+	collector_read();
+	usleep(oneshot_gap * 1000000.0f);
+	collector_read();
+
+	output_pre();
+	output_draw();
+	output_post();
+}
+
 int main(int argc, char *argv[])
 {
 	unsigned long sleep_time;
 	double read_interval;
+	unsigned int drawn = 0;
+	int update;
 	
 	start_time = time(NULL);
-	memset(&rtiming, 0, sizeof(rtiming));
-	rtiming.rt_variance.v_min = FLT_MAX;
+
+	/* before curses installs handlers of its own */
+	signal(SIGTERM, sig_term);
+	signal(SIGINT, sig_term);
+	signal(SIGUSR1, sig_usr1);
 
 	/*
 	 * Early initialization before reading config
@@ -282,106 +334,52 @@ int main(int argc, char *argv[])
 		return 1;
 	conf_init_post();
 
+	if (oneshot)
+		oneshot_setup();
+
 	module_init();
 
-	read_interval = cfg_read_interval;
+	if (oneshot) {
+		oneshot_run();
+		return 0;
+	}
+
+	DBG("Entering mainloop...");
+
+	collector_start(cfg_read_interval);
+	snapshot_start();
+
+	/* schedules may read more often than the read interval */
+	read_interval = sched_tick_interval();
 	sleep_time = cfg_getint(cfg, "sleep_time");
 
 	if (((double) sleep_time / 1000000.0f) > read_interval)
 		sleep_time = (unsigned long) (read_interval * 1000000.0f);
 
-	DBG("Entering mainloop...");
+	while (!exit_requested) {
+		output_pre();
 
-	do {
-		/*
-		 * E  := Elapsed time
-		 * NR := Next Read
-		 * LR := Last Read
-		 * RI := Read Interval
-		 * ST := Sleep Time
-		 * C  := Correction
-		 */
-		timestamp_t e, ri, tmp;
-		unsigned long st;
-
-		float_to_timestamp(&ri, read_interval);
-
-		/*
-		 * NR := NOW
-		 */
-		update_timestamp(&rtiming.rt_next_read);
-		
-		for (;;) {
-			output_pre();
-
-			/*
-			 * E := NOW
-			 */
-			update_timestamp(&e);
-
-			/*
-			 * IF NR <= E THEN
-			 */
-			if (timestamp_le(&rtiming.rt_next_read, &e)) {
-				timestamp_t c;
-
-				/*
-				 * C :=  (NR - E)
-				 */
-				timestamp_sub(&c, &rtiming.rt_next_read, &e);
-
-				//calc_variance(&c, &ri);
-
-				/*
-				 * LR := E
-				 */
-				copy_timestamp(&rtiming.rt_last_read, &e);
-
-				/*
-				 * NR := E + RI + C
-				 */
-				timestamp_add(&rtiming.rt_next_read, &e, &ri);
-				timestamp_add(&rtiming.rt_next_read,
-				       &rtiming.rt_next_read, &c);
-
-
-				reset_update_flags();
-				input_read();
-				free_unused_elements();
-				output_draw();
-				output_post();
-			}
-
-			/*
-			 * ST := Configured ST
-			 */
-			st = sleep_time;
-
-			/*
-			 * IF (NR - E) < ST THEN
-			 */
-			timestamp_sub(&tmp, &rtiming.rt_next_read, &e);
-
-			if (tmp.tv_sec < 0)
-				continue;
-
-			if (tmp.tv_sec == 0 && tmp.tv_usec < st) {
-				if (tmp.tv_usec < 0)
-					continue;
-				/*
-				 * ST := (NR - E)
-				 */
-				st = tmp.tv_usec;
-			}
-			
-			/*
-			 * SLEEP(ST)
-			 */
-			usleep(st);
+		/* sampling only waits for the copy, not for the drawing */
+		collector_lock();
+
+		update = 0;
+		if (drawn != collector_generation()) {
+			drawn = collector_generation();
+			snapshot_update();
+			update = 1;
 		}
-	} while (0);
 
-	return 0; /* buddha says i'll never be reached */
+		collector_unlock();
+
+		if (update)
+			output_draw();
+
+		output_post();
+
+		collector_wait(drawn, sleep_time);
+	}
+
+	return 0;
 }
 
 static void __init bmon_init(void)
@@ -0,0 +1,244 @@
+/*
+ * burst.c		Microburst Detection
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/attr.h>
+#include <bmon/burst.h>
+#include <bmon/element.h>
+#include <bmon/pool.h>
+#include <bmon/unit.h>
+#include <bmon/utils.h>
+
+struct burst_series
+{
+	/* total of counter at previous read */
+	uint64_t		bs_prev;
+
+	/* peak rate or maximum, minimum in current window */
+	float			bs_peak;
+	float			bs_min;
+
+	unsigned int		bs_bursts;
+	/* previous sample was above threshold */
+	int			bs_above;
+};
+
+struct burst
+{
+	struct burst_series	b_rx,
+				b_tx;
+
+	timestamp_t		b_last;		/* previous read */
+	timestamp_t		b_start;	/* start of window */
+	int			b_nsamples;
+};
+
+static LIST_HEAD(burst_def_list);
+
+static DEFINE_POOL(burst_pool, "burst", struct burst);
+
+struct burst_def *burst_lookup(const char *name)
+{
+	struct burst_def *bd;
+
+	list_for_each_entry(bd, &burst_def_list, bd_list)
+		if (!strcmp(bd->bd_name, name))
+			return bd;
+
+	return NULL;
+}
+
+struct burst_def *burst_def_add(const char *name, float threshold)
+{
+	struct burst_def *bd;
+
+	if (!(bd = burst_lookup(name))) {
+		bd = xcalloc(1, sizeof(*bd));
+		bd->bd_name = strdup(name);
+		bd->bd_peak_id = -1;
+		bd->bd_min_id = -1;
+		bd->bd_max_id = -1;
+		bd->bd_bursts_id = -1;
+		list_add_tail(&bd->bd_list, &burst_def_list);
+	}
+
+	bd->bd_threshold = threshold;
+
+	return bd;
+}
+
+static int derived_add(struct attr_def *def, const char *suffix,
+		       const char *desc, struct unit *unit)
+{
+	char name[64], description[128];
+
+	snprintf(name, sizeof(name), "%s_%s", def->ad_name, suffix);
+	snprintf(description, sizeof(description), "%s %s",
+		 def->ad_description, desc);
+
+	return attr_def_add(name, description, unit, ATTR_TYPE_RATE,
+			    ATTR_FORCE_HISTORY);
+}
+
+/**
+ * Define attributes reporting bursts of attribute
+ * @def		Attribute definition with burst definition
+ *
+ * Called as the attribute is defined so outputs can refer to the
+ * derived attributes before any burst was reported.
+ */
+void burst_def_attach(struct attr_def *def)
+{
+	struct burst_def *bd = def->ad_burst;
+
+	if (def->ad_type == ATTR_TYPE_COUNTER)
+		bd->bd_peak_id = derived_add(def, "peak", "Peak", def->ad_unit);
+	else {
+		bd->bd_min_id = derived_add(def, "min", "Min", def->ad_unit);
+		bd->bd_max_id = derived_add(def, "max", "Max", def->ad_unit);
+	}
+
+	if (bd->bd_threshold)
+		bd->bd_bursts_id = derived_add(def, "bursts", "Bursts",
+					       unit_lookup(UNIT_NUMBER));
+}
+
+static void sample(struct burst_def *bd, struct burst_series *bs,
+		   struct rate *r, int counter, float diff, int first)
+{
+	float value;
+
+	if (counter) {
+		value = (r->r_total - bs->bs_prev) / diff;
+		bs->bs_prev = r->r_total;
+	} else
+		value = r->r_total;
+
+	if (first || value > bs->bs_peak)
+		bs->bs_peak = value;
+
+	if (first || value < bs->bs_min)
+		bs->bs_min = value;
+
+	/* a burst spanning windows counts in the window it started */
+	if (bd->bd_threshold && value >= bd->bd_threshold) {
+		if (!bs->bs_above)
+			bs->bs_bursts++;
+		bs->bs_above = 1;
+	} else
+		bs->bs_above = 0;
+}
+
+static void publish(struct attr *a, struct burst *b, int counter)
+{
+	struct burst_def *bd = a->a_def->ad_burst;
+	struct element *e = a->a_element;
+	int flags = 0;
+
+	if (a->a_flags & ATTR_RX_ENABLED)
+		flags |= UPDATE_FLAG_RX;
+
+	if (a->a_flags & ATTR_TX_ENABLED)
+		flags |= UPDATE_FLAG_TX;
+
+	if (counter)
+		attr_update(e, bd->bd_peak_id, b->b_rx.bs_peak,
+			    b->b_tx.bs_peak, flags);
+	else {
+		attr_update(e, bd->bd_min_id, b->b_rx.bs_min,
+			    b->b_tx.bs_min, flags);
+		attr_update(e, bd->bd_max_id, b->b_rx.bs_peak,
+			    b->b_tx.bs_peak, flags);
+	}
+
+	if (bd->bd_bursts_id >= 0)
+		attr_update(e, bd->bd_bursts_id, b->b_rx.bs_bursts,
+			    b->b_tx.bs_bursts, flags);
+}
+
+/**
+ * Sample watched attribute
+ * @a		Attribute with burst definition
+ * @ts		Time of read
+ *
+ * Called on every read of the attribute. Reports the window once it
+ * spans the rate interval.
+ */
+void burst_sample(struct attr *a, timestamp_t *ts)
+{
+	struct burst_def *bd = a->a_def->ad_burst;
+	struct burst *b = a->a_burst;
+	int counter = (a->a_def->ad_type == ATTR_TYPE_COUNTER);
+	float diff;
+
+	if (!b) {
+		b = a->a_burst = pool_alloc(&burst_pool);
+		b->b_rx.bs_prev = a->a_rx_rate.r_total;
+		b->b_tx.bs_prev = a->a_tx_rate.r_total;
+		copy_timestamp(&b->b_last, ts);
+		copy_timestamp(&b->b_start, ts);
+
+		/* counters need a second read for a rate */
+		if (counter)
+			return;
+
+		diff = 0.0f;
+	} else if ((diff = timestamp_diff(&b->b_last, ts)) <= 0.0f)
+		return;
+
+	copy_timestamp(&b->b_last, ts);
+
+	sample(bd, &b->b_rx, &a->a_rx_rate, counter, diff, !b->b_nsamples);
+	sample(bd, &b->b_tx, &a->a_tx_rate, counter, diff, !b->b_nsamples);
+	b->b_nsamples++;
+
+	if (timestamp_diff(&b->b_start, ts) <
+	    (cfg_rate_interval - cfg_rate_variance))
+		return;
+
+	publish(a, b, counter);
+
+	b->b_rx.bs_bursts = b->b_tx.bs_bursts = 0;
+	b->b_nsamples = 0;
+	copy_timestamp(&b->b_start, ts);
+}
+
+void burst_free(struct attr *a)
+{
+	pool_free(&burst_pool, a->a_burst);
+	a->a_burst = NULL;
+}
+
+static void __exit burst_exit(void)
+{
+	struct burst_def *bd, *n;
+
+	list_for_each_entry_safe(bd, n, &burst_def_list, bd_list) {
+		xfree(bd->bd_name);
+		xfree(bd);
+	}
+}
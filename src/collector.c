@@ -0,0 +1,225 @@
+/*
+ * collector.c		Sampling Thread
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <bmon/bmon.h>
+#include <bmon/collector.h>
+#include <bmon/context.h>
+#include <bmon/group.h>
+#include <bmon/history.h>
+#include <bmon/input.h>
+#include <bmon/recorder.h>
+#include <bmon/scheduler.h>
+#include <bmon/utils.h>
+
+#include <pthread.h>
+
+static pthread_t collector_thread;
+static pthread_mutex_t collector_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t collector_cond = PTHREAD_COND_INITIALIZER;
+
+/* Thread holding the lock, see collector_stop() */
+static pthread_t lock_owner;
+static int lock_held;
+
+/* Generation of the element tree, bumped after every read */
+static unsigned int collector_gen;
+
+static int running;
+
+void collector_lock(void)
+{
+	pthread_mutex_lock(&collector_mutex);
+	lock_owner = pthread_self();
+	lock_held = 1;
+}
+
+void collector_unlock(void)
+{
+	lock_held = 0;
+	pthread_mutex_unlock(&collector_mutex);
+}
+
+static int lock_is_mine(void)
+{
+	return lock_held && pthread_equal(lock_owner, pthread_self());
+}
+
+/* Caller must hold the collector lock */
+unsigned int collector_generation(void)
+{
+	return collector_gen;
+}
+
+/**
+ * Read all inputs of the current context once
+ *
+ * Called by the sampling thread with the lock held and by users of
+ * libbmon for every tick.
+ */
+void collector_read(void)
+{
+	struct reader_timing *rt = &bmon_ctx->c_rtiming;
+	timestamp_t prev = rt->rt_last_read;
+	unsigned int cycles = 1;
+
+	update_timestamp(&rt->rt_last_read);
+
+	/* reads are not evenly spaced with adaptive schedules */
+	if (prev.tv_sec)
+		cycles = (timestamp_diff(&prev, &rt->rt_last_read) /
+			  sched_tick_interval()) + 0.5f;
+
+	if (!cycles)
+		cycles = 1;
+
+	reset_update_flags();
+	input_read();
+	recorder_read(&rt->rt_last_read);
+	free_unused_elements(cycles);
+	history_enforce_budget();
+}
+
+static void collect(timestamp_t *now)
+{
+	collector_lock();
+
+	sched_begin(now);
+	collector_read();
+	sched_end(now);
+
+	collector_gen++;
+	pthread_cond_broadcast(&collector_cond);
+
+	collector_unlock();
+}
+
+static void *collector_main(void *arg)
+{
+	struct reader_timing *rt = &bmon_ctx->c_rtiming;
+	timestamp_t now, tmp;
+	struct timespec ts;
+
+	for (;;) {
+		update_timestamp(&now);
+
+		/*
+		 * Deadlines are advanced by their interval rather than
+		 * set relative to the time of the read, so late reads
+		 * do not add up to drift. The schedules are torn down on
+		 * exit while holding the lock, see collector_stop().
+		 */
+		collector_lock();
+		sched_next(&rt->rt_next_read);
+		collector_unlock();
+
+		if (timestamp_le(&rt->rt_next_read, &now)) {
+			collect(&now);
+			continue;
+		}
+
+		timestamp_sub(&tmp, &rt->rt_next_read, &now);
+
+		ts.tv_sec = tmp.tv_sec;
+		ts.tv_nsec = tmp.tv_usec * 1000;
+
+		nanosleep(&ts, NULL);
+	}
+
+	return NULL;
+}
+
+/**
+ * Start sampling thread
+ * @interval		Read interval in seconds
+ *
+ * Inputs listed in a schedule are read at their own interval, see
+ * scheduler.h. The first read is done right away.
+ */
+void collector_start(double interval)
+{
+	int err;
+
+	input_schedule();
+	sched_start(interval);
+	recorder_start();
+
+	if ((err = pthread_create(&collector_thread, NULL,
+				  collector_main, NULL)))
+		quit("Unable to start sampling thread: %s\n", strerror(err));
+
+	running = 1;
+}
+
+/**
+ * Stop sampling for good
+ *
+ * Waits for a read in progress to finish and keeps the lock so the
+ * element tree can be torn down on exit. Must not be followed by
+ * collector_unlock(). exit() may be called with the lock held, e.g. by
+ * quit() during a read, the lock is kept as is then.
+ */
+void collector_stop(void)
+{
+	if (running) {
+		running = 0;
+		if (!lock_is_mine())
+			collector_lock();
+	}
+}
+
+/**
+ * Wait for a new generation of the element tree
+ * @gen		Last generation seen by the caller
+ * @usec	Maximum time to wait in microseconds
+ *
+ * Returns the current generation.
+ */
+unsigned int collector_wait(unsigned int gen, unsigned long usec)
+{
+	struct timespec ts;
+	unsigned int cur;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += usec / 1000000;
+	ts.tv_nsec += (usec % 1000000) * 1000;
+
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	/* not owned in between as the wait releases the mutex */
+	pthread_mutex_lock(&collector_mutex);
+
+	while (collector_gen == gen &&
+	       !pthread_cond_timedwait(&collector_cond, &collector_mutex, &ts))
+		;
+
+	cur = collector_gen;
+	pthread_mutex_unlock(&collector_mutex);
+
+	return cur;
+}
@@ -31,6 +31,9 @@
 #include <bmon/element_cfg.h>
 #include <bmon/history.h>
 #include <bmon/layout.h>
+#include <bmon/scheduler.h>
+#include <bmon/burst.h>
+#include <bmon/recorder.h>
 #include <bmon/utils.h>
 
 cfg_t *cfg;
@@ -41,13 +44,43 @@ static cfg_opt_t element_opts[] = {
 	CFG_INT("rxmax", 0, CFGF_NONE),
 	CFG_INT("txmax", 0, CFGF_NONE),
 	CFG_INT("max", 0, CFGF_NONE),
+	CFG_BOOL("record", cfg_false, CFGF_NONE),
 	CFG_END()
 };
 
 static cfg_opt_t history_opts[] = {
 	CFG_FLOAT("interval", 1.0f, CFGF_NONE),
 	CFG_INT("size", 60, CFGF_NONE),
-	CFG_STR("type", "64bit", CFGF_NONE),
+	CFG_STR("type", "16bit", CFGF_NONE),
+	CFG_END()
+};
+
+static cfg_opt_t schedule_opts[] = {
+	CFG_FLOAT("interval", 1.0f, CFGF_NONE),
+	CFG_STR_LIST("input", "{}", CFGF_NONE),
+	CFG_STR_LIST("group", "{}", CFGF_NONE),
+	CFG_STR_LIST("attr", "{}", CFGF_NONE),
+	CFG_FLOAT("fast_interval", 0.0f, CFGF_NONE),
+	CFG_FLOAT("cooldown", 30.0f, CFGF_NONE),
+	CFG_STR("trigger", "bytes", CFGF_NONE),
+	CFG_FLOAT("rate_change", 0.5f, CFGF_NONE),
+	CFG_FLOAT("rate_floor", 1024.0f, CFGF_NONE),
+	CFG_FLOAT("rate_threshold", 0.0f, CFGF_NONE),
+	CFG_END()
+};
+
+static cfg_opt_t burst_opts[] = {
+	CFG_FLOAT("threshold", 0.0f, CFGF_NONE),
+	CFG_END()
+};
+
+static cfg_opt_t recorder_opts[] = {
+	CFG_STR("dir", "", CFGF_NONE),
+	CFG_STR("attrs", "bytes+packets+drop", CFGF_NONE),
+	CFG_FLOAT("duration", 120.0f, CFGF_NONE),
+	CFG_FLOAT("holdoff", 60.0f, CFGF_NONE),
+	CFG_STR("format", "csv", CFGF_NONE),
+	CFG_STR_LIST("rule", "{}", CFGF_NONE),
 	CFG_END()
 };
 
@@ -94,9 +127,14 @@ static cfg_opt_t global_opts[] = {
 	CFG_STR("uid", NULL, CFGF_NONE),
 	CFG_STR("gid", NULL, CFGF_NONE),
 	CFG_STR("policy", "", CFGF_NONE),
+	CFG_STR("history_dir", "", CFGF_NONE),
+	CFG_INT("history_budget", 0, CFGF_NONE),
 	CFG_SEC("unit", unit_opts, CFGF_MULTI | CFGF_TITLE),
 	CFG_SEC("attr", attr_opts, CFGF_MULTI | CFGF_TITLE),
 	CFG_SEC("history", history_opts, CFGF_MULTI | CFGF_TITLE),
+	CFG_SEC("schedule", schedule_opts, CFGF_MULTI | CFGF_TITLE),
+	CFG_SEC("burst", burst_opts, CFGF_MULTI | CFGF_TITLE),
+	CFG_SEC("recorder", recorder_opts, CFGF_NONE),
 	CFG_SEC("element", element_opts, CFGF_MULTI | CFGF_TITLE),
     CFG_SEC("layout", layout_opts, CFGF_MULTI | CFGF_TITLE),
 	CFG_END()
@@ -108,6 +146,9 @@ float			cfg_rate_variance;
 float			cfg_history_variance;
 int			cfg_show_all;
 int			cfg_unit_exp		= DYNAMIC_EXP;
+int			cfg_unit_variant	= UNIT_DEFAULT;
+char *			cfg_history_dir;
+uint64_t		cfg_history_budget;
 
 static char *		configfile		= NULL;
 
@@ -196,6 +237,21 @@ module_conf_t * parse_module(char *data)
 	return m;
 }
 
+void module_conf_free(module_conf_t *m)
+{
+	tv_t *tv, *n;
+
+	list_for_each_entry_safe(tv, n, &m->m_attrs, tv_list) {
+		list_del(&tv->tv_list);
+		xfree(tv->tv_type);
+		xfree(tv->tv_value);
+		xfree(tv);
+	}
+
+	xfree(m->m_name);
+	xfree(m);
+}
+
 
 int parse_module_param(const char *data, struct list_head *list)
 {
@@ -271,6 +327,90 @@ static void configfile_read_history(void)
 	}
 }
 
+static void read_schedule_members(struct sched_class *sc, cfg_t *schedule,
+				  const char *opt, int type)
+{
+	int i, n = cfg_size(schedule, opt);
+
+	for (i = 0; i < n; i++)
+		sched_member_add(sc, type, cfg_getnstr(schedule, opt, i));
+}
+
+static void configfile_read_schedules(void)
+{
+	int i, nschedules;
+
+	nschedules = cfg_size(cfg, "schedule");
+
+	for (i = 0; i < nschedules; i++) {
+		struct sched_class *sc;
+		cfg_t *schedule;
+		const char *name;
+		float interval;
+
+		if (!(schedule = cfg_getnsec(cfg, "schedule", i)))
+			BUG();
+
+		if (!(name = cfg_title(schedule)))
+			BUG();
+
+		interval = cfg_getfloat(schedule, "interval");
+		if (interval <= 0.0f)
+			quit("Interval of schedule '%s' must be positive\n",
+			     name);
+
+		sc = sched_class_add(name, interval);
+
+		if ((sc->sc_fast_interval = cfg_getfloat(schedule,
+							 "fast_interval"))) {
+			if (sc->sc_fast_interval < 0.0f ||
+			    sc->sc_fast_interval >= interval)
+				quit("Fast interval of schedule '%s' must be "
+				     "shorter than its interval\n", name);
+
+			sc->sc_cooldown = cfg_getfloat(schedule, "cooldown");
+			sc->sc_rate_change = cfg_getfloat(schedule,
+							  "rate_change");
+			sc->sc_rate_floor = cfg_getfloat(schedule,
+							 "rate_floor");
+			sc->sc_rate_threshold = cfg_getfloat(schedule,
+							     "rate_threshold");
+			attr_set_parse(&sc->sc_trigger,
+				       cfg_getstr(schedule, "trigger"));
+		}
+
+		read_schedule_members(sc, schedule, "input", SCHED_INPUT);
+		read_schedule_members(sc, schedule, "group", SCHED_GROUP);
+		read_schedule_members(sc, schedule, "attr", SCHED_ATTR);
+	}
+}
+
+static void configfile_read_bursts(void)
+{
+	int i, nbursts;
+
+	nbursts = cfg_size(cfg, "burst");
+
+	for (i = 0; i < nbursts; i++) {
+		cfg_t *burst;
+		const char *name;
+		float threshold;
+
+		if (!(burst = cfg_getnsec(cfg, "burst", i)))
+			BUG();
+
+		if (!(name = cfg_title(burst)))
+			BUG();
+
+		threshold = cfg_getfloat(burst, "threshold");
+		if (threshold < 0.0f)
+			quit("Threshold of burst '%s' must not be negative\n",
+			     name);
+
+		burst_def_add(name, threshold);
+	}
+}
+
 static void configfile_read_element_cfg(void)
 {
 	int i, nelement;
@@ -307,9 +447,37 @@ static void configfile_read_element_cfg(void)
 			ec->ec_flags |= ELEMENT_CFG_SHOW;
 		else
 			ec->ec_flags |= ELEMENT_CFG_HIDE;
+
+		if (cfg_getbool(element, "record")) {
+			ec->ec_flags |= ELEMENT_CFG_RECORD;
+			recorder_add_element(ec);
+		}
 	}
 }
 
+static void configfile_read_recorder(void)
+{
+	cfg_t *recorder;
+	const char *dir;
+	int i, nrules;
+
+	if (!(recorder = cfg_getsec(cfg, "recorder")))
+		return;
+
+	dir = cfg_getstr(recorder, "dir");
+	if (!dir || !*dir)
+		return;
+
+	recorder_setup(dir, cfg_getstr(recorder, "format"),
+		       cfg_getstr(recorder, "attrs"),
+		       cfg_getfloat(recorder, "duration"),
+		       cfg_getfloat(recorder, "holdoff"));
+
+	nrules = cfg_size(recorder, "rule");
+	for (i = 0; i < nrules; i++)
+		recorder_add_rule(cfg_getnstr(recorder, "rule", i));
+}
+
 static void add_div(struct unit *unit, int type, cfg_t *variant)
 {
 	int ndiv, n, ntxt;
@@ -499,8 +667,11 @@ static void conf_read(const char *path, int must)
 
 	configfile_read_units();
 	configfile_read_history();
+	configfile_read_schedules();
+	configfile_read_bursts();
 	configfile_read_attrs();
 	configfile_read_element_cfg();
+	configfile_read_recorder();
     configfile_read_layout_cfg();
 }
 
@@ -597,8 +768,11 @@ static void conf_read_default(void)
 
 	configfile_read_units();
 	configfile_read_history();
+	configfile_read_schedules();
+	configfile_read_bursts();
 	configfile_read_attrs();
 	configfile_read_element_cfg();
+	configfile_read_recorder();
     configfile_read_layout_cfg();
 }
 
@@ -632,7 +806,19 @@ void conf_init_post(void)
 	cfg_show_all = cfg_getbool(cfg, "show_all");
 	cfg_unit_exp = cfg_getint(cfg, "unit_exp");
 
+	if (cfg_getbool(cfg, "use_bit"))
+		cfg_unit_variant = UNIT_BIT;
+	else if (cfg_getbool(cfg, "use_si"))
+		cfg_unit_variant = UNIT_SI;
+
 	element_parse_policy(cfg_getstr(cfg, "policy"));
+
+	cfg_history_dir = cfg_getstr(cfg, "history_dir");
+	if (cfg_history_dir && !*cfg_history_dir)
+		cfg_history_dir = NULL;
+
+	/* configured in KiB */
+	cfg_history_budget = cfg_getint(cfg, "history_budget") * 1024ULL;
 }
 
 void set_configfile(const char *file)
@@ -662,10 +848,11 @@ void set_unit_exp(const char *name)
 		quit("Unknown unit exponent '%s'\n", name);
 }
 
+/* Number of reads an element survives without being updated */
 unsigned int get_lifecycles(void)
 {
 	return (unsigned int)
-		(cfg_getfloat(cfg, "lifetime") / cfg_getfloat(cfg, "read_interval"));
+		(cfg_getfloat(cfg, "lifetime") / sched_tick_interval());
 }
 
 static void __exit conf_shutdown(void)
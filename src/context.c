@@ -0,0 +1,45 @@
+/*
+ * context.c		Collection Context
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/context.h>
+
+static struct bmon_ctx default_ctx = {
+	.c_groups	= LIST_SELF(default_ctx.c_groups),
+	.c_rtiming	= {
+		.rt_variance	= {
+			.v_min	= FLT_MAX,
+		},
+	},
+};
+
+__thread struct bmon_ctx *bmon_ctx = &default_ctx;
+
+void bmon_ctx_init(struct bmon_ctx *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	init_list_head(&ctx->c_groups);
+	ctx->c_rtiming.rt_variance.v_min = FLT_MAX;
+}
@@ -28,12 +28,19 @@
 #include <bmon/element.h>
 #include <bmon/element_cfg.h>
 #include <bmon/group.h>
+#include <bmon/context.h>
 #include <bmon/input.h>
+#include <bmon/pool.h>
+#include <bmon/recorder.h>
+#include <bmon/scheduler.h>
 #include <bmon/utils.h>
 
 static LIST_HEAD(allowed);
 static LIST_HEAD(denied);
 
+static DEFINE_POOL(element_pool, "element", struct element);
+static DEFINE_POOL(info_pool, "info", struct info);
+
 static int match_mask(const struct policy *p, const char *str)
 {
 	int i, n;
@@ -113,20 +120,61 @@ void element_parse_policy(const char *policy)
 	xfree(copy);
 }
 
+static unsigned int element_hash(const char *name, uint32_t id,
+				 struct element *parent)
+{
+	unsigned int h = id ^ (unsigned int) ((uintptr_t) parent >> 4);
+
+	while (*name)
+		h = (h * 31) + (unsigned char) *name++;
+
+	return h;
+}
+
+static struct list_head *element_bucket(struct element_group *group,
+					const char *name, uint32_t id,
+					struct element *parent)
+{
+	unsigned int h = element_hash(name, id, parent);
+
+	return &group->g_hash[h & (group->g_hash_size - 1)];
+}
+
+static void element_hash_grow(struct element_group *group)
+{
+	unsigned int i, size = group->g_hash_size ? group->g_hash_size * 2 : 64;
+	struct list_head *old = group->g_hash;
+	unsigned int old_size = group->g_hash_size;
+	struct element *e, *n;
+
+	group->g_hash = xcalloc(size, sizeof(struct list_head));
+	group->g_hash_size = size;
+
+	for (i = 0; i < size; i++)
+		init_list_head(&group->g_hash[i]);
+
+	for (i = 0; i < old_size; i++)
+		list_for_each_entry_safe(e, n, &old[i], e_hash_list)
+			list_add_tail(&e->e_hash_list,
+				      element_bucket(group, e->e_name,
+						     e->e_id, e->e_parent));
+
+	xfree(old);
+}
+
 static struct element *__lookup_element(struct element_group *group,
 					const char *name, uint32_t id,
 					struct element *parent)
 {
-	struct list_head *list;
 	struct element *e;
 
-	if (parent)
-		list = &parent->e_childs;
-	else
-		list = &group->g_elements;
+	if (!group->g_hash_size)
+		return NULL;
 
-	list_for_each_entry(e, list, e_list)
-		if (!strcmp(name, e->e_name) && e->e_id == id)
+	list_for_each_entry(e, element_bucket(group, name, id, parent),
+			    e_hash_list)
+		if (e->e_parent == parent && e->e_id == id &&
+		    !strcmp(name, e->e_name))
 			return e;
 
 	return NULL;
@@ -154,17 +202,18 @@ struct element *element_lookup(struct element_group *group, const char *name,
 
 	DBG("Creating element %d \"%s\"", id, name);
 
-	e = xcalloc(1, sizeof(*e));
+	e = pool_alloc(&element_pool);
 
 	init_list_head(&e->e_list);
 	init_list_head(&e->e_childs);
 	init_list_head(&e->e_info_list);
 	init_list_head(&e->e_attr_sorted);
+	init_list_head(&e->e_record_list);
 
 	for (i = 0; i < ATTR_HASH_SIZE; i++)
 		init_list_head(&e->e_attrhash[i]);
 
-	e->e_name = strdup(name);
+	e->e_name = pool_strdup(name);
 	e->e_id = id;
 	e->e_parent = parent;
 	e->e_group = group;
@@ -179,6 +228,9 @@ struct element *element_lookup(struct element_group *group, const char *name,
 	
 		element_set_rxmax(e, e->e_cfg->ec_rxmax);
 		element_set_txmax(e, e->e_cfg->ec_txmax);
+
+		if (e->e_cfg->ec_flags & ELEMENT_CFG_RECORD)
+			recorder_attach(e);
 	}
 
 	if (parent) {
@@ -189,7 +241,13 @@ struct element *element_lookup(struct element_group *group, const char *name,
 		list_add_tail(&e->e_list, &group->g_elements);
 	}
 
+	if (group->g_nelements >= group->g_hash_size)
+		element_hash_grow(group);
+
+	list_add_tail(&e->e_hash_list, element_bucket(group, name, id, parent));
+
 	group->g_nelements++;
+	group_tree_gen++;
 
 	return e;
 }
@@ -205,10 +263,10 @@ void element_free(struct element *e)
 		element_free(c);
 
 	list_for_each_entry_safe(info, ninfo, &e->e_info_list, i_list) {
-		xfree(info->i_name);
-		xfree(info->i_value);
+		pool_strfree(info->i_name);
+		pool_strfree(info->i_value);
 		list_del(&info->i_list);
-		xfree(info);
+		pool_free(&info_pool, info);
 	}
 
 	for (i = 0; i < ATTR_HASH_SIZE; i++)
@@ -222,10 +280,13 @@ void element_free(struct element *e)
 	}
 
 	list_del(&e->e_list);
+	list_del(&e->e_hash_list);
+	list_del(&e->e_record_list);
 	e->e_group->g_nelements--;
+	group_tree_gen++;
 
-	xfree(e->e_name);
-	xfree(e);
+	pool_strfree(e->e_name);
+	pool_free(&element_pool, e);
 }
 
 #if 0
@@ -296,12 +357,17 @@ void element_notify_update(struct element *e, timestamp_t *ts)
 
 	e->e_flags |= ELEMENT_FLAG_UPDATED;
 
+	/* rates span the time since the group was last due */
+	if (!sched_due(e->e_group->g_sched))
+		return;
+
 	if (ts == NULL)
-		ts = &rtiming.rt_last_read;
+		ts = &bmon_ctx->c_rtiming.rt_last_read;
 
 	for (i = 0; i < ATTR_HASH_SIZE; i++)
 		list_for_each_entry(a, &e->e_attrhash[i], a_list)
-			attr_notify_update(a, ts);
+			if (sched_due(a->a_def->ad_sched))
+				attr_notify_update(a, ts);
 
 	if (e->e_usage_attr && e->e_cfg &&
 	    (a = attr_lookup(e, e->e_usage_attr->ad_id))) {
@@ -321,10 +387,13 @@ void element_lifesign(struct element *e, int n)
 void element_check_if_dead(struct element_group *g,
 			   struct element *e, void *arg)
 {
-	if (--(e->e_lifecycles) <= 0) {
-		element_free(e);
+	unsigned int cycles = *(unsigned int *) arg;
+
+	if (e->e_lifecycles <= cycles) {
 		DBG("Deleting dead element %s", e->e_name);
-	}
+		element_free(e);
+	} else
+		e->e_lifecycles -= cycles;
 }
 
 void element_foreach_attr(struct element *e,
@@ -499,6 +568,21 @@ struct element *element_select_prev(void)
 	return e;
 }
 
+void element_select(struct element *e)
+{
+	group_select(e->e_group);
+	e->e_group->g_current = e;
+}
+
+void element_set_folded(struct element *e, int folded)
+{
+	if (!folded == !(e->e_flags & ELEMENT_FLAG_FOLDED))
+		return;
+
+	e->e_flags ^= ELEMENT_FLAG_FOLDED;
+	group_tree_gen++;
+}
+
 static struct info *element_info_lookup(struct element *e, const char *name)
 {
 	struct info *i;
@@ -515,16 +599,18 @@ void element_update_info(struct element *e, const char *name, const char *value)
 	struct info *i;
 
 	if ((i = element_info_lookup(e, name))) {
-		xfree(i->i_value);
-		i->i_value = strdup(value);
+		if (strcmp(i->i_value, value)) {
+			pool_strfree(i->i_value);
+			i->i_value = pool_strdup(value);
+		}
 		return;
 	}
 
 	DBG("Created element info %s (\"%s\")", name, value);
 
-	i = xcalloc(1, sizeof(*i));
-	i->i_name = strdup(name);
-	i->i_value = strdup(value);
+	i = pool_alloc(&info_pool);
+	i->i_name = pool_strdup(name);
+	i->i_value = pool_strdup(value);
 
 	e->e_ninfo++;
 
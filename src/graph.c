@@ -58,76 +58,197 @@ static inline char *tbl_pos(struct graph_cfg *cfg, char *tbl, int nrow, int ncol
 	return at_col(at_row(cfg, tbl, nrow), ncol);
 }
 
-static void fill_table(struct graph *g, struct graph_table *tbl,
-		       struct history *h, struct history_store *data)
+static void render_column(struct graph_cfg *cfg, struct graph_table *tbl,
+			  int i)
 {
-	struct graph_cfg *cfg = &g->g_cfg;
-	uint64_t max = 0;
-	double v;
-	int i, n, t;
-	float half_step, step;
+	char *col = at_col(tbl->gt_table, i);
+	uint64_t mean = tbl->gt_mean[i], peak = tbl->gt_peak[i];
+	double half_step = tbl->gt_step / 2.0f, v = mean;
+	int t;
+
+	for (t = 0; t < cfg->gc_height; t++)
+		*(at_row(cfg, col, t)) = cfg->gc_background;
+
+	if (mean == HISTORY_UNKNOWN) {
+		for (t = 0; t < cfg->gc_height; t++)
+			*(at_row(cfg, col, t)) = cfg->gc_unknown;
+	} else if (peak > 0) {
+		*(at_row(cfg, col, 0)) = cfg->gc_noise;
+
+		/* peaks of rolled up histories above the mean */
+		if (cfg->gc_peak)
+			for (t = 0; t < cfg->gc_height; t++)
+				if (peak >= ((t + 1) * tbl->gt_step) - half_step)
+					*(at_row(cfg, col, t)) = cfg->gc_peak;
 
-	if (!tbl->gt_table) {
-		tbl->gt_table = xcalloc(table_size(cfg), sizeof(char));
-		tbl->gt_scale = xcalloc(cfg->gc_height, sizeof(double));
+		for (t = 0; t < cfg->gc_height; t++)
+			if (v >= ((t + 1) * tbl->gt_step) - half_step)
+				*(at_row(cfg, col, t)) = cfg->gc_foreground;
 	}
+}
+
+static void clear_table(struct graph_cfg *cfg, struct graph_table *tbl)
+{
+	int i;
 
 	memset(tbl->gt_table, cfg->gc_background, table_size(cfg));
 
 	/* end each line with a \0 */
 	for (i = 0; i < cfg->gc_height; i++)
 		*tbl_pos(cfg, tbl->gt_table, i, cfg->gc_width) = '\0';
+}
+
+static void render_table(struct graph_cfg *cfg, struct graph_table *tbl)
+{
+	double v;
+	int i, n;
+
+	tbl->gt_step = (double) tbl->gt_max / (double) cfg->gc_height;
+
+	for (i = 0; i < cfg->gc_height; i++)
+		tbl->gt_scale[i] = (double) (i + 1) * tbl->gt_step;
+
+	for (i = 0; i < cfg->gc_width; i++)
+		render_column(cfg, tbl, i);
+
+	n = (cfg->gc_height / 3) * 2;
+	if (n >= cfg->gc_height)
+		n = (cfg->gc_height - 1);
+
+	v = unit_divisor(tbl->gt_scale[n], cfg->gc_unit,
+			 &tbl->gt_y_unit, NULL);
+
+	for (i = 0; i < cfg->gc_height; i++)
+		tbl->gt_scale[i] /= v;
+}
+
+/*
+ * Bring table up to date with nnew samples added to the history since
+ * the last update. The cached samples and character columns are shifted
+ * and only the new columns are rendered. The whole table is rendered
+ * again only if the largest peak and thus the scale changed.
+ */
+static void update_table(struct graph *g, struct graph_table *tbl,
+			 struct history *h, struct history_store *data,
+			 unsigned long nnew)
+{
+	struct graph_cfg *cfg = &g->g_cfg;
+	int i, width = cfg->gc_width;
+	uint64_t max = 0;
 
 	/* leave table blank if there is no data */
-	if (!h || !data->hs_data)
+	if (!h || !data->hs_data) {
+		if (tbl->gt_valid)
+			clear_table(cfg, tbl);
+		tbl->gt_valid = 0;
 		return;
+	}
 
-	if (cfg->gc_width > h->h_definition->hd_size)
-		BUG();
+	if (cfg->gc_zoom || cfg->gc_pan) {
+		if (tbl->gt_valid && !nnew)
+			return;
+
+		history_decimate(h, data, cfg->gc_pan, 1UL << cfg->gc_zoom,
+				 width, tbl->gt_mean, NULL, tbl->gt_peak);
+		nnew = width;
+	} else if (!tbl->gt_valid || nnew >= width) {
+		history_copy(h, data, HISTORY_MEAN, tbl->gt_mean, width);
+		history_copy(h, data, HISTORY_MAX, tbl->gt_peak, width);
+		nnew = width;
+	} else if (nnew) {
+		/* column 0 holds the newest sample */
+		memmove(tbl->gt_mean + nnew, tbl->gt_mean,
+			(width - nnew) * sizeof(uint64_t));
+		memmove(tbl->gt_peak + nnew, tbl->gt_peak,
+			(width - nnew) * sizeof(uint64_t));
+
+		history_copy(h, data, HISTORY_MEAN, tbl->gt_mean, nnew);
+		history_copy(h, data, HISTORY_MAX, tbl->gt_peak, nnew);
+	} else
+		return;
 
 	/* find the largest peak */
-	for (n = h->h_index, i = 0; i < cfg->gc_width; i++) {
-		if (--n < 0)
-			n = h->h_definition->hd_size - 1;
-		v = history_data(h, data, n);
-		if (v != HISTORY_UNKNOWN && max < v)
-			max = v;
+	for (i = 0; i < width; i++)
+		if (tbl->gt_peak[i] != HISTORY_UNKNOWN && max < tbl->gt_peak[i])
+			max = tbl->gt_peak[i];
+
+	if (!tbl->gt_valid || nnew == width || max != tbl->gt_max) {
+		tbl->gt_max = max;
+		tbl->gt_valid = 1;
+		render_table(cfg, tbl);
+		return;
 	}
 
-	step = (double) max / (double) cfg->gc_height;
-	half_step = step / 2.0f;
+	for (i = 0; i < cfg->gc_height; i++) {
+		char *row = at_row(cfg, tbl->gt_table, i);
 
-	for (i = 0; i < cfg->gc_height; i++)
-		tbl->gt_scale[i] = (double) (i + 1) * step;
+		memmove(row + nnew, row, width - nnew);
+	}
 
-	for (n = h->h_index, i = 0; i < cfg->gc_width; i++) {
-		char * col = at_col(tbl->gt_table, i);
+	for (i = 0; i < nnew; i++)
+		render_column(cfg, tbl, i);
+}
 
-		if (--n < 0)
-			n = h->h_definition->hd_size - 1;
-		v = history_data(h, data, n);
+static void alloc_table(struct graph_cfg *cfg, struct graph_table *tbl)
+{
+	tbl->gt_table = xcalloc(table_size(cfg), sizeof(char));
+	tbl->gt_scale = xcalloc(cfg->gc_height, sizeof(double));
+	tbl->gt_mean = xcalloc(cfg->gc_width, sizeof(uint64_t));
+	tbl->gt_peak = xcalloc(cfg->gc_width, sizeof(uint64_t));
 
-		if (v == HISTORY_UNKNOWN) {
-			for (t = 0; t < cfg->gc_height; t++)
-				*(at_row(cfg, col, t)) = cfg->gc_unknown;
-		} else if (v > 0) {
-			*(at_row(cfg, col, 0)) = cfg->gc_noise;
+	clear_table(cfg, tbl);
+}
 
-			for (t = 0; t < cfg->gc_height; t++)
-				if (v >= (tbl->gt_scale[t] - half_step))
-					*(at_row(cfg, col, t)) = cfg->gc_foreground;
-		}
-	}
+static void free_table(struct graph_table *tbl)
+{
+	xfree(tbl->gt_table);
+	xfree(tbl->gt_scale);
+	xfree(tbl->gt_mean);
+	xfree(tbl->gt_peak);
+}
 
-	n = (cfg->gc_height / 3) * 2;
-	if (n >= cfg->gc_height)
-		n = (cfg->gc_height - 1);
+/*
+ * Limit graph width to the size of the history and do not zoom out or
+ * pan further than the history reaches back.
+ */
+static void fit_cfg(struct graph_cfg *cfg, struct history *h)
+{
+	unsigned long size, span;
 
-	v = unit_divisor(tbl->gt_scale[n], cfg->gc_unit,
-			 &tbl->gt_y_unit, NULL);
-	
-	for (i = 0; i < cfg->gc_height; i++)
-		tbl->gt_scale[i] /= v;
+	if (cfg->gc_zoom < 0)
+		cfg->gc_zoom = 0;
+
+	if (!h)
+		return;
+
+	size = h->h_definition->hd_size;
+
+	if (cfg->gc_width > size || !cfg->gc_width)
+		cfg->gc_width = size;
+
+	while (cfg->gc_zoom > 0 &&
+	       ((unsigned long) cfg->gc_width << (cfg->gc_zoom - 1)) >= size)
+		cfg->gc_zoom--;
+
+	span = (unsigned long) cfg->gc_width << cfg->gc_zoom;
+
+	if (cfg->gc_pan + span > size)
+		cfg->gc_pan = size > span ? size - span : 0;
+}
+
+static int cfg_equal(struct graph_cfg *a, struct graph_cfg *b)
+{
+	return a->gc_height == b->gc_height &&
+	       a->gc_width == b->gc_width &&
+	       a->gc_flags == b->gc_flags &&
+	       a->gc_zoom == b->gc_zoom &&
+	       a->gc_pan == b->gc_pan &&
+	       a->gc_background == b->gc_background &&
+	       a->gc_foreground == b->gc_foreground &&
+	       a->gc_noise == b->gc_noise &&
+	       a->gc_peak == b->gc_peak &&
+	       a->gc_unknown == b->gc_unknown &&
+	       a->gc_unit == b->gc_unit;
 }
 
 struct graph *graph_alloc(struct history *h, struct graph_cfg *cfg)
@@ -140,21 +261,63 @@ struct graph *graph_alloc(struct history *h, struct graph_cfg *cfg)
 	g = xcalloc(1, sizeof(*g));
 
 	memcpy(&g->g_cfg, cfg, sizeof(*cfg));
-
-	if (h != NULL &&
-	    (cfg->gc_width > h->h_definition->hd_size || !cfg->gc_width))
-		g->g_cfg.gc_width = h->h_definition->hd_size;
+	fit_cfg(&g->g_cfg, h);
 
 	if (!g->g_cfg.gc_width)
 		BUG();
 
+	alloc_table(&g->g_cfg, &g->g_rx);
+	alloc_table(&g->g_cfg, &g->g_tx);
+
 	return g;
 }
 
 void graph_refill(struct graph *g, struct history *h)
 {
-	fill_table(g, &g->g_rx, h, h ? &h->h_rx : NULL);
-	fill_table(g, &g->g_tx, h, h ? &h->h_tx : NULL);
+	g->g_rx.gt_valid = g->g_tx.gt_valid = 0;
+
+	if (h)
+		g->g_seq = h->h_seq;
+
+	update_table(g, &g->g_rx, h, h ? &h->h_rx : NULL, 0);
+	update_table(g, &g->g_tx, h, h ? &h->h_tx : NULL, 0);
+}
+
+/**
+ * Get up to date graph of history
+ * @h		History
+ * @cfg		Graph configuration
+ *
+ * The graph is cached with the history and updated incrementally with
+ * the samples added since the last call. It is owned by the history and
+ * must not be freed by the caller.
+ */
+struct graph *graph_get(struct history *h, struct graph_cfg *cfg)
+{
+	struct graph *g = h->h_graph;
+	struct graph_cfg want = *cfg;
+	unsigned long nnew;
+
+	fit_cfg(&want, h);
+
+	if (g && !cfg_equal(&g->g_cfg, &want)) {
+		graph_free(g);
+		g = NULL;
+	}
+
+	if (!g) {
+		g = h->h_graph = graph_alloc(h, cfg);
+		graph_refill(g, h);
+		return g;
+	}
+
+	nnew = h->h_seq - g->g_seq;
+	g->g_seq = h->h_seq;
+
+	update_table(g, &g->g_rx, h, &h->h_rx, nnew);
+	update_table(g, &g->g_tx, h, &h->h_tx, nnew);
+
+	return g;
 }
 
 void graph_free(struct graph *g)
@@ -162,10 +325,8 @@ void graph_free(struct graph *g)
 	if (!g)
 		return;
 
-	xfree(g->g_rx.gt_table);
-	xfree(g->g_rx.gt_scale);
-	xfree(g->g_tx.gt_table);
-	xfree(g->g_tx.gt_scale);
+	free_table(&g->g_rx);
+	free_table(&g->g_tx);
 	xfree(g);
 }
 
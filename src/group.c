@@ -26,12 +26,13 @@
 #include <bmon/bmon.h>
 #include <bmon/element.h>
 #include <bmon/group.h>
+#include <bmon/context.h>
+#include <bmon/scheduler.h>
 #include <bmon/utils.h>
 
 static LIST_HEAD(titles_list);
-static LIST_HEAD(group_list);
-static unsigned int ngroups;
-static struct element_group *current_group;
+
+__thread unsigned int group_tree_gen;
 
 static void __group_foreach_element(struct element_group *g,
 				    struct list_head *list,
@@ -63,7 +64,7 @@ void group_foreach_recursive(void (*cb)(struct element_group *,
 {
 	struct element_group *g, *n;
 
-	list_for_each_entry_safe(g, n, &group_list, g_list)
+	list_for_each_entry_safe(g, n, &bmon_ctx->c_groups, g_list)
 		__group_foreach_element(g, &g->g_elements, cb, arg);
 }
 
@@ -71,68 +72,75 @@ void group_foreach(void (*cb)(struct element_group *, void *), void *arg)
 {
 	struct element_group *g, *n;
 
-	list_for_each_entry_safe(g, n, &group_list, g_list)
+	list_for_each_entry_safe(g, n, &bmon_ctx->c_groups, g_list)
 		cb(g, arg);
 }
 
 struct element_group *group_select_first(void)
 {
-	if (list_empty(&group_list))
-		current_group = NULL;
+	struct bmon_ctx *ctx = bmon_ctx;
+
+	if (list_empty(&ctx->c_groups))
+		ctx->c_current_group = NULL;
 	else
-		current_group = list_first_entry(&group_list,
-						 struct element_group, g_list);
+		ctx->c_current_group = list_first_entry(&ctx->c_groups,
+						struct element_group, g_list);
 
-	return current_group;
+	return ctx->c_current_group;
 }
 
 struct element_group *group_select_last(void)
 {
-	if (list_empty(&group_list))
-		current_group = NULL;
+	struct bmon_ctx *ctx = bmon_ctx;
+
+	if (list_empty(&ctx->c_groups))
+		ctx->c_current_group = NULL;
 	else
-		current_group = list_entry(group_list.prev,
-					   struct element_group, g_list);
+		ctx->c_current_group = list_entry(ctx->c_groups.prev,
+						  struct element_group, g_list);
 
-	return current_group;
+	return ctx->c_current_group;
 }
 
 struct element_group *group_select_next(void)
 {
-	if (!current_group)
-		return group_select_first();
+	struct bmon_ctx *ctx = bmon_ctx;
+	struct element_group *g = ctx->c_current_group;
 
-	if (current_group->g_list.next != &group_list)
-		current_group = list_entry(current_group->g_list.next,
-					   struct element_group,
-					   g_list);
-	else
+	if (!g || g->g_list.next == &ctx->c_groups)
 		return group_select_first();
 
-	return current_group;
+	ctx->c_current_group = list_entry(g->g_list.next,
+					  struct element_group, g_list);
+
+	return ctx->c_current_group;
 }
 
 struct element_group *group_select_prev(void)
 {
-	if (!current_group)
-		return group_select_last();
+	struct bmon_ctx *ctx = bmon_ctx;
+	struct element_group *g = ctx->c_current_group;
 
-	if (current_group->g_list.prev != &group_list)
-		current_group = list_entry(current_group->g_list.prev,
-					   struct element_group,
-					   g_list);
-	else
+	if (!g || g->g_list.prev == &ctx->c_groups)
 		return group_select_last();
 
-	return current_group;
+	ctx->c_current_group = list_entry(g->g_list.prev,
+					  struct element_group, g_list);
+
+	return ctx->c_current_group;
+}
+
+void group_select(struct element_group *g)
+{
+	bmon_ctx->c_current_group = g;
 }
 
 struct element_group *group_current(void)
 {
-	if (current_group == NULL)
-		current_group = group_select_first();
+	if (bmon_ctx->c_current_group == NULL)
+		bmon_ctx->c_current_group = group_select_first();
 
-	return current_group;
+	return bmon_ctx->c_current_group;
 }
 
 struct element_group *group_lookup(const char *name, int flags)
@@ -140,7 +148,7 @@ struct element_group *group_lookup(const char *name, int flags)
 	struct element_group *g;
 	struct group_hdr *hdr;
 
-	list_for_each_entry(g, &group_list, g_list)
+	list_for_each_entry(g, &bmon_ctx->c_groups, g_list)
 		if (!strcmp(name, g->g_name))
 			return g;
 
@@ -158,9 +166,11 @@ struct element_group *group_lookup(const char *name, int flags)
 
 	g->g_name = hdr->gh_name;
 	g->g_hdr = hdr;
+	g->g_sched = sched_lookup(SCHED_GROUP, name);
 
-	list_add_tail(&g->g_list, &group_list);
-	ngroups++;
+	list_add_tail(&g->g_list, &bmon_ctx->c_groups);
+	bmon_ctx->c_ngroups++;
+	group_tree_gen++;
 
 	return g;
 }
@@ -170,15 +180,20 @@ static void group_free(struct element_group *g)
 	struct element *e, *n;
 	struct element_group *next;
 
-	if (current_group == g) {
+	if (bmon_ctx->c_current_group == g) {
 		next = group_select_next();
 		if (!next || next == g)
-			current_group = NULL;
+			bmon_ctx->c_current_group = NULL;
 	}
 
 	list_for_each_entry_safe(e, n, &g->g_elements, e_list)
 		element_free(e);
 
+	list_del(&g->g_list);
+	bmon_ctx->c_ngroups--;
+	group_tree_gen++;
+
+	xfree(g->g_hash);
 	xfree(g);
 }
 
@@ -187,9 +202,13 @@ void reset_update_flags(void)
 	group_foreach_recursive(&element_reset_update_flag, NULL);
 }
 
-void free_unused_elements(void)
+/**
+ * Expire elements which have not been updated
+ * @cycles	Number of lifecycles passed since the previous call
+ */
+void free_unused_elements(unsigned int cycles)
 {
-	group_foreach_recursive(&element_check_if_dead, NULL);
+	group_foreach_recursive(&element_check_if_dead, &cycles);
 }
 
 struct group_hdr *group_lookup_hdr(const char *name)
@@ -265,13 +284,20 @@ static void __init group_init(void)
 		      "RX bps", "pps", "TX bps", "pps");
 }
 
-static void __exit group_exit(void)
+/* Frees all groups of the current context along with their elements */
+void group_free_all(void)
 {
 	struct element_group *g, *next;
-	struct group_hdr *hdr, *gnext;
 
-	list_for_each_entry_safe(g, next, &group_list, g_list)
+	list_for_each_entry_safe(g, next, &bmon_ctx->c_groups, g_list)
 		group_free(g);
+}
+
+static void __exit group_exit(void)
+{
+	struct group_hdr *hdr, *gnext;
+
+	group_free_all();
 
 	list_for_each_entry_safe(hdr, gnext, &titles_list, gh_list)
 		group_hdr_free(hdr);
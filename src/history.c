@@ -25,13 +25,23 @@
 
 #include <bmon/bmon.h>
 #include <bmon/conf.h>
+#include <bmon/element.h>
+#include <bmon/graph.h>
+#include <bmon/group.h>
 #include <bmon/history.h>
+#include <bmon/pool.h>
 #include <bmon/utils.h>
 
 static LIST_HEAD(def_list);
 
+static DEFINE_POOL(history_pool, "history", struct history);
+
 static struct history_def *current_history;
 
+/* memory accounting */
+static struct history_stats stats;
+static unsigned long generation;
+
 struct history_def *history_def_lookup(const char *name)
 {
 	struct history_def *def;
@@ -52,6 +62,7 @@ struct history_def *history_def_alloc(const char *name)
 
 	def = xcalloc(1, sizeof(*def));
 	def->hd_name = strdup(name);
+	def->hd_refcnt = 1;
 
 	list_add_tail(&def->hd_list, &def_list);
 
@@ -60,6 +71,41 @@ struct history_def *history_def_alloc(const char *name)
 	return def;
 }
 
+/*
+ * A history whose interval is a multiple of the interval of a finer
+ * history is derived from it instead of being sampled on its own. The
+ * coarsest such source is picked so second -> minute -> hour -> day
+ * forms a chain. Sources which would discard the samples of an
+ * attribute read as rarely as @interval are not considered, so the
+ * chain may differ between attributes on different schedules.
+ */
+static struct history_def *find_source(struct history_def *def,
+				       float interval, int *ratio)
+{
+	struct history_def *src, *best = NULL;
+	float r;
+	int n;
+
+	list_for_each_entry(src, &def_list, hd_list) {
+		if (src->hd_interval >= def->hd_interval ||
+		    src->hd_interval / cfg_history_variance < interval ||
+		    src->hd_interval <= 0.0f)
+			continue;
+
+		r = def->hd_interval / src->hd_interval;
+		n = (int) (r + 0.5f);
+		if (n < 2 || r - n > 0.01f || n - r > 0.01f)
+			continue;
+
+		if (!best || src->hd_interval > best->hd_interval) {
+			best = src;
+			*ratio = n;
+		}
+	}
+
+	return best;
+}
+
 static void history_def_free(struct history_def *def)
 {
 	if (!def)
@@ -69,143 +115,568 @@ static void history_def_free(struct history_def *def)
 	xfree(def);
 }
 
-static void *history_alloc_data(struct history_def *def)
+/*
+ * Histories may outlive the definition list on exit, the definition
+ * is needed to release their rings.
+ */
+static void history_def_put(struct history_def *def)
 {
-	return xcalloc(def->hd_size, def->hd_type);
+	if (--def->hd_refcnt == 0)
+		history_def_free(def);
 }
 
-static void history_store_data(struct history *h, struct history_store *hs,
-			       uint64_t total, float diff)
+/*
+ * History rings are stored as block floating point: every sample is an
+ * unsigned mantissa of hd_type bytes and every block of
+ * HISTORY_BLOCK_SIZE samples shares a binary exponent. A rate which
+ * does not fit the mantissa raises the exponent of its block instead of
+ * being truncated. The all-ones mantissa marks unknown samples.
+ *
+ * 64bit histories store raw values and carry no exponents.
+ */
+
+static inline int history_nblocks(struct history_def *def)
 {
-	uint64_t delta;
+	if (def->hd_type == HISTORY_TYPE_64)
+		return 0;
 
-	if (!hs->hs_data) {
-		if (total == HISTORY_UNKNOWN)
-			return;
+	return (def->hd_size + HISTORY_BLOCK_SIZE - 1) / HISTORY_BLOCK_SIZE;
+}
 
-		hs->hs_data = history_alloc_data(h->h_definition);
-	}
+size_t history_data_size(struct history_def *def)
+{
+	return (def->hd_size * def->hd_type) + history_nblocks(def);
+}
+
+static void *history_alloc_data(struct history_def *def)
+{
+	return pool_alloc_size(history_data_size(def));
+}
 
-	if (total == HISTORY_UNKNOWN)
-		delta = HISTORY_UNKNOWN;
-	else {
-		delta = (total - hs->hs_prev_total);
+static void history_free_data(struct history_def *def, void *data)
+{
+	pool_free_size(data, history_data_size(def));
+}
+
+static inline uint8_t *history_exp(struct history_def *def, void *data,
+				   int index)
+{
+	return (uint8_t *) data + (def->hd_size * def->hd_type) +
+		(index / HISTORY_BLOCK_SIZE);
+}
 
-		if (delta > 0)
-			delta /= diff;
-		hs->hs_prev_total = total;
+/* All-ones mantissa, reserved for unknown samples */
+static inline uint64_t mant_unknown(int type)
+{
+	return type == HISTORY_TYPE_64 ? HISTORY_UNKNOWN :
+		(1ULL << (type * 8)) - 1;
+}
+
+static uint64_t get_mant(int type, void *data, int index)
+{
+	switch (type) {
+	case HISTORY_TYPE_8:
+		return ((uint8_t *) data)[index];
+	case HISTORY_TYPE_16:
+		return ((uint16_t *) data)[index];
+	case HISTORY_TYPE_32:
+		return ((uint32_t *) data)[index];
+	case HISTORY_TYPE_64:
+		return ((uint64_t *) data)[index];
+	default:
+		BUG();
 	}
+}
 
-	switch (h->h_definition->hd_type) {
+static void set_mant(int type, void *data, int index, uint64_t m)
+{
+	switch (type) {
 	case HISTORY_TYPE_8:
-		((uint8_t *) hs->hs_data)[h->h_index] = (uint8_t) delta;
+		((uint8_t *) data)[index] = m;
 		break;
-	
 	case HISTORY_TYPE_16:
-		((uint16_t *) hs->hs_data)[h->h_index] = (uint16_t) delta;
+		((uint16_t *) data)[index] = m;
 		break;
-
 	case HISTORY_TYPE_32:
-		((uint32_t *) hs->hs_data)[h->h_index] = (uint32_t) delta;
+		((uint32_t *) data)[index] = m;
 		break;
-
 	case HISTORY_TYPE_64:
-		((uint64_t *) hs->hs_data)[h->h_index] = (uint64_t) delta;
+		((uint64_t *) data)[index] = m;
 		break;
-
 	default:
 		BUG();
 	}
 }
 
+static inline uint64_t decode(uint64_t m, uint64_t unknown, int exp)
+{
+	return m == unknown ? HISTORY_UNKNOWN : m << exp;
+}
+
+/* Round to nearest, returns a mantissa > max if v does not fit */
+static inline uint64_t encode(uint64_t v, int exp)
+{
+	if (!exp)
+		return v;
+
+	return (v >> exp) + ((v >> (exp - 1)) & 1);
+}
+
+static int min_exp(uint64_t v, uint64_t max)
+{
+	int exp = 0;
+
+	while (encode(v, exp) > max)
+		exp++;
+
+	return exp;
+}
+
+/* Re-encode all known samples of a block with a new exponent */
+static void rescale_block(struct history_def *def, void *data, int block,
+			  int old_exp, int new_exp)
+{
+	uint64_t unknown = mant_unknown(def->hd_type);
+	int i, first = block * HISTORY_BLOCK_SIZE;
+
+	for (i = first; i < first + HISTORY_BLOCK_SIZE && i < def->hd_size; i++) {
+		uint64_t m = get_mant(def->hd_type, data, i);
+
+		if (m != unknown)
+			set_mant(def->hd_type, data, i,
+				 encode(m << old_exp, new_exp));
+	}
+}
+
+static void history_put(struct history_def *def, void *data, int index,
+			uint64_t v)
+{
+	uint64_t unknown = mant_unknown(def->hd_type);
+	int block = index / HISTORY_BLOCK_SIZE;
+	uint8_t *exp;
+	int i, need;
+
+	if (def->hd_type == HISTORY_TYPE_64) {
+		set_mant(def->hd_type, data, index, v);
+		return;
+	}
+
+	exp = history_exp(def, data, index);
+
+	if (v == HISTORY_UNKNOWN) {
+		set_mant(def->hd_type, data, index, unknown);
+		return;
+	}
+
+	/*
+	 * Entering a block: the samples left in it are from the previous
+	 * round of the ring. Lower the exponent again if they allow for
+	 * it so a burst does not cost precision forever.
+	 */
+	if (!(index % HISTORY_BLOCK_SIZE) && *exp) {
+		uint64_t max = 0;
+
+		for (i = index + 1; i < index + HISTORY_BLOCK_SIZE &&
+				    i < def->hd_size; i++) {
+			uint64_t m = get_mant(def->hd_type, data, i);
+
+			if (m != unknown && m > max)
+				max = m;
+		}
+
+		need = min_exp(max << *exp, unknown - 1);
+		if (need < *exp) {
+			rescale_block(def, data, block, *exp, need);
+			*exp = need;
+		}
+	}
+
+	need = min_exp(v, unknown - 1);
+	if (need > *exp) {
+		rescale_block(def, data, block, *exp, need);
+		*exp = need;
+	}
+
+	set_mant(def->hd_type, data, index, encode(v, *exp));
+}
+
+static inline int store_nseries(struct history_store *hs)
+{
+	return !!hs->hs_data + !!hs->hs_min + !!hs->hs_max;
+}
+
+static void history_store_alloc(struct history *h, struct history_store *hs)
+{
+	struct history_def *def = h->h_definition;
+
+	/* accounted when mapped, see map_store() */
+	if (h->h_file) {
+		history_file_store(h, hs);
+		return;
+	}
+
+	hs->hs_data = history_alloc_data(def);
+
+	if (h->h_source) {
+		hs->hs_min = history_alloc_data(def);
+		hs->hs_max = history_alloc_data(def);
+	}
+
+	stats.hst_used += store_nseries(hs) * history_data_size(def);
+}
+
+static void history_store_free(struct history *h, struct history_store *hs)
+{
+	stats.hst_used -= store_nseries(hs) * history_data_size(h->h_definition);
+
+	/* owned by the history file */
+	if (h->h_file)
+		return;
+
+	history_free_data(h->h_definition, hs->hs_data);
+	history_free_data(h->h_definition, hs->hs_min);
+	history_free_data(h->h_definition, hs->hs_max);
+}
+
+static uint64_t history_get(struct history_def *def, void *data, int index)
+{
+	uint64_t m = get_mant(def->hd_type, data, index);
+
+	if (def->hd_type == HISTORY_TYPE_64)
+		return m;
+
+	return decode(m, mant_unknown(def->hd_type),
+		      *history_exp(def, data, index));
+}
+
+/* Average rate since the previous sample */
+static uint64_t history_rate(struct history_store *hs, uint64_t total,
+			     float diff)
+{
+	uint64_t delta = (total - hs->hs_prev_total);
+
+	if (delta > 0)
+		delta /= diff;
+	hs->hs_prev_total = total;
+
+	return delta;
+}
+
+static void history_store_data(struct history *h, struct history_store *hs,
+			       uint64_t value)
+{
+	if (!hs->hs_data) {
+		if (value == HISTORY_UNKNOWN)
+			return;
+
+		history_store_alloc(h, hs);
+	}
+
+	history_put(h->h_definition, hs->hs_data, h->h_index, value);
+}
+
 static inline void inc_history_index(struct history *h)
 {
 	if (h->h_index < (h->h_definition->hd_size - 1))
 		h->h_index++;
 	else
 		h->h_index = 0;
+
+	h->h_seq++;
+
+	if (h->h_file)
+		history_file_sync(h);
+}
+
+static void store_unknown(struct history *h, struct history_store *hs)
+{
+	struct history_def *def = h->h_definition;
+
+	if (hs->hs_data)
+		history_put(def, hs->hs_data, h->h_index, HISTORY_UNKNOWN);
+	if (hs->hs_min)
+		history_put(def, hs->hs_min, h->h_index, HISTORY_UNKNOWN);
+	if (hs->hs_max)
+		history_put(def, hs->hs_max, h->h_index, HISTORY_UNKNOWN);
+}
+
+/**
+ * Advance history without data
+ * @h		History
+ * @n		Number of samples to skip
+ *
+ * Marks the next n samples as unknown, e.g. to cover the time bmon was
+ * not running when resuming a history file.
+ */
+void history_skip(struct history *h, unsigned long n)
+{
+	int size = h->h_definition->hd_size;
+	unsigned long i;
+
+	for (i = 0; i < n && i < (unsigned long) size; i++) {
+		store_unknown(h, &h->h_rx);
+		store_unknown(h, &h->h_tx);
+		h->h_index = (h->h_index + 1) % size;
+	}
+
+	h->h_index = (h->h_index + ((n - i) % size)) % size;
+	h->h_seq += n;
+
+	h->h_nrolled = 0;
+	h->h_rx.hs_nknown = 0;
+	h->h_tx.hs_nknown = 0;
 }
 
 uint64_t history_data(struct history *h, struct history_store *hs, int index)
 {
-	switch (h->h_definition->hd_type) {
-	case HISTORY_TYPE_8: {
-		uint8_t v = ((uint8_t *) hs->hs_data)[index];
-		return (v == (uint8_t) -1) ? HISTORY_UNKNOWN : v;
+	return history_get(h->h_definition, hs->hs_data, index);
+}
+
+/*
+ * Rolled up histories keep the minimum, maximum and mean of every
+ * bucket. Plain histories hold a single sample per slot which serves
+ * as all three.
+ */
+static void *history_series(struct history_store *hs, int series)
+{
+	switch (series) {
+	case HISTORY_MIN:
+		return hs->hs_min ? : hs->hs_data;
+	case HISTORY_MAX:
+		return hs->hs_max ? : hs->hs_data;
+	default:
+		return hs->hs_data;
 	}
-	
-	case HISTORY_TYPE_16: {
-		uint16_t v = ((uint16_t *) hs->hs_data)[index];
-		return (v == (uint16_t) -1) ? HISTORY_UNKNOWN : v;
+}
+
+uint64_t history_sample(struct history *h, struct history_store *hs,
+			int series, int index)
+{
+	return history_get(h->h_definition, history_series(hs, series), index);
+}
+
+/**
+ * Decode the most recent samples of a history
+ * @h		History
+ * @hs		RX or TX store of history
+ * @series	HISTORY_MEAN, HISTORY_MIN or HISTORY_MAX
+ * @dst		Destination buffer
+ * @n		Number of samples to decode
+ *
+ * Stores the n most recent samples in dst, newest first. Returns the
+ * number of samples decoded which is limited by the history size and
+ * is 0 if no data has been collected yet.
+ */
+int history_copy(struct history *h, struct history_store *hs, int series,
+		 uint64_t *dst, int n)
+{
+	struct history_def *def = h->h_definition;
+	uint64_t unknown = mant_unknown(def->hd_type);
+	void *data = history_series(hs, series);
+	int i, idx, exp = 0;
+
+	if (!data)
+		return 0;
+
+	if (n > def->hd_size)
+		n = def->hd_size;
+
+	for (i = 0, idx = h->h_index; i < n; i++) {
+		if (--idx < 0)
+			idx = def->hd_size - 1;
+
+		if (def->hd_type == HISTORY_TYPE_64) {
+			dst[i] = get_mant(def->hd_type, data, idx);
+			continue;
+		}
+
+		/* Exponent only changes at block boundaries */
+		if (i == 0 || (idx % HISTORY_BLOCK_SIZE) == HISTORY_BLOCK_SIZE - 1
+		    || idx == def->hd_size - 1)
+			exp = *history_exp(def, data, idx);
+
+		dst[i] = decode(get_mant(def->hd_type, data, idx),
+				unknown, exp);
+	}
+
+	return n;
+}
+
+static void history_last(struct history *h, struct history_store *hs,
+			 uint64_t *min, uint64_t *max, uint64_t *mean)
+{
+	struct history_def *def = h->h_definition;
+	int idx = (h->h_index ? h->h_index : def->hd_size) - 1;
+
+	if (!hs->hs_data) {
+		*min = *max = *mean = HISTORY_UNKNOWN;
+		return;
+	}
+
+	*mean = history_get(def, hs->hs_data, idx);
+	*min = history_get(def, history_series(hs, HISTORY_MIN), idx);
+	*max = history_get(def, history_series(hs, HISTORY_MAX), idx);
+}
+
+static void rollup_feed(struct history_store *hs, struct history *src,
+			struct history_store *src_hs)
+{
+	uint64_t min, max, mean;
+
+	history_last(src, src_hs, &min, &max, &mean);
+
+	if (mean == HISTORY_UNKNOWN)
+		return;
+
+	if (!hs->hs_nknown++) {
+		hs->hs_bucket_min = min;
+		hs->hs_bucket_max = max;
+		hs->hs_bucket_sum = 0;
+	} else {
+		if (min < hs->hs_bucket_min)
+			hs->hs_bucket_min = min;
+		if (max > hs->hs_bucket_max)
+			hs->hs_bucket_max = max;
 	}
- 
-	case HISTORY_TYPE_32: {
-		uint32_t v = ((uint32_t *) hs->hs_data)[index];
-		return (v == (uint32_t) -1) ? HISTORY_UNKNOWN : v;
+
+	hs->hs_bucket_sum += mean;
+}
+
+static void rollup_flush(struct history *h, struct history_store *hs)
+{
+	struct history_def *def = h->h_definition;
+	uint64_t min = HISTORY_UNKNOWN, max = HISTORY_UNKNOWN,
+		 mean = HISTORY_UNKNOWN;
+
+	if (hs->hs_nknown) {
+		min = hs->hs_bucket_min;
+		max = hs->hs_bucket_max;
+		mean = hs->hs_bucket_sum / hs->hs_nknown;
 	}
 
-	case HISTORY_TYPE_64: {
-		uint64_t v = ((uint64_t *) hs->hs_data)[index];
-		return (v == (uint64_t) -1) ? HISTORY_UNKNOWN : v;
+	hs->hs_nknown = 0;
+
+	if (!hs->hs_data) {
+		if (mean == HISTORY_UNKNOWN)
+			return;
+
+		history_store_alloc(h, hs);
 	}
 
-	default:
-		BUG();
+	history_put(def, hs->hs_data, h->h_index, mean);
+	history_put(def, hs->hs_min, h->h_index, min);
+	history_put(def, hs->hs_max, h->h_index, max);
+}
+
+/*
+ * Feed the sample just stored in src into all histories rolled up from
+ * it. A rolled up history stores a bucket every h_ratio samples of its
+ * source and passes it on to the next coarser history in turn.
+ */
+static void history_push(struct attr *a, struct history *src,
+			 timestamp_t *ts)
+{
+	struct history *h;
+
+	list_for_each_entry(h, &a->a_history_list, h_list) {
+		if (h->h_source != src->h_definition)
+			continue;
+
+		rollup_feed(&h->h_rx, src, &src->h_rx);
+		rollup_feed(&h->h_tx, src, &src->h_tx);
+
+		if (++h->h_nrolled < h->h_ratio)
+			continue;
+
+		rollup_flush(h, &h->h_rx);
+		rollup_flush(h, &h->h_tx);
+		inc_history_index(h);
+		h->h_nrolled = 0;
+		copy_timestamp(&h->h_last_update, ts);
+
+		history_push(a, h, ts);
 	}
 }
 
 void history_update(struct attr *a, struct history *h, timestamp_t *ts)
 {
 	struct history_def *def = h->h_definition;
-	float timediff;
+	uint64_t rx, tx;
+	float timediff, spacing = 0.0f;
+	int n;
+
+	/* updated by history_push() of its source */
+	if (h->h_source)
+		return;
 
-	if (h->h_last_update.tv_sec)
+	/* time since the previous read of the attribute */
+	if (h->h_last_read.tv_sec)
+		spacing = timestamp_diff(&h->h_last_read, ts);
+	copy_timestamp(&h->h_last_read, ts);
+
+	if (h->h_last_update.tv_sec) {
 		timediff = timestamp_diff(&h->h_last_update, ts);
-	else {
-		timediff = 0.0f; /* initial history update */
 
+		/*
+		 * A gap this long, e.g. because the system was suspended,
+		 * can't be accounted to any sample. Mark history data as
+		 * invalid.
+		 */
+		if (timediff > h->h_max_interval)
+			goto discard;
+
+		/*
+		 * The interval between reads may change at any time, see
+		 * adaptive schedules. Wait for the next read if it is
+		 * expected to come closer to the history interval than
+		 * this one.
+		 */
+		if (timediff < def->hd_interval - (spacing / 2.0f))
+			return;
+
+		/*
+		 * A read spanning several samples, e.g. while an adaptive
+		 * schedule samples slowly, stores the average rate in all
+		 * of them so the time axis of the history stays intact.
+		 */
+		n = (int) ((timediff / def->hd_interval) + 0.5f);
+		if (n < 1)
+			n = 1;
+	} else {
 		/* Need a delta when working with counters */
 		if (a->a_def->ad_type == ATTR_TYPE_COUNTER)
 			goto update_prev_total;
-	}
-
-	/*
-	 * A read interval greater than the desired history interval
-	 * can't possibly result in anything useful. Discard it and
-	 * mark history data as invalid. The user has to adjust the
-	 * read interval.
-	 */
-	if (cfg_read_interval > def->hd_interval)
-		goto discard;
 
-	/*
-	 * If the history interval matches the read interval it makes
-	 * sense to update upon every read. The reader timing already
-	 * took care of being as close as possible to the desired
-	 * interval.
-	 */
-	if (cfg_read_interval == def->hd_interval)
-		goto update;
-
-	if (timediff > h->h_max_interval)
-		goto discard;
+		/* initial history update, store the value as read */
+		timediff = 0.0f;
+		n = 1;
+	}
 
-	if (timediff < h->h_min_interval)
-		return;
+	if (a->a_def->ad_type == ATTR_TYPE_COUNTER) {
+		rx = history_rate(&h->h_rx, a->a_rx_rate.r_total, timediff);
+		tx = history_rate(&h->h_tx, a->a_tx_rate.r_total, timediff);
+	} else {
+		/* rates and gauges are stored as read */
+		rx = a->a_rx_rate.r_total;
+		tx = a->a_tx_rate.r_total;
+	}
 
-update:
-	history_store_data(h, &h->h_rx, a->a_rx_rate.r_total, timediff);
-	history_store_data(h, &h->h_tx, a->a_tx_rate.r_total, timediff);
-	inc_history_index(h);
+	while (n--) {
+		history_store_data(h, &h->h_rx, rx);
+		history_store_data(h, &h->h_tx, tx);
+		inc_history_index(h);
+		history_push(a, h, ts);
+	}
 
 	goto update_ts;
 
 discard:
 	while(timediff >= (def->hd_interval / 2)) {
-		history_store_data(h, &h->h_rx, HISTORY_UNKNOWN, 0.0f);
-		history_store_data(h, &h->h_tx, HISTORY_UNKNOWN, 0.0f);
+		history_store_data(h, &h->h_rx, HISTORY_UNKNOWN);
+		history_store_data(h, &h->h_tx, HISTORY_UNKNOWN);
 
 		inc_history_index(h);
+		history_push(a, h, ts);
 		timediff -= def->hd_interval;
 	}
 
@@ -217,18 +688,27 @@ update_ts:
 	copy_timestamp(&h->h_last_update, ts);
 }
 
-struct history *history_alloc(struct history_def *def)
+/**
+ * Allocate history
+ * @def		History definition
+ * @interval	Longest time between updates of the attribute
+ */
+struct history *history_alloc(struct history_def *def, float interval)
 {
 	struct history *h;
 
-	h  = xcalloc(1, sizeof(*h));
+	h = pool_alloc(&history_pool);
 
 	init_list_head(&h->h_list);
 
 	h->h_definition = def;
+	def->hd_refcnt++;
 
-	h->h_min_interval = (def->hd_interval - (cfg_read_interval / 2.0f));
 	h->h_max_interval = (def->hd_interval / cfg_history_variance);
+	h->h_source = find_source(def, interval, &h->h_ratio);
+
+	stats.hst_used += sizeof(*h);
+	stats.hst_count++;
 
 	return h;
 }
@@ -238,11 +718,151 @@ void history_free(struct history *h)
 	if (!h)
 		return;
 
-	xfree(h->h_rx.hs_data);
-	xfree(h->h_tx.hs_data);
+	history_store_free(h, &h->h_rx);
+	history_store_free(h, &h->h_tx);
+	history_lod_free(&h->h_rx);
+	history_lod_free(&h->h_tx);
+	graph_free(h->h_graph);
+
+	stats.hst_used -= sizeof(*h);
+	stats.hst_count--;
+
+	list_del(&h->h_list);
+
+	history_def_put(h->h_definition);
+	pool_free(&history_pool, h);
+}
+
+static void copy_block(struct history_def *def, void *dst, void *src,
+		       int block)
+{
+	int first = block * HISTORY_BLOCK_SIZE;
+	int n = def->hd_size - first;
+
+	if (n > HISTORY_BLOCK_SIZE)
+		n = HISTORY_BLOCK_SIZE;
+
+	memcpy((uint8_t *) dst + (first * def->hd_type),
+	       (uint8_t *) src + (first * def->hd_type), n * def->hd_type);
+
+	if (def->hd_type != HISTORY_TYPE_64)
+		*history_exp(def, dst, first) = *history_exp(def, src, first);
+}
+
+/*
+ * Only the blocks written since the previous copy are copied, storing
+ * a sample may rescale the whole block holding it.
+ */
+static void clone_series(struct history *dst, struct history *src,
+			 void **dstp, void *data, unsigned long nnew)
+{
+	struct history_def *def = src->h_definition;
+	int i, block, last = -1;
+
+	if (!data)
+		return;
+
+	if (!*dstp) {
+		*dstp = xcalloc(1, history_data_size(def));
+		nnew = def->hd_size;
+	}
+
+	if (nnew >= def->hd_size) {
+		memcpy(*dstp, data, history_data_size(def));
+		return;
+	}
+
+	for (i = 0; i <= nnew; i++) {
+		block = ((src->h_index - i + def->hd_size) % def->hd_size) /
+			HISTORY_BLOCK_SIZE;
+
+		if (block != last)
+			copy_block(def, *dstp, data, block);
+		last = block;
+	}
+}
+
+static void clone_store(struct history *dst, struct history_store *ds,
+			struct history *src, struct history_store *ss,
+			unsigned long nnew)
+{
+	clone_series(dst, src, &ds->hs_data, ss->hs_data, nnew);
+	clone_series(dst, src, &ds->hs_min, ss->hs_min, nnew);
+	clone_series(dst, src, &ds->hs_max, ss->hs_max, nnew);
+
+	ds->hs_prev_total = ss->hs_prev_total;
+	ds->hs_bucket_sum = ss->hs_bucket_sum;
+	ds->hs_bucket_min = ss->hs_bucket_min;
+	ds->hs_bucket_max = ss->hs_bucket_max;
+	ds->hs_nknown = ss->hs_nknown;
+}
+
+/**
+ * Bring copy of a history up to date
+ * @dst		Copy, NULL to allocate a new one
+ * @src		History
+ *
+ * Copies of histories are neither accounted to the history budget nor
+ * backed by history files. Only the samples stored since the previous
+ * call are copied. The graph and decimation caches of the copy are kept
+ * unless the history was restarted.
+ *
+ * Returns the copy.
+ */
+struct history *history_clone(struct history *dst, struct history *src)
+{
+	unsigned long nnew;
+
+	if (!dst) {
+		dst = xcalloc(1, sizeof(*dst));
+		init_list_head(&dst->h_list);
+		dst->h_flags = HISTORY_CLONE;
+		dst->h_definition = src->h_definition;
+		dst->h_definition->hd_refcnt++;
+	}
+
+	if (src->h_seq < dst->h_seq) {
+		history_lod_free(&dst->h_rx);
+		history_lod_free(&dst->h_tx);
+		graph_free(dst->h_graph);
+		dst->h_graph = NULL;
+		dst->h_seq = 0;
+		nnew = ULONG_MAX;
+	} else
+		nnew = src->h_seq - dst->h_seq;
+
+	clone_store(dst, &dst->h_rx, src, &src->h_rx, nnew);
+	clone_store(dst, &dst->h_tx, src, &src->h_tx, nnew);
+
+	dst->h_index = src->h_index;
+	dst->h_seq = src->h_seq;
+	dst->h_max_interval = src->h_max_interval;
+	dst->h_source = src->h_source;
+	dst->h_ratio = src->h_ratio;
+	dst->h_nrolled = src->h_nrolled;
+	copy_timestamp(&dst->h_last_update, &src->h_last_update);
+	copy_timestamp(&dst->h_last_read, &src->h_last_read);
+
+	return dst;
+}
+
+static void clone_store_free(struct history_store *hs)
+{
+	xfree(hs->hs_data);
+	xfree(hs->hs_min);
+	xfree(hs->hs_max);
+	history_lod_free(hs);
+}
+
+void history_clone_free(struct history *h)
+{
+	clone_store_free(&h->h_rx);
+	clone_store_free(&h->h_tx);
+	graph_free(h->h_graph);
 
 	list_del(&h->h_list);
 
+	history_def_put(h->h_definition);
 	xfree(h);
 }
 
@@ -252,9 +872,186 @@ void history_attach(struct attr *attr)
 	struct history *h;
 
 	list_for_each_entry(def, &def_list, hd_list) {
-		h = history_alloc(def);
+		h = history_alloc(def, attr->a_interval);
 		list_add_tail(&h->h_list, &attr->a_history_list);
 	}
+
+	history_file_open(attr);
+}
+
+void history_detach(struct attr *attr)
+{
+	struct history *h, *n;
+
+	list_for_each_entry_safe(h, n, &attr->a_history_list, h_list)
+		history_free(h);
+
+	history_file_close(attr);
+}
+
+/**
+ * Memory used by a history
+ * @h		History
+ *
+ * Returns the number of bytes accounted to the history, including the
+ * rings of both directions.
+ */
+size_t history_bytes(struct history *h)
+{
+	return sizeof(*h) + (store_nseries(&h->h_rx) + store_nseries(&h->h_tx)) *
+		history_data_size(h->h_definition) +
+		history_lod_bytes(&h->h_rx) + history_lod_bytes(&h->h_tx);
+}
+
+size_t attr_history_bytes(struct attr *a)
+{
+	struct history *h;
+	size_t bytes = 0;
+
+	list_for_each_entry(h, &a->a_history_list, h_list)
+		bytes += history_bytes(h);
+
+	return bytes;
+}
+
+static void element_bytes(struct element *e, struct attr *a, void *arg)
+{
+	*(size_t *) arg += attr_history_bytes(a);
+}
+
+size_t element_history_bytes(struct element *e)
+{
+	size_t bytes = 0;
+
+	element_foreach_attr(e, element_bytes, &bytes);
+
+	return bytes;
+}
+
+void history_account(ssize_t bytes)
+{
+	stats.hst_used += bytes;
+}
+
+void history_get_stats(struct history_stats *st)
+{
+	memcpy(st, &stats, sizeof(*st));
+	st->hst_budget = cfg_history_budget;
+}
+
+/**
+ * Mark histories of attribute as displayed
+ * @a		Attribute
+ *
+ * Recently displayed attributes are evicted last. An evicted attribute
+ * resumes collecting history as soon as it is displayed again.
+ */
+void history_viewed(struct attr *a)
+{
+	a->a_history_viewed = generation;
+
+	if (a->a_flags & ATTR_HISTORY_EVICTED) {
+		a->a_flags &= ~ATTR_HISTORY_EVICTED;
+		attr_start_collecting_history(a);
+	}
+}
+
+struct evict_list {
+	struct attr **		el_attrs;
+	unsigned int		el_n,
+				el_size;
+};
+
+static void add_candidate(struct element *e, struct attr *a, void *arg)
+{
+	struct evict_list *el = arg;
+
+	if (!(a->a_flags & ATTR_DOING_HISTORY))
+		return;
+
+	/* displayed in this or the previous round */
+	if (a->a_history_viewed + 1 >= generation)
+		return;
+
+	if (el->el_n >= el->el_size) {
+		el->el_size = el->el_size ? el->el_size * 2 : 64;
+		el->el_attrs = xrealloc(el->el_attrs,
+					el->el_size * sizeof(struct attr *));
+	}
+
+	el->el_attrs[el->el_n++] = a;
+}
+
+static void add_element_candidates(struct element_group *g,
+				   struct element *e, void *arg)
+{
+	element_foreach_attr(e, add_candidate, arg);
+}
+
+static inline int attr_idle(struct attr *a)
+{
+	return a->a_rx_rate.r_rate == 0.0f && a->a_tx_rate.r_rate == 0.0f;
+}
+
+/* idle attributes first, then least recently displayed */
+static int evict_cmp(const void *_a, const void *_b)
+{
+	struct attr *a = *(struct attr **) _a;
+	struct attr *b = *(struct attr **) _b;
+
+	if (attr_idle(a) != attr_idle(b))
+		return attr_idle(b) - attr_idle(a);
+
+	if (a->a_history_viewed != b->a_history_viewed)
+		return a->a_history_viewed < b->a_history_viewed ? -1 : 1;
+
+	return 0;
+}
+
+static void evict(struct attr *a)
+{
+	DBG("Evicting history of attribute %s (%zu bytes)",
+	    a->a_def->ad_name, attr_history_bytes(a));
+
+	history_detach(a);
+
+	a->a_flags &= ~ATTR_DOING_HISTORY;
+	a->a_flags |= ATTR_HISTORY_EVICTED;
+
+	stats.hst_evictions++;
+}
+
+/**
+ * Enforce history memory budget
+ *
+ * Called once per read interval. If the histories use more memory than
+ * the configured budget, histories are evicted until usage drops below
+ * 90% of the budget. Histories backed by a history file are resumed
+ * from it once collected again.
+ */
+void history_enforce_budget(void)
+{
+	struct evict_list el = { NULL, 0, 0 };
+	uint64_t low;
+	unsigned int i;
+
+	generation++;
+
+	if (!cfg_history_budget || stats.hst_used <= cfg_history_budget)
+		return;
+
+	low = (cfg_history_budget / 10) * 9;
+
+	group_foreach_recursive(add_element_candidates, &el);
+	qsort(el.el_attrs, el.el_n, sizeof(struct attr *), evict_cmp);
+
+	for (i = 0; i < el.el_n && stats.hst_used > low; i++)
+		evict(el.el_attrs[i]);
+
+	xfree(el.el_attrs);
+
+	/* rings are recycled through the pools, give the memory back */
+	pool_trim_all();
 }
 
 struct history_def *history_select_first(void)
@@ -313,6 +1110,8 @@ static void __exit history_exit(void)
 {
 	struct history_def *def, *n;
 
-	list_for_each_entry_safe(def, n, &def_list, hd_list)
-		history_def_free(def);
+	list_for_each_entry_safe(def, n, &def_list, hd_list) {
+		list_del(&def->hd_list);
+		history_def_put(def);
+	}
 }
@@ -0,0 +1,347 @@
+/*
+ * history_file.c	Persistent History
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/attr.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/history.h>
+#include <bmon/utils.h>
+
+#include <sys/mman.h>
+
+/*
+ * The histories of an attribute are kept in a single file which is
+ * mapped shared into memory. The history rings are stored in the file
+ * as they are in memory, so updates are plain stores to the mapping and
+ * reach the disk through the page cache.
+ *
+ * Layout:
+ *   struct history_file_hdr
+ *   struct history_file_entry	one per history definition
+ *   ring data			rx then tx, mean/min/max each
+ */
+
+#define HISTORY_FILE_MAGIC	"bmonhist"
+#define HISTORY_FILE_VERSION	1
+
+struct history_file_hdr
+{
+	char			fh_magic[8];
+	uint32_t		fh_version;
+	uint32_t		fh_nentries;
+	uint64_t		fh_size;
+};
+
+#define HFE_RX			(1 << 0)	/* rx rings hold data */
+#define HFE_TX			(1 << 1)	/* tx rings hold data */
+
+struct history_file_entry
+{
+	char			fe_name[32];
+	float			fe_interval;
+	int32_t			fe_size;
+	int32_t			fe_type;
+	int32_t			fe_index;
+	uint32_t		fe_flags;
+	uint32_t		fe_nseries;
+	/* wall clock time of last sample */
+	int64_t			fe_wall;
+	uint64_t		fe_offset;
+};
+
+struct history_file
+{
+	char *			hf_map;
+	size_t			hf_size;
+	int			hf_fd;
+};
+
+static int history_dir_ready;
+
+static void path_append(char *buf, size_t len, const char *name)
+{
+	size_t n = strlen(buf);
+
+	snprintf(buf + n, len - n, "%s%s", n ? "." : "", name);
+
+	/* element names may contain slashes */
+	for (; buf[n]; n++)
+		if (buf[n] == '/')
+			buf[n] = '_';
+}
+
+static void element_path(char *buf, size_t len, struct element *e)
+{
+	if (e->e_parent)
+		element_path(buf, len, e->e_parent);
+
+	path_append(buf, len, e->e_name);
+}
+
+static int entry_nseries(struct history *h)
+{
+	/* rolled up histories store mean, min and max */
+	return h->h_source ? 3 : 1;
+}
+
+static size_t layout(struct attr *a, struct history_file_entry *entries)
+{
+	struct history *h;
+	size_t off;
+	int n = 0;
+
+	list_for_each_entry(h, &a->a_history_list, h_list)
+		n++;
+
+	off = sizeof(struct history_file_hdr) +
+	      n * sizeof(struct history_file_entry);
+
+	list_for_each_entry(h, &a->a_history_list, h_list) {
+		struct history_def *def = h->h_definition;
+		struct history_file_entry *fe = entries++;
+
+		memset(fe, 0, sizeof(*fe));
+		strncpy(fe->fe_name, def->hd_name, sizeof(fe->fe_name) - 1);
+		fe->fe_interval = def->hd_interval;
+		fe->fe_size = def->hd_size;
+		fe->fe_type = def->hd_type;
+		fe->fe_nseries = entry_nseries(h);
+
+		off = (off + 7) & ~7UL;
+		fe->fe_offset = off;
+		off += 2 * fe->fe_nseries * history_data_size(def);
+	}
+
+	return off;
+}
+
+static int entry_matches(struct history_file_entry *fe,
+			 struct history_file_entry *want)
+{
+	return !strcmp(fe->fe_name, want->fe_name) &&
+	       fe->fe_interval == want->fe_interval &&
+	       fe->fe_size == want->fe_size &&
+	       fe->fe_type == want->fe_type &&
+	       fe->fe_nseries == want->fe_nseries &&
+	       fe->fe_offset == want->fe_offset;
+}
+
+static void *entry_data(struct history *h, int tx, int series)
+{
+	struct history_file_entry *fe = h->h_file_entry;
+	size_t size = history_data_size(h->h_definition);
+
+	return h->h_file->hf_map + fe->fe_offset +
+	       ((tx * fe->fe_nseries) + series) * size;
+}
+
+static void map_store(struct history *h, struct history_store *hs, int tx)
+{
+	hs->hs_data = entry_data(h, tx, HISTORY_MEAN);
+
+	if (h->h_file_entry->fe_nseries > 1) {
+		hs->hs_min = entry_data(h, tx, HISTORY_MIN);
+		hs->hs_max = entry_data(h, tx, HISTORY_MAX);
+	}
+
+	/* released by history_store_free() like memory backed rings */
+	history_account(h->h_file_entry->fe_nseries *
+			history_data_size(h->h_definition));
+}
+
+void history_file_store(struct history *h, struct history_store *hs)
+{
+	int tx = (hs == &h->h_tx);
+
+	map_store(h, hs, tx);
+	h->h_file_entry->fe_flags |= tx ? HFE_TX : HFE_RX;
+}
+
+void history_file_sync(struct history *h)
+{
+	h->h_file_entry->fe_index = h->h_index;
+	h->h_file_entry->fe_wall = time(NULL);
+}
+
+/*
+ * Continue the rings where the previous instance stopped and mark the
+ * samples missed in between as unknown. Counters are not continued as
+ * they may have been reset in the meantime, the first read after
+ * resuming only establishes a new base.
+ */
+static void resume(struct history *h, time_t now)
+{
+	struct history_file_entry *fe = h->h_file_entry;
+	struct history_def *def = h->h_definition;
+
+	if (fe->fe_index >= 0 && fe->fe_index < def->hd_size)
+		h->h_index = fe->fe_index;
+
+	if (fe->fe_flags & HFE_RX)
+		map_store(h, &h->h_rx, 0);
+
+	if (fe->fe_flags & HFE_TX)
+		map_store(h, &h->h_tx, 1);
+
+	if (fe->fe_wall && now > fe->fe_wall)
+		history_skip(h, (now - fe->fe_wall) / def->hd_interval);
+
+	history_file_sync(h);
+}
+
+static int file_valid(struct history_file_hdr *hdr, size_t size, int n,
+		      struct history_file_entry *want)
+{
+	struct history_file_entry *fe = (struct history_file_entry *) (hdr + 1);
+	int i;
+
+	if (memcmp(hdr->fh_magic, HISTORY_FILE_MAGIC, sizeof(hdr->fh_magic)) ||
+	    hdr->fh_version != HISTORY_FILE_VERSION ||
+	    hdr->fh_nentries != n || hdr->fh_size != size)
+		return 0;
+
+	for (i = 0; i < n; i++)
+		if (!entry_matches(&fe[i], &want[i]))
+			return 0;
+
+	return 1;
+}
+
+static void history_dir_setup(void)
+{
+	if (history_dir_ready)
+		return;
+
+	if (mkdir(cfg_history_dir, 0755) < 0 && errno != EEXIST)
+		quit("Unable to create history directory \"%s\": %s\n",
+		     cfg_history_dir, strerror(errno));
+
+	history_dir_ready = 1;
+}
+
+/**
+ * Back histories of attribute with history file
+ * @a		Attribute with histories attached
+ *
+ * Maps the history file of the attribute, creating it if needed, and
+ * resumes the histories stored in it. The histories stay in memory if
+ * no history directory is configured or the file cannot be used, e.g.
+ * because another instance of bmon holds it.
+ */
+void history_file_open(struct attr *a)
+{
+	struct history_file_entry *want, *fe;
+	struct history_file_hdr *hdr;
+	struct history_file *hf;
+	struct element *e = a->a_element;
+	struct history *h;
+	char path[FILENAME_MAX+1];
+	char name[FILENAME_MAX+1] = "";
+	struct stat st;
+	size_t size;
+	void *map;
+	int fd, n = 0, i = 0;
+
+	if (!cfg_history_dir || !e || list_empty(&a->a_history_list))
+		return;
+
+	history_dir_setup();
+
+	path_append(name, sizeof(name), e->e_group->g_name);
+	element_path(name, sizeof(name), e);
+	path_append(name, sizeof(name), a->a_def->ad_name);
+	snprintf(path, sizeof(path), "%s/%s", cfg_history_dir, name);
+
+	list_for_each_entry(h, &a->a_history_list, h_list)
+		n++;
+
+	want = xcalloc(n, sizeof(*want));
+	size = layout(a, want);
+
+	if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+		goto errout;
+
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0 || fstat(fd, &st) < 0)
+		goto errout_close;
+
+	if (st.st_size != size &&
+	    (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0))
+		goto errout_close;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto errout_close;
+
+	hdr = map;
+	fe = (struct history_file_entry *) (hdr + 1);
+
+	if (!file_valid(hdr, size, n, want)) {
+		DBG("Initializing history file %s", path);
+
+		memset(map, 0, size);
+		memcpy(hdr->fh_magic, HISTORY_FILE_MAGIC, sizeof(hdr->fh_magic));
+		hdr->fh_version = HISTORY_FILE_VERSION;
+		hdr->fh_nentries = n;
+		hdr->fh_size = size;
+		memcpy(fe, want, n * sizeof(*want));
+	}
+
+	hf = xcalloc(1, sizeof(*hf));
+	hf->hf_map = map;
+	hf->hf_size = size;
+	hf->hf_fd = fd;
+	a->a_history_file = hf;
+
+	list_for_each_entry(h, &a->a_history_list, h_list) {
+		h->h_file = hf;
+		h->h_file_entry = &fe[i++];
+		resume(h, time(NULL));
+	}
+
+	xfree(want);
+	return;
+
+errout_close:
+	close(fd);
+errout:
+	DBG("Unable to use history file %s: %s", path, strerror(errno));
+	xfree(want);
+}
+
+void history_file_close(struct attr *a)
+{
+	struct history_file *hf = a->a_history_file;
+
+	if (!hf)
+		return;
+
+	munmap(hf->hf_map, hf->hf_size);
+	close(hf->hf_fd);
+	xfree(hf);
+
+	a->a_history_file = NULL;
+}
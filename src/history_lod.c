@@ -0,0 +1,319 @@
+/*
+ * history_lod.c	History Decimation
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/history.h>
+#include <bmon/utils.h>
+
+/*
+ * Decimation pyramid over the slots of a history ring. A leaf summarizes
+ * one block of HISTORY_BLOCK_SIZE slots, every node of the next level
+ * summarizes two nodes of the level below. Any range of slots is covered
+ * by O(log n) nodes, so mapping a history of any size onto the columns
+ * of a graph costs O(columns * log n) instead of a full scan.
+ *
+ * The pyramid is built when first needed and brought up to date before
+ * each query by rebuilding the leaves of the slots written since.
+ */
+
+#define LOD_LEAF		HISTORY_BLOCK_SIZE
+#define LOD_MAX_LEVELS		32
+
+struct lod_node
+{
+	uint64_t		ln_min,
+				ln_max,
+				ln_sum;
+	uint32_t		ln_nknown;
+};
+
+struct history_lod
+{
+	unsigned long		hl_seq;
+	int			hl_nlevels;
+	int			hl_len[LOD_MAX_LEVELS];
+	struct lod_node *	hl_level[LOD_MAX_LEVELS];
+	size_t			hl_bytes;
+	/* charged to the history budget */
+	int			hl_accounted;
+};
+
+static inline void node_clear(struct lod_node *n)
+{
+	n->ln_min = UINT64_MAX;
+	n->ln_max = 0;
+	n->ln_sum = 0;
+	n->ln_nknown = 0;
+}
+
+static inline void node_merge(struct lod_node *dst, struct lod_node *src)
+{
+	if (!src->ln_nknown)
+		return;
+
+	if (src->ln_min < dst->ln_min)
+		dst->ln_min = src->ln_min;
+	if (src->ln_max > dst->ln_max)
+		dst->ln_max = src->ln_max;
+
+	dst->ln_sum += src->ln_sum;
+	dst->ln_nknown += src->ln_nknown;
+}
+
+static void node_add_slot(struct lod_node *n, struct history *h,
+			  struct history_store *hs, int slot)
+{
+	struct lod_node s;
+
+	s.ln_sum = history_sample(h, hs, HISTORY_MEAN, slot);
+	if (s.ln_sum == HISTORY_UNKNOWN)
+		return;
+
+	s.ln_min = history_sample(h, hs, HISTORY_MIN, slot);
+	s.ln_max = history_sample(h, hs, HISTORY_MAX, slot);
+	s.ln_nknown = 1;
+
+	node_merge(n, &s);
+}
+
+static struct history_lod *lod_alloc(struct history *h)
+{
+	struct history_lod *l;
+	struct lod_node *nodes;
+	int k, len, total = 0;
+
+	l = xcalloc(1, sizeof(*l));
+
+	len = (h->h_definition->hd_size + LOD_LEAF - 1) / LOD_LEAF;
+
+	for (k = 0; k < LOD_MAX_LEVELS; k++) {
+		l->hl_len[k] = len;
+		total += len;
+
+		if (len == 1)
+			break;
+
+		len = (len + 1) / 2;
+	}
+
+	l->hl_nlevels = k + 1;
+
+	nodes = xcalloc(total, sizeof(*nodes));
+	for (k = 0; k < l->hl_nlevels; k++) {
+		l->hl_level[k] = nodes;
+		nodes += l->hl_len[k];
+	}
+
+	l->hl_bytes = sizeof(*l) + total * sizeof(struct lod_node);
+
+	/* copies are owned by the reader, not the collector */
+	if (!(h->h_flags & HISTORY_CLONE)) {
+		history_account(l->hl_bytes);
+		l->hl_accounted = 1;
+	}
+
+	return l;
+}
+
+void history_lod_free(struct history_store *hs)
+{
+	struct history_lod *l = hs->hs_lod;
+
+	if (!l)
+		return;
+
+	if (l->hl_accounted)
+		history_account(-(ssize_t) l->hl_bytes);
+
+	xfree(l->hl_level[0]);
+	xfree(l);
+
+	hs->hs_lod = NULL;
+}
+
+size_t history_lod_bytes(struct history_store *hs)
+{
+	return hs->hs_lod ? hs->hs_lod->hl_bytes : 0;
+}
+
+static void build_node(struct history_lod *l, int k, int i)
+{
+	struct lod_node *n = &l->hl_level[k][i];
+
+	node_clear(n);
+	node_merge(n, &l->hl_level[k - 1][2 * i]);
+
+	if (2 * i + 1 < l->hl_len[k - 1])
+		node_merge(n, &l->hl_level[k - 1][2 * i + 1]);
+}
+
+static void build_leaf(struct history_lod *l, struct history *h,
+		       struct history_store *hs, int leaf)
+{
+	struct lod_node *n = &l->hl_level[0][leaf];
+	int slot, end = (leaf + 1) * LOD_LEAF;
+
+	if (end > h->h_definition->hd_size)
+		end = h->h_definition->hd_size;
+
+	node_clear(n);
+
+	for (slot = leaf * LOD_LEAF; slot < end; slot++)
+		node_add_slot(n, h, hs, slot);
+}
+
+static void lod_update(struct history *h, struct history_store *hs)
+{
+	struct history_lod *l = hs->hs_lod;
+	int size = h->h_definition->hd_size;
+	unsigned long i, nnew = ULONG_MAX;
+	int k, leaf, last = -1;
+
+	if (!l)
+		l = hs->hs_lod = lod_alloc(h);
+	else
+		nnew = h->h_seq - l->hl_seq;
+
+	if (nnew >= (unsigned long) size) {
+		for (leaf = 0; leaf < l->hl_len[0]; leaf++)
+			build_leaf(l, h, hs, leaf);
+
+		for (k = 1; k < l->hl_nlevels; k++)
+			for (i = 0; i < l->hl_len[k]; i++)
+				build_node(l, k, i);
+	} else {
+		/* rebuild leaves written since, newest first */
+		for (i = 0; i < nnew; i++) {
+			int slot = (h->h_index - 1 - (int) i + size) % size;
+
+			if ((leaf = slot / LOD_LEAF) == last)
+				continue;
+
+			last = leaf;
+			build_leaf(l, h, hs, leaf);
+
+			for (k = 1; k < l->hl_nlevels; k++) {
+				leaf >>= 1;
+				build_node(l, k, leaf);
+			}
+		}
+	}
+
+	l->hl_seq = h->h_seq;
+}
+
+/* Summarize slots [lo, hi) */
+static void lod_query(struct history_lod *l, struct history *h,
+		      struct history_store *hs, int lo, int hi,
+		      struct lod_node *acc)
+{
+	int k;
+
+	/* partial leaves at both ends */
+	for (; lo < hi && (lo % LOD_LEAF); lo++)
+		node_add_slot(acc, h, hs, lo);
+
+	for (; hi > lo && (hi % LOD_LEAF) && hi != h->h_definition->hd_size; hi--)
+		node_add_slot(acc, h, hs, hi - 1);
+
+	if (lo >= hi)
+		return;
+
+	lo /= LOD_LEAF;
+	hi = (hi + LOD_LEAF - 1) / LOD_LEAF;
+
+	for (k = 0; lo < hi; k++, lo >>= 1, hi >>= 1) {
+		if (lo & 1)
+			node_merge(acc, &l->hl_level[k][lo++]);
+		if (hi & 1)
+			node_merge(acc, &l->hl_level[k][--hi]);
+	}
+}
+
+/**
+ * Map history onto graph columns
+ * @h		History
+ * @hs		RX or TX store of history
+ * @back	Number of most recent samples to skip
+ * @per_col	Number of samples per column
+ * @ncols	Number of columns
+ * @mean	Mean of each column
+ * @min		Minimum of each column (may be NULL)
+ * @max		Maximum of each column
+ *
+ * Column 0 covers the newest samples. Columns without a known sample are
+ * HISTORY_UNKNOWN, columns beyond the size of the history are 0.
+ */
+void history_decimate(struct history *h, struct history_store *hs,
+		      unsigned long back, unsigned long per_col, int ncols,
+		      uint64_t *mean, uint64_t *min, uint64_t *max)
+{
+	long size = h->h_definition->hd_size;
+	struct lod_node n;
+	int c;
+
+	lod_update(h, hs);
+
+	for (c = 0; c < ncols; c++) {
+		unsigned long b0 = back + c * per_col, b1 = b0 + per_col;
+		long lo, hi;
+
+		if (b0 >= size) {
+			mean[c] = max[c] = 0;
+			if (min)
+				min[c] = 0;
+			continue;
+		}
+
+		if (b1 > size)
+			b1 = size;
+
+		/* the sample b back from the newest lives in slot index-1-b */
+		hi = h->h_index - (long) b0;
+		lo = h->h_index - (long) b1;
+
+		node_clear(&n);
+
+		if (lo >= 0)
+			lod_query(hs->hs_lod, h, hs, lo, hi, &n);
+		else if (hi <= 0)
+			lod_query(hs->hs_lod, h, hs, lo + size, hi + size, &n);
+		else {
+			lod_query(hs->hs_lod, h, hs, 0, hi, &n);
+			lod_query(hs->hs_lod, h, hs, lo + size, size, &n);
+		}
+
+		if (n.ln_nknown) {
+			mean[c] = n.ln_sum / n.ln_nknown;
+			max[c] = n.ln_max;
+			if (min)
+				min[c] = n.ln_min;
+		} else {
+			mean[c] = max[c] = HISTORY_UNKNOWN;
+			if (min)
+				min[c] = HISTORY_UNKNOWN;
+		}
+	}
+}
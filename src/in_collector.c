@@ -0,0 +1,719 @@
+/*
+ * in_collector.c	Collector, receives elements from agents
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/input.h>
+#include <bmon/group.h>
+#include <bmon/element.h>
+#include <bmon/attr.h>
+#include <bmon/agent.h>
+#include <bmon/net.h>
+#include <bmon/utils.h>
+
+#include <sys/epoll.h>
+
+#define COLLECTOR_DEFAULT_MAX	4096
+#define COLLECTOR_EVENTS	64
+#define COLLECTOR_BUF_SIZE	(AGENT_HDR_LEN + AGENT_MAX_PAYLOAD)
+#define COLLECTOR_MAX_ELEMENTS	65536	/* per agent */
+#define COLLECTOR_MAX_ATTRS	256	/* per agent */
+#define COLLECTOR_MAX_DEFS	1024	/* defined by all agents */
+
+static char *c_listen;
+static int c_max = COLLECTOR_DEFAULT_MAX;
+
+struct remote_value
+{
+	uint8_t			v_flags;
+	uint64_t		v_rx;
+	uint64_t		v_tx;
+};
+
+struct remote_elem
+{
+	struct element_group *	re_group;
+	char *			re_name;
+	uint32_t		re_id;
+	/* id of parent + 1, 0 if none */
+	uint32_t		re_parent;
+	struct attr_def *	re_key[__GT_MAX];
+	struct attr_def *	re_usage;
+
+	/* resolved in this read */
+	unsigned long		re_read;
+	struct element *	re_element;
+
+	/* values indexed by the attribute id of the agent */
+	struct remote_value *	re_values;
+	unsigned int		re_nvalues;
+};
+
+/*
+ * Connection of an agent. Messages are read into ac_buf and applied as
+ * soon as they are complete. Ids of the agent are translated through
+ * arrays, agents reuse the ids of removed elements.
+ */
+struct agent_conn
+{
+	int			ac_fd;
+	char *			ac_host;
+	int			ac_magic;
+	int			ac_hello;
+
+	unsigned char *		ac_buf;
+	size_t			ac_len;
+
+	/* local attribute id, indexed by the id of the agent */
+	int *			ac_attrs;
+	unsigned int		ac_nattrs;
+
+	struct remote_elem **	ac_elems;
+	unsigned int		ac_nelems;
+
+	struct list_head	ac_list;
+};
+
+static LIST_HEAD(conns);
+static int nconns;
+static int listen_fd = -1;
+static int epoll_fd = -1;
+static unsigned long nreads;
+static unsigned int nremote_defs;
+
+struct msg
+{
+	const unsigned char *	m_pos;
+	const unsigned char *	m_end;
+	int			m_err;
+};
+
+static uint64_t get_varint(struct msg *m)
+{
+	uint64_t v = 0;
+	int shift = 0;
+
+	while (m->m_pos < m->m_end && shift < 64) {
+		unsigned char c = *m->m_pos++;
+
+		v |= (uint64_t) (c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return v;
+
+		shift += 7;
+	}
+
+	m->m_err = 1;
+	return 0;
+}
+
+static uint64_t get_delta(struct msg *m)
+{
+	uint64_t v = get_varint(m);
+
+	return (v >> 1) ^ -(v & 1);
+}
+
+/* Copies string into buf, truncating it if needed */
+static void get_str(struct msg *m, char *buf, size_t size)
+{
+	uint64_t len = get_varint(m);
+
+	if (m->m_err || len > m->m_end - m->m_pos) {
+		m->m_err = 1;
+		buf[0] = '\0';
+		return;
+	}
+
+	snprintf(buf, size, "%.*s", (int) len, m->m_pos);
+	m->m_pos += len;
+}
+
+static void remote_elem_free(struct remote_elem *re)
+{
+	if (!re)
+		return;
+
+	xfree(re->re_name);
+	xfree(re->re_values);
+	xfree(re);
+}
+
+static void conn_free(struct agent_conn *ac)
+{
+	unsigned int i;
+
+	if (ac->ac_host)
+		DBG("Agent %s disconnected", ac->ac_host);
+
+	/* the elements expire once their lifetime ends */
+	for (i = 0; i < ac->ac_nelems; i++)
+		remote_elem_free(ac->ac_elems[i]);
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ac->ac_fd, NULL);
+	close(ac->ac_fd);
+	list_del(&ac->ac_list);
+	nconns--;
+
+	xfree(ac->ac_host);
+	xfree(ac->ac_buf);
+	xfree(ac->ac_attrs);
+	xfree(ac->ac_elems);
+	xfree(ac);
+}
+
+static int host_taken(const char *host)
+{
+	struct agent_conn *ac;
+
+	list_for_each_entry(ac, &conns, ac_list)
+		if (ac->ac_host && !strcmp(ac->ac_host, host))
+			return 1;
+
+	return 0;
+}
+
+static int handle_hello(struct agent_conn *ac, struct msg *m)
+{
+	char host[64], name[80];
+	int n = 1;
+
+	get_str(m, host, sizeof(host));
+	if (m->m_err || !host[0])
+		return -EINVAL;
+
+	/* several agents may report the same name */
+	snprintf(name, sizeof(name), "%s", host);
+	while (host_taken(name))
+		snprintf(name, sizeof(name), "%s#%d", host, ++n);
+
+	ac->ac_host = strdup(name);
+	ac->ac_hello = 1;
+
+	DBG("Agent %s connected", ac->ac_host);
+
+	return 0;
+}
+
+/*
+ * Attribute names end up in file names, metric names and the output of
+ * every module, only letters, digits, '_', '-' and '.' are accepted.
+ */
+static int valid_attr_name(const char *name)
+{
+	const char *p;
+
+	if (!isalnum((unsigned char) name[0]))
+		return 0;
+
+	for (p = name; *p; p++)
+		if (!isalnum((unsigned char) *p) && !strchr("_-.", *p))
+			return 0;
+
+	return 1;
+}
+
+static int handle_attr(struct agent_conn *ac, struct msg *m)
+{
+	char name[64], desc[128], unit[32];
+	uint64_t id, type, flags;
+	struct unit *u;
+
+	id = get_varint(m);
+	type = get_varint(m);
+	flags = get_varint(m);
+	get_str(m, name, sizeof(name));
+	get_str(m, desc, sizeof(desc));
+	get_str(m, unit, sizeof(unit));
+
+	if (m->m_err || !valid_attr_name(name))
+		return -EINVAL;
+
+	if (type != ATTR_TYPE_COUNTER && type != ATTR_TYPE_RATE &&
+	    type != ATTR_TYPE_PERCENT)
+		return -EINVAL;
+
+	if (id >= COLLECTOR_MAX_ATTRS)
+		return -ENOSPC;
+
+	if (!(u = unit_lookup(unit)) && !(u = unit_lookup(UNIT_NUMBER)))
+		return -ENOENT;
+
+	/* definitions are never freed, limit what agents may add */
+	if (!attr_def_lookup(name)) {
+		if (nremote_defs >= COLLECTOR_MAX_DEFS) {
+			DBG("Agent %s exceeds the limit of %d attributes",
+			    ac->ac_host, COLLECTOR_MAX_DEFS);
+			return -ENOSPC;
+		}
+
+		nremote_defs++;
+	}
+
+	if (id >= ac->ac_nattrs) {
+		ac->ac_attrs = xrealloc(ac->ac_attrs,
+					(id + 1) * sizeof(*ac->ac_attrs));
+		memset(ac->ac_attrs + ac->ac_nattrs, 0xff,
+		       (id + 1 - ac->ac_nattrs) * sizeof(*ac->ac_attrs));
+		ac->ac_nattrs = id + 1;
+	}
+
+	/* attributes unknown to this bmon are defined as announced */
+	ac->ac_attrs[id] = attr_def_add(name, desc, u, type, flags &
+					(ATTR_FORCE_HISTORY |
+					 ATTR_IGNORE_OVERFLOWS |
+					 ATTR_TRUE_64BIT));
+
+	return 0;
+}
+
+static struct element_group *host_group(struct agent_conn *ac,
+					const char *remote)
+{
+	struct element_group *g;
+	char name[160];
+
+	if (!strcmp(remote, DEFAULT_GROUP))
+		snprintf(name, sizeof(name), "%s", ac->ac_host);
+	else
+		snprintf(name, sizeof(name), "%s:%s", ac->ac_host, remote);
+
+	if ((g = group_lookup(name, 0)))
+		return g;
+
+	if (group_new_derived_hdr(name, name, remote) == -ENOENT)
+		group_new_derived_hdr(name, name, DEFAULT_GROUP);
+
+	return group_lookup(name, GROUP_CREATE);
+}
+
+static struct attr_def *local_def(struct agent_conn *ac, const char *name)
+{
+	return name[0] ? attr_def_lookup(name) : NULL;
+}
+
+static int handle_element(struct agent_conn *ac, struct msg *m)
+{
+	char group[64], name[256], major[64], minor[64], usage[64];
+	struct remote_elem *re;
+	uint64_t id, parent, eid;
+
+	id = get_varint(m);
+	parent = get_varint(m);
+	eid = get_varint(m);
+	get_str(m, group, sizeof(group));
+	get_str(m, name, sizeof(name));
+	get_str(m, major, sizeof(major));
+	get_str(m, minor, sizeof(minor));
+	get_str(m, usage, sizeof(usage));
+
+	if (m->m_err || id >= COLLECTOR_MAX_ELEMENTS ||
+	    parent > ac->ac_nelems || !name[0])
+		return -EINVAL;
+
+	if (id >= ac->ac_nelems) {
+		unsigned int n = ac->ac_nelems ? ac->ac_nelems : 16;
+
+		while (n <= id)
+			n *= 2;
+
+		ac->ac_elems = xrealloc(ac->ac_elems, n * sizeof(re));
+		memset(ac->ac_elems + ac->ac_nelems, 0,
+		       (n - ac->ac_nelems) * sizeof(re));
+		ac->ac_nelems = n;
+	}
+
+	re = xcalloc(1, sizeof(*re));
+	if (!(re->re_group = host_group(ac, group))) {
+		xfree(re);
+		return -ENOENT;
+	}
+
+	re->re_name = strdup(name);
+	re->re_id = eid;
+	re->re_parent = parent;
+	re->re_key[GT_MAJOR] = local_def(ac, major);
+	re->re_key[GT_MINOR] = local_def(ac, minor);
+	re->re_usage = local_def(ac, usage);
+
+	remote_elem_free(ac->ac_elems[id]);
+	ac->ac_elems[id] = re;
+
+	return 0;
+}
+
+static struct remote_elem *lookup_elem(struct agent_conn *ac, uint64_t id)
+{
+	return id < ac->ac_nelems ? ac->ac_elems[id] : NULL;
+}
+
+static int handle_remove(struct agent_conn *ac, struct msg *m)
+{
+	uint64_t id = get_varint(m);
+	struct remote_elem *re;
+
+	if (m->m_err || !(re = lookup_elem(ac, id)))
+		return -EINVAL;
+
+	remote_elem_free(re);
+	ac->ac_elems[id] = NULL;
+
+	return 0;
+}
+
+static int handle_sample(struct agent_conn *ac, struct msg *m)
+{
+	struct remote_elem *re;
+	struct remote_value *v;
+	uint64_t id, flags;
+
+	if (!(re = lookup_elem(ac, get_varint(m))) || m->m_err)
+		return -EINVAL;
+
+	while (m->m_pos < m->m_end) {
+		id = get_varint(m);
+		flags = get_varint(m);
+
+		if (m->m_err || id >= ac->ac_nattrs)
+			return -EINVAL;
+
+		if (id >= re->re_nvalues) {
+			re->re_values = xrealloc(re->re_values,
+					(id + 1) * sizeof(*re->re_values));
+			memset(re->re_values + re->re_nvalues, 0,
+			       (id + 1 - re->re_nvalues) *
+			       sizeof(*re->re_values));
+			re->re_nvalues = id + 1;
+		}
+
+		v = &re->re_values[id];
+		v->v_flags = flags;
+		v->v_rx += get_delta(m);
+		v->v_tx += get_delta(m);
+	}
+
+	return m->m_err ? -EINVAL : 0;
+}
+
+static int handle_msg(struct agent_conn *ac, int type,
+		      const unsigned char *payload, size_t len)
+{
+	struct msg m = {
+		.m_pos	= payload,
+		.m_end	= payload + len,
+	};
+
+	if (!ac->ac_hello && type != AGENT_MSG_HELLO)
+		return -EINVAL;
+
+	switch (type) {
+	case AGENT_MSG_HELLO:
+		return ac->ac_hello ? -EINVAL : handle_hello(ac, &m);
+	case AGENT_MSG_ATTR:
+		return handle_attr(ac, &m);
+	case AGENT_MSG_ELEMENT:
+		return handle_element(ac, &m);
+	case AGENT_MSG_REMOVE:
+		return handle_remove(ac, &m);
+	case AGENT_MSG_SAMPLE:
+		return handle_sample(ac, &m);
+	}
+
+	/* unknown messages are skipped for newer agents */
+	return 0;
+}
+
+/* Reads all available data, returns a negative error to drop the agent */
+static int conn_read(struct agent_conn *ac)
+{
+	unsigned char *p, *end;
+	size_t len;
+	ssize_t n;
+
+	for (;;) {
+		n = recv(ac->ac_fd, ac->ac_buf + ac->ac_len,
+			 COLLECTOR_BUF_SIZE - ac->ac_len, 0);
+		if (n == 0)
+			return -ECONNRESET;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ?
+				0 : -errno;
+		}
+
+		ac->ac_len += n;
+		p = ac->ac_buf;
+		end = p + ac->ac_len;
+
+		if (!ac->ac_magic) {
+			if (end - p < AGENT_MAGIC_LEN)
+				continue;
+
+			if (memcmp(p, AGENT_MAGIC, AGENT_MAGIC_LEN))
+				return -EPROTO;
+
+			p += AGENT_MAGIC_LEN;
+			ac->ac_magic = 1;
+		}
+
+		while (end - p >= AGENT_HDR_LEN) {
+			len = (p[1] << 8) | p[2];
+			if (end - p < AGENT_HDR_LEN + len)
+				break;
+
+			if (handle_msg(ac, p[0], p + AGENT_HDR_LEN, len) < 0)
+				return -EPROTO;
+
+			p += AGENT_HDR_LEN + len;
+		}
+
+		ac->ac_len = end - p;
+		memmove(ac->ac_buf, p, ac->ac_len);
+	}
+}
+
+static void accept_agents(void)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	struct agent_conn *ac;
+	int fd;
+
+	while ((fd = accept4(listen_fd, NULL, NULL,
+			     SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		if (nconns >= c_max) {
+			close(fd);
+			continue;
+		}
+
+		ac = xcalloc(1, sizeof(*ac));
+		ac->ac_fd = fd;
+		ac->ac_buf = xcalloc(1, COLLECTOR_BUF_SIZE);
+
+		ev.data.ptr = ac;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			close(fd);
+			xfree(ac->ac_buf);
+			xfree(ac);
+			continue;
+		}
+
+		list_add_tail(&ac->ac_list, &conns);
+		nconns++;
+	}
+}
+
+static struct element *resolve(struct agent_conn *ac, struct remote_elem *re)
+{
+	struct element *parent = NULL, *e;
+	struct remote_elem *pre;
+
+	if (re->re_read == nreads)
+		return re->re_element;
+
+	re->re_read = nreads;
+	re->re_element = NULL;
+
+	if (re->re_parent) {
+		if (!(pre = lookup_elem(ac, re->re_parent - 1)) ||
+		    !(parent = resolve(ac, pre)))
+			return NULL;
+	}
+
+	e = element_lookup(re->re_group, re->re_name, re->re_id, parent,
+			   ELEMENT_CREAT);
+	if (!e)
+		return NULL;
+
+	if (e->e_flags & ELEMENT_FLAG_CREATED) {
+		e->e_key_attr[GT_MAJOR] = re->re_key[GT_MAJOR];
+		e->e_key_attr[GT_MINOR] = re->re_key[GT_MINOR];
+		e->e_usage_attr = re->re_usage;
+		e->e_level = parent ? parent->e_level + 1 : 0;
+		e->e_flags &= ~ELEMENT_FLAG_CREATED;
+	}
+
+	return re->re_element = e;
+}
+
+static void update_elements(struct agent_conn *ac)
+{
+	struct remote_elem *re;
+	struct remote_value *v;
+	struct element *e;
+	unsigned int i, id;
+
+	for (i = 0; i < ac->ac_nelems; i++) {
+		if (!(re = ac->ac_elems[i]) || !(e = resolve(ac, re)))
+			continue;
+
+		if (e->e_flags & ELEMENT_FLAG_UPDATED)
+			continue;
+
+		for (id = 0; id < re->re_nvalues; id++) {
+			int flags = UPDATE_FLAG_64BIT;
+
+			v = &re->re_values[id];
+			if (!v->v_flags || ac->ac_attrs[id] < 0)
+				continue;
+
+			if (v->v_flags & AGENT_RX)
+				flags |= UPDATE_FLAG_RX;
+			if (v->v_flags & AGENT_TX)
+				flags |= UPDATE_FLAG_TX;
+
+			attr_update(e, ac->ac_attrs[id], v->v_rx, v->v_tx,
+				    flags);
+		}
+
+		element_notify_update(e, NULL);
+		element_lifesign(e, 1);
+	}
+}
+
+/*
+ * Called by the collector thread on every read. Takes whatever the
+ * agents have sent in the meantime without waiting and then updates
+ * all elements of connected agents with their latest values.
+ */
+static void collector_read(void)
+{
+	struct epoll_event events[COLLECTOR_EVENTS];
+	struct agent_conn *ac, *n;
+	int i, nev;
+
+	do {
+		nev = epoll_wait(epoll_fd, events, COLLECTOR_EVENTS, 0);
+
+		for (i = 0; i < nev; i++) {
+			if (!(ac = events[i].data.ptr))
+				accept_agents();
+			else if (conn_read(ac) < 0)
+				conn_free(ac);
+		}
+	} while (nev == COLLECTOR_EVENTS);
+
+	nreads++;
+
+	list_for_each_entry_safe(ac, n, &conns, ac_list)
+		if (ac->ac_hello)
+			update_elements(ac);
+}
+
+static int collector_probe(void)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+
+	if ((listen_fd = net_listen(c_listen, AGENT_DEFAULT_PORT)) < 0)
+		return 0;
+
+	fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+	if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+	    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+		fprintf(stderr, "Unable to set up epoll: %s\n",
+			strerror(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+static void collector_shutdown(void)
+{
+	struct agent_conn *ac, *n;
+
+	list_for_each_entry_safe(ac, n, &conns, ac_list)
+		conn_free(ac);
+
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		listen_fd = -1;
+	}
+
+	if (epoll_fd >= 0) {
+		close(epoll_fd);
+		epoll_fd = -1;
+	}
+}
+
+static void print_help(void)
+{
+	printf(
+	"collector - Receive elements from agents\n" \
+	"\n" \
+	"  Accepts connections of bmon instances running the agent output\n" \
+	"  module and shows their elements. Each host gets a group of its\n" \
+	"  own, named after the host, or host:group for groups other than\n" \
+	"  the default group. Elements of disconnected agents expire like\n" \
+	"  any other element. Only local agents can connect unless an\n" \
+	"  address to listen on is given.\n" \
+	"\n" \
+	"  Options:\n" \
+	"    listen=ADDR    Address to listen on (default: 127.0.0.1:%s)\n" \
+	"                   ADDR may be host:port, [ipv6]:port or a port,\n" \
+	"                   without a host all addresses are used\n" \
+	"    max=NUM        Maximum number of agents (default: %d)\n" \
+	"\n" \
+	"  Example:\n" \
+	"    bmon -i 'collector:listen=10.0.0.1:%s'\n" \
+	"    bmon -i 'collector:listen=:%s'     # all addresses\n" \
+	"\n", AGENT_DEFAULT_PORT, COLLECTOR_DEFAULT_MAX, AGENT_DEFAULT_PORT,
+	AGENT_DEFAULT_PORT);
+}
+
+static void collector_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "listen") && value) {
+		xfree(c_listen);
+		c_listen = strdup(value);
+	} else if (!strcasecmp(type, "max") && value)
+		c_max = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static struct bmon_module collector_ops = {
+	.m_name		= "collector",
+	.m_do		= collector_read,
+	.m_parse_opt	= collector_parse_opt,
+	.m_probe	= collector_probe,
+	.m_shutdown	= collector_shutdown,
+};
+
+static void __init collector_init(void)
+{
+	/* agents are not authenticated, listening on all addresses is opt-in */
+	c_listen = strdup("127.0.0.1:" AGENT_DEFAULT_PORT);
+
+	input_register(&collector_ops);
+}
+
+static void __exit collector_exit(void)
+{
+	collector_shutdown();
+	xfree(c_listen);
+}
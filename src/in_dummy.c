@@ -41,6 +41,9 @@ static int c_randomize = 0;
 static int c_mtu = 1540;
 static int c_maxpps = 100000;
 static int c_numgroups = 2;
+static int c_churn = 0;
+
+static unsigned int churn_gen, churn_reads;
 
 static uint64_t *cnts;
 
@@ -85,6 +88,15 @@ static void dummy_read(void)
 {
 	int gidx, n;
 
+	/*
+	 * Rename all devices every `churn' reads, the old elements will
+	 * expire once their lifetime ends.
+	 */
+	if (c_churn && ++churn_reads >= c_churn) {
+		churn_reads = 0;
+		churn_gen++;
+	}
+
 	for (gidx = 0; gidx < c_numgroups; gidx++) {
 		char gname[32];
 		struct element_group *group;
@@ -101,7 +113,8 @@ static void dummy_read(void)
 			struct element *e;
 			int i;
 
-			snprintf(ifname, sizeof(ifname), "dummy%d", n);
+			snprintf(ifname, sizeof(ifname), "dummy%u",
+				 n + (churn_gen * c_numdev));
 
 			if (!(e = element_lookup(group, ifname, 0, NULL, ELEMENT_CREAT)))
 				return;
@@ -167,6 +180,7 @@ static void print_help(void)
 	"    seed=NUM       Seed for randomizer (default: time(0))\n" \
 	"    mtu=NUM        Maximal Transmission Unit (default: 1540)\n" \
 	"    maxpps=NUM     Upper limit for packets per second (default: 100K)\n" \
+	"    churn=NUM      Replace all devices every NUM reads (default: off)\n" \
 	"\n" \
 	"  Randomizer:\n" \
 	"    RX-packets := Rand() %% maxpps\n" \
@@ -198,6 +212,8 @@ static void dummy_parse_opt(const char *type, const char *value)
 		c_maxpps = strtol(value, NULL, 0);
 	else if (!strcasecmp(type, "numgroups") && value)
 		c_numgroups = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "churn") && value)
+		c_churn = strtol(value, NULL, 0);
 	else if (!strcasecmp(type, "help")) {
 		print_help();
 		exit(0);
@@ -29,6 +29,7 @@
 #include <bmon/attr.h>
 #include <bmon/conf.h>
 #include <bmon/input.h>
+#include <bmon/scheduler.h>
 #include <bmon/utils.h>
 
 #ifndef SYS_BSD
@@ -512,6 +513,134 @@ struct rdata {
 static struct nl_sock *sock;
 static struct nl_cache *link_cache, *qdisc_cache;
 
+/* the tc walk may be scheduled apart from the link statistics */
+static struct sched_class *tc_sched;
+static int tc_due;
+
+/*
+ * Links and their top level qdiscs by ifindex, rebuilt on every read.
+ * The lookup functions of libnl walk the whole cache which makes a read
+ * quadratic in the number of links.
+ */
+enum {
+	QDISC_ROOT,
+	QDISC_UNSPEC,
+	QDISC_INGRESS,
+	__QDISC_MAX,
+};
+
+struct link_slot {
+	int			ls_ifindex;
+	struct rtnl_link *	ls_link;
+	struct rtnl_qdisc *	ls_qdisc[__QDISC_MAX];
+};
+
+static struct link_slot *link_index;
+static unsigned int link_index_size;
+
+static struct link_slot *link_slot(int ifindex, int create)
+{
+	unsigned int mask = link_index_size - 1;
+	unsigned int i = (ifindex * 2654435761U) & mask;
+	struct link_slot *ls;
+
+	for (;; i = (i + 1) & mask) {
+		ls = &link_index[i];
+
+		if (ls->ls_ifindex == ifindex)
+			return ls;
+
+		if (!ls->ls_ifindex)
+			break;
+	}
+
+	if (!create)
+		return NULL;
+
+	ls->ls_ifindex = ifindex;
+
+	return ls;
+}
+
+static void index_link(struct nl_object *obj, void *arg)
+{
+	struct rtnl_link *link = (struct rtnl_link *) obj;
+
+	link_slot(rtnl_link_get_ifindex(link), 1)->ls_link = link;
+}
+
+static void index_qdisc(struct nl_object *obj, void *arg)
+{
+	struct rtnl_tc *tc = (struct rtnl_tc *) obj;
+	struct link_slot *ls;
+	int i;
+
+	switch (rtnl_tc_get_parent(tc)) {
+	case TC_H_ROOT:
+		i = QDISC_ROOT;
+		break;
+	case 0:
+		i = QDISC_UNSPEC;
+		break;
+	case TC_H_INGRESS:
+		i = QDISC_INGRESS;
+		break;
+	default:
+		return;
+	}
+
+	ls = link_slot(rtnl_tc_get_ifindex(tc), 1);
+	if (!ls->ls_qdisc[i])
+		ls->ls_qdisc[i] = (struct rtnl_qdisc *) tc;
+}
+
+static void build_link_index(void)
+{
+	unsigned int n = nl_cache_nitems(link_cache), size = 64;
+
+	if (tc_due)
+		n += nl_cache_nitems(qdisc_cache);
+
+	while (size < 2 * n)
+		size <<= 1;
+
+	if (size != link_index_size) {
+		xfree(link_index);
+		link_index = xcalloc(size, sizeof(*link_index));
+		link_index_size = size;
+	} else
+		memset(link_index, 0, size * sizeof(*link_index));
+
+	nl_cache_foreach(link_cache, index_link, NULL);
+
+	if (tc_due)
+		nl_cache_foreach(qdisc_cache, index_qdisc, NULL);
+}
+
+/* Qdiscs which can have neither classes nor filters attached */
+static const char *leaf_qdiscs[] = {
+	"noqueue",
+	"pfifo_fast",
+	"pfifo",
+	"bfifo",
+	"pfifo_head_drop",
+	"codel",
+	"pie",
+	"fq",
+};
+
+static int qdisc_is_leaf(struct rtnl_tc *tc)
+{
+	const char *kind = rtnl_tc_get_kind(tc);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(leaf_qdiscs); i++)
+		if (!strcmp(kind, leaf_qdiscs[i]))
+			return 1;
+
+	return 0;
+}
+
 static void update_tc_attrs(struct element *e, struct rtnl_tc *tc)
 {
 	int i;
@@ -672,6 +801,9 @@ static void handle_qdisc(struct nl_object *obj, void *arg)
 
 	ndata.parent = e;
 
+	if (qdisc_is_leaf(tc))
+		return;
+
 	find_cls(rtnl_tc_get_ifindex(tc), rtnl_tc_get_handle(tc), &ndata);
 
 	if (rtnl_tc_get_parent(tc) == TC_H_ROOT) {
@@ -684,36 +816,33 @@ static void handle_qdisc(struct nl_object *obj, void *arg)
 
 static void handle_tc(struct element *e, struct rtnl_link *link)
 {
-	struct rtnl_qdisc *qdisc;
-	struct nl_cache *class_cache;
+	struct link_slot *ls;
+	struct nl_cache *class_cache = NULL;
 	int ifindex = rtnl_link_get_ifindex(link);
 	struct rdata rdata = {
 		.level = 1,
 		.parent = e,
 	};
+	int i, need_classes = 0;
 
-	if (rtnl_class_alloc_cache(sock, ifindex, &class_cache) < 0)
+	if (!(ls = link_slot(ifindex, 0)))
 		return;
 
-	rdata.class_cache = class_cache;
+	/* the class dump costs a round trip per link, avoid it if possible */
+	for (i = 0; i < __QDISC_MAX; i++)
+		if (ls->ls_qdisc[i] &&
+		    !qdisc_is_leaf((struct rtnl_tc *) ls->ls_qdisc[i]))
+			need_classes = 1;
 
-	qdisc = rtnl_qdisc_get_by_parent(qdisc_cache, ifindex, TC_H_ROOT);
-	if (qdisc) {
-		handle_qdisc(OBJ_CAST(qdisc), &rdata);
-		rtnl_qdisc_put(qdisc);
-	}
+	if (need_classes &&
+	    rtnl_class_alloc_cache(sock, ifindex, &class_cache) < 0)
+		return;
 
-	qdisc = rtnl_qdisc_get_by_parent(qdisc_cache, ifindex, 0);
-	if (qdisc) {
-		handle_qdisc(OBJ_CAST(qdisc), &rdata);
-		rtnl_qdisc_put(qdisc);
-	}
+	rdata.class_cache = class_cache;
 
-	qdisc = rtnl_qdisc_get_by_parent(qdisc_cache, ifindex, TC_H_INGRESS);
-	if (qdisc) {
-		handle_qdisc(OBJ_CAST(qdisc), &rdata);
-		rtnl_qdisc_put(qdisc);
-	}
+	for (i = 0; i < __QDISC_MAX; i++)
+		if (ls->ls_qdisc[i])
+			handle_qdisc(OBJ_CAST(ls->ls_qdisc[i]), &rdata);
 
 	nl_cache_free(class_cache);
 }
@@ -776,12 +905,12 @@ static void do_link(struct nl_object *obj, void *arg)
 
 	/* Check if the interface is a slave of another interface */
 	if ((master_ifindex = rtnl_link_get_link(link))) {
-		char parent[IFNAMSIZ+1];
-
-		rtnl_link_i2name(link_cache, master_ifindex,
-				 parent, sizeof(parent));
+		struct link_slot *ls = link_slot(master_ifindex, 0);
 
-		e_parent = element_lookup(grp, parent, master_ifindex, NULL, 0);
+		if (ls && ls->ls_link)
+			e_parent = element_lookup(grp,
+						  rtnl_link_get_name(ls->ls_link),
+						  master_ifindex, NULL, 0);
 	}
 
 	if (!(e = element_lookup(grp, rtnl_link_get_name(link),
@@ -820,8 +949,12 @@ static void do_link(struct nl_object *obj, void *arg)
 		attr_update(e, m->attrid, c_rx, c_tx, flags);
 	}
 
-	if (!c_notc && qdisc_cache)
+	if (tc_due) {
+		struct sched_class *prev = sched_enter(tc_sched);
+
 		handle_tc(e, link);
+		sched_enter(prev);
+	}
 
 	element_notify_update(e, NULL);
 	element_lifesign(e, 1);
@@ -836,12 +969,19 @@ static void netlink_read(void)
 		goto disable;
 	}
 
-	if (qdisc_cache &&
+	tc_due = !c_notc && qdisc_cache && sched_due(tc_sched);
+
+	if (tc_due &&
 	    (err = nl_cache_resync(sock, qdisc_cache, NULL, NULL)) < 0) {
 		fprintf(stderr, "Unable to resync qdisc cache: %s\n", nl_geterror(err));
 		goto disable;
 	}
 
+	/* the group belongs to the context being read, see libbmon */
+	if (!(grp = group_lookup(DEFAULT_GROUP, GROUP_CREATE)))
+		BUG();
+
+	build_link_index();
 	nl_cache_foreach(link_cache, do_link, NULL);
 
 	return;
@@ -855,6 +995,7 @@ static void netlink_shutdown(void)
 	nl_cache_free(link_cache);
 	nl_cache_free(qdisc_cache);
 	nl_socket_free(sock);
+	xfree(link_index);
 }
 
 static void netlink_use_bit(struct attr_map *map, const int size)
@@ -870,29 +1011,6 @@ static void netlink_use_bit(struct attr_map *map, const int size)
 
 static int netlink_do_init(void)
 {
-	int err;
-
-	if (!(sock = nl_socket_alloc())) {
-		fprintf(stderr, "Unable to allocate netlink socket\n");
-		goto disable;
-	}
-
-	if ((err = nl_connect(sock, NETLINK_ROUTE)) < 0) {
-		fprintf(stderr, "Unable to connect netlink socket: %s\n", nl_geterror(err));
-		goto disable;
-	}
-
-	if ((err = rtnl_link_alloc_cache(sock, AF_UNSPEC, &link_cache)) < 0) {
-		fprintf(stderr, "Unable to allocate link cache: %s\n", nl_geterror(err));
-		goto disable;
-	}
-
-	if ((err = rtnl_qdisc_alloc_cache(sock, &qdisc_cache)) < 0) {
-		fprintf(stderr, "Warning: Unable to allocate qdisc cache: %s\n", nl_geterror(err));
-		fprintf(stderr, "Disabling QoS statistics.\n");
-		qdisc_cache = NULL;
-	}
-
 	netlink_use_bit(link_attrs, ARRAY_SIZE(link_attrs));
 	netlink_use_bit(tc_attrs, ARRAY_SIZE(tc_attrs));
 	if (attr_map_load(link_attrs, ARRAY_SIZE(link_attrs)) ||
@@ -902,32 +1020,54 @@ static int netlink_do_init(void)
 	if (!(grp = group_lookup(DEFAULT_GROUP, GROUP_CREATE)))
 		BUG();
 
-	return 0;
+	tc_sched = sched_lookup(SCHED_INPUT, "netlink.tc");
 
-disable:
-	return -EOPNOTSUPP;
+	return 0;
 }
 
+/*
+ * Probing only asks for a single link, the caches allocated are empty
+ * and filled by the first read. Dumping all links here as well would
+ * double the startup time on hosts with many links.
+ */
 static int netlink_probe(void)
 {
-	struct nl_sock *sock;
-	struct nl_cache *lc;
-	int ret = 0;
+	struct rtnl_link *lo;
+	int err;
+
+	if (sock)
+		return 1;
 
 	if (!(sock = nl_socket_alloc()))
 		return 0;
 
 	if (nl_connect(sock, NETLINK_ROUTE) < 0)
-		return 0;
+		goto errout;
+
+	/* the loopback device is ifindex 1 in every namespace */
+	if ((err = rtnl_link_get_kernel(sock, 1, NULL, &lo)) < 0 &&
+	    err != -NLE_OBJ_NOTFOUND && err != -NLE_NODEV)
+		goto errout;
+
+	if (err == 0)
+		rtnl_link_put(lo);
+
+	if (nl_cache_alloc_name("route/link", &link_cache) < 0)
+		goto errout;
 
-	if (rtnl_link_alloc_cache(sock, AF_UNSPEC, &lc) == 0) {
-		nl_cache_free(lc);
-		ret = 1;
+	if (!c_notc &&
+	    (err = nl_cache_alloc_name("route/qdisc", &qdisc_cache)) < 0) {
+		fprintf(stderr, "Warning: Unable to allocate qdisc cache: %s\n", nl_geterror(err));
+		fprintf(stderr, "Disabling QoS statistics.\n");
+		qdisc_cache = NULL;
 	}
 
-	nl_socket_free(sock);
+	return 1;
 
-	return ret;
+errout:
+	nl_socket_free(sock);
+	sock = NULL;
+	return 0;
 }
 
 static void print_help(void)
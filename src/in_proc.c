@@ -107,6 +107,10 @@ static void proc_read(void)
 	if (!(fd = fopen(c_path, "r")))
 		quit("Unable to open file %s: %s\n", c_path, strerror(errno));
 
+	/* every libbmon context has groups of its own */
+	if (!(grp = group_lookup(c_group, GROUP_CREATE)))
+		BUG();
+
 	/* Ignore header */
 	unused = fgets(buf, sizeof(buf), fd);
 	unused = fgets(buf, sizeof(buf), fd);
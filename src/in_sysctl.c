@@ -144,6 +144,9 @@ sysctl_read(void)
 	size_t n;
 	char *buf, *next, *lim;
 
+	if (!(grp = group_lookup(DEFAULT_GROUP, GROUP_CREATE)))
+		BUG();
+
 	if (sysctl(mib, 6, NULL, &n, NULL, 0) < 0)
 		quit("sysctl() failed");
 
@@ -26,6 +26,8 @@
 #include <bmon/bmon.h>
 #include <bmon/input.h>
 #include <bmon/module.h>
+#include <bmon/context.h>
+#include <bmon/scheduler.h>
 #include <bmon/utils.h>
 
 static struct bmon_subsys input_subsys;
@@ -70,7 +72,50 @@ static void activate_default(void)
 
 void input_read(void)
 {
-	module_foreach_run_enabled(&input_subsys);
+	struct bmon_ctx *ctx = bmon_ctx;
+	struct bmon_module *m;
+	int i;
+
+	if (ctx->c_flags & BMON_CTX_OWN_INPUTS) {
+		for (i = 0; i < ctx->c_ninputs; i++)
+			if (ctx->c_inputs[i]->m_do)
+				ctx->c_inputs[i]->m_do();
+		return;
+	}
+
+	list_for_each_entry(m, &input_subsys.s_mod_list, m_list) {
+		if (!(m->m_flags & BMON_MODULE_ENABLED) || !m->m_do)
+			continue;
+
+		if (!m->m_sched)
+			m->m_sched = sched_lookup(SCHED_INPUT, m->m_name);
+
+		if (!sched_due(m->m_sched))
+			continue;
+
+		sched_enter(m->m_sched);
+		m->m_do();
+	}
+}
+
+/* Look up the timers of all enabled inputs before sampling starts */
+void input_schedule(void)
+{
+	struct bmon_module *m;
+
+	list_for_each_entry(m, &input_subsys.s_mod_list, m_list)
+		if ((m->m_flags & BMON_MODULE_ENABLED) && !m->m_sched)
+			m->m_sched = sched_lookup(SCHED_INPUT, m->m_name);
+}
+
+void input_init(void)
+{
+	module_init_subsys(&input_subsys);
+}
+
+int input_enable(module_conf_t *m, struct bmon_module **result)
+{
+	return module_enable(&input_subsys, m, result);
 }
 
 int input_set(const char *name)
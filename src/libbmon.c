@@ -0,0 +1,378 @@
+/*
+ * libbmon.c		Embeddable Collection Engine
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/context.h>
+#include <bmon/collector.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/history.h>
+#include <bmon/input.h>
+#include <bmon/attr.h>
+#include <bmon/utils.h>
+#include <bmon/libbmon.h>
+
+/* 1 once configured, negative error code if the configuration failed */
+static int configured;
+
+/*
+ * Calls fn with quit() returning here instead of terminating the
+ * program of the caller. Returns the value returned by fn or -EINVAL if
+ * it quit, the reason has been printed already. Whatever fn was doing
+ * to the context @ctx is left half done, the context is marked failed.
+ */
+static int guarded(struct bmon_ctx *ctx, int (*fn)(void *), void *arg)
+{
+	jmp_buf env, *prev = quit_env;
+	int err;
+
+	if (setjmp(env)) {
+		quit_env = prev;
+		if (ctx)
+			ctx->c_flags |= BMON_CTX_FAILED;
+		return -EINVAL;
+	}
+
+	quit_env = &env;
+	err = fn(arg);
+	quit_env = prev;
+
+	return err;
+}
+
+static int do_configure(void *arg)
+{
+	const char *configfile = arg;
+
+	conf_init_pre();
+
+	if (configfile) {
+		set_configfile(configfile);
+		configfile_read();
+	}
+
+	conf_init_post();
+	input_init();
+
+	return 0;
+}
+
+int bmon_configure(const char *configfile)
+{
+	int err;
+
+	if (configured > 0)
+		return -EBUSY;
+
+	/* parts of a failed configuration may have been applied already */
+	if (configured < 0)
+		return configured;
+
+	if (configfile && access(configfile, R_OK) < 0)
+		return -errno;
+
+	if ((err = guarded(NULL, do_configure, (void *) configfile)) < 0) {
+		configured = err;
+		return err;
+	}
+
+	configured = 1;
+
+	return 0;
+}
+
+/* The engine works on the global context, point it to ctx for a call */
+static struct bmon_ctx *ctx_enter(struct bmon_ctx *ctx)
+{
+	struct bmon_ctx *prev = bmon_ctx;
+
+	bmon_ctx = ctx;
+
+	return prev;
+}
+
+static void ctx_leave(struct bmon_ctx *prev)
+{
+	bmon_ctx = prev;
+}
+
+struct bmon_ctx *bmon_ctx_new(void)
+{
+	struct bmon_ctx *ctx;
+
+	if (configured <= 0 && bmon_configure(NULL) < 0)
+		return NULL;
+
+	ctx = xcalloc(1, sizeof(*ctx));
+	bmon_ctx_init(ctx);
+	ctx->c_flags |= BMON_CTX_OWN_INPUTS;
+
+	return ctx;
+}
+
+void bmon_ctx_free(struct bmon_ctx *ctx)
+{
+	struct bmon_ctx *prev;
+
+	if (!ctx)
+		return;
+
+	prev = ctx_enter(ctx);
+	group_free_all();
+	ctx_leave(prev);
+
+	xfree(ctx->c_inputs);
+	xfree(ctx);
+}
+
+/* modules keep pointers to their options, see module_set() */
+static LIST_HEAD(input_confs);
+
+struct enable_arg {
+	module_conf_t *		m;
+	struct bmon_module *	mod;
+};
+
+static int do_enable(void *arg)
+{
+	struct enable_arg *ea = arg;
+
+	return input_enable(ea->m, &ea->mod);
+}
+
+int bmon_ctx_enable_input(struct bmon_ctx *ctx, const char *spec)
+{
+	struct enable_arg ea;
+	struct bmon_module *mod;
+	char *buf;
+	int i, err;
+
+	/* parse_module() terminates on empty module names */
+	if ((ctx->c_flags & BMON_CTX_FAILED) || !*spec || *spec == ':')
+		return -EINVAL;
+
+	buf = strdup(spec);
+	ea.m = parse_module(buf);
+	xfree(buf);
+
+	/* modules may quit() on invalid options or when probing */
+	err = guarded(ctx, do_enable, &ea);
+	list_add_tail(&ea.m->m_list, &input_confs);
+
+	if (err < 0)
+		return err;
+
+	mod = ea.mod;
+
+	for (i = 0; i < ctx->c_ninputs; i++)
+		if (ctx->c_inputs[i] == mod)
+			return 0;
+
+	ctx->c_inputs = xrealloc(ctx->c_inputs,
+				 (ctx->c_ninputs + 1) * sizeof(mod));
+	ctx->c_inputs[ctx->c_ninputs++] = mod;
+
+	return 0;
+}
+
+static int do_tick(void *arg)
+{
+	collector_read();
+
+	return 0;
+}
+
+int bmon_ctx_tick(struct bmon_ctx *ctx)
+{
+	struct bmon_ctx *prev;
+	int err;
+
+	if (ctx->c_flags & BMON_CTX_FAILED)
+		return -EINVAL;
+
+	prev = ctx_enter(ctx);
+	err = guarded(ctx, do_tick, NULL);
+
+	ctx_leave(prev);
+
+	return err;
+}
+
+static int foreach_element(struct list_head *list,
+			   int (*cb)(struct bmon_element *, void *), void *arg)
+{
+	struct element *e;
+	int err;
+
+	list_for_each_entry(e, list, e_list) {
+		if ((err = cb((struct bmon_element *) e, arg)))
+			return err;
+
+		if ((err = foreach_element(&e->e_childs, cb, arg)))
+			return err;
+	}
+
+	return 0;
+}
+
+int bmon_ctx_foreach_element(struct bmon_ctx *ctx,
+			     int (*cb)(struct bmon_element *, void *),
+			     void *arg)
+{
+	struct element_group *g;
+	int err;
+
+	if (ctx->c_flags & BMON_CTX_FAILED)
+		return -EINVAL;
+
+	list_for_each_entry(g, &ctx->c_groups, g_list)
+		if ((err = foreach_element(&g->g_elements, cb, arg)))
+			return err;
+
+	return 0;
+}
+
+const char *bmon_element_name(struct bmon_element *be)
+{
+	return ((struct element *) be)->e_name;
+}
+
+const char *bmon_element_group(struct bmon_element *be)
+{
+	return ((struct element *) be)->e_group->g_name;
+}
+
+struct bmon_element *bmon_element_parent(struct bmon_element *be)
+{
+	return (struct bmon_element *) ((struct element *) be)->e_parent;
+}
+
+unsigned int bmon_element_level(struct bmon_element *be)
+{
+	return ((struct element *) be)->e_level;
+}
+
+int bmon_element_foreach_attr(struct bmon_element *be,
+			      int (*cb)(struct bmon_element *, const char *,
+					void *),
+			      void *arg)
+{
+	struct element *e = (struct element *) be;
+	struct attr *a;
+	int err;
+
+	list_for_each_entry(a, &e->e_attr_sorted, a_sort_list)
+		if ((err = cb(be, a->a_def->ad_name, arg)))
+			return err;
+
+	return 0;
+}
+
+static struct attr *lookup_attr(struct bmon_element *be, const char *name)
+{
+	struct attr_def *def;
+
+	if (!(def = attr_def_lookup(name)))
+		return NULL;
+
+	return attr_lookup((struct element *) be, def->ad_id);
+}
+
+int bmon_element_rate(struct bmon_element *be, const char *name,
+		      struct bmon_rate *r)
+{
+	struct attr *a;
+
+	if (!(a = lookup_attr(be, name)))
+		return -ENOENT;
+
+	memset(r, 0, sizeof(*r));
+
+	if (a->a_flags & ATTR_RX_ENABLED) {
+		r->flags |= BMON_RATE_RX;
+		r->rx_total = rate_get_total(&a->a_rx_rate);
+		r->rx_rate = a->a_rx_rate.r_rate;
+	}
+
+	if (a->a_flags & ATTR_TX_ENABLED) {
+		r->flags |= BMON_RATE_TX;
+		r->tx_total = rate_get_total(&a->a_tx_rate);
+		r->tx_rate = a->a_tx_rate.r_rate;
+	}
+
+	return 0;
+}
+
+int bmon_element_history(struct bmon_element *be, const char *name,
+			 const char *history, int tx, double *buf, int n)
+{
+	struct history *h;
+	struct attr *a;
+	uint64_t *data;
+	int i;
+
+	if (!(a = lookup_attr(be, name)))
+		return -ENOENT;
+
+	if (!history_def_lookup(history))
+		return -ENOENT;
+
+	/* keeps the history from being evicted by the memory budget */
+	history_viewed(a);
+	attr_start_collecting_history(a);
+
+	list_for_each_entry(h, &a->a_history_list, h_list) {
+		if (strcmp(h->h_definition->hd_name, history))
+			continue;
+
+		if (n <= 0)
+			return 0;
+
+		data = xcalloc(n, sizeof(*data));
+		n = history_copy(h, tx ? &h->h_tx : &h->h_rx, HISTORY_MEAN,
+				 data, n);
+
+		for (i = 0; i < n; i++)
+			buf[i] = (data[i] == HISTORY_UNKNOWN) ?
+					NAN : (double) data[i];
+
+		xfree(data);
+		return n;
+	}
+
+	return 0;
+}
+
+static void __exit libbmon_exit(void)
+{
+	module_conf_t *m, *n;
+
+	list_for_each_entry_safe(m, n, &input_confs, m_list) {
+		list_del(&m->m_list);
+		module_conf_free(m);
+	}
+}
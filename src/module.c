@@ -158,6 +158,35 @@ int module_set(struct bmon_subsys *ss, const char *name)
 	return 0;
 }
 
+/**
+ * Enable module without terminating on errors
+ * @ss		Subsystem
+ * @m		Module name and options, see parse_module_param()
+ * @result	Enabled module
+ *
+ * Used by libbmon. Modules are shared by all contexts and configured
+ * only once, the options are ignored if the module is enabled already.
+ * Returns 0, -ENOENT if the module does not exist or -EINVAL if it
+ * failed to probe.
+ */
+int module_enable(struct bmon_subsys *ss, module_conf_t *m,
+		  struct bmon_module **result)
+{
+	struct bmon_module *mod;
+	int err;
+
+	if (!(mod = module_lookup(ss, m->m_name)))
+		return -ENOENT;
+
+	if (!(mod->m_flags & BMON_MODULE_ENABLED) &&
+	    (err = module_configure(mod, m)) < 0)
+		return err;
+
+	*result = mod;
+
+	return 0;
+}
+
 static void __module_init(struct bmon_module *m)
 {
 	if (m->m_init) {
@@ -167,6 +196,12 @@ static void __module_init(struct bmon_module *m)
 	}
 }
 
+/* Initializes the modules of a subsystem without enabling a default */
+void module_init_subsys(struct bmon_subsys *ss)
+{
+	module_foreach(ss, __module_init);
+}
+
 void module_init(void)
 {
 	struct bmon_subsys *ss;
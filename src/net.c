@@ -0,0 +1,181 @@
+/*
+ * net.c		Network Helpers
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/net.h>
+#include <bmon/utils.h>
+
+/**
+ * Split address into host and port
+ * @addr	"host:port", "[v6addr]:port", ":port", "port" or "host"
+ * @host	Buffer for host, empty if not given
+ * @hostlen	Size of host buffer
+ * @port	Buffer for port, left untouched if not given
+ * @portlen	Size of port buffer
+ *
+ * Returns 0 or -EINVAL.
+ */
+int net_split_addr(const char *addr, char *host, size_t hostlen,
+		   char *port, size_t portlen)
+{
+	const char *p, *end;
+
+	host[0] = '\0';
+
+	if (addr[0] == '[') {
+		if (!(end = strchr(addr, ']')))
+			return -EINVAL;
+
+		p = end[1] == ':' ? end + 2 : NULL;
+		addr++;
+	} else if ((p = strchr(addr, ':')) && p == strrchr(addr, ':')) {
+		end = p++;
+	} else if (addr[strspn(addr, "0123456789")] == '\0') {
+		end = addr;
+		p = addr;
+	} else {
+		/* host only, a bare IPv6 address has more than one colon */
+		end = addr + strlen(addr);
+		p = NULL;
+	}
+
+	if (end - addr >= hostlen)
+		return -EINVAL;
+
+	memcpy(host, addr, end - addr);
+	host[end - addr] = '\0';
+
+	if (p && *p) {
+		if (strlen(p) >= portlen)
+			return -EINVAL;
+		strcpy(port, p);
+	}
+
+	return 0;
+}
+
+/**
+ * Create listening TCP socket
+ * @addr	Address to listen on, see net_split_addr()
+ * @port	Port to use if the address does not specify one
+ *
+ * Listens on all addresses if no host is given. Returns the socket or a
+ * negative error code, the reason has been printed already.
+ */
+int net_listen(const char *addr, const char *port)
+{
+	struct addrinfo hints = {
+		.ai_family	= AF_UNSPEC,
+		.ai_socktype	= SOCK_STREAM,
+		.ai_flags	= AI_PASSIVE,
+	}, *res, *ai;
+	char host[256], service[32];
+	int fd = -1, err, one = 1;
+
+	snprintf(service, sizeof(service), "%s", port);
+
+	if (net_split_addr(addr, host, sizeof(host),
+			   service, sizeof(service)) < 0) {
+		fprintf(stderr, "Invalid address \"%s\"\n", addr);
+		return -EINVAL;
+	}
+
+	if ((err = getaddrinfo(host[0] ? host : NULL, service, &hints, &res))) {
+		fprintf(stderr, "Unable to resolve \"%s\": %s\n",
+			addr, gai_strerror(err));
+		return -ENOENT;
+	}
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+			    ai->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+		    listen(fd, SOMAXCONN) == 0)
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if (fd < 0) {
+		err = errno;
+		fprintf(stderr, "Unable to listen on \"%s\": %s\n",
+			addr, strerror(err));
+		return -err;
+	}
+
+	return fd;
+}
+
+/**
+ * Resolve address of remote peer
+ * @addr	Address of peer, see net_split_addr()
+ * @port	Port to use if the address does not specify one
+ * @socktype	SOCK_STREAM or SOCK_DGRAM
+ * @ss		Storage for the resolved address
+ * @len	Length of the resolved address
+ *
+ * Resolution may block, callers should resolve once and reuse the
+ * address for reconnects. Returns 0 or a negative error code, the
+ * reason has been printed already.
+ */
+int net_resolve(const char *addr, const char *port, int socktype,
+		struct sockaddr_storage *ss, socklen_t *len)
+{
+	struct addrinfo hints = {
+		.ai_family	= AF_UNSPEC,
+		.ai_socktype	= socktype,
+	}, *res;
+	char host[256], service[32];
+	int err;
+
+	snprintf(service, sizeof(service), "%s", port);
+
+	if (net_split_addr(addr, host, sizeof(host),
+			   service, sizeof(service)) < 0) {
+		fprintf(stderr, "Invalid address \"%s\"\n", addr);
+		return -EINVAL;
+	}
+
+	if ((err = getaddrinfo(host[0] ? host : NULL, service, &hints, &res))) {
+		fprintf(stderr, "Unable to resolve \"%s\": %s\n",
+			addr, gai_strerror(err));
+		return -ENOENT;
+	}
+
+	memcpy(ss, res->ai_addr, res->ai_addrlen);
+	*len = res->ai_addrlen;
+
+	freeaddrinfo(res);
+
+	return 0;
+}
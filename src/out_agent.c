@@ -0,0 +1,666 @@
+/*
+ * out_agent.c		Agent, streams elements to a collector
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/output.h>
+#include <bmon/group.h>
+#include <bmon/element.h>
+#include <bmon/attr.h>
+#include <bmon/agent.h>
+#include <bmon/net.h>
+#include <bmon/outbuf.h>
+#include <bmon/utils.h>
+
+#include <poll.h>
+
+#define AGENT_DEFAULT_QUEUE	(1024 * 1024)
+#define AGENT_RECONNECT_DELAY	1	/* seconds */
+#define AGENT_HASH_SIZE		256
+
+static char *c_to;
+static char *c_name;
+static size_t c_queue_size = AGENT_DEFAULT_QUEUE;
+
+struct agent_value
+{
+	uint8_t			v_flags;
+	uint64_t		v_rx;
+	uint64_t		v_tx;
+};
+
+/*
+ * Element as known to the collector. The key consists of the group name
+ * followed by name and id of the element and all its parents, so the
+ * key of the parent is a prefix of the key of the element.
+ */
+struct agent_elem
+{
+	uint32_t		ae_id;
+	char *			ae_key;
+	size_t			ae_keylen;
+
+	unsigned long		ae_seen;
+	/* connection the element has been announced on */
+	unsigned int		ae_conn;
+
+	/* values last sent, indexed by attribute id */
+	struct agent_value *	ae_values;
+	unsigned int		ae_nvalues;
+
+	struct agent_elem *	ae_hash_next;
+	struct list_head	ae_list;
+};
+
+static LIST_HEAD(elements);
+static struct agent_elem *elem_hash[AGENT_HASH_SIZE];
+
+static uint32_t *free_ids;
+static unsigned int nfree_ids, free_ids_size;
+static uint32_t next_id;
+
+/* connection each attribute has been announced on, indexed by id */
+static unsigned int *attr_conn;
+static unsigned int nattr_conn;
+
+/* elements of the last walk, valid while the element tree is unchanged */
+struct walk_slot
+{
+	struct element *	w_element;
+	struct agent_elem *	w_elem;
+};
+
+static struct walk_slot *walk;
+static unsigned int nwalk, walk_size, walk_valid;
+static unsigned int walk_tree_gen;
+static unsigned long tick;
+
+/* frames not yet sent start at qoff */
+static struct outbuf queue;
+static size_t qoff;
+
+static struct sockaddr_storage peer;
+static socklen_t peer_len;
+static int sock = -1;
+static int connecting;
+static time_t last_connect;
+/* bumped for every connection, everything is announced again */
+static unsigned int conn_gen;
+
+static void put_varint(struct outbuf *ob, uint64_t v)
+{
+	while (v >= 0x80) {
+		outbuf_putc(ob, (v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+
+	outbuf_putc(ob, v);
+}
+
+static void put_delta(struct outbuf *ob, uint64_t new, uint64_t old)
+{
+	int64_t d = new - old;
+
+	/* zigzag, small negative deltas stay short */
+	put_varint(ob, ((uint64_t) d << 1) ^ (uint64_t) (d >> 63));
+}
+
+static void put_str(struct outbuf *ob, const char *s)
+{
+	size_t len = strlen(s);
+
+	put_varint(ob, len);
+	outbuf_put(ob, s, len);
+}
+
+static size_t msg_begin(struct outbuf *ob, int type)
+{
+	size_t start = ob->ob_len;
+
+	outbuf_putc(ob, type);
+	outbuf_put(ob, "\0\0", 2);
+
+	return start;
+}
+
+static void msg_end(struct outbuf *ob, size_t start)
+{
+	size_t len = ob->ob_len - start - AGENT_HDR_LEN;
+
+	if (len > AGENT_MAX_PAYLOAD) {
+		DBG("Dropping oversized message of %zu bytes", len);
+		ob->ob_len = start;
+		return;
+	}
+
+	ob->ob_buf[start + 1] = len >> 8;
+	ob->ob_buf[start + 2] = len & 0xff;
+}
+
+static unsigned int hash_key(const char *key, size_t len)
+{
+	unsigned int h = 5381;
+
+	while (len--)
+		h = (h * 33) ^ (unsigned char) *key++;
+
+	return h % AGENT_HASH_SIZE;
+}
+
+static struct agent_elem *elem_lookup(const char *key, size_t len)
+{
+	struct agent_elem *ae;
+
+	for (ae = elem_hash[hash_key(key, len)]; ae; ae = ae->ae_hash_next)
+		if (ae->ae_keylen == len && !memcmp(ae->ae_key, key, len))
+			return ae;
+
+	return NULL;
+}
+
+static struct agent_elem *elem_new(const char *key, size_t len)
+{
+	struct agent_elem *ae;
+	unsigned int h = hash_key(key, len);
+
+	ae = xcalloc(1, sizeof(*ae));
+	ae->ae_id = nfree_ids ? free_ids[--nfree_ids] : next_id++;
+	ae->ae_key = xcalloc(1, len);
+	memcpy(ae->ae_key, key, len);
+	ae->ae_keylen = len;
+
+	ae->ae_hash_next = elem_hash[h];
+	elem_hash[h] = ae;
+	list_add_tail(&ae->ae_list, &elements);
+
+	return ae;
+}
+
+static void elem_free(struct agent_elem *ae)
+{
+	struct agent_elem **pp;
+
+	pp = &elem_hash[hash_key(ae->ae_key, ae->ae_keylen)];
+	while (*pp != ae)
+		pp = &(*pp)->ae_hash_next;
+	*pp = ae->ae_hash_next;
+
+	list_del(&ae->ae_list);
+
+	if (nfree_ids >= free_ids_size) {
+		free_ids_size = free_ids_size ? free_ids_size * 2 : 64;
+		free_ids = xrealloc(free_ids, free_ids_size * sizeof(*free_ids));
+	}
+
+	free_ids[nfree_ids++] = ae->ae_id;
+
+	xfree(ae->ae_key);
+	xfree(ae->ae_values);
+	xfree(ae);
+}
+
+/* Returns the length of the key, -1 if it does not fit */
+static int build_key(char *buf, size_t size, struct element *e)
+{
+	int off, n;
+
+	if (e->e_parent)
+		off = build_key(buf, size, e->e_parent);
+	else
+		off = snprintf(buf, size, "%s", e->e_group->g_name) + 1;
+
+	if (off < 0 || off >= size)
+		return -1;
+
+	n = snprintf(buf + off, size - off, "%s%c%u", e->e_name, 0, e->e_id);
+	if (n < 0 || off + n + 1 >= size)
+		return -1;
+
+	return off + n + 1;
+}
+
+static void announce_attr(struct attr_def *def)
+{
+	size_t start;
+
+	if (def->ad_id >= nattr_conn) {
+		attr_conn = xrealloc(attr_conn,
+				     (def->ad_id + 1) * sizeof(*attr_conn));
+		memset(attr_conn + nattr_conn, 0,
+		       (def->ad_id + 1 - nattr_conn) * sizeof(*attr_conn));
+		nattr_conn = def->ad_id + 1;
+	}
+
+	if (attr_conn[def->ad_id] == conn_gen)
+		return;
+
+	start = msg_begin(&queue, AGENT_MSG_ATTR);
+	put_varint(&queue, def->ad_id);
+	put_varint(&queue, def->ad_type);
+	put_varint(&queue, def->ad_flags &
+		   (ATTR_FORCE_HISTORY | ATTR_IGNORE_OVERFLOWS | ATTR_TRUE_64BIT));
+	put_str(&queue, def->ad_name);
+	put_str(&queue, def->ad_description);
+	put_str(&queue, def->ad_unit->u_name);
+	msg_end(&queue, start);
+
+	attr_conn[def->ad_id] = conn_gen;
+}
+
+static void announce_attr_cb(struct element *e, struct attr *a, void *arg)
+{
+	announce_attr(a->a_def);
+}
+
+static const char *def_name(struct attr_def *def)
+{
+	if (!def)
+		return "";
+
+	announce_attr(def);
+
+	return def->ad_name;
+}
+
+static void announce_elem(struct element_group *g, struct element *e,
+			  struct agent_elem *ae, struct agent_elem *parent)
+{
+	const char *major, *minor, *usage;
+	size_t start;
+
+	major = def_name(e->e_key_attr[GT_MAJOR]);
+	minor = def_name(e->e_key_attr[GT_MINOR]);
+	usage = def_name(e->e_usage_attr);
+
+	start = msg_begin(&queue, AGENT_MSG_ELEMENT);
+	put_varint(&queue, ae->ae_id);
+	put_varint(&queue, parent ? parent->ae_id + 1 : 0);
+	put_varint(&queue, e->e_id);
+	put_str(&queue, g->g_name);
+	put_str(&queue, e->e_name);
+	put_str(&queue, major);
+	put_str(&queue, minor);
+	put_str(&queue, usage);
+	msg_end(&queue, start);
+
+	/* the first sample carries the full values */
+	memset(ae->ae_values, 0, ae->ae_nvalues * sizeof(*ae->ae_values));
+	ae->ae_conn = conn_gen;
+}
+
+static void sample_attr(struct element *e, struct attr *a, void *arg)
+{
+	struct agent_elem *ae = arg;
+	struct agent_value *v;
+	unsigned int id = a->a_def->ad_id;
+	uint64_t rx, tx;
+	uint8_t flags = 0;
+
+	if (id >= ae->ae_nvalues) {
+		ae->ae_values = xrealloc(ae->ae_values,
+					 (id + 1) * sizeof(*ae->ae_values));
+		memset(ae->ae_values + ae->ae_nvalues, 0,
+		       (id + 1 - ae->ae_nvalues) * sizeof(*ae->ae_values));
+		ae->ae_nvalues = id + 1;
+	}
+
+	v = &ae->ae_values[id];
+
+	if (a->a_flags & ATTR_RX_ENABLED)
+		flags |= AGENT_RX;
+	if (a->a_flags & ATTR_TX_ENABLED)
+		flags |= AGENT_TX;
+
+	rx = rate_get_total(&a->a_rx_rate);
+	tx = rate_get_total(&a->a_tx_rate);
+
+	if (flags == v->v_flags && rx == v->v_rx && tx == v->v_tx)
+		return;
+
+	put_varint(&queue, id);
+	put_varint(&queue, flags);
+	put_delta(&queue, rx, v->v_rx);
+	put_delta(&queue, tx, v->v_tx);
+
+	v->v_flags = flags;
+	v->v_rx = rx;
+	v->v_tx = tx;
+}
+
+static struct agent_elem *elem_get(struct element *e,
+				   struct agent_elem **parent)
+{
+	char key[1024];
+	struct agent_elem *ae;
+	int len, plen;
+
+	/* the key of the parent is a prefix of the key of the element */
+	if (e->e_parent &&
+	    (plen = build_key(key, sizeof(key), e->e_parent)) >= 0)
+		*parent = elem_lookup(key, plen);
+
+	if ((len = build_key(key, sizeof(key), e)) < 0)
+		return NULL;
+
+	if (!(ae = elem_lookup(key, len)))
+		ae = elem_new(key, len);
+
+	return ae;
+}
+
+static void agent_element(struct element_group *g, struct element *e,
+			  void *arg)
+{
+	struct agent_elem *ae, *parent = NULL;
+	struct walk_slot *w;
+	size_t start, body;
+
+	if (nwalk >= walk_size) {
+		walk_size = walk_size ? walk_size * 2 : 64;
+		walk = xrealloc(walk, walk_size * sizeof(*walk));
+	}
+
+	w = &walk[nwalk];
+
+	if (nwalk < walk_valid && w->w_element == e)
+		ae = w->w_elem;
+	else {
+		if (!(ae = elem_get(e, &parent)))
+			return;
+
+		w->w_element = e;
+		w->w_elem = ae;
+		walk_valid = nwalk;
+	}
+
+	nwalk++;
+	ae->ae_seen = tick;
+
+	if (ae->ae_conn != conn_gen) {
+		/* parents are visited first and have been announced */
+		if (e->e_parent && !parent)
+			elem_get(e, &parent);
+
+		announce_elem(g, e, ae, parent);
+	}
+
+	element_foreach_attr(e, announce_attr_cb, NULL);
+
+	start = msg_begin(&queue, AGENT_MSG_SAMPLE);
+	put_varint(&queue, ae->ae_id);
+	body = queue.ob_len;
+	element_foreach_attr(e, sample_attr, ae);
+
+	/* nothing changed */
+	if (queue.ob_len == body)
+		queue.ob_len = start;
+	else
+		msg_end(&queue, start);
+}
+
+static void agent_draw(void)
+{
+	struct agent_elem *ae, *n;
+	size_t start;
+
+	/* skipped ticks are folded into the deltas of the next one */
+	if (sock < 0 || connecting || queue.ob_len - qoff >= c_queue_size)
+		return;
+
+	tick++;
+
+	if (walk_tree_gen != group_tree_gen) {
+		walk_tree_gen = group_tree_gen;
+		walk_valid = 0;
+	}
+
+	nwalk = 0;
+	group_foreach_recursive(agent_element, NULL);
+	walk_valid = nwalk;
+
+	list_for_each_entry_safe(ae, n, &elements, ae_list) {
+		if (ae->ae_seen == tick)
+			continue;
+
+		if (ae->ae_conn == conn_gen) {
+			start = msg_begin(&queue, AGENT_MSG_REMOVE);
+			put_varint(&queue, ae->ae_id);
+			msg_end(&queue, start);
+		}
+
+		elem_free(ae);
+	}
+}
+
+static void disconnect(void)
+{
+	close(sock);
+	sock = -1;
+	connecting = 0;
+
+	/* whatever is queued refers to the old connection */
+	queue.ob_len = qoff = 0;
+}
+
+static void connected(void)
+{
+	size_t start;
+
+	connecting = 0;
+	conn_gen++;
+
+	outbuf_put(&queue, AGENT_MAGIC, AGENT_MAGIC_LEN);
+
+	start = msg_begin(&queue, AGENT_MSG_HELLO);
+	put_str(&queue, c_name);
+	msg_end(&queue, start);
+
+	DBG("Connected to collector %s", c_to);
+}
+
+static int do_connect(void)
+{
+	if (time(NULL) - last_connect < AGENT_RECONNECT_DELAY)
+		return -EAGAIN;
+
+	last_connect = time(NULL);
+
+	sock = socket(peer.ss_family,
+		      SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+
+	if (connect(sock, (struct sockaddr *) &peer, peer_len) < 0) {
+		if (errno != EINPROGRESS) {
+			DBG("Unable to connect to %s: %s", c_to, strerror(errno));
+			disconnect();
+			return -errno;
+		}
+
+		connecting = 1;
+		return 0;
+	}
+
+	connected();
+
+	return 0;
+}
+
+/* Returns 0 once a pending connect has completed */
+static int check_connected(void)
+{
+	struct pollfd pfd = { .fd = sock, .events = POLLOUT };
+	socklen_t len = sizeof(int);
+	int err = 0;
+
+	if (poll(&pfd, 1, 0) <= 0)
+		return -EAGAIN;
+
+	if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+		DBG("Unable to connect to %s: %s", c_to, strerror(err));
+		disconnect();
+		return -ECONNREFUSED;
+	}
+
+	connected();
+
+	return 0;
+}
+
+static void drain(void)
+{
+	ssize_t n;
+
+	while (qoff < queue.ob_len) {
+		n = send(sock, queue.ob_buf + qoff, queue.ob_len - qoff,
+			 MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				DBG("Lost connection to %s: %s",
+				    c_to, strerror(errno));
+				disconnect();
+			}
+			break;
+		}
+
+		qoff += n;
+	}
+
+	if (qoff == queue.ob_len)
+		queue.ob_len = qoff = 0;
+	else if (qoff > queue.ob_len / 2) {
+		queue.ob_len -= qoff;
+		memmove(queue.ob_buf, queue.ob_buf + qoff, queue.ob_len);
+		qoff = 0;
+	}
+}
+
+static void agent_post(void)
+{
+	if (sock < 0 && do_connect() < 0)
+		return;
+
+	if (connecting && check_connected() < 0)
+		return;
+
+	if (sock >= 0 && !connecting)
+		drain();
+}
+
+static int agent_probe(void)
+{
+	char host[256];
+
+	if (net_resolve(c_to, AGENT_DEFAULT_PORT, SOCK_STREAM,
+			&peer, &peer_len) < 0)
+		return 0;
+
+	if (!c_name) {
+		if (gethostname(host, sizeof(host)) < 0)
+			strcpy(host, "localhost");
+		host[sizeof(host) - 1] = '\0';
+		c_name = strdup(host);
+	}
+
+	return 1;
+}
+
+static void agent_shutdown(void)
+{
+	if (sock >= 0)
+		disconnect();
+}
+
+static void print_help(void)
+{
+	printf(
+	"agent - Stream elements to a collector\n" \
+	"\n" \
+	"  Sends all elements and their attributes over TCP to a bmon\n" \
+	"  running the collector input module, which shows them in a\n" \
+	"  group named after this host. Only the difference to the\n" \
+	"  previously sent values is transmitted. Sending never blocks,\n" \
+	"  if the collector falls behind intervals are merged.\n" \
+	"\n" \
+	"  Options:\n" \
+	"    to=ADDR        Collector, host:port or [ipv6]:port\n" \
+	"                   (default: 127.0.0.1:%s)\n" \
+	"    name=NAME      Host name to report (default: hostname)\n" \
+	"    queue=NUM      Bytes queued before intervals are merged\n" \
+	"                   (default: %d)\n" \
+	"\n" \
+	"  Example:\n" \
+	"    bmon -o 'agent:to=10.0.0.1,null'\n" \
+	"\n", AGENT_DEFAULT_PORT, AGENT_DEFAULT_QUEUE);
+}
+
+static void agent_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "to") && value) {
+		xfree(c_to);
+		c_to = strdup(value);
+	} else if (!strcasecmp(type, "name") && value) {
+		xfree(c_name);
+		c_name = strdup(value);
+	} else if (!strcasecmp(type, "queue") && value)
+		c_queue_size = strtoul(value, NULL, 0);
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static struct bmon_module agent_ops = {
+	.m_name		= "agent",
+	.m_probe	= agent_probe,
+	.m_shutdown	= agent_shutdown,
+	.m_do		= agent_draw,
+	.m_post		= agent_post,
+	.m_parse_opt	= agent_parse_opt,
+};
+
+static void __init agent_init(void)
+{
+	c_to = strdup("127.0.0.1");
+
+	output_register(&agent_ops);
+}
+
+static void __exit agent_exit(void)
+{
+	struct agent_elem *ae, *n;
+
+	list_for_each_entry_safe(ae, n, &elements, ae_list)
+		elem_free(ae);
+
+	xfree(free_ids);
+	xfree(attr_conn);
+	xfree(walk);
+	xfree(queue.ob_buf);
+	xfree(c_to);
+	xfree(c_name);
+}
@@ -31,6 +31,7 @@
 #include <bmon/attr.h>
 #include <bmon/graph.h>
 #include <bmon/history.h>
+#include <bmon/outbuf.h>
 #include <bmon/utils.h>
 
 typedef enum diagram_type_e {
@@ -43,6 +44,7 @@ static struct graph_cfg graph_cfg = {
 	.gc_foreground = '*',
 	.gc_background = ' ',
 	.gc_noise = '.',
+	.gc_peak = '+',
 	.gc_unknown = '?',
 	.gc_height = 6,
 };
@@ -51,6 +53,24 @@ static diagram_type_t c_diagram_type = D_LIST;
 static char *c_hist = "second";
 static int c_quit_after = -1;
 
+static struct outbuf ob = OUTBUF_INIT(STDOUT_FILENO);
+
+static void print_usage(float usage)
+{
+	if (usage == FLT_MAX)
+		outbuf_puts(&ob, "   ");
+	else {
+		outbuf_fixed(&ob, usage, 0, 2);
+		outbuf_putc(&ob, '%');
+	}
+}
+
+static void print_rate(double v, int prec, const char *unit, int width)
+{
+	outbuf_fixed(&ob, v, prec, width);
+	outbuf_str(&ob, unit, -3);
+}
+
 static void print_list(struct element *e)
 {
 	char *rxu1 = "", *txu1 = "", *rxu2 = "", *txu2 = "";
@@ -80,20 +100,22 @@ static void print_list(struct element *e)
 		strncat(pad, ")", sizeof(pad) - strlen(pad) - 1);
 	}
 
-	printf("  %-36s %8.*f%-3s %8.*f%-3s ",
-	       pad, rx1prec, rx1, rxu1, rx2prec, rx2, rxu2);
-
-	if (e->e_rx_usage == FLT_MAX)
-		printf("   ");
-	else
-		printf("%2.0f%%", e->e_rx_usage);
-
-	printf("  %8.*f%-3s %8.*f%-3s ", tx1prec, tx1, txu1, tx2prec, tx2, txu2);
-
-	if (e->e_tx_usage == FLT_MAX)
-		printf("   \n");
-	else
-		printf("%2.0f%%\n", e->e_tx_usage);
+	outbuf_puts(&ob, "  ");
+	outbuf_str(&ob, pad, -36);
+	outbuf_putc(&ob, ' ');
+	print_rate(rx1, rx1prec, rxu1, 8);
+	outbuf_putc(&ob, ' ');
+	print_rate(rx2, rx2prec, rxu2, 8);
+	outbuf_putc(&ob, ' ');
+	print_usage(e->e_rx_usage);
+
+	outbuf_puts(&ob, "  ");
+	print_rate(tx1, tx1prec, txu1, 8);
+	outbuf_putc(&ob, ' ');
+	print_rate(tx2, tx2prec, txu2, 8);
+	outbuf_putc(&ob, ' ');
+	print_usage(e->e_tx_usage);
+	outbuf_putc(&ob, '\n');
 }
 
 static void print_attr_detail(struct element *e, struct attr *a, void *arg)
@@ -108,22 +130,31 @@ static void print_attr_detail(struct element *e, struct attr *a, void *arg)
 				   a->a_def->ad_unit,
 				   &tx_u, &txprec);
 
-	printf("  %-36s %12.*f%-3s %12.*f%-3s\n",
-	       a->a_def->ad_description, rxprec, rx, rx_u, txprec, tx, tx_u);
+	outbuf_puts(&ob, "  ");
+	outbuf_str(&ob, a->a_def->ad_description, -36);
+	outbuf_putc(&ob, ' ');
+	print_rate(rx, rxprec, rx_u, 12);
+	outbuf_putc(&ob, ' ');
+	print_rate(tx, txprec, tx_u, 12);
+	outbuf_putc(&ob, '\n');
 }
 
 static void print_details(struct element *e)
 {
-	printf(" %s", e->e_name);
+	outbuf_putc(&ob, ' ');
+	outbuf_puts(&ob, e->e_name);
 
-	if (e->e_id)
-		printf(" (%u)", e->e_id);
+	if (e->e_id) {
+		outbuf_puts(&ob, " (");
+		outbuf_u64(&ob, e->e_id, 0);
+		outbuf_putc(&ob, ')');
+	}
 
-	printf("\n");
+	outbuf_putc(&ob, '\n');
 
 	element_foreach_attr(e, print_attr_detail, NULL);
 
-	printf("\n");
+	outbuf_putc(&ob, '\n');
 }
 
 static void print_table(struct graph *g, struct graph_table *tbl, const char *hdr)
@@ -133,14 +164,20 @@ static void print_table(struct graph *g, struct graph_table *tbl, const char *hd
 	if (!tbl->gt_table)
 		return;
 
-	printf("%s   %s\n", hdr, tbl->gt_y_unit);
+	outbuf_puts(&ob, hdr);
+	outbuf_puts(&ob, "   ");
+	outbuf_puts(&ob, tbl->gt_y_unit ? : "");
+	outbuf_putc(&ob, '\n');
+
+	for (i = (g->g_cfg.gc_height - 1); i >= 0; i--) {
+		outbuf_fixed(&ob, tbl->gt_scale[i], 2, 8);
+		outbuf_putc(&ob, ' ');
+		outbuf_puts(&ob, tbl->gt_table + (i * graph_row_size(&g->g_cfg)));
+		outbuf_putc(&ob, '\n');
+	}
 
-	for (i = (g->g_cfg.gc_height - 1); i >= 0; i--)
-		printf("%8.2f %s\n", tbl->gt_scale[i],
-		    tbl->gt_table + (i * graph_row_size(&g->g_cfg)));
-	
-	printf("         1   5   10   15   20   25   30   35   40   " \
-		"45   50   55   60\n");
+	outbuf_puts(&ob, "         1   5   10   15   20   25   30   35   40   " \
+		    "45   50   55   60\n");
 }
 
 static void __print_graph(struct element *e, struct attr *a, void *arg)
@@ -157,17 +194,16 @@ static void __print_graph(struct element *e, struct attr *a, void *arg)
 		if (strcasecmp(c_hist, h->h_definition->hd_name))
 			continue;
 
-		g = graph_alloc(h, &graph_cfg);
-		graph_refill(g, h);
+		g = graph_get(h, &graph_cfg);
 
-		printf("Interface: %s\n", e->e_name);
-		printf("Attribute: %s\n", a->a_def->ad_description);
+		outbuf_puts(&ob, "Interface: ");
+		outbuf_puts(&ob, e->e_name);
+		outbuf_puts(&ob, "\nAttribute: ");
+		outbuf_puts(&ob, a->a_def->ad_description);
+		outbuf_putc(&ob, '\n');
 
 		print_table(g, &g->g_rx, "RX");
 		print_table(g, &g->g_tx, "TX");
-
-		graph_free(g);
-
 	}
 }
 
@@ -196,15 +232,20 @@ static void ascii_draw_element(struct element_group *g, struct element *e,
 
 static void ascii_draw_group(struct element_group *g, void *arg)
 {
-	if (c_diagram_type == D_LIST)
-		printf("%-37s%10s %11s      %%%10s %11s      %%\n",
-		       g->g_hdr->gh_title,
-		       g->g_hdr->gh_column[0],
-		       g->g_hdr->gh_column[1],
-		       g->g_hdr->gh_column[2],
-		       g->g_hdr->gh_column[3]);
-	else
-		printf("%s\n", g->g_hdr->gh_title);
+	if (c_diagram_type == D_LIST) {
+		outbuf_str(&ob, g->g_hdr->gh_title, -37);
+		outbuf_str(&ob, g->g_hdr->gh_column[0], 10);
+		outbuf_putc(&ob, ' ');
+		outbuf_str(&ob, g->g_hdr->gh_column[1], 11);
+		outbuf_puts(&ob, "      %");
+		outbuf_str(&ob, g->g_hdr->gh_column[2], 10);
+		outbuf_putc(&ob, ' ');
+		outbuf_str(&ob, g->g_hdr->gh_column[3], 11);
+		outbuf_puts(&ob, "      %\n");
+	} else {
+		outbuf_puts(&ob, g->g_hdr->gh_title);
+		outbuf_putc(&ob, '\n');
+	}
 
 	group_foreach_element(g, ascii_draw_element, NULL);
 }
@@ -212,11 +253,17 @@ static void ascii_draw_group(struct element_group *g, void *arg)
 static void ascii_draw(void)
 {
 	group_foreach(ascii_draw_group, NULL);
-	fflush(stdout);
 
 	if (c_quit_after > 0)
-		if (--c_quit_after == 0)
-			exit(0);
+		c_quit_after--;
+}
+
+static void ascii_post(void)
+{
+	outbuf_flush(&ob);
+
+	if (c_quit_after == 0)
+		exit(0);
 }
 
 static void print_help(void)
@@ -238,8 +285,11 @@ static void print_help(void)
 	"    fgchar=CHAR    Foreground character (default: '*')\n" \
 	"    bgchar=CHAR    Background character (default: '.')\n" \
 	"    nchar=CHAR     Noise character (default: ':')\n" \
+	"    pchar=CHAR     Peak character (default: '+')\n" \
 	"    uchar=CHAR     Unknown character (default: '?')\n" \
 	"    height=NUM     Height of graph (default: 6)\n" \
+	"    width=NUM      Width of graph (default: history size)\n" \
+	"    zoom=NUM       Show 2^NUM samples per column (default: 0)\n" \
 	"    xunit=UNIT     X-Axis Unit (default: seconds)\n" \
 	"    yunit=UNIT     Y-Axis Unit (default: dynamic)\n" \
 	"    quitafter=NUM  Quit bmon after NUM outputs\n");
@@ -262,6 +312,8 @@ static void ascii_parse_opt(const char *type, const char *value)
 		graph_cfg.gc_background = value[0];
 	else if (!strcasecmp(type, "nchar") && value)
 		graph_cfg.gc_noise = value[0];
+	else if (!strcasecmp(type, "pchar") && value)
+		graph_cfg.gc_peak = value[0];
 #if 0
 	else if (!strcasecmp(type, "uchar") && value)
 		set_unk_char(value[0]);
@@ -279,6 +331,10 @@ static void ascii_parse_opt(const char *type, const char *value)
 #endif
 	else if (!strcasecmp(type, "height") && value)
 		graph_cfg.gc_height = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "width") && value)
+		graph_cfg.gc_width = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "zoom") && value)
+		graph_cfg.gc_zoom = strtol(value, NULL, 0);
 	else if (!strcasecmp(type, "quitafter") && value)
 		c_quit_after = strtol(value, NULL, 0);
 	else if (!strcasecmp(type, "help")) {
@@ -291,6 +347,7 @@ static void ascii_parse_opt(const char *type, const char *value)
 static struct bmon_module ascii_ops = {
 	.m_name		= "ascii",
 	.m_do		= ascii_draw,
+	.m_post		= ascii_post,
 	.m_parse_opt	= ascii_parse_opt,
 };
 
@@ -0,0 +1,186 @@
+/*
+ * out_csv.c		CSV Output
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/output.h>
+#include <bmon/group.h>
+#include <bmon/element.h>
+#include <bmon/attr.h>
+#include <bmon/outbuf.h>
+#include <bmon/utils.h>
+
+static int c_quit_after = -1;
+static int c_header = 1;
+static struct attr_set c_attrs;
+
+static struct outbuf ob = OUTBUF_INIT(STDOUT_FILENO);
+static double tick_time;
+
+static const char *attr_columns[] = { "rx", "tx", "rxrate", "txrate" };
+
+static void put_rate(float rate)
+{
+	if (isfinite(rate))
+		outbuf_fixed(&ob, rate, 2, 0);
+}
+
+static void draw_element(struct element_group *g, struct element *e, void *arg)
+{
+	struct attr *a;
+	int i;
+
+	outbuf_fixed(&ob, tick_time, 3, 0);
+	outbuf_putc(&ob, ',');
+	outbuf_csv_str(&ob, g->g_name);
+	outbuf_putc(&ob, ',');
+	outbuf_csv_str(&ob, e->e_name);
+	outbuf_putc(&ob, ',');
+	outbuf_csv_str(&ob, e->e_parent ? e->e_parent->e_name : NULL);
+	outbuf_putc(&ob, ',');
+	outbuf_u64(&ob, e->e_level, 0);
+
+	for (i = 0; i < c_attrs.as_n; i++) {
+		/* columns of missing attributes are left empty */
+		if (!(a = attr_set_get(&c_attrs, i, e))) {
+			outbuf_put(&ob, ",,,,", 4);
+			continue;
+		}
+
+		outbuf_putc(&ob, ',');
+		outbuf_u64(&ob, rate_get_total(&a->a_rx_rate), 0);
+		outbuf_putc(&ob, ',');
+		outbuf_u64(&ob, rate_get_total(&a->a_tx_rate), 0);
+		outbuf_putc(&ob, ',');
+		put_rate(a->a_rx_rate.r_rate);
+		outbuf_putc(&ob, ',');
+		put_rate(a->a_tx_rate.r_rate);
+	}
+
+	outbuf_putc(&ob, '\n');
+}
+
+static void draw_header(void)
+{
+	int i, n;
+
+	outbuf_puts(&ob, "time,group,element,parent,level");
+
+	for (i = 0; i < c_attrs.as_n; i++) {
+		for (n = 0; n < ARRAY_SIZE(attr_columns); n++) {
+			outbuf_putc(&ob, ',');
+			outbuf_puts(&ob, c_attrs.as_name[i]);
+			outbuf_putc(&ob, '_');
+			outbuf_puts(&ob, attr_columns[n]);
+		}
+	}
+
+	outbuf_putc(&ob, '\n');
+}
+
+static void csv_draw(void)
+{
+	struct timeval tv;
+
+	if (c_header) {
+		draw_header();
+		c_header = 0;
+	}
+
+	gettimeofday(&tv, NULL);
+	tick_time = tv.tv_sec + (tv.tv_usec / 1000000.0);
+
+	group_foreach_recursive(draw_element, NULL);
+
+	if (c_quit_after > 0)
+		c_quit_after--;
+}
+
+static void csv_post(void)
+{
+	outbuf_flush(&ob);
+
+	if (c_quit_after == 0)
+		exit(0);
+}
+
+static void print_help(void)
+{
+	printf(
+	"csv - CSV Output\n" \
+	"\n" \
+	"  Writes one line of comma separated values per element and\n" \
+	"  interval. The first line names the columns, each selected\n" \
+	"  attribute adds the columns <attr>_rx, <attr>_tx, <attr>_rxrate\n" \
+	"  and <attr>_txrate. Columns of attributes an element does not\n" \
+	"  provide are left empty.\n" \
+	"\n" \
+	"  Options:\n" \
+	"    attrs=LIST     Attributes to include, separated by '+'\n" \
+	"                   (default: bytes+packets)\n" \
+	"    noheader       Do not write the header line\n" \
+	"    stderr         Write to stderr instead of stdout\n" \
+	"    quitafter=NUM  Quit bmon after NUM outputs\n" \
+	"\n" \
+	"  Example:\n" \
+	"    time,group,element,parent,level,bytes_rx,bytes_tx,bytes_rxrate,...\n" \
+	"    1381234567.250,intf,eth0,,0,1024,512,98.50,12.00,...\n" \
+	"\n");
+}
+
+static void csv_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "attrs") && value)
+		attr_set_parse(&c_attrs, value);
+	else if (!strcasecmp(type, "noheader"))
+		c_header = 0;
+	else if (!strcasecmp(type, "stderr"))
+		ob.ob_fd = STDERR_FILENO;
+	else if (!strcasecmp(type, "quitafter") && value)
+		c_quit_after = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static struct bmon_module csv_ops = {
+	.m_name		= "csv",
+	.m_do		= csv_draw,
+	.m_post		= csv_post,
+	.m_parse_opt	= csv_parse_opt,
+};
+
+static void __init csv_init(void)
+{
+	attr_set_parse(&c_attrs, "bytes+packets");
+
+	output_register(&csv_ops);
+}
+
+static void __exit csv_exit(void)
+{
+	attr_set_free(&c_attrs);
+}
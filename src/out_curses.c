@@ -26,12 +26,16 @@
 #include <bmon/bmon.h>
 #include <bmon/conf.h>
 #include <bmon/attr.h>
+#include <bmon/collector.h>
 #include <bmon/element.h>
 #include <bmon/element_cfg.h>
 #include <bmon/input.h>
 #include <bmon/history.h>
 #include <bmon/graph.h>
 #include <bmon/output.h>
+#include <bmon/pool.h>
+#include <bmon/snapshot.h>
+#include <bmon/top.h>
 #include <bmon/utils.h>
 
 enum {
@@ -45,6 +49,13 @@ enum {
 	KEY_TOGGLE_DETAILS	= 'd',
 	KEY_TOGGLE_INFO		= 'i',
 	KEY_COLLECT_HISTORY	= 'h',
+	KEY_TOGGLE_STATS	= 's',
+	KEY_TOGGLE_FOLD		= 'f',
+	KEY_TOGGLE_TOP		= 't',
+	KEY_ZOOM_IN		= '+',
+	KEY_ZOOM_OUT		= '-',
+	KEY_PAN_BACK		= ',',
+	KEY_PAN_FORWARD		= '.',
 	KEY_CTRL_N	= 14,
 	KEY_CTRL_P	= 16,
 };
@@ -94,6 +105,7 @@ static int info_cols;
 
 static int initialized;
 static int print_help;
+static int print_stats;
 static int quit_mode;
 static int help_page;
 
@@ -113,6 +125,27 @@ static int c_show_details = 0;
 static int c_show_list = 1;
 static int c_show_info = 0;
 static int c_list_min = 6;
+static int c_fps = 10;
+static int c_show_top = 0;
+static struct top c_top;
+
+/*
+ * Model of the last frame sent to the terminal, one hash per line.
+ * Lines which hash the same as in the previous frame are untouched
+ * before refreshing so curses does not compare or emit them, a frame
+ * without any changed line is not refreshed at all.
+ */
+static uint64_t *frame_hash;
+static chtype *frame_line;
+static int frame_rows, frame_cols;
+static int frame_invalid = 1;
+
+/* A frame is due but held back by the frame rate limit */
+static int frame_pending;
+
+/* A frame has been drawn to stdscr but not sent to the terminal yet */
+static int frame_dirty;
+static timestamp_t last_frame;
 
 static struct graph_cfg c_graph_cfg = {
 	.gc_width		= 60,
@@ -120,6 +153,7 @@ static struct graph_cfg c_graph_cfg = {
 	.gc_foreground		= '|',
 	.gc_background		= '.',
 	.gc_noise		= ':',
+	.gc_peak		= '+',
 	.gc_unknown		= '?',
 };
 
@@ -148,25 +182,34 @@ static char *float2str(double value, int width, int prec, char *buf, size_t len)
 
 static void put_line(const char *fmt, ...)
 {
+	static char *buf;
+	static int size;
 	va_list args;
-	char *buf;
-	int len;
+	int len, n;
 	int x, y __unused__;
 
 	getyx(stdscr, y, x);
 
-	len = cols - x;
-	buf = xcalloc(len+1, 1);
+	if ((len = cols - x) <= 0)
+		return;
+
+	if (len + 1 > size) {
+		size = len + 1;
+		buf = xrealloc(buf, size);
+	}
 
 	va_start(args, fmt);
-	vsnprintf(buf, len+1, fmt, args);
+	n = vsnprintf(buf, len+1, fmt, args);
 	va_end(args);
 
-	if (strlen(buf) < len)
-		memset(&buf[strlen(buf)], ' ', len - strlen(buf));
+	if (n < 0)
+		n = 0;
+
+	if (n < len)
+		memset(&buf[n], ' ', len - n);
+	buf[len] = '\0';
 
 	addstr(buf);
-	xfree(buf);
 }
 
 static void center_text(const char *fmt, ...)
@@ -193,6 +236,60 @@ static void center_text(const char *fmt, ...)
 	free(str);
 }
 
+static void clear_screen(void)
+{
+	clear();
+	frame_invalid = 1;
+}
+
+static uint64_t hash_line(const chtype *line, int len)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= line[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * Compare the frame drawn to stdscr against the model of the previous
+ * frame. Returns the number of changed lines.
+ */
+static int frame_damage(void)
+{
+	int y, n, changed = 0;
+
+	if (rows != frame_rows || cols != frame_cols) {
+		frame_hash = xrealloc(frame_hash, rows * sizeof(*frame_hash));
+		frame_line = xrealloc(frame_line,
+				      (cols + 1) * sizeof(*frame_line));
+		frame_rows = rows;
+		frame_cols = cols;
+		frame_invalid = 1;
+	}
+
+	for (y = 0; y < rows; y++) {
+		uint64_t hash;
+
+		n = mvwinchnstr(stdscr, y, 0, frame_line, cols);
+		hash = hash_line(frame_line, n > 0 ? n : 0);
+
+		if (frame_invalid || hash != frame_hash[y]) {
+			frame_hash[y] = hash;
+			changed++;
+		} else
+			wtouchln(stdscr, y, 1, 0);
+	}
+
+	frame_invalid = 0;
+
+	return changed;
+}
+
 static int curses_init(void)
 {
 	if (!initscr()) {
@@ -222,7 +319,7 @@ static int curses_init(void)
 	cbreak();
 	noecho();
 	nodelay(stdscr, TRUE);	  /* getch etc. must be non-blocking */
-	clear();
+	clear_screen();
 	curs_set(0);
 
 	return 0;
@@ -335,37 +432,48 @@ static void print_message(const char *text)
 	row = y + 2;
 }
 
-static void draw_help(void)
+/*
+ * Draw a standout box with its upper left inner corner at y/x. The
+ * caller is responsible for resetting the standout attribute.
+ */
+static void draw_box(int y, int x, int h, int w)
 {
-#define HW 46
-#define HH 19
-	int i, y = (rows/2) - (HH/2);
-	int x = (cols/2) - (HW/2);
-	char pad[HW+1];
+	char pad[w + 1];
+	int i;
 
-	memset(pad, ' ', sizeof(pad));
-	pad[sizeof(pad) - 1] = '\0';
+	memset(pad, ' ', w);
+	pad[w] = '\0';
 
 	attron(A_STANDOUT);
 
-	for (i = 0; i < HH; i++)
+	for (i = 0; i < h; i++)
 		mvaddnstr(y + i, x, pad, -1);
 
-	mvaddch(y  - 1, x - 1, ACS_ULCORNER);
-	mvaddch(y + HH, x - 1, ACS_LLCORNER);
+	mvaddch(y - 1, x - 1, ACS_ULCORNER);
+	mvaddch(y + h, x - 1, ACS_LLCORNER);
 	
-	mvaddch(y  - 1, x + HW, ACS_URCORNER);
-	mvaddch(y + HH, x + HW, ACS_LRCORNER);
+	mvaddch(y - 1, x + w, ACS_URCORNER);
+	mvaddch(y + h, x + w, ACS_LRCORNER);
 
-	for (i = 0; i < HH; i++) {
-		mvaddch(y + i, x -  1, ACS_VLINE);
-		mvaddch(y + i, x + HW, ACS_VLINE);
+	for (i = 0; i < h; i++) {
+		mvaddch(y + i, x - 1, ACS_VLINE);
+		mvaddch(y + i, x + w, ACS_VLINE);
 	}
 
-	for (i = 0; i < HW; i++) {
-		mvaddch(y  - 1, x + i, ACS_HLINE);
-		mvaddch(y + HH, x + i, ACS_HLINE);
+	for (i = 0; i < w; i++) {
+		mvaddch(y - 1, x + i, ACS_HLINE);
+		mvaddch(y + h, x + i, ACS_HLINE);
 	}
+}
+
+static void draw_help(void)
+{
+#define HW 46
+#define HH 24
+	int y = (rows/2) - (HH/2);
+	int x = (cols/2) - (HW/2);
+
+	draw_box(y, x, HH, HW);
 
 	attron(A_BOLD);
 	mvaddnstr(y- 1, x+15, "QUICK REFERENCE", -1);
@@ -387,22 +495,101 @@ static void draw_help(void)
 	mvaddnstr(y+ 9, x+3, "d             Toggle detailed statistics", -1);
 	mvaddnstr(y+10, x+3, "l             Toggle element list", -1);
 	mvaddnstr(y+11, x+3, "i             Toggle additional info", -1);
+	mvaddnstr(y+12, x+3, "f             Fold/unfold child elements", -1);
+	mvaddnstr(y+13, x+3, "t             Toggle top elements by rate", -1);
 
 	attron(A_BOLD | A_UNDERLINE);
-	mvaddnstr(y+13, x+1, "Graph Settings", -1);
+	mvaddnstr(y+15, x+1, "Graph Settings", -1);
 	attroff(A_BOLD | A_UNDERLINE);
 
-	mvaddnstr(y+14, x+3, "g             Toggle graphical statistics", -1);
-	mvaddnstr(y+15, x+3, "H             Start recording history data", -1);
-	mvaddnstr(y+16, x+3, "TAB           Switch time unit of graph", -1);
-	mvaddnstr(y+17, x+3, "<, >          Change number of graphs", -1);
-	mvaddnstr(y+18, x+3, "r             Reset counter of element", -1);
+	mvaddnstr(y+16, x+3, "g             Toggle graphical statistics", -1);
+	mvaddnstr(y+17, x+3, "H             Start recording history data", -1);
+	mvaddnstr(y+18, x+3, "TAB           Switch time unit of graph", -1);
+	mvaddnstr(y+19, x+3, "<, >          Change number of graphs", -1);
+	mvaddnstr(y+20, x+3, "+, -          Zoom graph in/out", -1);
+	mvaddnstr(y+21, x+3, ",, .          Pan graph back/forward", -1);
+	mvaddnstr(y+22, x+3, "r             Reset counter of element", -1);
+	mvaddnstr(y+23, x+3, "s             Toggle bmon statistics", -1);
 
 	attroff(A_STANDOUT);
 
 	row = y + HH;
 }
 
+#define SW 60
+
+static void count_pool(struct pool *p, void *arg)
+{
+	(*(int *) arg)++;
+}
+
+static void draw_pool_stats(struct pool *p, void *arg)
+{
+	int *y = arg;
+	int x = (cols/2) - (SW/2);
+
+	mvprintw((*y)++, x + 1, "%-14.14s %7zu %9lu %9lu %7lu %7zu",
+		 p->p_name, p->p_size, p->p_inuse, p->p_nfree,
+		 p->p_nchunks, pool_bytes(p) / 1024);
+}
+
+static void draw_history_stats(int y, int x)
+{
+	struct history_stats st;
+
+	history_get_stats(&st);
+
+	attron(A_BOLD | A_UNDERLINE);
+	mvaddnstr(y, x + 1, "History", -1);
+	attroff(A_BOLD | A_UNDERLINE);
+
+	if (st.hst_budget)
+		mvprintw(y + 1, x + 1, "Budget: %7" PRIu64 " KiB  Used: %7zu KiB (%3u%%)",
+			 st.hst_budget / 1024, st.hst_used / 1024,
+			 (unsigned int) ((st.hst_used * 100) / st.hst_budget));
+	else
+		mvprintw(y + 1, x + 1, "Budget: %11s  Used: %7zu KiB",
+			 "unlimited", st.hst_used / 1024);
+
+	mvprintw(y + 2, x + 1, "Histories: %8lu  Evicted: %8lu",
+		 st.hst_count, st.hst_evictions);
+}
+
+static void draw_stats(void)
+{
+	int npools = 0, y, x = (cols/2) - (SW/2);
+
+	/* pools and history statistics belong to the sampling thread */
+	collector_lock();
+
+	pool_foreach(count_pool, &npools);
+
+	y = (rows/2) - ((npools + 7) / 2);
+
+	draw_box(y, x, npools + 7, SW);
+
+	attron(A_BOLD);
+	mvaddnstr(y - 1, x + 21, "BMON STATISTICS", -1);
+	attron(A_UNDERLINE);
+	mvaddnstr(y, x + 1, "Memory Pools", -1);
+	attroff(A_UNDERLINE);
+	mvprintw(y + 1, x + 1, "%-14s %7s %9s %9s %7s %7s",
+		 "Pool", "ObjSize", "InUse", "Free", "Chunks", "KiB");
+	attroff(A_BOLD);
+
+	y += 2;
+	pool_foreach(draw_pool_stats, &y);
+
+	draw_history_stats(++y, x);
+	y += 3;
+
+	collector_unlock();
+
+	attroff(A_STANDOUT);
+
+	row = y;
+}
+
 static int lines_required_for_header(void)
 {
 	return 1;
@@ -506,42 +693,178 @@ static int lines_required_for_details(void)
 	return lines;
 }
 
-static void count_element_lines(struct element_group *g, struct element *e,
-				void *arg)
+/*
+ * The element list is drawn from a flat index of its rows, group titles
+ * and elements in display order with children of folded elements left
+ * out. The index is rebuilt only when the element tree changes, drawing
+ * and moving the selection then only touches the rows involved. The top
+ * view lists the ranked elements below a single title row instead and
+ * follows the ranking.
+ */
+struct list_row
 {
-	int *lines = arg;
+	struct element_group *	lr_group;
+	struct element *	lr_element;	/* NULL for group title */
+};
 
-	if (e == current_element)
-		selection_offset = *lines;
-	
-	(*lines)++;
+static struct list_row *list_rows;
+static unsigned int list_nrows;
+static unsigned int list_size;
+static unsigned int list_gen = -1U;
+
+static void add_row(struct element_group *g, struct element *e)
+{
+	if (list_nrows >= list_size) {
+		list_size = list_size ? list_size * 2 : 64;
+		list_rows = xrealloc(list_rows, list_size * sizeof(*list_rows));
+	}
+
+	list_rows[list_nrows].lr_group = g;
+	list_rows[list_nrows].lr_element = e;
+
+	if (e)
+		e->e_row = list_nrows;
+
+	list_nrows++;
 }
 
-static void count_group_lines(struct element_group *g, void *arg)
+static void add_element_rows(struct element_group *g, struct list_head *list)
 {
-	int *lines = arg;
+	struct element *e;
 
-	/* group title */
-	(*lines)++;
+	list_for_each_entry(e, list, e_list) {
+		add_row(g, e);
 
-	group_foreach_element(g, &count_element_lines, arg);
+		if (!(e->e_flags & ELEMENT_FLAG_FOLDED))
+			add_element_rows(g, &e->e_childs);
+	}
 }
 
-static int lines_required_for_list(void)
+static void add_group_rows(struct element_group *g, void *arg)
 {
-	int lines = 0;
+	add_row(g, NULL);
+	add_element_rows(g, &g->g_elements);
+}
 
-	if (c_show_list)
-		group_foreach(&count_group_lines, &lines);
-	else
-		lines = 1;
+static void add_top_row(struct element_group *g, struct element *e, void *arg)
+{
+	add_row(g, e);
+}
 
-	return lines;
+static void update_list_rows(void)
+{
+	if (c_show_top) {
+		if (!top_update(&c_top) && list_gen == group_tree_gen)
+			return;
+
+		list_nrows = 0;
+		add_row(NULL, NULL);
+		top_foreach(&c_top, &add_top_row, NULL);
+		list_gen = group_tree_gen;
+		return;
+	}
+
+	if (list_gen == group_tree_gen)
+		return;
+
+	list_nrows = 0;
+	group_foreach(&add_group_rows, NULL);
+	list_gen = group_tree_gen;
+}
+
+static inline int row_is(unsigned int n, struct element *e)
+{
+	return n < list_nrows && list_rows[n].lr_element == e;
+}
+
+/*
+ * Row of an element, elements hidden by a folded parent map to the row
+ * of the parent.
+ */
+static int element_row(struct element *e)
+{
+	for (; e; e = e->e_parent)
+		if (row_is(e->e_row, e))
+			return e->e_row;
+
+	return -1;
+}
+
+static struct element *scan_rows(int n, int dir)
+{
+	for (; n >= 0 && n < list_nrows; n += dir)
+		if (list_rows[n].lr_element)
+			return list_rows[n].lr_element;
+
+	return NULL;
+}
+
+static void toggle_top(void)
+{
+	struct element *e;
+
+	if (!c_top.t_n)
+		top_set_size(&c_top, 20);
+
+	c_show_top = !c_show_top;
+	list_gen = -1U;
+	update_list_rows();
+
+	/* keep the selection on a listed element */
+	if ((!(e = element_current()) || element_row(e) < 0) &&
+	    (e = scan_rows(0, 1)))
+		element_select(e);
 }
 
-static inline int line_visible(int line)
+/*
+ * Move the selection by delta rows, group titles are skipped in the
+ * direction of the move. Single steps wrap around at either end of the
+ * list like element_select_next() and element_select_prev() do.
+ */
+static void move_selection(int delta, int wrap)
 {
-	return line >= offset && line < (offset + list_length);
+	struct element *e;
+	int n, dir = delta > 0 ? 1 : -1;
+
+	update_list_rows();
+
+	if (!(e = element_current()) || (n = element_row(e)) < 0)
+		return;
+
+	n += delta;
+
+	if (n < 0 || n >= list_nrows) {
+		if (wrap)
+			n = dir > 0 ? 0 : list_nrows - 1;
+		else
+			n = dir > 0 ? list_nrows - 1 : 0;
+	}
+
+	if (!(e = scan_rows(n, dir))) {
+		if (wrap)
+			e = scan_rows(dir > 0 ? 0 : list_nrows - 1, dir);
+		else
+			e = scan_rows(n, -dir);
+	}
+
+	if (e)
+		element_select(e);
+}
+
+static int lines_required_for_list(void)
+{
+	struct element *e;
+	int n;
+
+	if (!c_show_list)
+		return 1;
+
+	update_list_rows();
+
+	if ((e = current_element) && (n = element_row(e)) >= 0)
+		selection_offset = n;
+
+	return list_nrows;
 }
 
 static void draw_attr(double rate1, int prec1, char *unit1,
@@ -564,112 +887,121 @@ static void draw_attr(double rate1, int prec1, char *unit1,
 		printw("%3s", "");
 }
 
-static void draw_element(struct element_group *g, struct element *e,
-			 void *arg)
+static void draw_element(struct element *e, int line)
 {
-	int *line = arg;
+	char *rxu1 = "", *txu1 = "", *rxu2 = "", *txu2 = "";
+	double rx1 = 0.0f, tx1 = 0.0f, rx2 = 0.0f, tx2 = 0.0f;
+	char pad[IFNAMSIZ + 32];
+	int rx1prec = 0, tx1prec = 0, rx2prec = 0, tx2prec = 0;
+	struct attr *a;
 
 	apply_layout(LAYOUT_LIST);
+	NEXT_ROW();
 
-	if (line_visible(*line)) {
-		char *rxu1 = "", *txu1 = "", *rxu2 = "", *txu2 = "";
-		double rx1 = 0.0f, tx1 = 0.0f, rx2 = 0.0f, tx2 = 0.0f;
-		char pad[IFNAMSIZ + 32];
-		int rx1prec = 0, tx1prec = 0, rx2prec = 0, tx2prec = 0;
-		struct attr *a;
-
-		NEXT_ROW();
+	if (e->e_key_attr[GT_MAJOR] &&
+	    (a = attr_lookup(e, e->e_key_attr[GT_MAJOR]->ad_id)))
+		attr_rate2float(a, &rx1, &rxu1, &rx1prec,
+				&tx1, &txu1, &tx1prec);
 
-		if (e->e_key_attr[GT_MAJOR] &&
-		    (a = attr_lookup(e, e->e_key_attr[GT_MAJOR]->ad_id)))
-			attr_rate2float(a, &rx1, &rxu1, &rx1prec,
-					&tx1, &txu1, &tx1prec);
+	if (e->e_key_attr[GT_MINOR] &&
+	    (a = attr_lookup(e, e->e_key_attr[GT_MINOR]->ad_id)))
+		attr_rate2float(a, &rx2, &rxu2, &rx2prec,
+				&tx2, &txu2, &tx2prec);
 
-		if (e->e_key_attr[GT_MINOR] &&
-		    (a = attr_lookup(e, e->e_key_attr[GT_MINOR]->ad_id)))
-			attr_rate2float(a, &rx2, &rxu2, &rx2prec,
-					&tx2, &txu2, &tx2prec);
+	memset(pad, 0, sizeof(pad));
+	memset(pad, ' ', e->e_level < 6 ? e->e_level * 2 : 12);
 
-		memset(pad, 0, sizeof(pad));
-		memset(pad, ' ', e->e_level < 6 ? e->e_level * 2 : 12);
+	strncat(pad, e->e_name, sizeof(pad) - strlen(pad) - 1);
 
-		strncat(pad, e->e_name, sizeof(pad) - strlen(pad) - 1);
+	if (e->e_description) {
+		strncat(pad, " (", sizeof(pad) - strlen(pad) - 1);
+		strncat(pad, e->e_description, sizeof(pad) - strlen(pad) - 1);
+		strncat(pad, ")", sizeof(pad) - strlen(pad) - 1);
+	}
 
-		if (e->e_description) {
-			strncat(pad, " (", sizeof(pad) - strlen(pad) - 1);
-			strncat(pad, e->e_description, sizeof(pad) - strlen(pad) - 1);
-			strncat(pad, ")", sizeof(pad) - strlen(pad) - 1);
-		}
+	if ((e->e_flags & ELEMENT_FLAG_FOLDED) && !list_empty(&e->e_childs))
+		strncat(pad, " [+]", sizeof(pad) - strlen(pad) - 1);
 
-		if (*line == offset) {
-			attron(A_BOLD);
-			addch(ACS_UARROW);
-			attroff(A_BOLD);
-			addch(' ');
-		} else if (e == current_element) {
-			apply_layout(LAYOUT_SELECTED);
-			addch(' ');
-			attron(A_BOLD);
-			addch(ACS_RARROW);
-			attroff(A_BOLD);
-			apply_layout(LAYOUT_LIST);
-		} else if (*line == offset + list_length - 1 &&
-		           *line < (list_req - 1)) {
-			attron(A_BOLD);
-			addch(ACS_DARROW);
-			attroff(A_BOLD);
-			addch(' ');
-		} else
-			printw("  ");
+	if (line == offset) {
+		attron(A_BOLD);
+		addch(ACS_UARROW);
+		attroff(A_BOLD);
+		addch(' ');
+	} else if (e == current_element) {
+		apply_layout(LAYOUT_SELECTED);
+		addch(' ');
+		attron(A_BOLD);
+		addch(ACS_RARROW);
+		attroff(A_BOLD);
+		apply_layout(LAYOUT_LIST);
+	} else if (line == offset + list_length - 1 &&
+	           line < (list_req - 1)) {
+		attron(A_BOLD);
+		addch(ACS_DARROW);
+		attroff(A_BOLD);
+		addch(' ');
+	} else
+		printw("  ");
 
-		put_line("%-30.30s", pad);
+	put_line("%-30.30s", pad);
 
-		draw_attr(rx1, rx1prec, rxu1, rx2, rx2prec, rxu2,
-			  e->e_rx_usage, LIST_COL_1);
-	
-		draw_attr(tx1, tx1prec, txu1, tx2, tx2prec, txu2,
-			  e->e_tx_usage, LIST_COL_2);
-		
-	}
+	draw_attr(rx1, rx1prec, rxu1, rx2, rx2prec, rxu2,
+		  e->e_rx_usage, LIST_COL_1);
 
-	(*line)++;
+	draw_attr(tx1, tx1prec, txu1, tx2, tx2prec, txu2,
+		  e->e_tx_usage, LIST_COL_2);
 }
 
-static void draw_group(struct element_group *g, void *arg)
+static void draw_group(struct element_group *g)
 {
 	apply_layout(LAYOUT_HEADER);
-	int *line = arg;
 
-	if (line_visible(*line)) {
-		NEXT_ROW();
-		attron(A_BOLD);
-		put_line("%s", g->g_hdr->gh_title);
+	NEXT_ROW();
+	attron(A_BOLD);
+	put_line("%s", g->g_hdr->gh_title);
 
-		attroff(A_BOLD);
-		mvaddch(row, LIST_COL_1, ACS_VLINE);
-		attron(A_BOLD);
-		put_line("%7s   %7s     %%",
-			g->g_hdr->gh_column[0],
-			g->g_hdr->gh_column[1]);
+	attroff(A_BOLD);
+	mvaddch(row, LIST_COL_1, ACS_VLINE);
+	attron(A_BOLD);
+	put_line("%7s   %7s     %%",
+		g->g_hdr->gh_column[0],
+		g->g_hdr->gh_column[1]);
 
-		attroff(A_BOLD);
-		mvaddch(row, LIST_COL_2, ACS_VLINE);
-		attron(A_BOLD);
-		put_line("%7s   %7s     %%",
-			g->g_hdr->gh_column[2],
-			g->g_hdr->gh_column[3]);
-	}
+	attroff(A_BOLD);
+	mvaddch(row, LIST_COL_2, ACS_VLINE);
+	attron(A_BOLD);
+	put_line("%7s   %7s     %%",
+		g->g_hdr->gh_column[2],
+		g->g_hdr->gh_column[3]);
+}
 
-	(*line)++;
+static void draw_top_title(void)
+{
+	apply_layout(LAYOUT_HEADER);
 
-	group_foreach_element(g, draw_element, arg);
+	NEXT_ROW();
+	attron(A_BOLD);
+	put_line("Top %d by %s", c_top.t_n,
+		 c_top.t_attr.as_n ? c_top.t_attr.as_name[0] : "");
+	attroff(A_BOLD);
+
+	mvaddch(row, LIST_COL_1, ACS_VLINE);
+	mvaddch(row, LIST_COL_2, ACS_VLINE);
 }
 
 static void draw_element_list(void)
 {
-	int line = 0;
-
-	group_foreach(draw_group, &line);
+	int line;
+
+	for (line = offset; line < offset + list_length &&
+			    line < list_nrows; line++) {
+		if (list_rows[line].lr_element)
+			draw_element(list_rows[line].lr_element, line);
+		else if (list_rows[line].lr_group)
+			draw_group(list_rows[line].lr_group);
+		else
+			draw_top_title();
+	}
 }
 
 static inline int attr_visible(int nattr)
@@ -693,7 +1025,7 @@ static void draw_table(struct graph *g, struct graph_table *tbl,
 		       const char *hdr, int ncol, int layout)
 {
 	int i, save_row;
-	char buf[32];
+	char buf[64];
 
 	if (!tbl->gt_table) {
 		for (i = g->g_cfg.gc_height; i >= 0; i--) {
@@ -706,9 +1038,15 @@ static void draw_table(struct graph *g, struct graph_table *tbl,
 	move(++row, ncol);
 	put_line("%8s", tbl->gt_y_unit ? : "");
 
-	snprintf(buf, sizeof(buf), "(%s %s/%s)",
-		 hdr, a->a_def->ad_description,
-		 h ? h->h_definition->hd_name : "?");
+	if (g->g_cfg.gc_zoom || g->g_cfg.gc_pan)
+		snprintf(buf, sizeof(buf), "(%s %s/%s x%lu -%lu)",
+			 hdr, a->a_def->ad_description,
+			 h ? h->h_definition->hd_name : "?",
+			 1UL << g->g_cfg.gc_zoom, g->g_cfg.gc_pan);
+	else
+		snprintf(buf, sizeof(buf), "(%s %s/%s)",
+			 hdr, a->a_def->ad_description,
+			 h ? h->h_definition->hd_name : "?");
 
 	draw_graph_centered(g, row, ncol, buf);
 
@@ -752,8 +1090,16 @@ static void draw_history_graph(struct attr *a, struct history *h)
 	struct graph *g;
 	int ncol = 0, save_row;
 
-	g = graph_alloc(h, &c_graph_cfg);
-	graph_refill(g, h);
+	if (h) {
+		g = graph_get(h, &c_graph_cfg);
+
+		/* keep zoom and pan within reach of the history */
+		c_graph_cfg.gc_zoom = g->g_cfg.gc_zoom;
+		c_graph_cfg.gc_pan = g->g_cfg.gc_pan;
+	} else {
+		g = graph_alloc(NULL, &c_graph_cfg);
+		graph_refill(g, NULL);
+	}
 
 	save_row = row;
 	draw_table(g, &g->g_rx, a, h, "RX", ncol, LAYOUT_RX_GRAPH);
@@ -765,7 +1111,8 @@ static void draw_history_graph(struct attr *a, struct history *h)
 
 	draw_table(g, &g->g_tx, a, h, "TX", ncol, LAYOUT_TX_GRAPH);
 
-	graph_free(g);
+	if (!h)
+		graph_free(g);
 }
 
 static void draw_attr_graph(struct element *e, struct attr *a, void *arg)
@@ -779,6 +1126,8 @@ static void draw_attr_graph(struct element *e, struct attr *a, void *arg)
 		sel = history_current();
 		c_graph_cfg.gc_unit = a->a_def->ad_unit;
 
+		snapshot_apply(a, history_viewed, 0);
+
 		list_for_each_entry(h, &a->a_history_list, h_list) {
 			if (h->h_definition != sel)
 				continue;
@@ -1046,7 +1395,7 @@ draw:
 }
 
 
-static void curses_draw(void)
+static void draw_frame(void)
 {
 	row = 0;
 	move(0,0);
@@ -1054,13 +1403,13 @@ static void curses_draw(void)
 	getmaxyx(stdscr, rows, cols);
 
 	if (rows < 4) {
-		clear();
+		clear_screen();
 		put_line("Screen must be at least 4 rows in height");
 		goto out;
 	}
 
 	if (cols < 48) {
-		clear();
+		clear_screen();
 		put_line("Screen must be at least 48 columns width");
 		goto out;
 	}
@@ -1090,16 +1439,57 @@ static void curses_draw(void)
 		else
 			draw_help_2();
 #endif
-	}
+	} else if (print_stats)
+		draw_stats();
 
 out:
 	attrset(0);
-	refresh();
+
+	if (frame_damage())
+		frame_dirty = 1;
+}
+
+/*
+ * Draw a frame if one is due and the frame rate limit permits. Frames
+ * held back are drawn by a later call from curses_pre().
+ */
+static void curses_frame(void)
+{
+	timestamp_t now;
+
+	if (!frame_pending)
+		return;
+
+	update_timestamp(&now);
+
+	if (c_fps > 0 && last_frame.tv_sec &&
+	    timestamp_diff(&last_frame, &now) < (1.0f / c_fps))
+		return;
+
+	frame_pending = 0;
+	copy_timestamp(&last_frame, &now);
+
+	draw_frame();
+}
+
+static void curses_draw(void)
+{
+	frame_pending = 1;
+	curses_frame();
+}
+
+/* Called without the collector lock held */
+static void curses_post(void)
+{
+	if (frame_dirty) {
+		frame_dirty = 0;
+		refresh();
+	}
 }
 
 static void __reset_attr_counter(struct element *e, struct attr *a, void *arg)
 {
-	attr_reset_counter(a);
+	snapshot_apply(a, attr_reset_counter, SNAPSHOT_RESTART);
 }
 
 static void reset_counters(void)
@@ -1114,6 +1504,8 @@ static int handle_input(int ch)
 		case 'q':
 			if (print_help)
 				print_help = 0;
+			else if (print_stats)
+				print_stats = 0;
 			else
 				quit_mode = quit_mode ? 0 : 1;
 			return 1;
@@ -1121,6 +1513,7 @@ static int handle_input(int ch)
 		case 0x1b:
 			quit_mode = 0;
 			print_help = 0;
+			print_stats = 0;
 			return 1;
 
 		case 'y':
@@ -1133,16 +1526,21 @@ static int handle_input(int ch)
 				quit_mode = 0;
 			return 1;
 
+#ifdef KEY_RESIZE
+		case KEY_RESIZE:
+			return 1;
+#endif
+
 		case 12:
 		case KEY_CLEAR:
 #ifdef HAVE_REDRAWWIN
 			redrawwin(stdscr);
 #endif
-			clear();
+			clear_screen();
 			return 1;
 
 		case '?':
-			clear();
+			clear_screen();
 			print_help = print_help ? 0 : 1;
 			return 1;
 
@@ -1164,37 +1562,51 @@ static int handle_input(int ch)
 			c_show_info = !c_show_info;
 			return 1;
 
+		case KEY_TOGGLE_STATS:
+			clear_screen();
+			print_stats = !print_stats;
+			return 1;
+
 		case KEY_COLLECT_HISTORY:
-			if (current_attr) {
-				attr_start_collecting_history(current_attr);
+			if ((current_attr = attr_current())) {
+				snapshot_apply(current_attr,
+					       attr_start_collecting_history,
+					       SNAPSHOT_RESTART);
 				return 1;
 			}
 			break;
 
 		case KEY_PPAGE:
-			{
-				int i;
-				for (i = 1; i < list_length; i++)
-					element_select_prev();
-			}
+			move_selection(-(list_length - 1), 0);
 			return 1;
 
 		case KEY_NPAGE:
-			{
-				int i;
-				for (i = 1; i < list_length; i++)
-					element_select_next();
-			}
+			move_selection(list_length - 1, 0);
 			return 1;
 
 		case KEY_DOWN:
 		case KEY_CTRL_N:
-			element_select_next();
+			move_selection(1, 1);
 			return 1;
 
 		case KEY_UP:
 		case KEY_CTRL_P:
-			element_select_prev();
+			move_selection(-1, 1);
+			return 1;
+
+		case KEY_TOGGLE_TOP:
+			toggle_top();
+			return 1;
+
+		case KEY_TOGGLE_FOLD:
+			{
+				struct element *e;
+
+				if ((e = element_current()) &&
+				    !list_empty(&e->e_childs))
+					element_set_folded(e,
+					    !(e->e_flags & ELEMENT_FLAG_FOLDED));
+			}
 			return 1;
 
 		case KEY_LEFT:
@@ -1229,6 +1641,35 @@ static int handle_input(int ch)
 			history_select_next();
 			return 1;
 
+		case KEY_ZOOM_IN:
+			if (c_graph_cfg.gc_zoom > 0)
+				c_graph_cfg.gc_zoom--;
+			return 1;
+
+		case KEY_ZOOM_OUT:
+			if (c_graph_cfg.gc_zoom < 24)
+				c_graph_cfg.gc_zoom++;
+			return 1;
+
+		case KEY_PAN_BACK:
+			c_graph_cfg.gc_pan += ((unsigned long) c_graph_cfg.gc_width
+						<< c_graph_cfg.gc_zoom) / 2;
+			return 1;
+
+		case KEY_PAN_FORWARD:
+			{
+				unsigned long step;
+
+				step = ((unsigned long) c_graph_cfg.gc_width
+					<< c_graph_cfg.gc_zoom) / 2;
+
+				if (c_graph_cfg.gc_pan > step)
+					c_graph_cfg.gc_pan -= step;
+				else
+					c_graph_cfg.gc_pan = 0;
+			}
+			return 1;
+
 		case 'r':
 			reset_counters();
 			return 1;
@@ -1253,8 +1694,10 @@ static void curses_pre(void)
 			break;
 
 		if (handle_input(ch))
-			curses_draw();
+			frame_pending = 1;
 	}
+
+	curses_frame();
 }
 
 static void print_module_help(void)
@@ -1269,6 +1712,7 @@ static void print_module_help(void)
 	"    fgchar=CHAR    Foreground character (default: '|')\n" \
 	"    bgchar=CHAR    Background character (default: '.')\n" \
 	"    nchar=CHAR     Noise character (default: ':')\n" \
+	"    pchar=CHAR     Peak character (default: '+')\n" \
 	"    uchar=CHAR     Unknown character (default: '?')\n" \
 	"    gheight=NUM    Height of graph (default: 6)\n" \
 	"    gwidth=NUM     Width of graph (default: 60)\n" \
@@ -1277,7 +1721,12 @@ static void print_module_help(void)
 	"    graph          Show graphical stats by default\n" \
 	"    details        Show detailed stats by default\n" \
 	"    info           Show additional info screen by default\n" \
-	"    minlist=INT    Minimum item list length\n");
+	"    minlist=INT    Minimum item list length\n" \
+	"    top[=NUM]      Start in top view listing the NUM top level elements\n" \
+	"                   with the highest rate (default: 20)\n" \
+	"    topattr=ATTR   Attribute to rank by, prefix rx: or tx: to rank by\n" \
+	"                   one direction only (default: bytes)\n" \
+	"    fps=NUM        Maximum frames per second, 0 for no limit (default: 10)\n");
 }
 
 static void curses_parse_opt(const char *type, const char *value)
@@ -1288,6 +1737,8 @@ static void curses_parse_opt(const char *type, const char *value)
 		c_graph_cfg.gc_background = value[0];
 	else if (!strcasecmp(type, "nchar") && value)
 		c_graph_cfg.gc_noise = value[0];
+	else if (!strcasecmp(type, "pchar") && value)
+		c_graph_cfg.gc_peak = value[0];
 	else if (!strcasecmp(type, "uchar") && value)
 		c_graph_cfg.gc_unknown = value[0];
 	else if (!strcasecmp(type, "gheight") && value)
@@ -1305,6 +1756,13 @@ static void curses_parse_opt(const char *type, const char *value)
 		c_use_colors = 0;
 	else if (!strcasecmp(type, "minlist") && value)
 		c_list_min = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "fps") && value)
+		c_fps = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "top")) {
+		top_set_size(&c_top, value ? strtol(value, NULL, 0) : 20);
+		c_show_top = !!c_top.t_n;
+	} else if (!strcasecmp(type, "topattr") && value)
+		top_set_attr(&c_top, value);
 	else if (!strcasecmp(type, "help")) {
 		print_module_help();
 		exit(0);
@@ -1317,10 +1775,17 @@ static struct bmon_module curses_ops = {
 	.m_shutdown	= curses_shutdown,
 	.m_pre		= curses_pre,
 	.m_do		= curses_draw,
+	.m_post		= curses_post,
 	.m_parse_opt	= curses_parse_opt,
 };
 
 static void __init do_curses_init(void)
 {
+	top_set_attr(&c_top, "bytes");
 	output_register(&curses_ops);
 }
+
+static void __exit do_curses_exit(void)
+{
+	top_free(&c_top);
+}
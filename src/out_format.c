@@ -30,174 +30,313 @@
 #include <bmon/group.h>
 #include <bmon/element.h>
 #include <bmon/input.h>
+#include <bmon/outbuf.h>
 #include <bmon/utils.h>
 #include <bmon/attr.h>
+#include <bmon/top.h>
 
 static int c_quit_after = -1;
 static char *c_format;
 static int c_debug = 0;
-static FILE *c_fd;
+static struct top c_top;
+static struct outbuf ob = OUTBUF_INIT(STDOUT_FILENO);
 
+/*
+ * The format string is compiled once into an array of ops. Literal text
+ * is written as is, placeholders are mapped to a field and attribute
+ * names are resolved to ids so that drawing an element does not have
+ * to parse anything.
+ */
 enum {
-	OT_STRING,
-	OT_TOKEN
+	OP_STRING,
+	OP_UNKNOWN,
+
+	OP_GROUP_NELEMENTS,
+	OP_GROUP_NAME,
+	OP_GROUP_TITLE,
+
+	OP_ELEMENT_NAME,
+	OP_ELEMENT_DESCRIPTION,
+	OP_ELEMENT_NATTRS,
+	OP_ELEMENT_LIFECYCLES,
+	OP_ELEMENT_LEVEL,
+	OP_ELEMENT_PARENT,
+	OP_ELEMENT_ID,
+	OP_ELEMENT_RXUSAGE,
+	OP_ELEMENT_TXUSAGE,
+	OP_ELEMENT_HASCHILDS,
+
+	/* ops from here on refer to an attribute */
+	OP_ATTR_RX,
+	OP_ATTR_TX,
+	OP_ATTR_RXRATE,
+	OP_ATTR_TXRATE,
 };
 
-static struct out_token {
-	int ot_type;
-	char *ot_str;
-} *out_tokens;
+struct format_field
+{
+	const char *		ff_name;
+	int			ff_op;
+};
 
-static int token_index;
-static int out_tokens_size;
+static const struct format_field group_fields[] = {
+	{ "nelements",		OP_GROUP_NELEMENTS },
+	{ "name",		OP_GROUP_NAME },
+	{ "title",		OP_GROUP_TITLE },
+	{ NULL },
+};
+
+static const struct format_field element_fields[] = {
+	{ "name",		OP_ELEMENT_NAME },
+	{ "description",	OP_ELEMENT_DESCRIPTION },
+	{ "nattrs",		OP_ELEMENT_NATTRS },
+	{ "lifecycles",		OP_ELEMENT_LIFECYCLES },
+	{ "level",		OP_ELEMENT_LEVEL },
+	{ "parent",		OP_ELEMENT_PARENT },
+	{ "id",			OP_ELEMENT_ID },
+	{ "rxusage",		OP_ELEMENT_RXUSAGE },
+	{ "txusage",		OP_ELEMENT_TXUSAGE },
+	{ "haschilds",		OP_ELEMENT_HASCHILDS },
+	{ NULL },
+};
 
-static char *get_token(struct element_group *g, struct element *e,
-		       const char *token, char *buf, size_t len)
+static const struct format_field attr_fields[] = {
+	{ "rx",			OP_ATTR_RX },
+	{ "tx",			OP_ATTR_TX },
+	{ "rxrate",		OP_ATTR_RXRATE },
+	{ "txrate",		OP_ATTR_TXRATE },
+	{ NULL },
+};
+
+static struct format_op {
+	int			fo_op;
+	/* literal text or placeholder */
+	char *			fo_str;
+	size_t			fo_len;
+	/* attribute name and id, -1 while unresolved */
+	char *			fo_attr_name;
+	int			fo_attr;
+} *ops;
+
+static int nops;
+static int ops_size;
+
+static int lookup_field(const struct format_field *f, const char *name,
+			size_t len)
 {
-	if (!strncasecmp(token, "group:", 6)) {
-		const char *n = token + 6;
-
-		if (!strcasecmp(n, "nelements")) {
-			snprintf(buf, len, "%u", g->g_nelements);
-			return buf;
-		} else if (!strcasecmp(n, "name"))
-			return g->g_name;
-		else if (!strcasecmp(n, "title"))
-			return g->g_hdr->gh_title;
-
-	} else if (!strncasecmp(token, "element:", 8)) {
-		const char *n = token + 8;
-
-		if (!strcasecmp(n, "name"))
-			return e->e_name;
-		else if (!strcasecmp(n, "description"))
-			return e->e_description;
-		else if (!strcasecmp(n, "nattrs")) {
-			snprintf(buf, len, "%u", e->e_nattrs);
-			return buf;
-		} else if (!strcasecmp(n, "lifecycles")) {
-			snprintf(buf, len, "%u", e->e_lifecycles);
-			return buf;
-		} else if (!strcasecmp(n, "level")) {
-			snprintf(buf, len, "%u", e->e_level);
-			return buf;
-		} else if (!strcasecmp(n, "parent"))
-			return e->e_parent ? e->e_parent->e_name : "";
-		else if (!strcasecmp(n, "id")) {
-			snprintf(buf, len, "%u", e->e_id);
-			return buf;
-		} else if (!strcasecmp(n, "rxusage")) {
-			snprintf(buf, len, "%2.0f",
-				e->e_rx_usage == FLT_MAX ? e->e_rx_usage : 0.0f);
-			return buf;
-		} else if (!strcasecmp(n, "txusage")) {
-			snprintf(buf, len, "%2.0f",
-				e->e_tx_usage == FLT_MAX ? e->e_tx_usage : 0.0f);
-			return buf;
-		} else if (!strcasecmp(n, "haschilds")) {
-			snprintf(buf, len, "%u",
-				list_empty(&e->e_childs) ? 0 : 1);
-			return buf;
-		}
-	} else if (!strncasecmp(token, "attr:", 5)) {
-		const char *type = token + 5;
-		char *name = strchr(type, ':');
-		struct attr_def *def;
-		struct attr *a;
+	for (; f->ff_name; f++)
+		if (strlen(f->ff_name) == len &&
+		    !strncasecmp(f->ff_name, name, len))
+			return f->ff_op;
 
-		if (!name) {
-			fprintf(stderr, "Invalid attribute field \"%s\"\n",
-				type);
-			goto out;
-		}
+	return OP_UNKNOWN;
+}
 
-		name++;
+static int resolve_attr(struct format_op *op)
+{
+	struct attr_def *def;
 
-		def = attr_def_lookup(name);
-		if (!def) {
-			fprintf(stderr, "Undefined attribute \"%s\"\n", name);
-			goto out;
-		}
+	if (op->fo_attr >= 0)
+		return 0;
 
-		if (!(a = attr_lookup(e, def->ad_id)))
-			goto out;
+	if (!(def = attr_def_lookup(op->fo_attr_name))) {
+		fprintf(stderr, "Undefined attribute \"%s\"\n",
+			op->fo_attr_name);
+		op->fo_op = OP_UNKNOWN;
+		return -ENOENT;
+	}
 
-		if (!strncasecmp(type, "rx:", 3)) {
-			snprintf(buf, len, "%" PRIu64, rate_get_total(&a->a_rx_rate));
-			return buf;
-		} else if (!strncasecmp(type, "tx:", 3)) {
-			snprintf(buf, len, "%" PRIu64, rate_get_total(&a->a_tx_rate));
-			return buf;
-		} else if (!strncasecmp(type, "rxrate:", 7)) {
-			snprintf(buf, len, "%.2f", a->a_rx_rate.r_rate);
-			return buf;
-		} else if (!strncasecmp(type, "txrate:", 7)) {
-			snprintf(buf, len, "%.2f", a->a_tx_rate.r_rate);
-			return buf;
+	op->fo_attr = def->ad_id;
+
+	return 0;
+}
+
+static void compile_token(struct format_op *op)
+{
+	char *token = op->fo_str, *name;
+
+	op->fo_op = OP_UNKNOWN;
+	op->fo_attr = -1;
+
+	if (!strncasecmp(token, "group:", 6))
+		op->fo_op = lookup_field(group_fields, token + 6,
+					 strlen(token + 6));
+	else if (!strncasecmp(token, "element:", 8))
+		op->fo_op = lookup_field(element_fields, token + 8,
+					 strlen(token + 8));
+	else if (!strncasecmp(token, "attr:", 5)) {
+		if (!(name = strchr(token + 5, ':'))) {
+			fprintf(stderr, "Invalid attribute field \"%s\"\n",
+				token + 5);
+			return;
 		}
+
+		op->fo_op = lookup_field(attr_fields, token + 5,
+					 name - (token + 5));
+		op->fo_attr_name = name + 1;
+
+		/*
+		 * Attribute definitions of input modules probed later are
+		 * resolved on first use.
+		 */
+		if (op->fo_op != OP_UNKNOWN && attr_def_lookup(name + 1))
+			resolve_attr(op);
 	}
 
-	fprintf(stderr, "Unknown field \"%s\"\n", token);
-out:
-	return "unknown";
+	if (op->fo_op == OP_UNKNOWN)
+		fprintf(stderr, "Unknown field \"%s\"\n", token);
+}
+
+static void put_u64(uint64_t value)
+{
+	outbuf_u64(&ob, value, 0);
 }
 
 static void draw_element(struct element_group *g, struct element *e, void *arg)
 {
-	int i;
+	struct attr *a = NULL;
+	int i, attr = -1;
 
-	for (i = 0; i < token_index; i++) {
-		char buf[128];
-		char *p;
+	for (i = 0; i < nops; i++) {
+		struct format_op *op = &ops[i];
 
-		if (out_tokens[i].ot_type == OT_STRING)
-			p = out_tokens[i].ot_str;
-		else if (out_tokens[i].ot_type == OT_TOKEN)
-			p = get_token(g, e, out_tokens[i].ot_str,
-				      buf, sizeof(buf));
-		else
-			BUG();
+		if (op->fo_op >= OP_ATTR_RX) {
+			if (resolve_attr(op) < 0)
+				goto unknown;
+
+			/* consecutive ops mostly refer to the same attribute */
+			if (op->fo_attr != attr) {
+				attr = op->fo_attr;
+				a = attr_lookup(e, attr);
+			}
 
-		if (p)
-			fprintf(c_fd, "%s", p);
+			if (!a)
+				goto unknown;
+		}
+
+		switch (op->fo_op) {
+		case OP_STRING:
+			outbuf_put(&ob, op->fo_str, op->fo_len);
+			break;
+
+		case OP_GROUP_NELEMENTS:
+			put_u64(g->g_nelements);
+			break;
+
+		case OP_GROUP_NAME:
+			outbuf_puts(&ob, g->g_name);
+			break;
+
+		case OP_GROUP_TITLE:
+			outbuf_puts(&ob, g->g_hdr->gh_title);
+			break;
+
+		case OP_ELEMENT_NAME:
+			outbuf_puts(&ob, e->e_name);
+			break;
+
+		case OP_ELEMENT_DESCRIPTION:
+			if (e->e_description)
+				outbuf_puts(&ob, e->e_description);
+			break;
+
+		case OP_ELEMENT_NATTRS:
+			put_u64(e->e_nattrs);
+			break;
+
+		case OP_ELEMENT_LIFECYCLES:
+			put_u64(e->e_lifecycles);
+			break;
+
+		case OP_ELEMENT_LEVEL:
+			put_u64(e->e_level);
+			break;
+
+		case OP_ELEMENT_PARENT:
+			if (e->e_parent)
+				outbuf_puts(&ob, e->e_parent->e_name);
+			break;
+
+		case OP_ELEMENT_ID:
+			put_u64(e->e_id);
+			break;
+
+		case OP_ELEMENT_RXUSAGE:
+			outbuf_fixed(&ob, e->e_rx_usage != FLT_MAX ?
+					  e->e_rx_usage : 0.0f, 0, 2);
+			break;
+
+		case OP_ELEMENT_TXUSAGE:
+			outbuf_fixed(&ob, e->e_tx_usage != FLT_MAX ?
+					  e->e_tx_usage : 0.0f, 0, 2);
+			break;
+
+		case OP_ELEMENT_HASCHILDS:
+			put_u64(list_empty(&e->e_childs) ? 0 : 1);
+			break;
+
+		case OP_ATTR_RX:
+			put_u64(rate_get_total(&a->a_rx_rate));
+			break;
+
+		case OP_ATTR_TX:
+			put_u64(rate_get_total(&a->a_tx_rate));
+			break;
+
+		case OP_ATTR_RXRATE:
+			outbuf_fixed(&ob, a->a_rx_rate.r_rate, 2, 0);
+			break;
+
+		case OP_ATTR_TXRATE:
+			outbuf_fixed(&ob, a->a_tx_rate.r_rate, 2, 0);
+			break;
+
+		default:
+		unknown:
+			outbuf_puts(&ob, "unknown");
+			break;
+		}
 	}
 }
 
 static void format_draw(void)
 {
-	group_foreach_recursive(draw_element, NULL);
-	fflush(stdout);
+	if (c_top.t_n)
+		top_foreach(&c_top, draw_element, NULL);
+	else
+		group_foreach_recursive(draw_element, NULL);
 
 	if (c_quit_after > 0)
-		if (--c_quit_after == 0)
-			exit(0);
+		c_quit_after--;
 }
 
-static inline void add_token(int type, char *data)
+static void format_post(void)
 {
-	if (!out_tokens_size) {
-		out_tokens_size = 32;
-		out_tokens = calloc(out_tokens_size, sizeof(struct out_token));
-		if (out_tokens == NULL)
-			quit("Cannot allocate out token array\n");
-	}
+	outbuf_flush(&ob);
+
+	if (c_quit_after == 0)
+		exit(0);
+}
+
+static inline void add_op(int type, char *data)
+{
+	struct format_op *op;
 
-	if (out_tokens_size <= token_index) {
-		out_tokens_size += 32;
-		out_tokens = realloc(out_tokens, out_tokens_size * sizeof(struct out_token));
-		if (out_tokens == NULL)
-			quit("Cannot reallocate out token array\n");
+	if (ops_size <= nops) {
+		ops_size += 32;
+		ops = xrealloc(ops, ops_size * sizeof(struct format_op));
 	}
 
+	op = &ops[nops++];
+	memset(op, 0, sizeof(*op));
 
-	out_tokens[token_index].ot_type = type;
-	out_tokens[token_index].ot_str = data;
-	token_index++;
+	op->fo_op = type;
+	op->fo_str = data;
 }
 
 static int format_probe(void)
 {
-	int new_one = 1;
+	int new_one = 1, i;
 	char *p, *e;
 
 	for (p = c_format; *p; p++) {
@@ -214,7 +353,7 @@ static int format_probe(void)
 
 				*p = '\0';
 				*e = '\0';
-				add_token(OT_TOKEN, s);
+				add_op(OP_UNKNOWN, s);
 				new_one = 1;
 				p = e;
 				continue;
@@ -252,7 +391,7 @@ static int format_probe(void)
 
 finish_escape:
 			*p = '\0';
-			add_token(OT_STRING, s);
+			add_op(OP_STRING, s);
 			p = s;
 			new_one = 0;
 			continue;
@@ -260,15 +399,26 @@ finish_escape:
 
 out:
 		if (new_one) {
-			add_token(OT_STRING, p);
+			add_op(OP_STRING, p);
 			new_one = 0;
 		}
 	}
 
+	/*
+	 * Literal text ends where the next token starts, so the tokens
+	 * can only be compiled once the whole string has been split.
+	 */
+	for (i = 0; i < nops; i++) {
+		if (ops[i].fo_op == OP_STRING)
+			ops[i].fo_len = strlen(ops[i].fo_str);
+		else
+			compile_token(&ops[i]);
+	}
+
 	if (c_debug) {
-		int i;
-		for (i = 0; i < token_index; i++)
-			printf(">>%s<\n", out_tokens[i].ot_str);
+		for (i = 0; i < nops; i++)
+			printf(">>%s< op=%d\n", ops[i].fo_str,
+			       ops[i].fo_op);
 	}
 
 	return 1;
@@ -298,6 +448,10 @@ static void print_help(void)
 	"    fmt=FORMAT     Format string\n" \
 	"    stderr         Write to stderr instead of stdout\n" \
 	"    quitafter=NUM  Quit bmon after NUM outputs\n" \
+	"    top=NUM        Only output the NUM top level elements with the\n" \
+	"                   highest rate, heaviest first\n" \
+	"    topattr=ATTR   Attribute to rank by, prefix rx: or tx: to rank by\n" \
+	"                   one direction only (default: bytes)\n" \
 	"\n" \
 	"  Placeholders:\n" \
 	"    group:nelements       Number of elements this group\n" \
@@ -339,7 +493,7 @@ static void print_help(void)
 static void format_parse_opt(const char *type, const char *value)
 {
 	if (!strcasecmp(type, "stderr"))
-		c_fd = stderr;
+		ob.ob_fd = STDERR_FILENO;
 	else if (!strcasecmp(type, "debug"))
 		c_debug = 1;
 	else if (!strcasecmp(type, "fmt")) {
@@ -349,6 +503,10 @@ static void format_parse_opt(const char *type, const char *value)
 	} else if (!strcasecmp(type, "quitafter") &&
 			       value)
 		c_quit_after = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "top") && value)
+		top_set_size(&c_top, strtol(value, NULL, 0));
+	else if (!strcasecmp(type, "topattr") && value)
+		top_set_attr(&c_top, value);
 	else if (!strcasecmp(type, "help")) {
 		print_help();
 		exit(0);
@@ -358,15 +516,21 @@ static void format_parse_opt(const char *type, const char *value)
 static struct bmon_module format_ops = {
 	.m_name		= "format",
 	.m_do		= format_draw,
+	.m_post		= format_post,
 	.m_probe	= format_probe,
 	.m_parse_opt	= format_parse_opt,
 };
 
 static void __init ascii_init(void)
 {
-	c_fd = stdout;
 	c_format = strdup("$(element:name) $(attr:rx:bytes) $(attr:tx:bytes) " \
 	    "$(attr:rx:packets) $(attr:tx:packets)\\n");
+	top_set_attr(&c_top, "bytes");
 
 	output_register(&format_ops);
 }
+
+static void __exit format_exit(void)
+{
+	top_free(&c_top);
+}
@@ -0,0 +1,203 @@
+/*
+ * out_ndjson.c		Newline Delimited JSON Output
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/output.h>
+#include <bmon/group.h>
+#include <bmon/element.h>
+#include <bmon/attr.h>
+#include <bmon/outbuf.h>
+#include <bmon/utils.h>
+
+#define NDJSON_SCHEMA_VERSION	1
+
+static int c_quit_after = -1;
+static int c_header = 1;
+static struct attr_set c_attrs;
+
+static struct outbuf ob = OUTBUF_INIT(STDOUT_FILENO);
+static double tick_time;
+
+static void put_rate(float rate)
+{
+	if (isfinite(rate))
+		outbuf_fixed(&ob, rate, 2, 0);
+	else
+		outbuf_put(&ob, "null", 4);
+}
+
+static void put_attr(struct attr *a)
+{
+	outbuf_put(&ob, "{\"rx\":", 6);
+	outbuf_u64(&ob, rate_get_total(&a->a_rx_rate), 0);
+	outbuf_put(&ob, ",\"tx\":", 6);
+	outbuf_u64(&ob, rate_get_total(&a->a_tx_rate), 0);
+	outbuf_put(&ob, ",\"rxrate\":", 10);
+	put_rate(a->a_rx_rate.r_rate);
+	outbuf_put(&ob, ",\"txrate\":", 10);
+	put_rate(a->a_tx_rate.r_rate);
+	outbuf_putc(&ob, '}');
+}
+
+static void draw_element(struct element_group *g, struct element *e, void *arg)
+{
+	struct attr *a;
+	int i;
+
+	outbuf_put(&ob, "{\"time\":", 8);
+	outbuf_fixed(&ob, tick_time, 3, 0);
+	outbuf_put(&ob, ",\"group\":", 9);
+	outbuf_json_str(&ob, g->g_name);
+	outbuf_put(&ob, ",\"element\":", 11);
+	outbuf_json_str(&ob, e->e_name);
+	outbuf_put(&ob, ",\"parent\":", 10);
+	outbuf_json_str(&ob, e->e_parent ? e->e_parent->e_name : NULL);
+	outbuf_put(&ob, ",\"level\":", 9);
+	outbuf_u64(&ob, e->e_level, 0);
+	outbuf_put(&ob, ",\"attrs\":{", 10);
+
+	for (i = 0; i < c_attrs.as_n; i++) {
+		if (i)
+			outbuf_putc(&ob, ',');
+
+		outbuf_json_str(&ob, c_attrs.as_name[i]);
+		outbuf_putc(&ob, ':');
+
+		if ((a = attr_set_get(&c_attrs, i, e)))
+			put_attr(a);
+		else
+			outbuf_put(&ob, "null", 4);
+	}
+
+	outbuf_put(&ob, "}}\n", 3);
+}
+
+/*
+ * The first line describes the records that follow so consumers can
+ * verify they understand the stream before parsing it.
+ */
+static void draw_header(void)
+{
+	int i;
+
+	outbuf_puts(&ob, "{\"schema\":\"bmon\",\"version\":");
+	outbuf_u64(&ob, NDJSON_SCHEMA_VERSION, 0);
+	outbuf_puts(&ob, ",\"fields\":[\"time\",\"group\",\"element\","
+			 "\"parent\",\"level\",\"attrs\"],\"attrs\":[");
+
+	for (i = 0; i < c_attrs.as_n; i++) {
+		if (i)
+			outbuf_putc(&ob, ',');
+		outbuf_json_str(&ob, c_attrs.as_name[i]);
+	}
+
+	outbuf_puts(&ob, "],\"attr_fields\":[\"rx\",\"tx\",\"rxrate\","
+			 "\"txrate\"]}\n");
+}
+
+static void ndjson_draw(void)
+{
+	struct timeval tv;
+
+	if (c_header) {
+		draw_header();
+		c_header = 0;
+	}
+
+	gettimeofday(&tv, NULL);
+	tick_time = tv.tv_sec + (tv.tv_usec / 1000000.0);
+
+	group_foreach_recursive(draw_element, NULL);
+
+	if (c_quit_after > 0)
+		c_quit_after--;
+}
+
+static void ndjson_post(void)
+{
+	outbuf_flush(&ob);
+
+	if (c_quit_after == 0)
+		exit(0);
+}
+
+static void print_help(void)
+{
+	printf(
+	"ndjson - Newline Delimited JSON Output\n" \
+	"\n" \
+	"  Writes one JSON object per element and interval for consumption\n" \
+	"  by scripts and log pipelines. The first line is a schema record\n" \
+	"  listing the fields and attributes of the records that follow.\n" \
+	"\n" \
+	"  Options:\n" \
+	"    attrs=LIST     Attributes to include, separated by '+'\n" \
+	"                   (default: bytes+packets)\n" \
+	"    noheader       Do not write the schema record\n" \
+	"    stderr         Write to stderr instead of stdout\n" \
+	"    quitafter=NUM  Quit bmon after NUM outputs\n" \
+	"\n" \
+	"  Example:\n" \
+	"    {\"time\":1381234567.250,\"group\":\"intf\",\"element\":\"eth0\",\n" \
+	"     \"parent\":null,\"level\":0,\"attrs\":{\"bytes\":{\"rx\":1024,\n" \
+	"     \"tx\":512,\"rxrate\":98.50,\"txrate\":12.00},\"packets\":null}}\n" \
+	"\n");
+}
+
+static void ndjson_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "attrs") && value)
+		attr_set_parse(&c_attrs, value);
+	else if (!strcasecmp(type, "noheader"))
+		c_header = 0;
+	else if (!strcasecmp(type, "stderr"))
+		ob.ob_fd = STDERR_FILENO;
+	else if (!strcasecmp(type, "quitafter") && value)
+		c_quit_after = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static struct bmon_module ndjson_ops = {
+	.m_name		= "ndjson",
+	.m_do		= ndjson_draw,
+	.m_post		= ndjson_post,
+	.m_parse_opt	= ndjson_parse_opt,
+};
+
+static void __init ndjson_init(void)
+{
+	attr_set_parse(&c_attrs, "bytes+packets");
+
+	output_register(&ndjson_ops);
+}
+
+static void __exit ndjson_exit(void)
+{
+	attr_set_free(&c_attrs);
+}
@@ -0,0 +1,719 @@
+/*
+ * out_prometheus.c	Prometheus/OpenMetrics Exporter
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/output.h>
+#include <bmon/group.h>
+#include <bmon/element.h>
+#include <bmon/attr.h>
+#include <bmon/unit.h>
+#include <bmon/net.h>
+#include <bmon/outbuf.h>
+#include <bmon/top.h>
+#include <bmon/utils.h>
+
+#include <pthread.h>
+#include <poll.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#define PROM_DEFAULT_PORT	"9449"
+#define PROM_MAX_REQUEST	4096
+#define PROM_MAX_CLIENTS	16
+#define PROM_TIMEOUT		2	/* seconds per request */
+
+#define PROM_CONTENT_TYPE \
+	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/*
+ * The metrics are rendered once per interval into a snapshot which is
+ * then published. Scrapes are served by a thread of their own from the
+ * published snapshot, they never look at the element tree and never
+ * take the collector lock. A snapshot stays alive until the last scrape
+ * using it has finished, retired snapshots are recycled.
+ */
+struct snapshot
+{
+	struct outbuf		s_text;
+	/* compressed on first request asking for it */
+	struct outbuf		s_gzip;
+	int			s_gzip_done;
+	int			s_refcnt;
+	struct snapshot *	s_next;
+};
+
+static char *c_listen;
+static struct attr_set c_attrs;
+static struct top c_top;
+
+static int listen_fd = -1;
+static int wakeup_pipe[2] = { -1, -1 };
+static pthread_t server_thread;
+static int server_running;
+
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct snapshot *current, *pending, *spare;
+
+static struct snapshot *snapshot_get(void)
+{
+	struct snapshot *s;
+
+	pthread_mutex_lock(&snapshot_lock);
+	if ((s = spare))
+		spare = s->s_next;
+	pthread_mutex_unlock(&snapshot_lock);
+
+	if (!s)
+		s = xcalloc(1, sizeof(*s));
+
+	s->s_text.ob_len = 0;
+	s->s_gzip.ob_len = 0;
+	s->s_gzip_done = 0;
+	s->s_refcnt = 1;
+	s->s_next = NULL;
+
+	return s;
+}
+
+/* Caller must hold snapshot_lock */
+static void snapshot_put(struct snapshot *s)
+{
+	if (--s->s_refcnt == 0) {
+		s->s_next = spare;
+		spare = s;
+	}
+}
+
+static void snapshot_free_list(struct snapshot *s)
+{
+	struct snapshot *next;
+
+	for (; s; s = next) {
+		next = s->s_next;
+		xfree(s->s_text.ob_buf);
+		xfree(s->s_gzip.ob_buf);
+		xfree(s);
+	}
+}
+
+/*
+ * Metric names may only consist of [a-zA-Z0-9_:], anything else in an
+ * attribute name is replaced with an underscore.
+ */
+static void put_name(struct outbuf *ob, const char *name)
+{
+	for (; *name; name++) {
+		if (isalnum((unsigned char) *name) || *name == '_')
+			outbuf_putc(ob, *name);
+		else
+			outbuf_putc(ob, '_');
+	}
+}
+
+/* Label values and help texts escape backslashes, quotes and newlines */
+static void put_escaped(struct outbuf *ob, const char *value)
+{
+	const char *p;
+
+	for (p = value; *p; p++) {
+		if (*p != '\\' && *p != '"' && *p != '\n')
+			continue;
+
+		outbuf_put(ob, value, p - value);
+		outbuf_putc(ob, '\\');
+		outbuf_putc(ob, *p == '\n' ? 'n' : *p);
+		value = p + 1;
+	}
+
+	outbuf_puts(ob, value);
+}
+
+static void put_label(struct outbuf *ob, const char *name, const char *value)
+{
+	outbuf_puts(ob, name);
+	outbuf_put(ob, "=\"", 2);
+	put_escaped(ob, value);
+	outbuf_putc(ob, '"');
+}
+
+struct family
+{
+	struct outbuf *		f_ob;
+	struct attr_def *	f_def;
+	int			f_index;
+	int			f_counter;
+	int			f_bytes;
+};
+
+static void put_family_name(struct family *f)
+{
+	outbuf_put(f->f_ob, "bmon_", 5);
+	put_name(f->f_ob, f->f_def->ad_name);
+
+	if (f->f_bytes)
+		outbuf_put(f->f_ob, "_bytes", 6);
+}
+
+static void put_sample(struct family *f, struct element_group *g,
+		       struct element *e, const char *dir, struct rate *r)
+{
+	struct outbuf *ob = f->f_ob;
+
+	put_family_name(f);
+
+	if (f->f_counter)
+		outbuf_put(ob, "_total", 6);
+
+	outbuf_putc(ob, '{');
+	put_label(ob, "group", g->g_name);
+	outbuf_putc(ob, ',');
+	put_label(ob, "element", e->e_name);
+
+	if (e->e_parent) {
+		outbuf_putc(ob, ',');
+		put_label(ob, "parent", e->e_parent->e_name);
+	}
+
+	outbuf_putc(ob, ',');
+	put_label(ob, "direction", dir);
+	outbuf_put(ob, "} ", 2);
+	outbuf_u64(ob, rate_get_total(r), 0);
+	outbuf_putc(ob, '\n');
+}
+
+static void draw_element(struct element_group *g, struct element *e, void *arg)
+{
+	struct family *f = arg;
+	struct attr *a;
+
+	if (!(a = attr_set_get(&c_attrs, f->f_index, e)))
+		return;
+
+	if (a->a_flags & ATTR_RX_ENABLED)
+		put_sample(f, g, e, "rx", &a->a_rx_rate);
+
+	if (a->a_flags & ATTR_TX_ENABLED)
+		put_sample(f, g, e, "tx", &a->a_tx_rate);
+}
+
+static void draw_family(struct outbuf *ob, int index)
+{
+	struct family f = {
+		.f_ob		= ob,
+		.f_index	= index,
+	};
+
+	if (!(f.f_def = attr_set_def(&c_attrs, index)))
+		return;
+
+	f.f_counter = (f.f_def->ad_type == ATTR_TYPE_COUNTER);
+
+	/* OpenMetrics requires the unit to be a suffix of the name */
+	if (f.f_def->ad_unit && !strcmp(f.f_def->ad_unit->u_name, UNIT_BYTE)) {
+		size_t len = strlen(f.f_def->ad_name);
+
+		f.f_bytes = len < 5 ||
+			    strcmp(f.f_def->ad_name + len - 5, "bytes");
+	}
+
+	outbuf_puts(ob, "# TYPE ");
+	put_family_name(&f);
+	outbuf_puts(ob, f.f_counter ? " counter\n" : " gauge\n");
+
+	if (f.f_def->ad_unit && !strcmp(f.f_def->ad_unit->u_name, UNIT_BYTE)) {
+		outbuf_puts(ob, "# UNIT ");
+		put_family_name(&f);
+		outbuf_puts(ob, " bytes\n");
+	}
+
+	if (f.f_def->ad_description) {
+		outbuf_puts(ob, "# HELP ");
+		put_family_name(&f);
+		outbuf_putc(ob, ' ');
+		put_escaped(ob, f.f_def->ad_description);
+		outbuf_putc(ob, '\n');
+	}
+
+	if (c_top.t_n)
+		top_foreach(&c_top, draw_element, &f);
+	else
+		group_foreach_recursive(draw_element, &f);
+}
+
+static void prometheus_draw(void)
+{
+	int i;
+
+	pending = snapshot_get();
+
+	for (i = 0; i < c_attrs.as_n; i++)
+		draw_family(&pending->s_text, i);
+
+	outbuf_puts(&pending->s_text, "# EOF\n");
+}
+
+static void prometheus_post(void)
+{
+	/* post runs on every wakeup, not only after drawing */
+	if (!pending)
+		return;
+
+	pthread_mutex_lock(&snapshot_lock);
+
+	if (current)
+		snapshot_put(current);
+
+	current = pending;
+	pending = NULL;
+
+	pthread_mutex_unlock(&snapshot_lock);
+}
+
+#ifdef HAVE_LIBZ
+static int compress_snapshot(struct snapshot *s)
+{
+	struct outbuf *gz = &s->s_gzip;
+	z_stream zs = { 0 };
+	int err;
+
+	if (s->s_gzip_done)
+		return gz->ob_len ? 0 : -1;
+
+	s->s_gzip_done = 1;
+
+	/* windowBits + 16 selects the gzip wrapper */
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+			 Z_DEFAULT_STRATEGY) != Z_OK)
+		return -1;
+
+	outbuf_reserve(gz, deflateBound(&zs, s->s_text.ob_len));
+
+	zs.next_in = (Bytef *) s->s_text.ob_buf;
+	zs.avail_in = s->s_text.ob_len;
+	zs.next_out = (Bytef *) gz->ob_buf;
+	zs.avail_out = gz->ob_size;
+
+	err = deflate(&zs, Z_FINISH);
+	gz->ob_len = (err == Z_STREAM_END) ? zs.total_out : 0;
+	deflateEnd(&zs);
+
+	return gz->ob_len ? 0 : -1;
+}
+#endif
+
+/*
+ * Scrapes are served concurrently from non-blocking sockets. Every
+ * connection has PROM_TIMEOUT seconds to send its request and read the
+ * response so a stalled client cannot hold up the others.
+ */
+struct client
+{
+	int			c_fd;
+	timestamp_t		c_start;
+	char			c_req[PROM_MAX_REQUEST];
+	size_t			c_len;
+
+	/* response, c_hdr followed by c_body */
+	char			c_hdr[512];
+	size_t			c_hdr_len;
+	const char *		c_body;
+	size_t			c_body_len;
+	size_t			c_sent;
+
+	/* snapshot c_body points into, if any */
+	struct snapshot *	c_snapshot;
+};
+
+static struct client clients[PROM_MAX_CLIENTS];
+static int nclients;
+
+static void respond(struct client *c, const char *status, const char *type,
+		    const char *encoding, const char *body, size_t len,
+		    int head)
+{
+	c->c_hdr_len = snprintf(c->c_hdr, sizeof(c->c_hdr),
+		"HTTP/1.1 %s\r\n"
+		"Content-Type: %s\r\n"
+		"%s%s%s"
+		"Content-Length: %zu\r\n"
+		"Connection: close\r\n"
+		"\r\n",
+		status, type,
+		encoding ? "Content-Encoding: " : "",
+		encoding ? : "", encoding ? "\r\n" : "",
+		len);
+
+	c->c_body = body;
+	c->c_body_len = head ? 0 : len;
+	c->c_sent = 0;
+}
+
+static void respond_error(struct client *c, const char *status)
+{
+	respond(c, status, "text/plain", NULL, status, strlen(status), 0);
+}
+
+/* Returns the value of header @name or NULL */
+static const char *find_header(const char *req, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p = req;
+
+	while ((p = strstr(p, "\r\n"))) {
+		p += 2;
+		if (!strncasecmp(p, name, len) && p[len] == ':')
+			return p + len + 1;
+	}
+
+	return NULL;
+}
+
+static int accepts_gzip(const char *req)
+{
+	const char *v = find_header(req, "Accept-Encoding");
+	const char *end;
+
+	if (!v)
+		return 0;
+
+	end = strstr(v, "\r\n");
+
+	for (; (v = strcasestr(v, "gzip")) && v < end; v += 4)
+		if (strncmp(v + 4, ";q=0", 4) || v[8] == '.')
+			return 1;
+
+	return 0;
+}
+
+static void handle_request(struct client *c)
+{
+	const char *req = c->c_req;
+	struct snapshot *s;
+	int head = 0;
+
+	if (!strncmp(req, "HEAD ", 5))
+		head = 1;
+	else if (strncmp(req, "GET ", 4)) {
+		respond_error(c, "405 Method Not Allowed");
+		return;
+	}
+
+	if (strncmp(req + (head ? 5 : 4), "/metrics", 8) ||
+	    !strchr(" ?", req[(head ? 5 : 4) + 8])) {
+		respond_error(c, "404 Not Found");
+		return;
+	}
+
+	pthread_mutex_lock(&snapshot_lock);
+	if ((s = current))
+		s->s_refcnt++;
+	pthread_mutex_unlock(&snapshot_lock);
+
+	if (!s) {
+		respond_error(c, "503 Service Unavailable");
+		return;
+	}
+
+	c->c_snapshot = s;
+
+#ifdef HAVE_LIBZ
+	/* only this thread touches the compressed copy */
+	if (accepts_gzip(req) && compress_snapshot(s) == 0)
+		respond(c, "200 OK", PROM_CONTENT_TYPE, "gzip",
+			s->s_gzip.ob_buf, s->s_gzip.ob_len, head);
+	else
+#endif
+		respond(c, "200 OK", PROM_CONTENT_TYPE, NULL,
+			s->s_text.ob_buf, s->s_text.ob_len, head);
+}
+
+/* Returns -1 if the connection is to be closed */
+static int client_read(struct client *c)
+{
+	ssize_t n;
+
+	n = recv(c->c_fd, c->c_req + c->c_len,
+		 sizeof(c->c_req) - c->c_len - 1, 0);
+	if (n < 0)
+		return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+	if (n == 0)
+		return -1;
+
+	c->c_len += n;
+	c->c_req[c->c_len] = '\0';
+
+	if (strstr(c->c_req, "\r\n\r\n") || c->c_len == sizeof(c->c_req) - 1)
+		handle_request(c);
+
+	return 0;
+}
+
+/* Returns 1 once the response has been sent, -1 on error */
+static int client_write(struct client *c)
+{
+	const char *buf;
+	size_t len;
+	ssize_t n;
+
+	if (c->c_sent < c->c_hdr_len) {
+		buf = c->c_hdr + c->c_sent;
+		len = c->c_hdr_len - c->c_sent;
+	} else {
+		buf = c->c_body + (c->c_sent - c->c_hdr_len);
+		len = c->c_body_len - (c->c_sent - c->c_hdr_len);
+	}
+
+	n = send(c->c_fd, buf, len, MSG_NOSIGNAL);
+	if (n < 0)
+		return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+
+	c->c_sent += n;
+
+	return c->c_sent == c->c_hdr_len + c->c_body_len;
+}
+
+static void client_close(int i)
+{
+	struct client *c = &clients[i];
+
+	if (c->c_snapshot) {
+		pthread_mutex_lock(&snapshot_lock);
+		snapshot_put(c->c_snapshot);
+		pthread_mutex_unlock(&snapshot_lock);
+	}
+
+	close(c->c_fd);
+
+	if (i != --nclients)
+		memcpy(c, &clients[nclients], sizeof(*c));
+}
+
+/* Returns the milliseconds left to client @c */
+static int client_left(struct client *c, timestamp_t *now)
+{
+	float left = PROM_TIMEOUT - timestamp_diff(&c->c_start, now);
+
+	return left > 0.0f ? (int) (left * 1000.0f) + 1 : 0;
+}
+
+static void *server_main(void *arg)
+{
+	struct pollfd fds[PROM_MAX_CLIENTS + 2];
+	struct client *c;
+	timestamp_t now;
+	int i, fd, done, left, timeout;
+
+	for (;;) {
+		/* leave connections in the backlog while all slots are busy */
+		fds[0].fd = listen_fd;
+		fds[0].events = nclients < PROM_MAX_CLIENTS ? POLLIN : 0;
+		fds[1].fd = wakeup_pipe[0];
+		fds[1].events = POLLIN;
+
+		update_timestamp(&now);
+		timeout = -1;
+
+		for (i = 0; i < nclients; i++) {
+			c = &clients[i];
+			fds[i + 2].fd = c->c_fd;
+			fds[i + 2].events = c->c_hdr_len ? POLLOUT : POLLIN;
+
+			left = client_left(c, &now);
+			if (timeout < 0 || left < timeout)
+				timeout = left;
+		}
+
+		if (poll(fds, nclients + 2, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (fds[1].revents)
+			break;
+
+		update_timestamp(&now);
+
+		/* closing a client moves the last one into its slot */
+		for (i = nclients - 1; i >= 0; i--) {
+			c = &clients[i];
+			done = 0;
+
+			if (fds[i + 2].revents & (POLLERR | POLLHUP | POLLNVAL))
+				done = 1;
+			else if (fds[i + 2].revents & POLLIN)
+				done = client_read(c);
+			else if (fds[i + 2].revents & POLLOUT)
+				done = client_write(c);
+
+			if (done || !client_left(c, &now))
+				client_close(i);
+		}
+
+		if (!(fds[0].revents & POLLIN))
+			continue;
+
+		fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+		if (fd < 0)
+			continue;
+
+		c = &clients[nclients++];
+		memset(c, 0, sizeof(*c));
+		c->c_fd = fd;
+		update_timestamp(&c->c_start);
+	}
+
+	while (nclients)
+		client_close(nclients - 1);
+
+	return NULL;
+}
+
+static int prometheus_probe(void)
+{
+	sigset_t set, old;
+	int err;
+
+	if ((listen_fd = net_listen(c_listen, PROM_DEFAULT_PORT)) < 0)
+		return 0;
+
+	if (pipe2(wakeup_pipe, O_CLOEXEC) < 0)
+		goto errout;
+
+	/* signals are handled by the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	err = pthread_create(&server_thread, NULL, server_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (err) {
+		fprintf(stderr, "Unable to start exporter thread: %s\n",
+			strerror(err));
+		goto errout;
+	}
+
+	server_running = 1;
+
+	return 1;
+
+errout:
+	close(listen_fd);
+	listen_fd = -1;
+	return 0;
+}
+
+static void prometheus_shutdown(void)
+{
+	if (server_running) {
+		if (write(wakeup_pipe[1], "", 1) < 0)
+			BUG();
+		pthread_join(server_thread, NULL);
+		server_running = 0;
+	}
+
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		listen_fd = -1;
+	}
+}
+
+static void print_help(void)
+{
+	printf(
+	"prometheus - Prometheus/OpenMetrics Exporter\n" \
+	"\n" \
+	"  Serves the counters of the selected attributes in the OpenMetrics\n" \
+	"  text format over HTTP. The metrics are rendered once per interval,\n" \
+	"  scrapes are served from the last rendering and compressed if the\n" \
+	"  client accepts gzip.\n" \
+	"\n" \
+	"  Options:\n" \
+	"    listen=ADDR    Address to listen on (default: 127.0.0.1:" PROM_DEFAULT_PORT ")\n" \
+	"                   ADDR may be host:port, [ipv6]:port or a port\n" \
+	"    attrs=LIST     Attributes to export, separated by '+'\n" \
+	"                   (default: bytes+packets+errors+drop)\n" \
+	"    top=NUM        Only export the NUM top level elements with the\n" \
+	"                   highest rate\n" \
+	"    topattr=ATTR   Attribute to rank by, prefix rx: or tx: to rank by\n" \
+	"                   one direction only (default: bytes)\n" \
+	"\n" \
+	"  Example:\n" \
+	"    bmon -o 'prometheus:listen=:" PROM_DEFAULT_PORT "' -p eth0\n" \
+	"    curl --compressed http://localhost:" PROM_DEFAULT_PORT "/metrics\n" \
+	"\n");
+}
+
+static void prometheus_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "listen") && value) {
+		xfree(c_listen);
+		c_listen = strdup(value);
+	} else if (!strcasecmp(type, "attrs") && value)
+		attr_set_parse(&c_attrs, value);
+	else if (!strcasecmp(type, "top") && value)
+		top_set_size(&c_top, strtol(value, NULL, 0));
+	else if (!strcasecmp(type, "topattr") && value)
+		top_set_attr(&c_top, value);
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static struct bmon_module prometheus_ops = {
+	.m_name		= "prometheus",
+	.m_probe	= prometheus_probe,
+	.m_shutdown	= prometheus_shutdown,
+	.m_do		= prometheus_draw,
+	.m_post		= prometheus_post,
+	.m_parse_opt	= prometheus_parse_opt,
+};
+
+static void __init prometheus_init(void)
+{
+	c_listen = strdup("127.0.0.1:" PROM_DEFAULT_PORT);
+	attr_set_parse(&c_attrs, "bytes+packets+errors+drop");
+	top_set_attr(&c_top, "bytes");
+
+	output_register(&prometheus_ops);
+}
+
+static void __exit prometheus_exit(void)
+{
+	prometheus_shutdown();
+
+	if (pending)
+		snapshot_put(pending);
+	if (current)
+		snapshot_put(current);
+
+	snapshot_free_list(spare);
+	attr_set_free(&c_attrs);
+	top_free(&c_top);
+	xfree(c_listen);
+}
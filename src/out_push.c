@@ -0,0 +1,608 @@
+/*
+ * out_push.c		Graphite/Influx Push Exporter
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/output.h>
+#include <bmon/group.h>
+#include <bmon/element.h>
+#include <bmon/attr.h>
+#include <bmon/net.h>
+#include <bmon/outbuf.h>
+#include <bmon/utils.h>
+
+#include <poll.h>
+
+enum {
+	PROTO_GRAPHITE,
+	PROTO_INFLUX,
+};
+
+#define PUSH_DEFAULT_MTU	1400
+#define PUSH_DEFAULT_QUEUE	(1024 * 1024)
+#define PUSH_RECONNECT_DELAY	1	/* seconds */
+
+static int c_proto = PROTO_GRAPHITE;
+static int c_tcp;
+static char *c_to;
+static char *c_prefix;
+static int c_mtu = PUSH_DEFAULT_MTU;
+static size_t c_queue_size = PUSH_DEFAULT_QUEUE;
+static struct attr_set c_attrs;
+
+/*
+ * Sends never block. Each interval is rendered into the batch buffer
+ * and appended to a bounded queue which is drained as far as the
+ * socket accepts data. Whatever does not fit into the queue is dropped
+ * and accounted for, so a slow or dead receiver never holds up bmon.
+ *
+ * With UDP the queue holds datagrams, each prefixed with its length.
+ * With TCP it holds the plain byte stream.
+ */
+struct push_queue
+{
+	char *			q_buf;
+	size_t			q_size;
+	size_t			q_head;
+	size_t			q_tail;
+};
+
+static struct push_queue queue;
+static struct outbuf batch;
+
+static struct sockaddr_storage peer;
+static socklen_t peer_len;
+static int sock = -1;
+static int connecting;
+static time_t last_connect;
+/* the stream was cut in the middle of a line */
+static int partial;
+
+static uint64_t nsent, ndropped;
+static struct timeval tick_time;
+
+static void put_path(struct outbuf *ob, const char *s)
+{
+	for (; *s; s++) {
+		if (isalnum((unsigned char) *s) || *s == '_' || *s == '-')
+			outbuf_putc(ob, *s);
+		else
+			outbuf_putc(ob, '_');
+	}
+}
+
+static void put_element_path(struct outbuf *ob, struct element *e)
+{
+	if (e->e_parent)
+		put_element_path(ob, e->e_parent);
+
+	outbuf_putc(ob, '.');
+	put_path(ob, e->e_name);
+}
+
+static void put_graphite(struct outbuf *ob, struct element_group *g,
+			 struct element *e, const char *attr,
+			 const char *field, double value, int integer)
+{
+	outbuf_puts(ob, c_prefix);
+	outbuf_putc(ob, '.');
+	put_path(ob, g->g_name);
+	put_element_path(ob, e);
+	outbuf_putc(ob, '.');
+	put_path(ob, attr);
+	outbuf_putc(ob, '.');
+	outbuf_puts(ob, field);
+	outbuf_putc(ob, ' ');
+
+	if (integer)
+		outbuf_u64(ob, value, 0);
+	else
+		outbuf_fixed(ob, isfinite(value) ? value : 0.0, 2, 0);
+
+	outbuf_putc(ob, ' ');
+	outbuf_u64(ob, tick_time.tv_sec, 0);
+	outbuf_putc(ob, '\n');
+}
+
+static void graphite_element(struct element_group *g, struct element *e,
+			     void *arg)
+{
+	struct attr *a;
+	int i;
+
+	for (i = 0; i < c_attrs.as_n; i++) {
+		const char *name = c_attrs.as_name[i];
+
+		if (!(a = attr_set_get(&c_attrs, i, e)))
+			continue;
+
+		if (a->a_flags & ATTR_RX_ENABLED) {
+			put_graphite(&batch, g, e, name, "rx",
+				     rate_get_total(&a->a_rx_rate), 1);
+			put_graphite(&batch, g, e, name, "rxrate",
+				     a->a_rx_rate.r_rate, 0);
+		}
+
+		if (a->a_flags & ATTR_TX_ENABLED) {
+			put_graphite(&batch, g, e, name, "tx",
+				     rate_get_total(&a->a_tx_rate), 1);
+			put_graphite(&batch, g, e, name, "txrate",
+				     a->a_tx_rate.r_rate, 0);
+		}
+	}
+}
+
+/* Tag keys and values escape commas, blanks and equal signs */
+static void put_tag(struct outbuf *ob, const char *key, const char *value)
+{
+	const char *p;
+
+	outbuf_putc(ob, ',');
+	outbuf_puts(ob, key);
+	outbuf_putc(ob, '=');
+
+	for (p = value; *p; p++) {
+		if (*p != ',' && *p != ' ' && *p != '=')
+			continue;
+
+		outbuf_put(ob, value, p - value);
+		outbuf_putc(ob, '\\');
+		value = p;
+	}
+
+	outbuf_puts(ob, value);
+}
+
+static void put_field(struct outbuf *ob, int *nfields, const char *attr,
+		      const char *field, uint64_t total, float rate)
+{
+	outbuf_putc(ob, (*nfields)++ ? ',' : ' ');
+	put_path(ob, attr);
+	outbuf_putc(ob, '_');
+	outbuf_puts(ob, field);
+	outbuf_putc(ob, '=');
+	outbuf_u64(ob, total, 0);
+	outbuf_put(ob, "i,", 2);
+	put_path(ob, attr);
+	outbuf_putc(ob, '_');
+	outbuf_puts(ob, field);
+	outbuf_put(ob, "rate=", 5);
+	outbuf_fixed(ob, isfinite(rate) ? rate : 0.0, 2, 0);
+}
+
+static void influx_element(struct element_group *g, struct element *e,
+			   void *arg)
+{
+	size_t start = batch.ob_len;
+	int i, nfields = 0;
+	struct attr *a;
+
+	outbuf_puts(&batch, "bmon");
+	put_tag(&batch, "group", g->g_name);
+	put_tag(&batch, "element", e->e_name);
+	if (e->e_parent)
+		put_tag(&batch, "parent", e->e_parent->e_name);
+
+	for (i = 0; i < c_attrs.as_n; i++) {
+		if (!(a = attr_set_get(&c_attrs, i, e)))
+			continue;
+
+		if (a->a_flags & ATTR_RX_ENABLED)
+			put_field(&batch, &nfields, c_attrs.as_name[i], "rx",
+				  rate_get_total(&a->a_rx_rate),
+				  a->a_rx_rate.r_rate);
+
+		if (a->a_flags & ATTR_TX_ENABLED)
+			put_field(&batch, &nfields, c_attrs.as_name[i], "tx",
+				  rate_get_total(&a->a_tx_rate),
+				  a->a_tx_rate.r_rate);
+	}
+
+	/* a line without fields is invalid */
+	if (!nfields) {
+		batch.ob_len = start;
+		return;
+	}
+
+	outbuf_putc(&batch, ' ');
+	outbuf_u64(&batch, tick_time.tv_sec * 1000000000ULL +
+			   tick_time.tv_usec * 1000ULL, 0);
+	outbuf_putc(&batch, '\n');
+}
+
+/* Reports the number of records lost so far along with the data */
+static void put_drops(void)
+{
+	if (c_proto == PROTO_INFLUX) {
+		outbuf_puts(&batch, "bmon_push dropped=");
+		outbuf_u64(&batch, ndropped, 0);
+		outbuf_put(&batch, "i ", 2);
+		outbuf_u64(&batch, tick_time.tv_sec * 1000000000ULL +
+				   tick_time.tv_usec * 1000ULL, 0);
+	} else {
+		outbuf_puts(&batch, c_prefix);
+		outbuf_puts(&batch, ".push.dropped ");
+		outbuf_u64(&batch, ndropped, 0);
+		outbuf_putc(&batch, ' ');
+		outbuf_u64(&batch, tick_time.tv_sec, 0);
+	}
+
+	outbuf_putc(&batch, '\n');
+}
+
+static void push_draw(void)
+{
+	gettimeofday(&tick_time, NULL);
+
+	batch.ob_len = 0;
+
+	/* first so it survives if the queue only takes part of the batch */
+	put_drops();
+
+	if (c_proto == PROTO_INFLUX)
+		group_foreach_recursive(influx_element, NULL);
+	else
+		group_foreach_recursive(graphite_element, NULL);
+}
+
+static unsigned int count_lines(const char *buf, size_t len)
+{
+	unsigned int n = 0;
+	const char *end = buf + len;
+
+	while ((buf = memchr(buf, '\n', end - buf))) {
+		buf++;
+		n++;
+	}
+
+	return n;
+}
+
+static int queue_append(struct push_queue *q, const void *hdr, size_t hlen,
+			const char *data, size_t len)
+{
+	if (q->q_size - (q->q_tail - q->q_head) < hlen + len) {
+		ndropped += count_lines(data, len);
+		return -ENOBUFS;
+	}
+
+	if (q->q_tail + hlen + len > q->q_size) {
+		memmove(q->q_buf, q->q_buf + q->q_head, q->q_tail - q->q_head);
+		q->q_tail -= q->q_head;
+		q->q_head = 0;
+	}
+
+	if (hlen)
+		memcpy(q->q_buf + q->q_tail, hdr, hlen);
+	memcpy(q->q_buf + q->q_tail + hlen, data, len);
+	q->q_tail += hlen + len;
+
+	return 0;
+}
+
+/* Queues as many complete lines as fit */
+static void enqueue_stream(const char *buf, size_t len)
+{
+	size_t room = queue.q_size - (queue.q_tail - queue.q_head);
+	const char *eol;
+
+	if (len > room) {
+		eol = room ? memrchr(buf, '\n', room) : NULL;
+		room = eol ? eol + 1 - buf : 0;
+
+		ndropped += count_lines(buf + room, len - room);
+		len = room;
+	}
+
+	if (len)
+		queue_append(&queue, NULL, 0, buf, len);
+}
+
+/* Splits the batch into datagrams at line boundaries */
+static void enqueue_datagrams(const char *buf, size_t len)
+{
+	const char *end = buf + len, *start = buf, *eol;
+	uint16_t dlen;
+
+	while (buf < end) {
+		if (!(eol = memchr(buf, '\n', end - buf)))
+			eol = end - 1;
+
+		/* flush before the line that would exceed the mtu */
+		if (buf > start && eol + 1 - start > c_mtu) {
+			dlen = buf - start;
+			queue_append(&queue, &dlen, sizeof(dlen), start, dlen);
+			start = buf;
+		}
+
+		buf = eol + 1;
+	}
+
+	if (buf > start) {
+		dlen = buf - start;
+		queue_append(&queue, &dlen, sizeof(dlen), start, dlen);
+	}
+}
+
+static void disconnect(void)
+{
+	close(sock);
+	sock = -1;
+	connecting = 0;
+}
+
+static int do_connect(void)
+{
+	int type = c_tcp ? SOCK_STREAM : SOCK_DGRAM;
+
+	if (time(NULL) - last_connect < PUSH_RECONNECT_DELAY)
+		return -EAGAIN;
+
+	last_connect = time(NULL);
+
+	sock = socket(peer.ss_family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -errno;
+
+	if (connect(sock, (struct sockaddr *) &peer, peer_len) < 0) {
+		if (errno != EINPROGRESS) {
+			DBG("Unable to connect to %s: %s", c_to, strerror(errno));
+			disconnect();
+			return -errno;
+		}
+
+		connecting = 1;
+	}
+
+	return 0;
+}
+
+/* Returns 0 once a pending TCP connect has completed */
+static int check_connected(void)
+{
+	struct pollfd pfd = { .fd = sock, .events = POLLOUT };
+	socklen_t len = sizeof(int);
+	int err = 0;
+
+	if (poll(&pfd, 1, 0) <= 0)
+		return -EAGAIN;
+
+	if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+		DBG("Unable to connect to %s: %s", c_to, strerror(err));
+		disconnect();
+		return -ECONNREFUSED;
+	}
+
+	connecting = 0;
+
+	/* resume at the start of the next complete line */
+	if (partial) {
+		char *p = memchr(queue.q_buf + queue.q_head, '\n',
+				 queue.q_tail - queue.q_head);
+
+		queue.q_head = p ? p + 1 - queue.q_buf : queue.q_tail;
+		ndropped++;
+		partial = 0;
+	}
+
+	return 0;
+}
+
+static void drain_udp(void)
+{
+	struct push_queue *q = &queue;
+	uint16_t len;
+	ssize_t n;
+
+	while (q->q_head < q->q_tail) {
+		memcpy(&len, q->q_buf + q->q_head, sizeof(len));
+
+		n = send(sock, q->q_buf + q->q_head + sizeof(len), len, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/*
+			 * Buffer full or a previous datagram was refused,
+			 * try again next time.
+			 */
+			break;
+		}
+
+		q->q_head += sizeof(len) + len;
+		nsent++;
+	}
+}
+
+static void drain_tcp(void)
+{
+	struct push_queue *q = &queue;
+	ssize_t n;
+
+	while (q->q_head < q->q_tail) {
+		n = send(sock, q->q_buf + q->q_head, q->q_tail - q->q_head,
+			 MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				DBG("Lost connection to %s: %s",
+				    c_to, strerror(errno));
+				disconnect();
+			}
+			break;
+		}
+
+		q->q_head += n;
+		nsent += n;
+
+		/* the peer never sees the rest if the connection breaks */
+		partial = (q->q_buf[q->q_head - 1] != '\n');
+	}
+}
+
+static void push_post(void)
+{
+	struct push_queue *q = &queue;
+
+	/* post runs on every wakeup, not only after drawing */
+	if (batch.ob_len) {
+		if (c_tcp)
+			enqueue_stream(batch.ob_buf, batch.ob_len);
+		else
+			enqueue_datagrams(batch.ob_buf, batch.ob_len);
+
+		batch.ob_len = 0;
+	}
+
+	if (q->q_head == q->q_tail) {
+		q->q_head = q->q_tail = 0;
+		return;
+	}
+
+	if (sock < 0 && do_connect() < 0)
+		return;
+
+	if (connecting && check_connected() < 0)
+		return;
+
+	if (c_tcp)
+		drain_tcp();
+	else
+		drain_udp();
+}
+
+static int push_probe(void)
+{
+	const char *port = (c_proto == PROTO_INFLUX) ? "8089" : "2003";
+
+	if (c_mtu < 64 || c_mtu > 65507) {
+		fprintf(stderr, "Invalid mtu %d\n", c_mtu);
+		return 0;
+	}
+
+	if (net_resolve(c_to, port, c_tcp ? SOCK_STREAM : SOCK_DGRAM,
+			&peer, &peer_len) < 0)
+		return 0;
+
+	queue.q_buf = xcalloc(1, c_queue_size);
+	queue.q_size = c_queue_size;
+
+	return 1;
+}
+
+static void push_shutdown(void)
+{
+	if (sock >= 0)
+		disconnect();
+
+	DBG("Pushed %" PRIu64 " datagrams/bytes, dropped %" PRIu64 " records",
+	    nsent, ndropped);
+}
+
+static void print_help(void)
+{
+	printf(
+	"push - Graphite/Influx Push Exporter\n" \
+	"\n" \
+	"  Sends the counters and rates of the selected attributes of all\n" \
+	"  elements every interval in the Graphite plaintext or the Influx\n" \
+	"  line protocol. Records are batched into datagrams of up to mtu\n" \
+	"  bytes or streamed over TCP. Sending never blocks, records which\n" \
+	"  do not fit into the queue are dropped and reported in the\n" \
+	"  metric <prefix>.push.dropped or the dropped field of bmon_push.\n" \
+	"\n" \
+	"  Options:\n" \
+	"    proto=PROTO    graphite or influx (default: graphite)\n" \
+	"    to=ADDR        Receiver, host:port or [ipv6]:port\n" \
+	"                   (default: 127.0.0.1:2003, influx: 127.0.0.1:8089)\n" \
+	"    tcp            Stream over TCP instead of sending datagrams\n" \
+	"    mtu=NUM        Maximum datagram payload (default: %d)\n" \
+	"    queue=NUM      Queue size in bytes (default: %d)\n" \
+	"    prefix=STR     Graphite path prefix (default: bmon)\n" \
+	"    attrs=LIST     Attributes to send, separated by '+'\n" \
+	"                   (default: bytes+packets)\n" \
+	"\n" \
+	"  Example:\n" \
+	"    bmon -o 'push:proto=influx;to=10.0.0.1' -p eth0\n" \
+	"    bmon.intf.eth0.bytes.rx 123456789 1381234567\n" \
+	"\n", PUSH_DEFAULT_MTU, PUSH_DEFAULT_QUEUE);
+}
+
+static void push_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "proto") && value) {
+		if (!strcasecmp(value, "graphite"))
+			c_proto = PROTO_GRAPHITE;
+		else if (!strcasecmp(value, "influx"))
+			c_proto = PROTO_INFLUX;
+		else
+			quit("Unknown protocol \"%s\"\n", value);
+	} else if (!strcasecmp(type, "to") && value) {
+		xfree(c_to);
+		c_to = strdup(value);
+	} else if (!strcasecmp(type, "tcp"))
+		c_tcp = 1;
+	else if (!strcasecmp(type, "mtu") && value)
+		c_mtu = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "queue") && value)
+		c_queue_size = strtoul(value, NULL, 0);
+	else if (!strcasecmp(type, "prefix") && value) {
+		xfree(c_prefix);
+		c_prefix = strdup(value);
+	} else if (!strcasecmp(type, "attrs") && value)
+		attr_set_parse(&c_attrs, value);
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static struct bmon_module push_ops = {
+	.m_name		= "push",
+	.m_probe	= push_probe,
+	.m_shutdown	= push_shutdown,
+	.m_do		= push_draw,
+	.m_post		= push_post,
+	.m_parse_opt	= push_parse_opt,
+};
+
+static void __init push_init(void)
+{
+	c_to = strdup("127.0.0.1");
+	c_prefix = strdup("bmon");
+	attr_set_parse(&c_attrs, "bytes+packets");
+
+	output_register(&push_ops);
+}
+
+static void __exit push_exit(void)
+{
+	xfree(queue.q_buf);
+	xfree(batch.ob_buf);
+	xfree(c_to);
+	xfree(c_prefix);
+	attr_set_free(&c_attrs);
+}
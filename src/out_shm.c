@@ -0,0 +1,297 @@
+/*
+ * out_shm.c		Shared Memory Export
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/output.h>
+#include <bmon/group.h>
+#include <bmon/element.h>
+#include <bmon/attr.h>
+#include <bmon/shm.h>
+#include <bmon/utils.h>
+
+#include <sys/mman.h>
+
+#define SHM_DEFAULT_CAPACITY	1024
+
+static char *c_name;
+static unsigned int c_capacity = SHM_DEFAULT_CAPACITY;
+static struct attr_set c_attrs;
+
+static struct bmon_shm_hdr *hdr;
+static size_t map_size;
+static unsigned int nelements;
+static int truncated;
+
+static void copy_name(char *dst, const char *src)
+{
+	strncpy(dst, src ? src : "", BMON_SHM_NAMSIZ - 1);
+}
+
+static void update_element(struct element_group *g, struct element *e,
+			   void *arg)
+{
+	struct bmon_shm_element *se;
+	struct attr *a;
+	int i;
+
+	if (nelements >= c_capacity) {
+		truncated = 1;
+		return;
+	}
+
+	se = bmon_shm_element(hdr, nelements++);
+	memset(se, 0, hdr->sh_stride);
+
+	copy_name(se->se_group, g->g_name);
+	copy_name(se->se_name, e->e_name);
+	copy_name(se->se_parent, e->e_parent ? e->e_parent->e_name : NULL);
+	se->se_level = e->e_level;
+	se->se_id = e->e_id;
+
+	for (i = 0; i < c_attrs.as_n; i++) {
+		struct bmon_shm_attr *sa = &se->se_attr[i];
+
+		if (!(a = attr_set_get(&c_attrs, i, e)))
+			continue;
+
+		if (a->a_flags & ATTR_RX_ENABLED)
+			sa->sa_flags |= BMON_SHM_ATTR_RX;
+		if (a->a_flags & ATTR_TX_ENABLED)
+			sa->sa_flags |= BMON_SHM_ATTR_TX;
+
+		sa->sa_rx = rate_get_total(&a->a_rx_rate);
+		sa->sa_tx = rate_get_total(&a->a_tx_rate);
+		sa->sa_rx_rate = a->a_rx_rate.r_rate;
+		sa->sa_tx_rate = a->a_tx_rate.r_rate;
+	}
+}
+
+/*
+ * Runs on the main thread and publishes the snapshot of the element
+ * tree, see bmon/snapshot.h. The sampling thread is never held up, the
+ * update itself is a few plain stores per element between the two
+ * sequence increments.
+ */
+static void shm_draw(void)
+{
+	uint32_t seq = hdr->sh_seq;
+	struct timeval tv;
+
+	__atomic_store_n(&hdr->sh_seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	nelements = 0;
+	truncated = 0;
+	group_foreach_recursive(update_element, NULL);
+
+	gettimeofday(&tv, NULL);
+
+	hdr->sh_nelements = nelements;
+	hdr->sh_generation++;
+	hdr->sh_update_sec = tv.tv_sec;
+	hdr->sh_update_usec = tv.tv_usec;
+
+	if (truncated)
+		hdr->sh_flags |= BMON_SHM_TRUNCATED;
+	else
+		hdr->sh_flags &= ~BMON_SHM_TRUNCATED;
+
+	__atomic_store_n(&hdr->sh_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Returns the pid of a running bmon publishing region @name or 0 */
+static pid_t shm_writer(const char *name)
+{
+	struct bmon_shm_hdr *old;
+	struct stat st;
+	pid_t pid = 0;
+	int fd;
+
+	if ((fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0)) < 0)
+		return 0;
+
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(*old)) {
+		close(fd);
+		return 0;
+	}
+
+	old = mmap(NULL, sizeof(*old), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (old == MAP_FAILED)
+		return 0;
+
+	/* a region which was never completed has no owner either */
+	if (__atomic_load_n(&old->sh_magic, __ATOMIC_ACQUIRE) == BMON_SHM_MAGIC &&
+	    old->sh_pid > 0 && old->sh_pid != getpid() &&
+	    (kill(old->sh_pid, 0) == 0 || errno == EPERM))
+		pid = old->sh_pid;
+
+	munmap(old, sizeof(*old));
+
+	return pid;
+}
+
+static int shm_probe(void)
+{
+	pid_t pid;
+	size_t stride;
+	int fd, i;
+	void *map;
+
+	if (c_attrs.as_n > BMON_SHM_MAX_ATTRS) {
+		fprintf(stderr, "Too many attributes, at most %d supported\n",
+			BMON_SHM_MAX_ATTRS);
+		return 0;
+	}
+
+	stride = sizeof(struct bmon_shm_element) +
+		 c_attrs.as_n * sizeof(struct bmon_shm_attr);
+	stride = (stride + 7) & ~7UL;
+	map_size = sizeof(struct bmon_shm_hdr) + c_capacity * stride;
+
+	if ((pid = shm_writer(c_name))) {
+		fprintf(stderr, "Shared memory \"%s\" is in use by bmon "
+			"(pid %d)\n", c_name, (int) pid);
+		return 0;
+	}
+
+	/*
+	 * Start over with a new object, readers still mapping the region
+	 * of a stale instance keep their copy.
+	 */
+	shm_unlink(c_name);
+
+	if ((fd = shm_open(c_name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+			   0644)) < 0) {
+		fprintf(stderr, "Unable to create shared memory \"%s\": %s\n",
+			c_name, strerror(errno));
+		return 0;
+	}
+
+	if (ftruncate(fd, map_size) < 0) {
+		fprintf(stderr, "Unable to size shared memory \"%s\": %s\n",
+			c_name, strerror(errno));
+		goto errout;
+	}
+
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Unable to map shared memory \"%s\": %s\n",
+			c_name, strerror(errno));
+		goto errout;
+	}
+
+	close(fd);
+
+	hdr = map;
+	hdr->sh_version = BMON_SHM_VERSION;
+	hdr->sh_size = map_size;
+	hdr->sh_capacity = c_capacity;
+	hdr->sh_stride = stride;
+	hdr->sh_nattrs = c_attrs.as_n;
+	hdr->sh_pid = getpid();
+
+	for (i = 0; i < c_attrs.as_n; i++)
+		copy_name(hdr->sh_attr_name[i], c_attrs.as_name[i]);
+
+	/* readers check the magic first */
+	__atomic_store_n(&hdr->sh_magic, BMON_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	return 1;
+
+errout:
+	close(fd);
+	shm_unlink(c_name);
+	return 0;
+}
+
+static void shm_shutdown(void)
+{
+	if (!hdr)
+		return;
+
+	munmap(hdr, map_size);
+	shm_unlink(c_name);
+	hdr = NULL;
+}
+
+static void print_help(void)
+{
+	printf(
+	"shm - Shared Memory Export\n" \
+	"\n" \
+	"  Publishes the counters and rates of all elements in a shared\n" \
+	"  memory region (/dev/shm) which is updated every interval. Local\n" \
+	"  programs can read it without any system call using the reader\n" \
+	"  library, see bmon/shm.h and the bmon-shm-read example.\n" \
+	"\n" \
+	"  Options:\n" \
+	"    name=NAME      Name of region (default: %s)\n" \
+	"    max=NUM        Maximum number of elements (default: %d)\n" \
+	"    attrs=LIST     Attributes to publish, separated by '+'\n" \
+	"                   (default: bytes+packets, at most %d)\n" \
+	"\n", BMON_SHM_DEFAULT_NAME, SHM_DEFAULT_CAPACITY, BMON_SHM_MAX_ATTRS);
+}
+
+static void shm_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "name") && value) {
+		xfree(c_name);
+		c_name = xcalloc(1, strlen(value) + 2);
+		sprintf(c_name, "%s%s", value[0] == '/' ? "" : "/", value);
+	} else if (!strcasecmp(type, "max") && value)
+		c_capacity = strtoul(value, NULL, 0);
+	else if (!strcasecmp(type, "attrs") && value)
+		attr_set_parse(&c_attrs, value);
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static struct bmon_module shm_ops = {
+	.m_name		= "shm",
+	.m_probe	= shm_probe,
+	.m_shutdown	= shm_shutdown,
+	.m_do		= shm_draw,
+	.m_parse_opt	= shm_parse_opt,
+};
+
+static void __init shm_init(void)
+{
+	c_name = strdup(BMON_SHM_DEFAULT_NAME);
+	attr_set_parse(&c_attrs, "bytes+packets");
+
+	output_register(&shm_ops);
+}
+
+static void __exit shm_exit(void)
+{
+	shm_shutdown();
+	attr_set_free(&c_attrs);
+	xfree(c_name);
+}
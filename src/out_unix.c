@@ -0,0 +1,843 @@
+/*
+ * out_unix.c		Unix Socket Subscriptions
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/output.h>
+#include <bmon/group.h>
+#include <bmon/element.h>
+#include <bmon/attr.h>
+#include <bmon/outbuf.h>
+#include <bmon/subscribe.h>
+#include <bmon/utils.h>
+
+#include <sys/un.h>
+#include <poll.h>
+#include <fnmatch.h>
+
+#define UNIX_DEFAULT_PATH	"/tmp/bmon.sock"
+#define UNIX_DEFAULT_CLIENTS	64
+#define UNIX_DEFAULT_QUEUE	(256 * 1024)
+#define UNIX_MAX_REQUEST	1024
+#define SERIES_HASH_SIZE	1024
+
+static char *c_path;
+static int c_max_clients = UNIX_DEFAULT_CLIENTS;
+static size_t c_queue = UNIX_DEFAULT_QUEUE;
+
+/*
+ * A series is an attribute of an element, identified by the names of
+ * group, element, parent and attribute so that it keeps its id if an
+ * element disappears and comes back before all clients were told. Once
+ * no client knows it any more the series is released and its id is
+ * handed out again. The values of all series are captured when drawing,
+ * frames for the clients are built from the captured values afterwards.
+ */
+struct series
+{
+	uint32_t		s_id;
+	/* group, element, parent and attribute name, NUL separated */
+	char *			s_names;
+	uint16_t		s_names_len;
+	uint16_t		s_level;
+	const char *		s_attr_name;
+	const char *		s_group;
+	const char *		s_element;
+
+	int			s_live;
+	unsigned long		s_seen;
+	/* clients the series is defined for */
+	unsigned int		s_nclients;
+
+	uint32_t		s_flags;
+	uint64_t		s_rx;
+	uint64_t		s_tx;
+	float			s_rx_rate;
+	float			s_tx_rate;
+
+	struct series *		s_hash_next;
+};
+
+/* indexed by id, NULL for released ids */
+static struct series **series;
+static unsigned int nseries;
+static uint32_t *free_ids;
+static unsigned int nfree;
+static struct series *series_hash[SERIES_HASH_SIZE];
+
+/*
+ * Series of the last walk in walk order. As long as the element tree
+ * does not change the walk visits the same attributes in the same order
+ * and the series can be taken from here without a name lookup.
+ */
+struct walk_slot
+{
+	struct element *	w_element;
+	struct attr *		w_attr;
+	struct series *		w_series;
+};
+
+static struct walk_slot *walk;
+static unsigned int nwalk, walk_size, walk_valid;
+static unsigned int walk_tree_gen;
+
+static unsigned long tick;
+static uint64_t tick_time;
+
+#define CS_CHECKED		(1 << 0)	/* match has been evaluated */
+#define CS_MATCH		(1 << 1)	/* subscribed */
+#define CS_DEFINED		(1 << 2)	/* client knows the id */
+
+struct client_series
+{
+	uint8_t			cs_flags;
+	uint32_t		cs_vflags;
+	uint64_t		cs_rx;
+	uint64_t		cs_tx;
+	float			cs_rx_rate;
+	float			cs_tx_rate;
+};
+
+struct client
+{
+	int			c_fd;
+
+	char			c_in[UNIX_MAX_REQUEST];
+	size_t			c_inlen;
+
+	/* frames not yet written, starting at c_outoff */
+	struct outbuf		c_out;
+	size_t			c_outoff;
+
+	/* subscription */
+	int			c_active;
+	char *			c_group;
+	char *			c_element;
+	struct attr_set		c_attrs;
+	double			c_interval;
+	double			c_next;
+	unsigned long		c_tick;
+
+	struct client_series *	c_series;
+	unsigned int		c_nseries;
+
+	struct list_head	c_list;
+};
+
+static LIST_HEAD(clients);
+static int nclients;
+static int listen_fd = -1;
+
+static unsigned int hash_names(const char *names, size_t len)
+{
+	unsigned int h = 5381;
+
+	while (len--)
+		h = (h * 33) ^ (unsigned char) *names++;
+
+	return h % SERIES_HASH_SIZE;
+}
+
+static struct series *series_get(struct element_group *g, struct element *e,
+				 struct attr *a)
+{
+	const char *parent = e->e_parent ? e->e_parent->e_name : "";
+	char names[512];
+	struct series *s;
+	unsigned int h;
+	int len;
+
+	len = snprintf(names, sizeof(names), "%s%c%s%c%s%c%s",
+		       g->g_name, 0, e->e_name, 0, parent, 0,
+		       a->a_def->ad_name);
+	if (len >= sizeof(names) - 4)
+		return NULL;
+
+	/* NUL terminate the last name and pad to a multiple of 4 */
+	memset(names + len, 0, 4);
+	len = (len + 4) & ~3;
+
+	h = hash_names(names, len);
+
+	for (s = series_hash[h]; s; s = s->s_hash_next)
+		if (s->s_names_len == len && !memcmp(s->s_names, names, len))
+			return s;
+
+	s = xcalloc(1, sizeof(*s));
+	s->s_names = xcalloc(1, len);
+	memcpy(s->s_names, names, len);
+	s->s_names_len = len;
+	s->s_level = e->e_level;
+	s->s_group = s->s_names;
+	s->s_element = s->s_group + strlen(s->s_group) + 1;
+	s->s_attr_name = s->s_element + strlen(s->s_element) + 1;
+	s->s_attr_name += strlen(s->s_attr_name) + 1;
+
+	s->s_hash_next = series_hash[h];
+	series_hash[h] = s;
+
+	if (nfree)
+		s->s_id = free_ids[--nfree];
+	else {
+		s->s_id = nseries++;
+		series = xrealloc(series, nseries * sizeof(*series));
+		free_ids = xrealloc(free_ids, nseries * sizeof(*free_ids));
+	}
+
+	series[s->s_id] = s;
+
+	return s;
+}
+
+static void series_free(struct series *s)
+{
+	xfree(s->s_names);
+	xfree(s);
+}
+
+static void series_release(struct series *s)
+{
+	struct series **pp;
+	struct client *c;
+
+	pp = &series_hash[hash_names(s->s_names, s->s_names_len)];
+	while (*pp != s)
+		pp = &(*pp)->s_hash_next;
+	*pp = s->s_hash_next;
+
+	/* the id may come back with other names, match it again */
+	list_for_each_entry(c, &clients, c_list)
+		if (s->s_id < c->c_nseries)
+			memset(&c->c_series[s->s_id], 0,
+			       sizeof(struct client_series));
+
+	series[s->s_id] = NULL;
+	free_ids[nfree++] = s->s_id;
+
+	series_free(s);
+}
+
+static void walk_attr(struct element *e, struct attr *a, void *arg)
+{
+	struct element_group *g = arg;
+	struct walk_slot *w;
+	struct series *s;
+
+	if (nwalk >= walk_size) {
+		walk_size = walk_size ? walk_size * 2 : 64;
+		walk = xrealloc(walk, walk_size * sizeof(*walk));
+	}
+
+	w = &walk[nwalk];
+
+	if (nwalk < walk_valid && w->w_element == e && w->w_attr == a)
+		s = w->w_series;
+	else {
+		if (!(s = series_get(g, e, a)))
+			return;
+
+		w->w_element = e;
+		w->w_attr = a;
+		w->w_series = s;
+
+		/* later slots of the previous walk are off by now */
+		walk_valid = nwalk;
+	}
+
+	nwalk++;
+
+	s->s_live = 1;
+	s->s_seen = tick;
+	s->s_flags = 0;
+	if (a->a_flags & ATTR_RX_ENABLED)
+		s->s_flags |= BMON_SUB_RX;
+	if (a->a_flags & ATTR_TX_ENABLED)
+		s->s_flags |= BMON_SUB_TX;
+	s->s_rx = rate_get_total(&a->a_rx_rate);
+	s->s_tx = rate_get_total(&a->a_tx_rate);
+	s->s_rx_rate = a->a_rx_rate.r_rate;
+	s->s_tx_rate = a->a_tx_rate.r_rate;
+}
+
+static void walk_element(struct element_group *g, struct element *e,
+			 void *arg)
+{
+	element_foreach_attr(e, walk_attr, g);
+}
+
+static void unix_draw(void)
+{
+	struct timeval tv;
+	struct series *s;
+	unsigned int i;
+
+	if (!nclients)
+		return;
+
+	tick++;
+	gettimeofday(&tv, NULL);
+	tick_time = tv.tv_sec * 1000000ULL + tv.tv_usec;
+
+	if (walk_tree_gen != group_tree_gen) {
+		walk_tree_gen = group_tree_gen;
+		walk_valid = 0;
+	}
+
+	nwalk = 0;
+	group_foreach_recursive(walk_element, NULL);
+	walk_valid = nwalk;
+
+	for (i = 0; i < nseries; i++) {
+		if (!(s = series[i]) || s->s_seen == tick)
+			continue;
+
+		s->s_live = 0;
+
+		/* removal has been sent to every client knowing it */
+		if (!s->s_nclients)
+			series_release(s);
+	}
+}
+
+/* Forgets all series defined for client @c */
+static void client_forget(struct client *c)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->c_nseries; i++) {
+		if (c->c_series[i].cs_flags & CS_DEFINED)
+			series[i]->s_nclients--;
+
+		c->c_series[i].cs_flags = 0;
+	}
+}
+
+static void client_free(struct client *c)
+{
+	client_forget(c);
+	close(c->c_fd);
+	list_del(&c->c_list);
+	nclients--;
+
+	xfree(c->c_out.ob_buf);
+	xfree(c->c_group);
+	xfree(c->c_element);
+	attr_set_free(&c->c_attrs);
+	xfree(c->c_series);
+	xfree(c);
+}
+
+static struct bmon_sub_frame *frame_begin(struct outbuf *ob, int type)
+{
+	struct bmon_sub_frame *f;
+
+	outbuf_reserve(ob, sizeof(*f));
+	f = (struct bmon_sub_frame *) (ob->ob_buf + ob->ob_len);
+	memset(f, 0, sizeof(*f));
+	ob->ob_len += sizeof(*f);
+
+	return f;
+}
+
+/*
+ * Writes the frame header at @start once the records are known. The
+ * buffer may have moved while appending records.
+ */
+static void frame_end(struct outbuf *ob, size_t start, int type,
+		      uint32_t count)
+{
+	struct bmon_sub_frame *f;
+
+	if (!count) {
+		ob->ob_len = start;
+		return;
+	}
+
+	f = (struct bmon_sub_frame *) (ob->ob_buf + start);
+	f->f_magic = BMON_SUB_MAGIC;
+	f->f_len = ob->ob_len - start;
+	f->f_type = type;
+	f->f_count = count;
+	f->f_time = tick_time;
+}
+
+static void send_error(struct client *c, const char *msg)
+{
+	size_t start = c->c_out.ob_len;
+
+	frame_begin(&c->c_out, BMON_SUB_ERROR);
+	outbuf_put(&c->c_out, msg, strlen(msg) + 1);
+	while (c->c_out.ob_len & 3)
+		outbuf_putc(&c->c_out, '\0');
+	frame_end(&c->c_out, start, BMON_SUB_ERROR, 1);
+}
+
+static int series_matches(struct client *c, struct series *s)
+{
+	int i;
+
+	if (c->c_group && fnmatch(c->c_group, s->s_group, 0))
+		return 0;
+
+	if (c->c_element && fnmatch(c->c_element, s->s_element, 0))
+		return 0;
+
+	if (!c->c_attrs.as_n)
+		return 1;
+
+	for (i = 0; i < c->c_attrs.as_n; i++)
+		if (!strcmp(c->c_attrs.as_name[i], s->s_attr_name))
+			return 1;
+
+	return 0;
+}
+
+static struct client_series *client_series(struct client *c,
+					   struct series *s)
+{
+	struct client_series *cs = &c->c_series[s->s_id];
+
+	if (!(cs->cs_flags & CS_CHECKED)) {
+		cs->cs_flags |= CS_CHECKED;
+		if (series_matches(c, s))
+			cs->cs_flags |= CS_MATCH;
+	}
+
+	return cs;
+}
+
+static int value_changed(struct client_series *cs, struct series *s)
+{
+	return cs->cs_vflags != s->s_flags || cs->cs_rx != s->s_rx ||
+	       cs->cs_tx != s->s_tx || cs->cs_rx_rate != s->s_rx_rate ||
+	       cs->cs_tx_rate != s->s_tx_rate;
+}
+
+static void client_frames(struct client *c)
+{
+	struct outbuf *ob = &c->c_out;
+	struct client_series *cs;
+	struct series *s;
+	uint32_t n = 0;
+	size_t start;
+	unsigned int i;
+
+	if (c->c_nseries < nseries) {
+		c->c_series = xrealloc(c->c_series,
+				       nseries * sizeof(*c->c_series));
+		memset(c->c_series + c->c_nseries, 0,
+		       (nseries - c->c_nseries) * sizeof(*c->c_series));
+		c->c_nseries = nseries;
+	}
+
+	/* series gone since the last frame */
+	start = ob->ob_len;
+	frame_begin(ob, BMON_SUB_REMOVE);
+	for (i = 0; i < nseries; i++) {
+		if (!(s = series[i]))
+			continue;
+
+		cs = client_series(c, s);
+
+		if (!s->s_live && (cs->cs_flags & CS_DEFINED)) {
+			cs->cs_flags &= ~CS_DEFINED;
+			s->s_nclients--;
+			outbuf_put(ob, (char *) &s->s_id, sizeof(s->s_id));
+			n++;
+		}
+	}
+	frame_end(ob, start, BMON_SUB_REMOVE, n);
+
+	/* series the client has not seen yet */
+	n = 0;
+	start = ob->ob_len;
+	frame_begin(ob, BMON_SUB_DEFINE);
+	for (i = 0; i < nseries; i++) {
+		struct bmon_sub_define d;
+
+		s = series[i];
+		cs = &c->c_series[i];
+
+		if (!s || !s->s_live || !(cs->cs_flags & CS_MATCH) ||
+		    (cs->cs_flags & CS_DEFINED))
+			continue;
+
+		d.d_id = s->s_id;
+		d.d_len = s->s_names_len;
+		d.d_level = s->s_level;
+		outbuf_put(ob, (char *) &d, sizeof(d));
+		outbuf_put(ob, s->s_names, s->s_names_len);
+
+		/* forces the values to be sent */
+		cs->cs_flags |= CS_DEFINED;
+		s->s_nclients++;
+		cs->cs_vflags = ~0U;
+		n++;
+	}
+	frame_end(ob, start, BMON_SUB_DEFINE, n);
+
+	n = 0;
+	start = ob->ob_len;
+	frame_begin(ob, BMON_SUB_VALUES);
+	for (i = 0; i < nseries; i++) {
+		struct bmon_sub_value v;
+
+		s = series[i];
+		cs = &c->c_series[i];
+
+		if (!s || !(cs->cs_flags & CS_DEFINED) || !value_changed(cs, s))
+			continue;
+
+		v.v_id = s->s_id;
+		v.v_flags = s->s_flags;
+		v.v_rx = s->s_rx;
+		v.v_tx = s->s_tx;
+		v.v_rx_rate = s->s_rx_rate;
+		v.v_tx_rate = s->s_tx_rate;
+		outbuf_put(ob, (char *) &v, sizeof(v));
+
+		cs->cs_vflags = s->s_flags;
+		cs->cs_rx = s->s_rx;
+		cs->cs_tx = s->s_tx;
+		cs->cs_rx_rate = s->s_rx_rate;
+		cs->cs_tx_rate = s->s_tx_rate;
+		n++;
+	}
+	frame_end(ob, start, BMON_SUB_VALUES, n);
+}
+
+static void subscribe(struct client *c, char *req)
+{
+	char *opt, *value, *save;
+
+	xfree(c->c_group);
+	xfree(c->c_element);
+	attr_set_free(&c->c_attrs);
+	c->c_group = c->c_element = NULL;
+	c->c_interval = 0;
+
+	for (opt = strtok_r(req, ";", &save); opt;
+	     opt = strtok_r(NULL, ";", &save)) {
+		if (!(value = strchr(opt, '='))) {
+			send_error(c, "Option without value");
+			continue;
+		}
+
+		*value++ = '\0';
+
+		if (!strcmp(opt, "group"))
+			c->c_group = strdup(value);
+		else if (!strcmp(opt, "element"))
+			c->c_element = strdup(value);
+		else if (!strcmp(opt, "attrs"))
+			attr_set_parse(&c->c_attrs, value);
+		else if (!strcmp(opt, "interval"))
+			c->c_interval = strtod(value, NULL);
+		else
+			send_error(c, "Unknown option");
+	}
+
+	/* start over, everything is defined again */
+	client_forget(c);
+	c->c_active = 1;
+	c->c_next = 0;
+	c->c_tick = 0;
+}
+
+static int client_read(struct client *c)
+{
+	char *eol;
+	ssize_t n;
+
+	n = recv(c->c_fd, c->c_in + c->c_inlen,
+		 sizeof(c->c_in) - c->c_inlen - 1, 0);
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+		return -1;
+	if (n < 0)
+		return 0;
+
+	c->c_inlen += n;
+	c->c_in[c->c_inlen] = '\0';
+
+	while ((eol = strchr(c->c_in, '\n'))) {
+		*eol = '\0';
+		if (eol > c->c_in && eol[-1] == '\r')
+			eol[-1] = '\0';
+
+		subscribe(c, c->c_in);
+
+		c->c_inlen -= eol + 1 - c->c_in;
+		memmove(c->c_in, eol + 1, c->c_inlen + 1);
+	}
+
+	if (c->c_inlen >= sizeof(c->c_in) - 1)
+		return -1;
+
+	return 0;
+}
+
+static int client_write(struct client *c)
+{
+	struct outbuf *ob = &c->c_out;
+	ssize_t n;
+
+	while (c->c_outoff < ob->ob_len) {
+		n = send(c->c_fd, ob->ob_buf + c->c_outoff,
+			 ob->ob_len - c->c_outoff, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -1;
+
+			/* keep a slow reader from growing the buffer */
+			if (c->c_outoff > ob->ob_len / 2) {
+				ob->ob_len -= c->c_outoff;
+				memmove(ob->ob_buf, ob->ob_buf + c->c_outoff,
+					ob->ob_len);
+				c->c_outoff = 0;
+			}
+
+			return 0;
+		}
+
+		c->c_outoff += n;
+	}
+
+	ob->ob_len = c->c_outoff = 0;
+
+	return 0;
+}
+
+static void accept_clients(void)
+{
+	struct client *c;
+	int fd;
+
+	while ((fd = accept4(listen_fd, NULL, NULL,
+			     SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		if (nclients >= c_max_clients) {
+			close(fd);
+			continue;
+		}
+
+		c = xcalloc(1, sizeof(*c));
+		c->c_fd = fd;
+		c->c_out.ob_fd = fd;
+		list_add_tail(&c->c_list, &clients);
+		nclients++;
+	}
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+/*
+ * Runs outside of the collector lock on every wakeup of the main loop.
+ * Nothing in here blocks. A client whose queue is above the limit does
+ * not get new frames, it catches up with the latest values once it has
+ * read the pending ones.
+ */
+static void unix_post(void)
+{
+	struct client *c, *n;
+	struct pollfd pfd;
+	double t = now();
+
+	accept_clients();
+
+	list_for_each_entry_safe(c, n, &clients, c_list) {
+		pfd.fd = c->c_fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		if (poll(&pfd, 1, 0) > 0) {
+			if ((pfd.revents & (POLLERR | POLLHUP)) &&
+			    !(pfd.revents & POLLIN)) {
+				client_free(c);
+				continue;
+			}
+
+			if ((pfd.revents & POLLIN) && client_read(c) < 0) {
+				client_free(c);
+				continue;
+			}
+		}
+
+		if (c->c_active && c->c_tick != tick && t >= c->c_next &&
+		    c->c_out.ob_len - c->c_outoff < c_queue) {
+			client_frames(c);
+			c->c_tick = tick;
+			c->c_next = t + c->c_interval;
+		}
+
+		if (c->c_out.ob_len && client_write(c) < 0)
+			client_free(c);
+	}
+}
+
+/* Returns 1 if another process is accepting connections on @addr */
+static int socket_in_use(struct sockaddr_un *addr)
+{
+	int fd, err;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return 0;
+
+	/* a full backlog still means someone is listening */
+	err = connect(fd, (struct sockaddr *) addr, sizeof(*addr));
+	err = (err == 0 || errno == EAGAIN);
+	close(fd);
+
+	return err;
+}
+
+static int unix_probe(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct stat st;
+
+	if (strlen(c_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path \"%s\" too long\n", c_path);
+		return 0;
+	}
+
+	strcpy(addr.sun_path, c_path);
+
+	if (lstat(c_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		if (socket_in_use(&addr)) {
+			fprintf(stderr, "Socket \"%s\" is in use by another "
+				"process\n", c_path);
+			return 0;
+		}
+
+		/* stale socket of a previous instance */
+		unlink(c_path);
+	}
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0 ||
+	    bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(listen_fd, 16) < 0) {
+		fprintf(stderr, "Unable to listen on \"%s\": %s\n",
+			c_path, strerror(errno));
+		if (listen_fd >= 0)
+			close(listen_fd);
+		listen_fd = -1;
+		return 0;
+	}
+
+	return 1;
+}
+
+static void unix_shutdown(void)
+{
+	struct client *c, *n;
+
+	list_for_each_entry_safe(c, n, &clients, c_list)
+		client_free(c);
+
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		unlink(c_path);
+		listen_fd = -1;
+	}
+}
+
+static void print_help(void)
+{
+	printf(
+	"unix - Unix Socket Subscriptions\n" \
+	"\n" \
+	"  Accepts clients on a Unix socket. Clients subscribe to a set of\n" \
+	"  elements and attributes and receive binary frames carrying the\n" \
+	"  values which changed since their last frame. The protocol is\n" \
+	"  described in bmon/subscribe.h.\n" \
+	"\n" \
+	"  Options:\n" \
+	"    path=PATH      Socket path (default: %s)\n" \
+	"    max=NUM        Maximum number of clients (default: %d)\n" \
+	"    queue=NUM      Bytes queued per client before frames are\n" \
+	"                   held back (default: %d)\n" \
+	"\n" \
+	"  Example:\n" \
+	"    bmon -o 'unix,curses'\n" \
+	"    client writes: element=eth*;attrs=bytes+packets;interval=1\n" \
+	"\n", UNIX_DEFAULT_PATH, UNIX_DEFAULT_CLIENTS, UNIX_DEFAULT_QUEUE);
+}
+
+static void unix_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "path") && value) {
+		xfree(c_path);
+		c_path = strdup(value);
+	} else if (!strcasecmp(type, "max") && value)
+		c_max_clients = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "queue") && value)
+		c_queue = strtoul(value, NULL, 0);
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static struct bmon_module unix_ops = {
+	.m_name		= "unix",
+	.m_probe	= unix_probe,
+	.m_shutdown	= unix_shutdown,
+	.m_do		= unix_draw,
+	.m_post		= unix_post,
+	.m_parse_opt	= unix_parse_opt,
+};
+
+static void __init unix_init(void)
+{
+	c_path = strdup(UNIX_DEFAULT_PATH);
+
+	output_register(&unix_ops);
+}
+
+static void __exit unix_exit(void)
+{
+	unsigned int i;
+
+	unix_shutdown();
+
+	for (i = 0; i < nseries; i++)
+		if (series[i])
+			series_free(series[i]);
+
+	xfree(series);
+	xfree(free_ids);
+	xfree(walk);
+	xfree(c_path);
+}
@@ -0,0 +1,302 @@
+/*
+ * outbuf.c		Output Buffer
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <bmon/bmon.h>
+#include <bmon/outbuf.h>
+#include <bmon/utils.h>
+
+#define OUTBUF_MIN_SIZE		4096
+
+static const char digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const uint64_t pow10_table[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL,
+};
+
+void outbuf_reserve(struct outbuf *ob, size_t len)
+{
+	size_t size = ob->ob_size ? ob->ob_size : OUTBUF_MIN_SIZE;
+
+	while (size < ob->ob_len + len)
+		size *= 2;
+
+	if (size != ob->ob_size) {
+		ob->ob_buf = xrealloc(ob->ob_buf, size);
+		ob->ob_size = size;
+	}
+}
+
+/**
+ * Write out buffered output
+ * @ob		Output buffer
+ *
+ * The buffer is emptied even if writing fails. Returns 0 or a negative
+ * error code.
+ */
+int outbuf_flush(struct outbuf *ob)
+{
+	size_t off = 0;
+	ssize_t n;
+	int err = 0;
+
+	while (off < ob->ob_len) {
+		n = write(ob->ob_fd, ob->ob_buf + off, ob->ob_len - off);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			break;
+		}
+
+		off += n;
+	}
+
+	ob->ob_len = 0;
+
+	return err;
+}
+
+void outbuf_printf(struct outbuf *ob, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	if (ob->ob_size - ob->ob_len < 128)
+		outbuf_reserve(ob, 128);
+
+	va_start(args, fmt);
+	n = vsnprintf(ob->ob_buf + ob->ob_len, ob->ob_size - ob->ob_len,
+		      fmt, args);
+	va_end(args);
+
+	if (n < 0)
+		return;
+
+	if (n >= ob->ob_size - ob->ob_len) {
+		outbuf_reserve(ob, n + 1);
+
+		va_start(args, fmt);
+		vsnprintf(ob->ob_buf + ob->ob_len, n + 1, fmt, args);
+		va_end(args);
+	}
+
+	ob->ob_len += n;
+}
+
+static void pad(struct outbuf *ob, int n)
+{
+	if (n <= 0)
+		return;
+
+	if (ob->ob_len + n > ob->ob_size)
+		outbuf_reserve(ob, n);
+
+	memset(ob->ob_buf + ob->ob_len, ' ', n);
+	ob->ob_len += n;
+}
+
+static void put_aligned(struct outbuf *ob, const char *s, int len, int width)
+{
+	if (width > 0)
+		pad(ob, width - len);
+
+	outbuf_put(ob, s, len);
+
+	if (width < 0)
+		pad(ob, -width - len);
+}
+
+void outbuf_str(struct outbuf *ob, const char *s, int width)
+{
+	put_aligned(ob, s, strlen(s), width);
+}
+
+/* Formats v right aligned into the end of buf, returns start of digits */
+static char *format_u64(char *end, uint64_t v)
+{
+	char *p = end;
+
+	while (v >= 100) {
+		unsigned int i = (v % 100) * 2;
+
+		v /= 100;
+		*--p = digit_pairs[i + 1];
+		*--p = digit_pairs[i];
+	}
+
+	if (v >= 10) {
+		*--p = digit_pairs[v * 2 + 1];
+		*--p = digit_pairs[v * 2];
+	} else
+		*--p = '0' + v;
+
+	return p;
+}
+
+void outbuf_u64(struct outbuf *ob, uint64_t v, int width)
+{
+	char buf[24], *end = buf + sizeof(buf), *p;
+
+	p = format_u64(end, v);
+	put_aligned(ob, p, end - p, width);
+}
+
+/**
+ * Append fixed point number
+ * @ob		Output buffer
+ * @v		Value
+ * @prec	Number of digits after the decimal point
+ * @width	Field width, see outbuf_str()
+ *
+ * Equivalent to "%*.*f" but without going through printf for the usual
+ * range of rates and counters.
+ */
+void outbuf_fixed(struct outbuf *ob, double v, int prec, int width)
+{
+	char buf[48], *end = buf + sizeof(buf), *p;
+	uint64_t m, scale;
+	int neg;
+
+	if (prec < 0 || prec >= ARRAY_SIZE(pow10_table) || !isfinite(v) ||
+	    fabs(v) >= 1e15) {
+		if (width < 0)
+			outbuf_printf(ob, "%-*.*f", -width, prec, v);
+		else
+			outbuf_printf(ob, "%*.*f", width, prec, v);
+		return;
+	}
+
+	scale = pow10_table[prec];
+	neg = signbit(v);
+
+	/* rint() rounds ties to even like printf does */
+	m = (uint64_t) rint(fabs(v) * scale);
+
+	p = end;
+
+	if (prec) {
+		uint64_t frac = m % scale;
+		int i;
+
+		for (i = 0; i < prec; i++) {
+			*--p = '0' + (frac % 10);
+			frac /= 10;
+		}
+
+		*--p = '.';
+	}
+
+	p = format_u64(p, m / scale);
+
+	if (neg)
+		*--p = '-';
+
+	put_aligned(ob, p, end - p, width);
+}
+
+/* Writes a JSON string literal, NULL is written as null */
+void outbuf_json_str(struct outbuf *ob, const char *s)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *p;
+
+	if (!s) {
+		outbuf_put(ob, "null", 4);
+		return;
+	}
+
+	outbuf_putc(ob, '"');
+
+	for (p = s; *p; p++) {
+		unsigned char c = *p;
+
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		outbuf_put(ob, s, p - s);
+		s = p + 1;
+
+		switch (c) {
+		case '"':
+			outbuf_put(ob, "\\\"", 2);
+			break;
+		case '\\':
+			outbuf_put(ob, "\\\\", 2);
+			break;
+		case '\n':
+			outbuf_put(ob, "\\n", 2);
+			break;
+		case '\t':
+			outbuf_put(ob, "\\t", 2);
+			break;
+		default:
+			outbuf_put(ob, "\\u00", 4);
+			outbuf_putc(ob, hex[c >> 4]);
+			outbuf_putc(ob, hex[c & 15]);
+			break;
+		}
+	}
+
+	outbuf_put(ob, s, p - s);
+	outbuf_putc(ob, '"');
+}
+
+/* Writes a CSV field, quoted only if it has to be */
+void outbuf_csv_str(struct outbuf *ob, const char *s)
+{
+	const char *p;
+
+	if (!s)
+		return;
+
+	if (!s[strcspn(s, ",\"\r\n")]) {
+		outbuf_puts(ob, s);
+		return;
+	}
+
+	outbuf_putc(ob, '"');
+
+	for (p = s; *p; p++) {
+		if (*p == '"') {
+			outbuf_put(ob, s, p - s + 1);
+			s = p;
+		}
+	}
+
+	outbuf_puts(ob, s);
+	outbuf_putc(ob, '"');
+}
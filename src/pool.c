@@ -0,0 +1,306 @@
+/*
+ * pool.c		Object Pools
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/pool.h>
+#include <bmon/utils.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/* Target size of a chunk, large objects get a chunk of their own */
+#define POOL_CHUNK_SIZE		16384
+
+#define POOL_ALIGN		16
+
+/* Size classes 16 bytes .. 16 MiB */
+#define SIZE_CLASS_MIN_SHIFT	4
+#define NR_SIZE_CLASSES		21
+
+struct pool_chunk
+{
+	struct list_head	pc_list;
+} __attribute__ ((aligned (POOL_ALIGN)));
+
+static LIST_HEAD(pool_list);
+
+static struct pool size_pools[NR_SIZE_CLASSES];
+static char size_pool_names[NR_SIZE_CLASSES][16];
+
+static void pool_setup(struct pool *p)
+{
+	if (p->p_size < sizeof(void *))
+		p->p_size = sizeof(void *);
+
+	p->p_size = (p->p_size + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+
+	p->p_chunk_objs = POOL_CHUNK_SIZE / p->p_size;
+	if (!p->p_chunk_objs)
+		p->p_chunk_objs = 1;
+
+	list_add_tail(&p->p_list, &pool_list);
+
+	DBG("New pool %s objsize=%zu objs/chunk=%u",
+	    p->p_name, p->p_size, p->p_chunk_objs);
+}
+
+static void pool_grow(struct pool *p)
+{
+	struct pool_chunk *c;
+	char *obj;
+	int i;
+
+	if (!p->p_chunk_objs)
+		pool_setup(p);
+
+	c = xcalloc(1, sizeof(*c) + (p->p_chunk_objs * p->p_size));
+	list_add_tail(&c->pc_list, &p->p_chunks);
+	p->p_nchunks++;
+
+	obj = (char *) (c + 1);
+
+	for (i = 0; i < p->p_chunk_objs; i++, obj += p->p_size) {
+		*(void **) obj = p->p_free_list;
+		p->p_free_list = obj;
+		p->p_nfree++;
+	}
+}
+
+/**
+ * Allocate object from pool
+ * @p		Object pool
+ *
+ * Returns a zeroed object of the size the pool was defined with. Aborts
+ * if the pool cannot be grown, just like xcalloc().
+ */
+void *pool_alloc(struct pool *p)
+{
+	void *obj;
+
+	if (!p->p_free_list)
+		pool_grow(p);
+
+	obj = p->p_free_list;
+	p->p_free_list = *(void **) obj;
+
+	p->p_nfree--;
+	p->p_inuse++;
+	p->p_allocs++;
+
+	memset(obj, 0, p->p_size);
+
+	return obj;
+}
+
+void pool_free(struct pool *p, void *obj)
+{
+	if (!obj)
+		return;
+
+	*(void **) obj = p->p_free_list;
+	p->p_free_list = obj;
+
+	p->p_nfree++;
+	p->p_inuse--;
+	p->p_frees++;
+}
+
+static struct pool *size_class(size_t size)
+{
+	struct pool *p;
+	int i;
+
+	for (i = 0; i < NR_SIZE_CLASSES; i++)
+		if (size <= (1UL << (i + SIZE_CLASS_MIN_SHIFT)))
+			break;
+
+	if (i >= NR_SIZE_CLASSES)
+		return NULL;
+
+	p = &size_pools[i];
+
+	if (!p->p_name) {
+		snprintf(size_pool_names[i], sizeof(size_pool_names[i]),
+			 "size-%lu", 1UL << (i + SIZE_CLASS_MIN_SHIFT));
+
+		p->p_name = size_pool_names[i];
+		p->p_size = 1UL << (i + SIZE_CLASS_MIN_SHIFT);
+		init_list_head(&p->p_chunks);
+		init_list_head(&p->p_list);
+	}
+
+	return p;
+}
+
+void *pool_alloc_size(size_t size)
+{
+	struct pool *p;
+
+	if (!(p = size_class(size)))
+		return xcalloc(1, size);
+
+	return pool_alloc(p);
+}
+
+void pool_free_size(void *obj, size_t size)
+{
+	struct pool *p;
+
+	if (!obj)
+		return;
+
+	if (!(p = size_class(size)))
+		xfree(obj);
+	else
+		pool_free(p, obj);
+}
+
+char *pool_strdup(const char *s)
+{
+	size_t len = strlen(s) + 1;
+
+	return memcpy(pool_alloc_size(len), s, len);
+}
+
+void pool_strfree(char *s)
+{
+	if (s)
+		pool_free_size(s, strlen(s) + 1);
+}
+
+static int chunk_cmp(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t) *(struct pool_chunk * const *) a;
+	uintptr_t y = (uintptr_t) *(struct pool_chunk * const *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Index of the chunk holding obj in the sorted chunk array */
+static size_t chunk_index(struct pool_chunk **chunks, size_t n, void *obj)
+{
+	size_t lo = 0, hi = n;
+
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+
+		if ((uintptr_t) chunks[mid] <= (uintptr_t) obj)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Returns the number of chunks released */
+static unsigned long pool_trim(struct pool *p)
+{
+	struct pool_chunk **chunks, *c;
+	unsigned int *nfree;
+	unsigned long ntrimmed = 0;
+	size_t n = 0, i;
+	void *obj, **link;
+
+	if (!p->p_nchunks || p->p_nfree < p->p_chunk_objs)
+		return 0;
+
+	chunks = xcalloc(p->p_nchunks, sizeof(*chunks));
+	nfree = xcalloc(p->p_nchunks, sizeof(*nfree));
+
+	list_for_each_entry(c, &p->p_chunks, pc_list)
+		chunks[n++] = c;
+
+	qsort(chunks, n, sizeof(*chunks), chunk_cmp);
+
+	for (obj = p->p_free_list; obj; obj = *(void **) obj)
+		nfree[chunk_index(chunks, n, obj)]++;
+
+	/* unlink the objects of chunks without objects in use */
+	for (link = &p->p_free_list; (obj = *link); ) {
+		if (nfree[chunk_index(chunks, n, obj)] == p->p_chunk_objs)
+			*link = *(void **) obj;
+		else
+			link = obj;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (nfree[i] != p->p_chunk_objs)
+			continue;
+
+		list_del(&chunks[i]->pc_list);
+		xfree(chunks[i]);
+
+		p->p_nchunks--;
+		p->p_nfree -= p->p_chunk_objs;
+		ntrimmed++;
+	}
+
+	xfree(chunks);
+	xfree(nfree);
+
+	return ntrimmed;
+}
+
+/**
+ * Return chunks without objects in use
+ *
+ * Chunks are otherwise kept for reuse. Meant to be called after many
+ * objects have been freed at once, e.g. when histories are evicted.
+ * The cost is proportional to the number of free objects.
+ */
+void pool_trim_all(void)
+{
+	struct pool *p;
+	unsigned long ntrimmed = 0;
+
+	list_for_each_entry(p, &pool_list, p_list)
+		ntrimmed += pool_trim(p);
+
+	if (!ntrimmed)
+		return;
+
+	DBG("Released %lu pool chunks", ntrimmed);
+
+#ifdef __GLIBC__
+	/* chunks are small enough to be served from the heap */
+	malloc_trim(0);
+#endif
+}
+
+size_t pool_bytes(struct pool *p)
+{
+	return p->p_nchunks * (sizeof(struct pool_chunk) +
+			       (p->p_chunk_objs * p->p_size));
+}
+
+void pool_foreach(void (*cb)(struct pool *, void *), void *arg)
+{
+	struct pool *p;
+
+	list_for_each_entry(p, &pool_list, p_list)
+		cb(p, arg);
+}
@@ -0,0 +1,548 @@
+/*
+ * recorder.c		Flight Recorder
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/attr.h>
+#include <bmon/element.h>
+#include <bmon/element_cfg.h>
+#include <bmon/recorder.h>
+#include <bmon/scheduler.h>
+#include <bmon/utils.h>
+
+#include <pthread.h>
+
+#define RECORDER_MAGIC		"bmonrec"
+#define RECORDER_VERSION	1
+#define RECORDER_NAME_MAX	32
+
+enum {
+	RECORDER_CSV,
+	RECORDER_BINARY,
+};
+
+/* raw counters of one attribute in one read */
+struct rec_sample
+{
+	int64_t			rs_time;	/* usec */
+	uint16_t		rs_element;
+	uint16_t		rs_attr;
+	uint32_t		rs_pad;
+	uint64_t		rs_rx;
+	uint64_t		rs_tx;
+};
+
+struct rec_ring
+{
+	struct rec_sample *	rr_samples;
+	size_t			rr_head;	/* next sample written */
+	size_t			rr_count;
+	char			rr_reason[64];
+};
+
+/*
+ * Binary dump: header, element names, attribute names, then the
+ * samples oldest first with wall clock time.
+ */
+struct rec_file_hdr
+{
+	char			fh_magic[8];
+	uint32_t		fh_version;
+	uint32_t		fh_nelements;
+	uint32_t		fh_nattrs;
+	uint32_t		fh_pad;
+	uint64_t		fh_nsamples;
+	char			fh_reason[64];
+};
+
+/* "attr>value" or "attr>value%" of element max */
+struct rec_rule
+{
+	char *			ru_text;
+	struct attr_set		ru_attr;
+	float			ru_value;
+	int			ru_percent;
+	struct list_head	ru_list;
+};
+
+static char *rec_dir;
+static int rec_format;
+static float rec_duration, rec_holdoff;
+static struct attr_set rec_attrs;
+static LIST_HEAD(rec_rules);
+
+/* element configurations recorded, index is the element slot */
+static struct element_cfg **rec_cfgs;
+static int rec_ncfgs;
+
+static LIST_HEAD(rec_elements);
+
+static struct rec_ring rings[2];
+static struct rec_ring *active;
+static size_t rec_capacity;
+static timestamp_t rec_last_dump;
+static int rec_running;
+
+static volatile sig_atomic_t dump_requested;
+
+/* protects the hand over to the writer */
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rec_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer_thread;
+static struct rec_ring *writing;
+static int writer_exit;
+
+static void rule_free(struct rec_rule *ru)
+{
+	list_del(&ru->ru_list);
+	attr_set_free(&ru->ru_attr);
+	xfree(ru->ru_text);
+	xfree(ru);
+}
+
+/**
+ * Configure flight recorder
+ * @dir		Directory dumps are written to
+ * @format	"csv" or "binary"
+ * @attrs	Attributes recorded, e.g. "bytes+packets"
+ * @duration	Seconds kept in the ring
+ * @holdoff	Minimum seconds between dumps triggered by rules
+ *
+ * Replaces the previous configuration including all rules.
+ */
+void recorder_setup(const char *dir, const char *format, const char *attrs,
+		    float duration, float holdoff)
+{
+	struct rec_rule *ru, *n;
+
+	if (!strcasecmp(format, "csv"))
+		rec_format = RECORDER_CSV;
+	else if (!strcasecmp(format, "binary"))
+		rec_format = RECORDER_BINARY;
+	else
+		quit("Invalid recorder format \"%s\", must be "
+		     "\"csv\" or \"binary\"\n", format);
+
+	if (duration <= 0.0f)
+		quit("Recorder duration must be positive\n");
+
+	xfree(rec_dir);
+	rec_dir = strdup(dir);
+	rec_duration = duration;
+	rec_holdoff = holdoff;
+	attr_set_parse(&rec_attrs, attrs);
+
+	list_for_each_entry_safe(ru, n, &rec_rules, ru_list)
+		rule_free(ru);
+}
+
+void recorder_add_rule(const char *text)
+{
+	struct rec_rule *ru;
+	char *buf, *op, *end;
+
+	buf = strdup(text);
+
+	if (!(op = strchr(buf, '>')))
+		quit("Invalid recorder rule \"%s\", expected "
+		     "\"attribute>value\"\n", text);
+
+	*op++ = '\0';
+
+	ru = xcalloc(1, sizeof(*ru));
+	ru->ru_text = strdup(text);
+	ru->ru_value = strtod(op, &end);
+
+	if (end == op)
+		quit("Invalid value in recorder rule \"%s\"\n", text);
+
+	if (*end == '%') {
+		ru->ru_percent = 1;
+		end++;
+	}
+
+	while (isspace(*end))
+		end++;
+
+	if (*end)
+		quit("Invalid value in recorder rule \"%s\"\n", text);
+
+	attr_set_parse(&ru->ru_attr, buf);
+	if (ru->ru_attr.as_n != 1)
+		quit("Recorder rule \"%s\" must name one attribute\n", text);
+
+	list_add_tail(&ru->ru_list, &rec_rules);
+	xfree(buf);
+}
+
+void recorder_add_element(struct element_cfg *ec)
+{
+	int i;
+
+	for (i = 0; i < rec_ncfgs; i++)
+		if (rec_cfgs[i] == ec)
+			return;
+
+	rec_cfgs = xrealloc(rec_cfgs, (rec_ncfgs + 1) * sizeof(*rec_cfgs));
+	rec_cfgs[rec_ncfgs++] = ec;
+}
+
+void recorder_attach(struct element *e)
+{
+	int i;
+
+	for (i = 0; i < rec_ncfgs; i++) {
+		if (rec_cfgs[i] == e->e_cfg) {
+			e->e_record_slot = i;
+			list_add_tail(&e->e_record_list, &rec_elements);
+			return;
+		}
+	}
+}
+
+static void ring_put(struct rec_ring *r, int64_t time, int element,
+		     int attr, struct attr *a)
+{
+	struct rec_sample *s = &r->rr_samples[r->rr_head];
+
+	s->rs_time = time;
+	s->rs_element = element;
+	s->rs_attr = attr;
+	s->rs_rx = a->a_rx_rate.r_total;
+	s->rs_tx = a->a_tx_rate.r_total;
+
+	if (++r->rr_head >= rec_capacity)
+		r->rr_head = 0;
+
+	if (r->rr_count < rec_capacity)
+		r->rr_count++;
+}
+
+static struct rec_sample *ring_get(struct rec_ring *r, size_t i)
+{
+	return &r->rr_samples[(r->rr_head + rec_capacity - r->rr_count + i) %
+			      rec_capacity];
+}
+
+static int rule_fires(struct rec_rule *ru, struct element *e)
+{
+	struct attr *a;
+	float rx, tx;
+
+	if (!(a = attr_set_get(&ru->ru_attr, 0, e)))
+		return 0;
+
+	if (ru->ru_percent) {
+		if (!e->e_cfg)
+			return 0;
+
+		attr_calc_usage(a, &rx, &tx, e->e_cfg->ec_rxmax,
+				e->e_cfg->ec_txmax);
+
+		/* no maximum configured */
+		if (rx == FLT_MAX)
+			rx = 0.0f;
+		if (tx == FLT_MAX)
+			tx = 0.0f;
+	} else {
+		rx = a->a_rx_rate.r_rate;
+		tx = a->a_tx_rate.r_rate;
+	}
+
+	return rx > ru->ru_value || tx > ru->ru_value;
+}
+
+static void write_csv(FILE *fd, struct rec_ring *r, int64_t offset)
+{
+	struct rec_sample *s;
+	int64_t t;
+	size_t i;
+
+	fprintf(fd, "# bmon flight recorder, trigger: %s\n", r->rr_reason);
+	fprintf(fd, "time,element,attribute,rx,tx\n");
+
+	for (i = 0; i < r->rr_count; i++) {
+		s = ring_get(r, i);
+		t = s->rs_time + offset;
+
+		fprintf(fd, "%lld.%06lld,%s,%s,%llu,%llu\n",
+			(long long) (t / 1000000), (long long) (t % 1000000),
+			rec_cfgs[s->rs_element]->ec_name,
+			rec_attrs.as_name[s->rs_attr],
+			(unsigned long long) s->rs_rx,
+			(unsigned long long) s->rs_tx);
+	}
+}
+
+static void write_binary(FILE *fd, struct rec_ring *r, int64_t offset)
+{
+	struct rec_file_hdr hdr;
+	struct rec_sample s;
+	char name[RECORDER_NAME_MAX];
+	size_t i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.fh_magic, RECORDER_MAGIC, sizeof(RECORDER_MAGIC));
+	hdr.fh_version = RECORDER_VERSION;
+	hdr.fh_nelements = rec_ncfgs;
+	hdr.fh_nattrs = rec_attrs.as_n;
+	hdr.fh_nsamples = r->rr_count;
+	memcpy(hdr.fh_reason, r->rr_reason, sizeof(hdr.fh_reason));
+	fwrite(&hdr, sizeof(hdr), 1, fd);
+
+	for (i = 0; i < rec_ncfgs; i++) {
+		memset(name, 0, sizeof(name));
+		strncpy(name, rec_cfgs[i]->ec_name, sizeof(name) - 1);
+		fwrite(name, sizeof(name), 1, fd);
+	}
+
+	for (i = 0; i < rec_attrs.as_n; i++) {
+		memset(name, 0, sizeof(name));
+		strncpy(name, rec_attrs.as_name[i], sizeof(name) - 1);
+		fwrite(name, sizeof(name), 1, fd);
+	}
+
+	for (i = 0; i < r->rr_count; i++) {
+		s = *ring_get(r, i);
+		s.rs_time += offset;
+		fwrite(&s, sizeof(s), 1, fd);
+	}
+}
+
+static void write_dump(struct rec_ring *r)
+{
+	char path[FILENAME_MAX+1], tmp[FILENAME_MAX+1], date[32];
+	struct timeval wall;
+	timestamp_t now;
+	int64_t offset;
+	time_t t;
+	FILE *fd;
+
+	/* samples carry the monotonic time of their read */
+	gettimeofday(&wall, NULL);
+	update_timestamp(&now);
+	offset = ((int64_t) wall.tv_sec * 1000000 + wall.tv_usec) -
+		 ((int64_t) now.tv_sec * 1000000 + now.tv_usec);
+
+	t = wall.tv_sec;
+	strftime(date, sizeof(date), "%Y%m%d-%H%M%S", localtime(&t));
+	if (snprintf(path, sizeof(path), "%s/bmon-%s.%03d.%s", rec_dir, date,
+		     (int) (wall.tv_usec / 1000),
+		     rec_format == RECORDER_CSV ? "csv" : "bin") >= sizeof(path) ||
+	    snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)) {
+		errno = ENAMETOOLONG;
+		goto errout;
+	}
+
+	if (!(fd = fopen(tmp, "w")))
+		goto errout;
+
+	if (rec_format == RECORDER_CSV)
+		write_csv(fd, r, offset);
+	else
+		write_binary(fd, r, offset);
+
+	if (fclose(fd) == EOF || rename(tmp, path) < 0) {
+		unlink(tmp);
+		goto errout;
+	}
+
+	DBG("Wrote %zu samples to %s", r->rr_count, path);
+	return;
+
+errout:
+	fprintf(stderr, "Unable to write flight recorder dump %s: %s\n",
+		path, strerror(errno));
+}
+
+static void *writer_main(void *arg)
+{
+	struct rec_ring *r;
+
+	pthread_mutex_lock(&rec_lock);
+
+	for (;;) {
+		while (!writing && !writer_exit)
+			pthread_cond_wait(&rec_cond, &rec_lock);
+
+		if (!(r = writing))
+			break;
+
+		pthread_mutex_unlock(&rec_lock);
+		write_dump(r);
+		pthread_mutex_lock(&rec_lock);
+
+		r->rr_head = r->rr_count = 0;
+		writing = NULL;
+	}
+
+	pthread_mutex_unlock(&rec_lock);
+
+	return NULL;
+}
+
+/* Hand the ring over to the writer and continue in the other one */
+static void dump(timestamp_t *ts, const char *reason)
+{
+	pthread_mutex_lock(&rec_lock);
+
+	if (writing) {
+		pthread_mutex_unlock(&rec_lock);
+		DBG("Flight recorder dump in progress, ignoring %s", reason);
+		return;
+	}
+
+	snprintf(active->rr_reason, sizeof(active->rr_reason), "%s", reason);
+	writing = active;
+	active = (active == &rings[0]) ? &rings[1] : &rings[0];
+	copy_timestamp(&rec_last_dump, ts);
+
+	pthread_cond_signal(&rec_cond);
+	pthread_mutex_unlock(&rec_lock);
+}
+
+/**
+ * Record attributes of recorded elements
+ * @ts		Time of read
+ *
+ * Called after every read with the collector lock held.
+ */
+void recorder_read(timestamp_t *ts)
+{
+	char reason[64] = "";
+	struct rec_rule *ru;
+	struct element *e;
+	struct attr *a;
+	int64_t time;
+	int i;
+
+	if (!rec_running)
+		return;
+
+	time = (int64_t) ts->tv_sec * 1000000 + ts->tv_usec;
+
+	list_for_each_entry(e, &rec_elements, e_record_list) {
+		if (!(e->e_flags & ELEMENT_FLAG_UPDATED))
+			continue;
+
+		for (i = 0; i < rec_attrs.as_n; i++)
+			if ((a = attr_set_get(&rec_attrs, i, e)))
+				ring_put(active, time, e->e_record_slot, i, a);
+
+		if (reason[0])
+			continue;
+
+		list_for_each_entry(ru, &rec_rules, ru_list) {
+			if (rule_fires(ru, e)) {
+				snprintf(reason, sizeof(reason), "%s on %s",
+					 ru->ru_text, e->e_name);
+				break;
+			}
+		}
+	}
+
+	if (dump_requested) {
+		dump_requested = 0;
+		dump(ts, "signal");
+	} else if (reason[0] &&
+		   (!rec_last_dump.tv_sec ||
+		    timestamp_diff(&rec_last_dump, ts) >= rec_holdoff))
+		dump(ts, reason);
+}
+
+void recorder_request_dump(void)
+{
+	dump_requested = 1;
+}
+
+/**
+ * Allocate rings and start writer
+ *
+ * The rings are sized for one sample of every recorded attribute in
+ * every read of the scheduler tick over the duration. The tick is the
+ * fastest interval of all timers including the fast interval of
+ * adaptive ones, so the duration is covered even while sampling fast.
+ * Must be called after sched_start().
+ */
+void recorder_start(void)
+{
+	sigset_t set, old;
+	size_t reads;
+	int err;
+
+	if (!rec_dir || !*rec_dir || !rec_ncfgs || !rec_attrs.as_n)
+		return;
+
+	if (mkdir(rec_dir, 0755) < 0 && errno != EEXIST)
+		quit("Unable to create recorder directory \"%s\": %s\n",
+		     rec_dir, strerror(errno));
+
+	reads = (rec_duration / sched_tick_interval()) + 1;
+	rec_capacity = reads * rec_ncfgs * rec_attrs.as_n;
+
+	rings[0].rr_samples = xcalloc(rec_capacity, sizeof(struct rec_sample));
+	rings[1].rr_samples = xcalloc(rec_capacity, sizeof(struct rec_sample));
+	active = &rings[0];
+
+	DBG("Flight recorder keeps %zu samples (%zu bytes)", rec_capacity,
+	    2 * rec_capacity * sizeof(struct rec_sample));
+
+	/* signals are handled by the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	err = pthread_create(&writer_thread, NULL, writer_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (err)
+		quit("Unable to start recorder thread: %s\n", strerror(err));
+
+	rec_running = 1;
+}
+
+static void __exit recorder_exit(void)
+{
+	struct rec_rule *ru, *n;
+
+	/* let a dump in progress finish */
+	if (rec_running) {
+		pthread_mutex_lock(&rec_lock);
+		writer_exit = 1;
+		pthread_cond_signal(&rec_cond);
+		pthread_mutex_unlock(&rec_lock);
+
+		pthread_join(writer_thread, NULL);
+		rec_running = 0;
+	}
+
+	list_for_each_entry_safe(ru, n, &rec_rules, ru_list)
+		rule_free(ru);
+
+	attr_set_free(&rec_attrs);
+	xfree(rings[0].rr_samples);
+	xfree(rings[1].rr_samples);
+	xfree(rec_cfgs);
+	xfree(rec_dir);
+}
@@ -0,0 +1,479 @@
+/*
+ * scheduler.c	Read Scheduler
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/attr.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/scheduler.h>
+#include <bmon/utils.h>
+
+struct sched_member
+{
+	int			sm_type;
+	char *			sm_name;
+	struct sched_class *	sm_class;
+	struct list_head	sm_list;
+};
+
+static LIST_HEAD(class_list);
+static LIST_HEAD(member_list);
+
+/* input modules not listed in any schedule */
+static struct sched_class default_class = {
+	.sc_name	= "default",
+	.sc_flags	= SCHED_TIMER,
+	.sc_heap	= -1,
+};
+
+/* min-heap of timer deadlines */
+static struct sched_class **heap;
+static int heap_len, heap_size;
+
+/* timer of the input being read */
+static struct sched_class *current;
+
+static float tick_interval;
+static timestamp_t slack;
+
+/* time of the read in progress */
+static timestamp_t read_time;
+
+int sched_active;
+
+static struct sched_class *class_lookup(const char *name)
+{
+	struct sched_class *sc;
+
+	list_for_each_entry(sc, &class_list, sc_list)
+		if (!strcmp(sc->sc_name, name))
+			return sc;
+
+	return NULL;
+}
+
+struct sched_class *sched_class_add(const char *name, float interval)
+{
+	struct sched_class *sc;
+
+	if (!(sc = class_lookup(name))) {
+		sc = xcalloc(1, sizeof(*sc));
+		sc->sc_name = strdup(name);
+		sc->sc_heap = -1;
+		list_add_tail(&sc->sc_list, &class_list);
+	}
+
+	sc->sc_interval = interval;
+
+	return sc;
+}
+
+static struct sched_member *member_lookup(int type, const char *name)
+{
+	struct sched_member *sm;
+
+	list_for_each_entry(sm, &member_list, sm_list)
+		if (sm->sm_type == type && !strcmp(sm->sm_name, name))
+			return sm;
+
+	return NULL;
+}
+
+/**
+ * Add input, group or attribute to schedule
+ * @sc		Schedule
+ * @type	SCHED_INPUT, SCHED_GROUP or SCHED_ATTR
+ * @name	Name of input module, "module.part", group or attribute
+ *
+ * A member already listed in another schedule is moved.
+ */
+void sched_member_add(struct sched_class *sc, int type, const char *name)
+{
+	struct sched_member *sm;
+
+	if (!(sm = member_lookup(type, name))) {
+		sm = xcalloc(1, sizeof(*sm));
+		sm->sm_type = type;
+		sm->sm_name = strdup(name);
+		list_add_tail(&sm->sm_list, &member_list);
+	}
+
+	sm->sm_class = sc;
+
+	if (type == SCHED_INPUT)
+		sc->sc_flags |= SCHED_TIMER;
+}
+
+/**
+ * Find schedule of input, group or attribute
+ * @type	SCHED_INPUT, SCHED_GROUP or SCHED_ATTR
+ * @name	Name
+ *
+ * Input modules not listed follow the read interval, for everything
+ * else NULL is returned which is always due. Parts of a module, e.g.
+ * "netlink.tc", thus follow their module unless listed.
+ */
+struct sched_class *sched_lookup(int type, const char *name)
+{
+	struct sched_member *sm;
+	struct sched_class *sc = NULL;
+
+	if ((sm = member_lookup(type, name)))
+		sc = sm->sm_class;
+	else if (type == SCHED_INPUT && !strchr(name, '.'))
+		sc = &default_class;
+
+	if (sc)
+		sc->sc_flags |= SCHED_USED;
+
+	return sc;
+}
+
+static inline int heap_before(int a, int b)
+{
+	return !timestamp_le(&heap[b]->sc_next, &heap[a]->sc_next);
+}
+
+static void heap_swap(int a, int b)
+{
+	struct sched_class *tmp = heap[a];
+
+	heap[a] = heap[b];
+	heap[b] = tmp;
+
+	heap[a]->sc_heap = a;
+	heap[b]->sc_heap = b;
+}
+
+static void heap_push(struct sched_class *sc)
+{
+	int i, parent;
+
+	if (heap_len == heap_size) {
+		heap_size = heap_size ? heap_size * 2 : 8;
+		heap = xrealloc(heap, heap_size * sizeof(*heap));
+	}
+
+	i = heap_len++;
+	heap[i] = sc;
+	sc->sc_heap = i;
+
+	for (; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (!heap_before(i, parent))
+			break;
+		heap_swap(i, parent);
+	}
+}
+
+static struct sched_class *heap_pop(void)
+{
+	struct sched_class *top = heap[0];
+	int i = 0, child;
+
+	heap[0] = heap[--heap_len];
+	heap[0]->sc_heap = 0;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= heap_len)
+			break;
+
+		if (child + 1 < heap_len && heap_before(child + 1, child))
+			child++;
+
+		if (!heap_before(child, i))
+			break;
+
+		heap_swap(i, child);
+		i = child;
+	}
+
+	top->sc_heap = -1;
+
+	return top;
+}
+
+static void start_class(struct sched_class *sc, timestamp_t *now)
+{
+	copy_timestamp(&sc->sc_next, now);
+
+	/* timers nobody reads through would only cause wakeups */
+	if (!(sc->sc_flags & SCHED_TIMER) || !(sc->sc_flags & SCHED_USED))
+		return;
+
+	if (sc->sc_interval < tick_interval)
+		tick_interval = sc->sc_interval;
+
+	if (sc->sc_fast_interval && sc->sc_fast_interval < tick_interval)
+		tick_interval = sc->sc_fast_interval;
+
+	heap_push(sc);
+}
+
+/**
+ * Start scheduling reads
+ * @read_interval	Interval of inputs not listed in a schedule
+ *
+ * Timers must have been looked up by their inputs before, see
+ * input_schedule(). All timers are due right away.
+ */
+void sched_start(float read_interval)
+{
+	float lifetime = cfg_getfloat(cfg, "lifetime");
+	struct sched_class *sc;
+	timestamp_t now;
+
+	update_timestamp(&now);
+
+	default_class.sc_interval = read_interval;
+	tick_interval = read_interval;
+
+	list_for_each_entry(sc, &class_list, sc_list) {
+		/* elements would expire in between reads */
+		if (sc->sc_interval >= lifetime)
+			quit("Interval of schedule \"%s\" must be shorter "
+			     "than the lifetime of elements\n", sc->sc_name);
+
+		start_class(sc, &now);
+	}
+
+	/* keep the sampling thread ticking if no input is enabled */
+	if (!heap_len)
+		default_class.sc_flags |= SCHED_USED;
+
+	start_class(&default_class, &now);
+
+	/*
+	 * Deadlines less than half a tick after the one being read are
+	 * merged into its read, see sched_begin().
+	 */
+	float_to_timestamp(&slack, tick_interval / 2.0f);
+
+	DBG("Scheduler started, tick interval %.3fs", tick_interval);
+}
+
+/* Deadline of the next read, no read is due before */
+void sched_next(timestamp_t *ts)
+{
+	copy_timestamp(ts, &heap[0]->sc_next);
+}
+
+/**
+ * Mark timers and gates due
+ * @now		Time of the read
+ *
+ * Must be followed by sched_end() once the read is done.
+ */
+void sched_begin(timestamp_t *now)
+{
+	struct sched_class *sc;
+	timestamp_t limit;
+
+	copy_timestamp(&read_time, now);
+	timestamp_add(&limit, now, &slack);
+
+	while (heap_len && timestamp_le(&heap[0]->sc_next, &limit))
+		heap_pop()->sc_flags |= SCHED_DUE;
+
+	list_for_each_entry(sc, &class_list, sc_list)
+		if (!(sc->sc_flags & SCHED_TIMER) &&
+		    timestamp_le(&sc->sc_next, &limit))
+			sc->sc_flags |= SCHED_DUE;
+
+	sched_active = 1;
+}
+
+static float class_interval(struct sched_class *sc, timestamp_t *now)
+{
+	if (sc->sc_fast_interval && !timestamp_le(&sc->sc_fast_until, now))
+		return sc->sc_fast_interval;
+
+	return sc->sc_interval;
+}
+
+static void advance(struct sched_class *sc, timestamp_t *now)
+{
+	timestamp_t interval;
+
+	float_to_timestamp(&interval, class_interval(sc, now));
+	timestamp_add(&sc->sc_next, &sc->sc_next, &interval);
+
+	/* fell behind, e.g. because a read took longer than the interval */
+	if (timestamp_le(&sc->sc_next, now))
+		timestamp_add(&sc->sc_next, now, &interval);
+}
+
+static void end_class(struct sched_class *sc, timestamp_t *now)
+{
+	int flags = sc->sc_flags;
+
+	if (!(flags & SCHED_DUE))
+		return;
+
+	sc->sc_flags &= ~(SCHED_DUE | SCHED_HIT);
+
+	if (flags & SCHED_TIMER) {
+		advance(sc, now);
+		heap_push(sc);
+	} else if (flags & SCHED_HIT) {
+		/* a gate nobody read through stays due */
+		advance(sc, now);
+	}
+}
+
+void sched_end(timestamp_t *now)
+{
+	struct sched_class *sc;
+
+	sched_active = 0;
+	current = NULL;
+
+	end_class(&default_class, now);
+
+	list_for_each_entry(sc, &class_list, sc_list)
+		end_class(sc, now);
+}
+
+/*
+ * Shortest interval of all timers including their fast intervals, the
+ * highest rate at which reads happen
+ */
+float sched_tick_interval(void)
+{
+	return tick_interval ? tick_interval : cfg_read_interval;
+}
+
+/**
+ * Switch timer of input being read
+ * @sc		Timer, NULL keeps the current one
+ *
+ * Returns the previous timer.
+ */
+struct sched_class *sched_enter(struct sched_class *sc)
+{
+	struct sched_class *prev = current;
+
+	if (sc)
+		current = sc;
+
+	return prev;
+}
+
+static int is_trigger(struct sched_class *sc, struct attr_def *def)
+{
+	int i;
+
+	for (i = 0; i < sc->sc_trigger.as_n; i++)
+		if (attr_set_def(&sc->sc_trigger, i) == def)
+			return 1;
+
+	return 0;
+}
+
+/**
+ * Watch rate of attribute for activity
+ * @a		Attribute
+ * @prev	Previous rate
+ * @rate	Rate just calculated
+ *
+ * Switches the adaptive timer being read to its fast interval if the
+ * rate of a trigger attribute crossed the threshold or changed by more
+ * than the configured fraction. Every further change extends the
+ * cooldown.
+ */
+void sched_observe(struct attr *a, float prev, float rate)
+{
+	struct sched_class *sc = current;
+	timestamp_t cooldown;
+	float base, change;
+
+	if (!sched_active || !sc || !sc->sc_fast_interval ||
+	    !is_trigger(sc, a->a_def))
+		return;
+
+	base = prev > sc->sc_rate_floor ? prev : sc->sc_rate_floor;
+	change = rate > prev ? rate - prev : prev - rate;
+
+	if (!(sc->sc_rate_threshold && rate >= sc->sc_rate_threshold) &&
+	    change <= sc->sc_rate_change * base)
+		return;
+
+	if (timestamp_le(&sc->sc_fast_until, &read_time))
+		DBG("Schedule %s switches to %.3fs on %s of %s",
+		    sc->sc_name, sc->sc_fast_interval, a->a_def->ad_name,
+		    a->a_element->e_name);
+
+	float_to_timestamp(&cooldown, sc->sc_cooldown);
+	timestamp_add(&sc->sc_fast_until, &read_time, &cooldown);
+}
+
+/**
+ * Interval at which an attribute is sampled
+ * @g		Group of element
+ * @def		Attribute definition
+ *
+ * An attribute is read by the current input no more often than its
+ * group and its own schedule allow. Adaptive timers may read faster
+ * for a while, the interval returned is the slowest one.
+ */
+float sched_interval(struct element_group *g, struct attr_def *def)
+{
+	float interval = cfg_read_interval;
+
+	if (!sched_active)
+		return interval;
+
+	if (current)
+		interval = current->sc_interval;
+
+	if (g->g_sched && g->g_sched->sc_interval > interval)
+		interval = g->g_sched->sc_interval;
+
+	if (def->ad_sched && def->ad_sched->sc_interval > interval)
+		interval = def->ad_sched->sc_interval;
+
+	return interval;
+}
+
+static void __exit sched_exit(void)
+{
+	struct sched_member *sm, *smn;
+	struct sched_class *sc, *scn;
+
+	list_for_each_entry_safe(sm, smn, &member_list, sm_list) {
+		xfree(sm->sm_name);
+		xfree(sm);
+	}
+
+	list_for_each_entry_safe(sc, scn, &class_list, sc_list) {
+		attr_set_free(&sc->sc_trigger);
+		xfree(sc->sc_name);
+		xfree(sc);
+	}
+
+	xfree(heap);
+}
@@ -0,0 +1,192 @@
+/*
+ * shm_reader.c		Shared Memory Export Reader
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Reader side of the shared memory export. Deliberately independent of
+ * the rest of bmon so that it can be linked into other programs.
+ */
+
+#include <bmon/shm.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* retries spinning before yielding the CPU to the writer */
+#define SNAPSHOT_SPINS		64
+/* time to wait for an update to complete after that */
+#define SNAPSHOT_TIMEOUT_MS	50
+
+static inline void cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Map shared memory region of a running bmon
+ * @s		Reader handle
+ * @name	Name of region or NULL for the default
+ *
+ * Returns 0 or a negative error code.
+ */
+int bmon_shm_open(struct bmon_shm *s, const char *name)
+{
+	struct bmon_shm_hdr *hdr;
+	struct stat st;
+	void *map;
+	int fd, err = 0;
+
+	memset(s, 0, sizeof(*s));
+
+	if ((fd = shm_open(name ? name : BMON_SHM_DEFAULT_NAME,
+			   O_RDONLY, 0)) < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0) {
+		err = -errno;
+		goto out;
+	}
+
+	if (st.st_size < sizeof(*hdr)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		err = -errno;
+		goto out;
+	}
+
+	hdr = map;
+
+	if (__atomic_load_n(&hdr->sh_magic, __ATOMIC_ACQUIRE) != BMON_SHM_MAGIC ||
+	    hdr->sh_version != BMON_SHM_VERSION ||
+	    hdr->sh_size > st.st_size) {
+		munmap(map, st.st_size);
+		err = -EINVAL;
+		goto out;
+	}
+
+	s->s_hdr = hdr;
+	s->s_size = st.st_size;
+out:
+	close(fd);
+	return err;
+}
+
+void bmon_shm_close(struct bmon_shm *s)
+{
+	if (s->s_hdr)
+		munmap(s->s_hdr, s->s_size);
+
+	memset(s, 0, sizeof(*s));
+}
+
+/**
+ * Take consistent copy of the region
+ * @s		Reader handle
+ * @buf		Destination, at least s->s_size bytes
+ * @len		Size of destination
+ *
+ * Copies header and elements without any system call or lock. While
+ * an update is in progress, retries spinning for a short while, then
+ * yields the CPU to the writer for up to SNAPSHOT_TIMEOUT_MS. Returns
+ * the number of elements copied, -ENOBUFS if the buffer is too small
+ * or -EAGAIN if no consistent copy could be taken, e.g. because bmon
+ * died during an update.
+ */
+int bmon_shm_snapshot(struct bmon_shm *s, void *buf, size_t len)
+{
+	const struct bmon_shm_hdr *hdr = s->s_hdr;
+	struct bmon_shm_hdr *copy = buf;
+	uint64_t deadline = 0;
+	uint32_t seq, n;
+	int i;
+
+	if (len < hdr->sh_size)
+		return -ENOBUFS;
+
+	for (i = 0; ; i++) {
+		if (i > SNAPSHOT_SPINS) {
+			if (!deadline)
+				deadline = now_ms() + SNAPSHOT_TIMEOUT_MS;
+			else if (now_ms() >= deadline)
+				return -EAGAIN;
+
+			sched_yield();
+		} else if (i)
+			cpu_relax();
+
+		seq = __atomic_load_n(&hdr->sh_seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		memcpy(copy, hdr, sizeof(*copy));
+
+		n = copy->sh_nelements;
+		if (n > copy->sh_capacity)
+			n = copy->sh_capacity;
+
+		memcpy(copy + 1, hdr + 1, (size_t) n * copy->sh_stride);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&hdr->sh_seq, __ATOMIC_RELAXED) == seq) {
+			copy->sh_nelements = n;
+			return n;
+		}
+	}
+}
+
+/* Returns the index of the attribute in the element records or -1 */
+int bmon_shm_attr_index(const struct bmon_shm_hdr *hdr, const char *name)
+{
+	int i;
+
+	for (i = 0; i < hdr->sh_nattrs && i < BMON_SHM_MAX_ATTRS; i++)
+		if (!strncmp(hdr->sh_attr_name[i], name, BMON_SHM_NAMSIZ))
+			return i;
+
+	return -1;
+}
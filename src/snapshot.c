@@ -0,0 +1,486 @@
+/*
+ * snapshot.c		Element Tree Snapshot
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/attr.h>
+#include <bmon/context.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/history.h>
+#include <bmon/snapshot.h>
+#include <bmon/utils.h>
+
+#include <pthread.h>
+
+/*
+ * The copy is allocated from the heap rather than the pools, the pools
+ * account the live tree only. Live elements point to their copy, see
+ * e_snapshot, everything else is matched by name or id.
+ */
+static struct bmon_ctx view;
+static struct bmon_ctx *live;
+static pthread_t owner;
+static int active;
+
+/* Changes to attributes passed to snapshot_apply() */
+struct pending {
+	struct attr *		p_attr;
+	void			(*p_fn)(struct attr *);
+	int			p_flags;
+	struct list_head	p_list;
+};
+
+static LIST_HEAD(pending_list);
+
+/* number of elements and groups added or removed by an update */
+static unsigned int nchanges;
+
+static void apply_pending(struct attr *va, struct attr *a)
+{
+	struct pending *p, *n;
+	struct history *h, *hn;
+	int restart = 0;
+
+	list_for_each_entry_safe(p, n, &pending_list, p_list) {
+		if (p->p_attr != va)
+			continue;
+
+		bmon_ctx = live;
+		p->p_fn(a);
+		bmon_ctx = &view;
+
+		restart |= p->p_flags & SNAPSHOT_RESTART;
+
+		list_del(&p->p_list);
+		xfree(p);
+	}
+
+	/* copy restarted histories from scratch */
+	if (restart)
+		list_for_each_entry_safe(h, hn, &va->a_history_list, h_list)
+			history_clone_free(h);
+}
+
+static void drop_pending(struct attr *va)
+{
+	struct pending *p, *n;
+
+	list_for_each_entry_safe(p, n, &pending_list, p_list) {
+		if (!va || p->p_attr == va) {
+			list_del(&p->p_list);
+			xfree(p);
+		}
+	}
+}
+
+static void view_attr_free(struct element *ve, struct attr *va)
+{
+	struct history *h, *n;
+
+	list_for_each_entry_safe(h, n, &va->a_history_list, h_list)
+		history_clone_free(h);
+
+	if (ve->e_current_attr == va)
+		ve->e_current_attr = NULL;
+
+	drop_pending(va);
+
+	list_del(&va->a_list);
+	list_del(&va->a_sort_list);
+	xfree(va);
+}
+
+static void view_info_free(struct element *ve)
+{
+	struct info *i, *n;
+
+	list_for_each_entry_safe(i, n, &ve->e_info_list, i_list) {
+		xfree(i->i_name);
+		xfree(i->i_value);
+		list_del(&i->i_list);
+		xfree(i);
+	}
+
+	ve->e_ninfo = 0;
+}
+
+static void view_element_free(struct element *ve)
+{
+	struct element *c, *cn;
+	struct attr *a, *an;
+	int i;
+
+	list_for_each_entry_safe(c, cn, &ve->e_childs, e_list)
+		view_element_free(c);
+
+	view_info_free(ve);
+
+	for (i = 0; i < ATTR_HASH_SIZE; i++)
+		list_for_each_entry_safe(a, an, &ve->e_attrhash[i], a_list)
+			view_attr_free(ve, a);
+
+	/* the parent is freed afterwards if it is gone as well */
+	if (ve->e_group->g_current == ve)
+		ve->e_group->g_current = ve->e_parent;
+
+	list_del(&ve->e_list);
+	nchanges++;
+
+	xfree(ve->e_name);
+	xfree(ve);
+}
+
+static void view_group_free(struct element_group *vg)
+{
+	struct element *e, *n;
+
+	list_for_each_entry_safe(e, n, &vg->g_elements, e_list)
+		view_element_free(e);
+
+	if (view.c_current_group == vg)
+		view.c_current_group = NULL;
+
+	list_del(&vg->g_list);
+	nchanges++;
+
+	xfree(vg);
+}
+
+static struct history *find_history(struct list_head *list,
+				    struct history_def *def)
+{
+	struct history *h;
+
+	list_for_each_entry(h, list, h_list)
+		if (h->h_definition == def)
+			return h;
+
+	return NULL;
+}
+
+static void copy_attr(struct attr *va, struct attr *a)
+{
+	struct history *h, *vh, *n;
+	LIST_HEAD(stale);
+
+	memcpy(&va->a_rx_rate, &a->a_rx_rate, sizeof(a->a_rx_rate));
+	memcpy(&va->a_tx_rate, &a->a_tx_rate, sizeof(a->a_tx_rate));
+	va->a_flags = a->a_flags;
+	va->a_interval = a->a_interval;
+	va->a_history_viewed = a->a_history_viewed;
+
+	list_splice_init(&va->a_history_list, &stale);
+
+	list_for_each_entry(h, &a->a_history_list, h_list) {
+		vh = history_clone(find_history(&stale, h->h_definition), h);
+		list_move_tail(&vh->h_list, &va->a_history_list);
+	}
+
+	list_for_each_entry_safe(vh, n, &stale, h_list)
+		history_clone_free(vh);
+}
+
+static void copy_attrs(struct element *ve, struct element *e)
+{
+	struct attr *a, *va, *n;
+	LIST_HEAD(stale);
+
+	list_splice_init(&ve->e_attr_sorted, &stale);
+
+	list_for_each_entry(a, &e->e_attr_sorted, a_sort_list) {
+		if (!(va = attr_lookup(ve, a->a_def->ad_id))) {
+			va = xcalloc(1, sizeof(*va));
+			va->a_def = a->a_def;
+			va->a_element = ve;
+
+			init_list_head(&va->a_history_list);
+			init_list_head(&va->a_sort_list);
+			list_add_tail(&va->a_list,
+				      &ve->e_attrhash[attr_hash(a->a_def->ad_id)]);
+		} else
+			apply_pending(va, a);
+
+		list_move_tail(&va->a_sort_list, &ve->e_attr_sorted);
+		copy_attr(va, a);
+	}
+
+	list_for_each_entry_safe(va, n, &stale, a_sort_list)
+		view_attr_free(ve, va);
+
+	ve->e_nattrs = e->e_nattrs;
+}
+
+static int infos_differ(struct element *ve, struct element *e)
+{
+	struct list_head *vl = ve->e_info_list.next;
+	struct info *i, *vi;
+
+	if (ve->e_ninfo != e->e_ninfo)
+		return 1;
+
+	list_for_each_entry(i, &e->e_info_list, i_list) {
+		vi = list_entry(vl, struct info, i_list);
+
+		if (strcmp(i->i_name, vi->i_name) ||
+		    strcmp(i->i_value, vi->i_value))
+			return 1;
+
+		vl = vl->next;
+	}
+
+	return 0;
+}
+
+static void copy_infos(struct element *ve, struct element *e)
+{
+	struct info *i, *vi;
+
+	if (!infos_differ(ve, e))
+		return;
+
+	view_info_free(ve);
+
+	list_for_each_entry(i, &e->e_info_list, i_list) {
+		vi = xcalloc(1, sizeof(*vi));
+		vi->i_name = strdup(i->i_name);
+		vi->i_value = strdup(i->i_value);
+		list_add_tail(&vi->i_list, &ve->e_info_list);
+		ve->e_ninfo++;
+	}
+}
+
+static struct element *view_element_alloc(struct element_group *vg,
+					  struct element *vparent,
+					  struct element *e)
+{
+	struct element *ve;
+	int i;
+
+	ve = xcalloc(1, sizeof(*ve));
+
+	init_list_head(&ve->e_list);
+	init_list_head(&ve->e_childs);
+	init_list_head(&ve->e_info_list);
+	init_list_head(&ve->e_attr_sorted);
+	init_list_head(&ve->e_record_list);
+	init_list_head(&ve->e_hash_list);
+
+	for (i = 0; i < ATTR_HASH_SIZE; i++)
+		init_list_head(&ve->e_attrhash[i]);
+
+	ve->e_name = strdup(e->e_name);
+	ve->e_id = e->e_id;
+	ve->e_parent = vparent;
+	ve->e_group = vg;
+
+	nchanges++;
+
+	return ve;
+}
+
+static void copy_element(struct element *ve, struct element *e)
+{
+	/* folding is up to the outputs */
+	ve->e_flags = (e->e_flags & ~ELEMENT_FLAG_FOLDED) |
+		      (ve->e_flags & ELEMENT_FLAG_FOLDED);
+	ve->e_lifecycles = e->e_lifecycles;
+	ve->e_level = e->e_level;
+
+	memcpy(ve->e_key_attr, e->e_key_attr, sizeof(e->e_key_attr));
+	ve->e_usage_attr = e->e_usage_attr;
+	ve->e_rx_usage = e->e_rx_usage;
+	ve->e_tx_usage = e->e_tx_usage;
+	ve->e_cfg = e->e_cfg;
+
+	copy_infos(ve, e);
+	copy_attrs(ve, e);
+}
+
+static void copy_elements(struct element_group *vg, struct element *vparent,
+			  struct list_head *vlist, struct list_head *list)
+{
+	struct element *e, *ve, *n;
+	LIST_HEAD(stale);
+
+	list_splice_init(vlist, &stale);
+
+	list_for_each_entry(e, list, e_list) {
+		if (!(ve = e->e_snapshot))
+			ve = e->e_snapshot = view_element_alloc(vg, vparent, e);
+
+		list_move_tail(&ve->e_list, vlist);
+
+		copy_element(ve, e);
+		copy_elements(vg, ve, &ve->e_childs, &e->e_childs);
+	}
+
+	list_for_each_entry_safe(ve, n, &stale, e_list)
+		view_element_free(ve);
+}
+
+static struct element_group *find_group(struct list_head *list,
+					const char *name)
+{
+	struct element_group *g;
+
+	list_for_each_entry(g, list, g_list)
+		if (!strcmp(g->g_name, name))
+			return g;
+
+	return NULL;
+}
+
+static struct element_group *view_group_alloc(struct element_group *g)
+{
+	struct element_group *vg;
+
+	vg = xcalloc(1, sizeof(*vg));
+
+	init_list_head(&vg->g_elements);
+	init_list_head(&vg->g_list);
+
+	/* titles live until exit */
+	vg->g_name = g->g_name;
+	vg->g_hdr = g->g_hdr;
+	vg->g_sched = g->g_sched;
+
+	nchanges++;
+
+	return vg;
+}
+
+/**
+ * Bring snapshot up to date
+ *
+ * Copies the live element tree into the snapshot, reusing the copies
+ * made by the previous update. Only the samples stored since then are
+ * copied from the histories. Must be called with the collector lock
+ * held.
+ */
+void snapshot_update(void)
+{
+	struct element_group *g, *vg, *n;
+	LIST_HEAD(stale);
+
+	if (!active)
+		return;
+
+	nchanges = 0;
+
+	list_splice_init(&view.c_groups, &stale);
+
+	list_for_each_entry(g, &live->c_groups, g_list) {
+		if (!(vg = find_group(&stale, g->g_name)))
+			vg = view_group_alloc(g);
+
+		list_move_tail(&vg->g_list, &view.c_groups);
+
+		copy_elements(vg, NULL, &vg->g_elements, &g->g_elements);
+		vg->g_nelements = g->g_nelements;
+	}
+
+	list_for_each_entry_safe(vg, n, &stale, g_list)
+		view_group_free(vg);
+
+	view.c_ngroups = live->c_ngroups;
+	memcpy(&view.c_rtiming, &live->c_rtiming, sizeof(view.c_rtiming));
+
+	/* left over changes were for attributes which are gone */
+	drop_pending(NULL);
+
+	if (nchanges)
+		group_tree_gen++;
+}
+
+/**
+ * Render snapshots on the calling thread
+ *
+ * Must be called after the sampling thread has been started.
+ */
+void snapshot_start(void)
+{
+	live = bmon_ctx;
+	bmon_ctx_init(&view);
+
+	owner = pthread_self();
+	active = 1;
+
+	bmon_ctx = &view;
+}
+
+/**
+ * Modify live attribute
+ * @a		Attribute of the snapshot
+ * @fn		Change to carry out
+ * @flags	SNAPSHOT_RESTART if the change restarts the histories
+ *
+ * The change is carried out on the live attribute by the next update
+ * and shows in the snapshot afterwards. Without a snapshot, the
+ * attribute is changed right away. Copies of the histories are kept
+ * unless the change restarts them.
+ */
+void snapshot_apply(struct attr *a, void (*fn)(struct attr *), int flags)
+{
+	struct pending *p;
+
+	if (!active || !pthread_equal(owner, pthread_self())) {
+		fn(a);
+		return;
+	}
+
+	list_for_each_entry(p, &pending_list, p_list)
+		if (p->p_attr == a && p->p_fn == fn)
+			return;
+
+	p = xcalloc(1, sizeof(*p));
+	p->p_attr = a;
+	p->p_fn = fn;
+	p->p_flags = flags;
+
+	list_add_tail(&p->p_list, &pending_list);
+}
+
+/**
+ * Release snapshot
+ *
+ * Switches the calling thread back to the live tree. Does nothing if
+ * called on any other thread than the one rendering, e.g. when exit()
+ * is called by the sampling thread.
+ */
+void snapshot_free(void)
+{
+	struct element_group *vg, *n;
+
+	if (!active || !pthread_equal(owner, pthread_self()))
+		return;
+
+	active = 0;
+	bmon_ctx = live;
+
+	list_for_each_entry_safe(vg, n, &view.c_groups, g_list)
+		view_group_free(vg);
+
+	drop_pending(NULL);
+}
@@ -0,0 +1,199 @@
+/*
+ * top.c		Top-N Ranking
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/attr.h>
+#include <bmon/context.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/top.h>
+#include <bmon/utils.h>
+
+static void invalidate(struct top *t)
+{
+	t->t_ctx = NULL;
+	t->t_len = 0;
+}
+
+/**
+ * Set attribute elements are ranked by
+ * @t		Ranking
+ * @spec	Attribute name, optionally prefixed by "rx:" or "tx:"
+ *
+ * Without prefix, elements are ranked by the sum of both directions.
+ */
+void top_set_attr(struct top *t, const char *spec)
+{
+	t->t_dir = TOP_RX | TOP_TX;
+
+	if (!strncasecmp(spec, "rx:", 3)) {
+		t->t_dir = TOP_RX;
+		spec += 3;
+	} else if (!strncasecmp(spec, "tx:", 3)) {
+		t->t_dir = TOP_TX;
+		spec += 3;
+	}
+
+	attr_set_free(&t->t_attr);
+	attr_set_parse(&t->t_attr, spec);
+	invalidate(t);
+}
+
+void top_set_size(struct top *t, int n)
+{
+	if (n < 0)
+		n = 0;
+
+	t->t_rank = xrealloc(t->t_rank, (n ? n : 1) * sizeof(*t->t_rank));
+	t->t_n = n;
+	invalidate(t);
+}
+
+static inline void swap(struct top_entry *a, struct top_entry *b)
+{
+	struct top_entry tmp = *a;
+
+	*a = *b;
+	*b = tmp;
+}
+
+static void sift_up(struct top_entry *h, int i)
+{
+	while (i > 0 && h[i].te_rate < h[(i - 1) / 2].te_rate) {
+		swap(&h[i], &h[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+}
+
+static void sift_down(struct top_entry *h, int len, int i)
+{
+	int l, r, min;
+
+	for (;;) {
+		l = 2 * i + 1;
+		r = l + 1;
+		min = i;
+
+		if (l < len && h[l].te_rate < h[min].te_rate)
+			min = l;
+		if (r < len && h[r].te_rate < h[min].te_rate)
+			min = r;
+
+		if (min == i)
+			return;
+
+		swap(&h[i], &h[min]);
+		i = min;
+	}
+}
+
+static void rank_element(struct top *t, struct element *e)
+{
+	struct top_entry *h = t->t_rank;
+	struct attr *a;
+	float rate = 0.0f;
+
+	if (!(a = attr_set_get(&t->t_attr, 0, e)))
+		return;
+
+	if ((t->t_dir & TOP_RX) && (a->a_flags & ATTR_RX_ENABLED))
+		rate += a->a_rx_rate.r_rate;
+
+	if ((t->t_dir & TOP_TX) && (a->a_flags & ATTR_TX_ENABLED))
+		rate += a->a_tx_rate.r_rate;
+
+	if (t->t_len < t->t_n) {
+		h[t->t_len].te_element = e;
+		h[t->t_len].te_rate = rate;
+		sift_up(h, t->t_len++);
+	} else if (rate > h[0].te_rate) {
+		/* replace the lightest of the current top */
+		h[0].te_element = e;
+		h[0].te_rate = rate;
+		sift_down(h, t->t_len, 0);
+	}
+}
+
+/**
+ * Bring ranking up to date
+ * @t		Ranking
+ *
+ * Returns 1 if the ranking was redone, 0 if it is still current. The
+ * elements ranked are valid until the next read.
+ */
+int top_update(struct top *t)
+{
+	struct reader_timing *rt = &bmon_ctx->c_rtiming;
+	struct element_group *g;
+	struct element *e;
+	int i;
+
+	if (t->t_ctx == bmon_ctx && t->t_tree_gen == group_tree_gen &&
+	    t->t_read.tv_sec == rt->rt_last_read.tv_sec &&
+	    t->t_read.tv_usec == rt->rt_last_read.tv_usec)
+		return 0;
+
+	t->t_len = 0;
+
+	if (t->t_n && t->t_attr.as_n) {
+		list_for_each_entry(g, &bmon_ctx->c_groups, g_list)
+			list_for_each_entry(e, &g->g_elements, e_list)
+				rank_element(t, e);
+	}
+
+	/* heap sort, moving the lightest to the end */
+	for (i = t->t_len - 1; i > 0; i--) {
+		swap(&t->t_rank[0], &t->t_rank[i]);
+		sift_down(t->t_rank, i, 0);
+	}
+
+	t->t_ctx = bmon_ctx;
+	t->t_tree_gen = group_tree_gen;
+	copy_timestamp(&t->t_read, &rt->rt_last_read);
+
+	return 1;
+}
+
+/* Call cb for the ranked elements, heaviest first */
+void top_foreach(struct top *t, void (*cb)(struct element_group *,
+					   struct element *, void *),
+		 void *arg)
+{
+	int i;
+
+	top_update(t);
+
+	for (i = 0; i < t->t_len; i++)
+		cb(t->t_rank[i].te_element->e_group,
+		   t->t_rank[i].te_element, arg);
+}
+
+void top_free(struct top *t)
+{
+	attr_set_free(&t->t_attr);
+	xfree(t->t_rank);
+	memset(t, 0, sizeof(*t));
+}
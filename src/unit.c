@@ -32,19 +32,65 @@ static struct unit *byte_unit, *bit_unit;
 
 static LIST_HEAD(units);
 
-static struct list_head *get_flist(struct unit *unit)
+static void table_free(struct unit_table *t)
 {
-	int div = UNIT_DEFAULT;
-
-	if (cfg_getbool(cfg, "use_bit"))
-		div = UNIT_BIT;
-	else if (cfg_getbool(cfg, "use_si"))
-		div = UNIT_SI;
-	
-	if (!list_empty(&unit->u_div[div]))
-		return &unit->u_div[div];
-	else
-		return &unit->u_div[UNIT_DEFAULT];
+	xfree(t->ut_div);
+	xfree(t->ut_idiv);
+	xfree(t->ut_name);
+	memset(t, 0, sizeof(*t));
+}
+
+static void table_build(struct unit_table *t, struct list_head *flist)
+{
+	struct fraction *f;
+	int n = 0;
+
+	table_free(t);
+
+	list_for_each_entry(f, flist, f_list)
+		t->ut_n++;
+
+	t->ut_div = xcalloc(t->ut_n, sizeof(*t->ut_div));
+	t->ut_idiv = xcalloc(t->ut_n, sizeof(*t->ut_idiv));
+	t->ut_name = xcalloc(t->ut_n, sizeof(*t->ut_name));
+
+	list_for_each_entry(f, flist, f_list) {
+		t->ut_div[n] = f->f_divisor;
+		if (f->f_divisor >= 1.0f && f->f_divisor == floorf(f->f_divisor))
+			t->ut_idiv[n] = f->f_divisor;
+		t->ut_name[n] = f->f_name;
+		n++;
+	}
+
+	t->ut_valid = 1;
+}
+
+static struct unit_table *get_table(struct unit *unit)
+{
+	int div = cfg_unit_variant;
+
+	if (list_empty(&unit->u_div[div]))
+		div = UNIT_DEFAULT;
+
+	if (!unit->u_table[div].ut_valid)
+		table_build(&unit->u_table[div], &unit->u_div[div]);
+
+	return &unit->u_table[div];
+}
+
+/* Index of divisor to use for hint, -1 if the value is not to be divided */
+static int find_div(struct unit_table *t, uint64_t hint)
+{
+	int n;
+
+	if (cfg_unit_exp == DYNAMIC_EXP) {
+		for (n = t->ut_n - 1; n >= 0; n--)
+			if (hint >= t->ut_div[n])
+				return n;
+	} else if (cfg_unit_exp > 0 && cfg_unit_exp <= t->ut_n)
+		return cfg_unit_exp - 1;
+
+	return -1;
 }
 
 struct unit *unit_lookup(const char *name)
@@ -77,46 +123,55 @@ struct unit *unit_lookup(const char *name)
 double unit_divisor(uint64_t hint, struct unit *unit, char **name,
 		    int *prec)
 {
-	struct list_head *flist = get_flist(unit);
-	struct fraction *f;
+	struct unit_table *t = get_table(unit);
+	int n;
 
 	if (prec)
 		*prec = 2;
 
-	if (cfg_unit_exp == DYNAMIC_EXP) {
-		list_for_each_entry_reverse(f, flist, f_list) {
-			if (hint >= f->f_divisor)
-				goto found_it;
-		}
-	} else {
-		int n = cfg_unit_exp;
-		list_for_each_entry(f, flist, f_list) {
-			if (--n == 0)
-				goto found_it;
-		}
+	if ((n = find_div(t, hint)) < 0) {
+		*name = "";
+		return 1;
 	}
 
-	*name = "";
-	return 1;
-
-found_it:
-	if (f->f_divisor == 1.0f && prec)
+	if (t->ut_div[n] == 1.0f && prec)
 		*prec = 0;
 
-	*name = f->f_name;
-	return f->f_divisor;
+	*name = t->ut_name[n];
+	return t->ut_div[n];
 }
 
 double unit_value2str(uint64_t value, struct unit *unit,
 		      char **name, int *prec)
 {
-	double div = unit_divisor(value, unit, name, prec);
-	double v = (double) value;
+	struct unit_table *t = get_table(unit);
+	double div = 1.0;
+	int n;
 
-	if (fmod(v, div) == 0.0f && prec)
+	if (prec)
+		*prec = 2;
+
+	if ((n = find_div(t, value)) < 0) {
+		*name = "";
+		goto exact;
+	}
+
+	*name = t->ut_name[n];
+	div = t->ut_div[n];
+
+	if (t->ut_idiv[n]) {
+		if (value % t->ut_idiv[n] == 0)
+			goto exact;
+	} else if (fmod((double) value, div) == 0.0f)
+		goto exact;
+
+	return (double) value / div;
+
+exact:
+	if (prec)
 		*prec = 0;
 
-	return v / div;
+	return (double) value / div;
 }
 
 void fraction_free(struct fraction *f)
@@ -144,6 +199,7 @@ void unit_add_div(struct unit *unit, int type, const char *txt, float div)
 	f->f_name = strdup(txt);
 
 	list_add_tail(&f->f_list, &unit->u_div[type]);
+	unit->u_table[type].ut_valid = 0;
 }
 
 struct unit *unit_add(const char *name)
@@ -167,6 +223,7 @@ struct unit *unit_add(const char *name)
 static void unit_free(struct unit *u)
 {
 	struct fraction *f, *n;
+	int i;
 
 	if (!u)
 		return;
@@ -177,6 +234,12 @@ static void unit_free(struct unit *u)
 	list_for_each_entry_safe(f, n, &u->u_div[UNIT_SI], f_list)
 		fraction_free(f);
 
+	list_for_each_entry_safe(f, n, &u->u_div[UNIT_BIT], f_list)
+		fraction_free(f);
+
+	for (i = 0; i < __UNIT_MAX; i++)
+		table_free(&u->u_table[i]);
+
 	xfree(u->u_name);
 	xfree(u);
 }
@@ -32,6 +32,27 @@
 #include <mach/mach.h>
 #endif
 
+jmp_buf *quit_env;
+
+/*
+ * Modules are shut down by the atexit() handler of the program, the
+ * library leaves cleaning up to the process exit. Within calls of
+ * libbmon, the error is returned to the caller of the library instead.
+ */
+void quit(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+
+	if (quit_env)
+		longjmp(*quit_env, 1);
+
+	exit(1);
+}
+
 void *xcalloc(size_t n, size_t s)
 {
 	void *d = calloc(n, s);
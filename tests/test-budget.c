@@ -0,0 +1,213 @@
+/*
+ * test-budget.c		History Budget Tests
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/attr.h>
+#include <bmon/conf.h>
+#include <bmon/context.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/history.h>
+#include <bmon/unit.h>
+#include <bmon/libbmon.h>
+
+#define NELEMENTS	4
+#define NREADS		8
+
+static int attr_id;
+
+static size_t history_used(void)
+{
+	struct history_stats st;
+
+	history_get_stats(&st);
+	return st.hst_used;
+}
+
+static struct element *feed_element(const char *name, uint64_t base)
+{
+	struct element_group *g;
+	struct element *e;
+	timestamp_t ts = { 1000, 0 };
+	int i;
+
+	g = group_lookup("intf", GROUP_CREATE);
+	if (!(e = element_lookup(g, name, 0, NULL, ELEMENT_CREAT)))
+		return NULL;
+
+	for (i = 0; i < NREADS; i++, ts.tv_sec++) {
+		attr_update(e, attr_id, base + i, base + i,
+			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		attr_notify_update(attr_lookup(e, attr_id), &ts);
+	}
+
+	return e;
+}
+
+/*
+ * Rings are accounted when allocated and released when the history
+ * is freed, whether it was evicted or went away with its element.
+ */
+static int test_budget_eviction(void)
+{
+	struct element *e[NELEMENTS];
+	struct history_stats st;
+	size_t base, used;
+	unsigned long evictions;
+	char name[16];
+	int i;
+
+	base = history_used();
+
+	for (i = 0; i < NELEMENTS; i++) {
+		snprintf(name, sizeof(name), "budget%d", i);
+		if (!(e[i] = feed_element(name, 1000 * i))) {
+			fprintf(stderr, "Unable to create element %s\n", name);
+			return 1;
+		}
+	}
+
+	used = history_used();
+	if (used <= base) {
+		fprintf(stderr, "Histories not accounted: %zu bytes before, "
+			"%zu after\n", base, used);
+		return 1;
+	}
+
+	history_get_stats(&st);
+	evictions = st.hst_evictions;
+
+	/* new histories are spared for a round like displayed ones */
+	history_enforce_budget();
+
+	cfg_history_budget = base + (used - base) / 2;
+	history_enforce_budget();
+	history_get_stats(&st);
+	cfg_history_budget = 0;
+
+	if (st.hst_evictions == evictions ||
+	    st.hst_used > (st.hst_budget / 10) * 9) {
+		fprintf(stderr, "Budget of %" PRIu64 " bytes not enforced: "
+			"%zu bytes used after %lu evictions\n", st.hst_budget,
+			st.hst_used, st.hst_evictions - evictions);
+		return 1;
+	}
+
+	for (i = 0; i < NELEMENTS; i++)
+		element_free(e[i]);
+
+	if ((used = history_used()) != base) {
+		fprintf(stderr, "%zu bytes used after freeing all histories, "
+			"expected %zu\n", used, base);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Rings resumed from a history file are mapped rather than allocated
+ * and must be accounted the same way.
+ */
+static int test_budget_file(void)
+{
+	char dir[] = "/tmp/bmon-test-XXXXXX";
+	char path[FILENAME_MAX+1];
+	struct element *e;
+	size_t base, used, resumed;
+	int i, err = 1;
+
+	if (!mkdtemp(dir)) {
+		fprintf(stderr, "Unable to create %s: %s\n", dir,
+			strerror(errno));
+		return 1;
+	}
+
+	cfg_history_dir = dir;
+	base = history_used();
+
+	for (i = 0, used = 0; i < 2; i++) {
+		if (!(e = feed_element("file0", 0))) {
+			fprintf(stderr, "Unable to create element file0\n");
+			goto out;
+		}
+
+		if (i == 0)
+			used = history_used();
+		else
+			resumed = history_used();
+
+		element_free(e);
+
+		if (history_used() != base) {
+			fprintf(stderr, "%zu bytes used after freeing file "
+				"backed history, expected %zu\n",
+				history_used(), base);
+			goto out;
+		}
+	}
+
+	if (used <= base || resumed != used) {
+		fprintf(stderr, "File backed history accounted %zu bytes, "
+			"%zu when resumed\n", used - base, resumed - base);
+		goto out;
+	}
+
+	err = 0;
+out:
+	cfg_history_dir = NULL;
+	snprintf(path, sizeof(path), "%s/intf.file0.test_budget", dir);
+	unlink(path);
+	rmdir(dir);
+
+	return err;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bmon_ctx *ctx, *prev = bmon_ctx;
+	int err = 0;
+
+	/* the engine works on the global context */
+	ctx = bmon_ctx_new();
+	bmon_ctx = ctx;
+
+	attr_id = attr_def_add("test_budget", "Test budget",
+			       unit_lookup(UNIT_NUMBER), ATTR_TYPE_RATE,
+			       ATTR_FORCE_HISTORY);
+	if (attr_id < 0) {
+		fprintf(stderr, "Unable to add attribute\n");
+		return 1;
+	}
+
+	err |= test_budget_eviction();
+	err |= test_budget_file();
+
+	bmon_ctx = prev;
+	bmon_ctx_free(ctx);
+
+	return err;
+}
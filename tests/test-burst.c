@@ -0,0 +1,104 @@
+/*
+ * test-burst.c		Burst Tests
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/libbmon.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define NTICKS		60
+#define TICK_USEC	100000
+
+static const char *config =
+	"burst bytes {\n"
+	"}\n";
+
+static int check_history(struct bmon_element *e, void *arg)
+{
+	const char *attr = arg;
+	double buf[60];
+	int i, n, known = 0;
+
+	n = bmon_element_history(e, attr, "second", 0, buf, 60);
+
+	for (i = 0; i < n; i++)
+		if (!isnan(buf[i]))
+			known++;
+
+	/* a sample per second after the first rate interval */
+	if (known < 3) {
+		fprintf(stderr, "%s of %s has %d history samples\n",
+			attr, bmon_element_name(e), known);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char path[] = "/tmp/test-burst.XXXXXX";
+	struct bmon_ctx *ctx;
+	int fd, i, err;
+
+	if ((fd = mkstemp(path)) < 0 ||
+	    write(fd, config, strlen(config)) != strlen(config)) {
+		perror("Unable to write configuration");
+		return 1;
+	}
+	close(fd);
+
+	err = bmon_configure(path);
+	unlink(path);
+
+	if (err < 0) {
+		fprintf(stderr, "Unable to configure: %s\n", strerror(-err));
+		return 1;
+	}
+
+	ctx = bmon_ctx_new();
+	if ((err = bmon_ctx_enable_input(ctx, "dummy:num=1;numgroups=1")) < 0) {
+		fprintf(stderr, "Unable to enable input: %s\n", strerror(-err));
+		return 1;
+	}
+
+	for (i = 0; i < NTICKS; i++) {
+		if (i)
+			usleep(TICK_USEC);
+
+		bmon_ctx_tick(ctx);
+	}
+
+	err = bmon_ctx_foreach_element(ctx, check_history, "bytes") ||
+	      bmon_ctx_foreach_element(ctx, check_history, "bytes_peak");
+
+	bmon_ctx_free(ctx);
+
+	return err;
+}
@@ -0,0 +1,212 @@
+/*
+ * test-codec.c		History Codec Tests
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/attr.h>
+#include <bmon/context.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/history.h>
+#include <bmon/unit.h>
+#include <bmon/libbmon.h>
+
+#define RING_SIZE	64
+#define NREADS		(RING_SIZE + 48)
+
+static const struct {
+	const char *	name;
+	int		type;
+} codec_defs[] = {
+	{ "codec8",	HISTORY_TYPE_8 },
+	{ "codec16",	HISTORY_TYPE_16 },
+	{ "codec32",	HISTORY_TYPE_32 },
+	{ "codec64",	HISTORY_TYPE_64 },
+};
+
+static struct history *find_history(struct attr *a, const char *name)
+{
+	struct history *h;
+
+	list_for_each_entry(h, &a->a_history_list, h_list)
+		if (!strcmp(h->h_definition->hd_name, name))
+			return h;
+
+	return NULL;
+}
+
+/*
+ * The first lap fills each block of the ring with a different shape:
+ * small values, magnitudes growing within the block, random 40bit
+ * values and a burst. The second lap overwrites the first three blocks
+ * so new samples are encoded next to the leftovers of the first lap.
+ */
+static uint64_t sample_value(int s)
+{
+	static uint64_t seed = 0x2545f4914f6cdd1dULL;
+
+	switch (s / HISTORY_BLOCK_SIZE) {
+	case 0:
+		return s * 3;
+	case 1:
+		return (1ULL << ((s - 16) * 2)) + s;
+	case 2:
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (seed >> 11) & ((1ULL << 40) - 1);
+	case 3:
+		return (s % 4) ? s : (1ULL << 36);
+	case 4:
+		return s;
+	case 5:
+		return (1ULL << ((95 - s) * 2)) + s;
+	default:
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (seed >> 11) & ((1ULL << 20) - 1);
+	}
+}
+
+static int ring_pos(struct history *h, int s)
+{
+	return ((h->h_index - (NREADS - s)) % RING_SIZE + RING_SIZE) % RING_SIZE;
+}
+
+/*
+ * All samples of a block share an exponent, values which fit into the
+ * mantissa are stored exactly and all others are off by at most one
+ * step of the block's exponent. The exponent is bounded by the largest
+ * value the block held while it was encoded.
+ */
+static int check_codec(struct history *h, const uint64_t *values)
+{
+	struct history_def *def = h->h_definition;
+	uint64_t unknown = (1ULL << (8 * def->hd_type)) - 1;
+	uint64_t blockmax[RING_SIZE / HISTORY_BLOCK_SIZE] = { 0 };
+	uint64_t data[RING_SIZE], v, err;
+	int i, s, b, n;
+
+	for (s = 0; s < NREADS; s++) {
+		b = ring_pos(h, s) / HISTORY_BLOCK_SIZE;
+		if (values[s] > blockmax[b])
+			blockmax[b] = values[s];
+	}
+
+	n = history_copy(h, &h->h_rx, HISTORY_MEAN, data, RING_SIZE);
+	if (n != RING_SIZE) {
+		fprintf(stderr, "%s: expected %d samples, got %d\n",
+			def->hd_name, RING_SIZE, n);
+		return 1;
+	}
+
+	/* newest first */
+	for (i = 0; i < RING_SIZE; i++) {
+		s = NREADS - 1 - i;
+		b = ring_pos(h, s) / HISTORY_BLOCK_SIZE;
+		v = values[s];
+		err = data[i] > v ? data[i] - v : v - data[i];
+
+		if (def->hd_type == HISTORY_TYPE_64 || blockmax[b] < unknown) {
+			if (err) {
+				fprintf(stderr, "%s: sample %d is %" PRIu64
+					", expected exactly %" PRIu64 "\n",
+					def->hd_name, s, data[i], v);
+				return 1;
+			}
+		} else if ((double) err * (unknown - 2) > 2.0 * blockmax[b]) {
+			fprintf(stderr, "%s: sample %d is %" PRIu64 ", expected "
+				"%" PRIu64 " (block max %" PRIu64 ")\n",
+				def->hd_name, s, data[i], v, blockmax[b]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int test_codec(void)
+{
+	struct element_group *g;
+	struct element *e;
+	struct history_def *def;
+	struct history *h;
+	struct attr *a;
+	timestamp_t ts = { 1000, 0 };
+	uint64_t values[NREADS];
+	int id, i, err = 0;
+
+	/* sampled directly, a ratio of 1 is never rolled up */
+	for (i = 0; i < ARRAY_SIZE(codec_defs); i++) {
+		def = history_def_alloc(codec_defs[i].name);
+		def->hd_interval = 1.0f;
+		def->hd_size = RING_SIZE;
+		def->hd_type = codec_defs[i].type;
+	}
+
+	g = group_lookup("intf", GROUP_CREATE);
+	e = element_lookup(g, "codec0", 0, NULL, ELEMENT_CREAT);
+	id = attr_def_add("test_codec", "Test codec", unit_lookup(UNIT_NUMBER),
+			  ATTR_TYPE_RATE, ATTR_FORCE_HISTORY);
+
+	if (!g || !e || id < 0) {
+		fprintf(stderr, "Unable to create element\n");
+		return 1;
+	}
+
+	for (i = 0; i < NREADS; i++, ts.tv_sec++) {
+		values[i] = sample_value(i);
+		attr_update(e, id, values[i], 0,
+			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		attr_notify_update(attr_lookup(e, id), &ts);
+	}
+
+	a = attr_lookup(e, id);
+	for (i = 0; i < ARRAY_SIZE(codec_defs); i++) {
+		if (!(h = find_history(a, codec_defs[i].name))) {
+			fprintf(stderr, "History \"%s\" not collected\n",
+				codec_defs[i].name);
+			return 1;
+		}
+
+		err |= check_codec(h, values);
+	}
+
+	return err;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bmon_ctx *ctx, *prev = bmon_ctx;
+	int err = 0;
+
+	/* the engine works on the global context */
+	ctx = bmon_ctx_new();
+	bmon_ctx = ctx;
+
+	err |= test_codec();
+
+	bmon_ctx = prev;
+	bmon_ctx_free(ctx);
+
+	return err;
+}
@@ -0,0 +1,118 @@
+/*
+ * test-history.c	History Tests
+ *
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2013 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/attr.h>
+#include <bmon/context.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/history.h>
+#include <bmon/unit.h>
+#include <bmon/libbmon.h>
+
+#define NREADS		10
+
+static struct history *find_history(struct attr *a, const char *name)
+{
+	struct history *h;
+
+	list_for_each_entry(h, &a->a_history_list, h_list)
+		if (!strcmp(h->h_definition->hd_name, name))
+			return h;
+
+	return NULL;
+}
+
+/*
+ * Rates and gauges are stored as read, starting with the first read,
+ * while counters need a second read to establish a delta.
+ */
+static int test_gauge_history(void)
+{
+	struct element_group *g;
+	struct element *e;
+	struct history *h;
+	struct attr *a;
+	timestamp_t ts = { 1000, 0 };
+	uint64_t data[NREADS];
+	int id, i, n;
+
+	g = group_lookup("intf", GROUP_CREATE);
+	e = element_lookup(g, "test0", 0, NULL, ELEMENT_CREAT);
+	id = attr_def_add("test_gauge", "Test gauge", unit_lookup(UNIT_NUMBER),
+			  ATTR_TYPE_RATE, ATTR_FORCE_HISTORY);
+
+	if (!g || !e || id < 0) {
+		fprintf(stderr, "Unable to create element\n");
+		return 1;
+	}
+
+	for (i = 0; i < NREADS; i++, ts.tv_sec++) {
+		attr_update(e, id, 100 + i, 200 + i,
+			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		attr_notify_update(attr_lookup(e, id), &ts);
+	}
+
+	a = attr_lookup(e, id);
+	if (!(h = find_history(a, "second"))) {
+		fprintf(stderr, "History \"second\" not collected\n");
+		return 1;
+	}
+
+	n = history_copy(h, &h->h_rx, HISTORY_MEAN, data, NREADS);
+	if (n < NREADS) {
+		fprintf(stderr, "Expected %d samples, got %d\n", NREADS, n);
+		return 1;
+	}
+
+	/* newest first */
+	for (i = 0; i < NREADS; i++) {
+		if (data[i] != 100 + NREADS - 1 - i) {
+			fprintf(stderr, "Sample %d is %" PRIu64 ", expected %d\n",
+				i, data[i], 100 + NREADS - 1 - i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bmon_ctx *ctx, *prev = bmon_ctx;
+	int err = 0;
+
+	/* the engine works on the global context */
+	ctx = bmon_ctx_new();
+	bmon_ctx = ctx;
+
+	err |= test_gauge_history();
+
+	bmon_ctx = prev;
+	bmon_ctx_free(ctx);
+
+	return err;
+}
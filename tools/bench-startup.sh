@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# bench-startup.sh	Startup time of bmon in one-shot mode
+#
+# Usage: bench-startup.sh [-n links] [-r runs] [-g gap] [bmon]
+#
+# Creates the links as veth pairs in a network namespace of its own,
+# which requires root and unshare(1), then runs "bmon -1" repeatedly
+# and prints the minimum, median and maximum wall clock time of a run.
+# The gap between the two samples is included, keep it small.
+#
+
+links=1000
+runs=20
+gap=0.0001
+
+while getopts "n:r:g:" opt; do
+	case $opt in
+	n) links=$OPTARG ;;
+	r) runs=$OPTARG ;;
+	g) gap=$OPTARG ;;
+	*) sed -n 5p "$0"; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+bmon=${1:-$(dirname "$0")/../src/bmon}
+
+if [ -z "$BENCH_NETNS" ]; then
+	BENCH_NETNS=1 exec unshare -n "$0" -n "$links" -r "$runs" \
+		-g "$gap" "$bmon"
+fi
+
+i=0
+while [ $i -lt $((links / 2)) ]; do
+	echo "link add bv$i type veth peer name bp$i"
+	echo "link set bv$i up"
+	echo "link set bp$i up"
+	i=$((i + 1))
+done | ip -batch - || exit 1
+
+ip link set lo up
+echo "$(ip -o link | wc -l) links"
+
+i=0
+while [ $i -lt "$runs" ]; do
+	start=$(date +%s%N)
+	"$bmon" -1 -G "$gap" -o 'format:fmt=$(element:name)\n' >/dev/null
+	end=$(date +%s%N)
+	echo $(((end - start) / 1000))
+	i=$((i + 1))
+done | sort -n | awk '
+	{ t[NR] = $1 }
+	END {
+		printf "runs %d  min %.2fms  median %.2fms  max %.2fms\n",
+		       NR, t[1] / 1000, t[int((NR + 1) / 2)] / 1000,
+		       t[NR] / 1000
+	}'